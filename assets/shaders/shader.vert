@@ -6,12 +6,17 @@ layout(location = 1) in vec2 uv;
 layout(location = 0) out vec2 out_uv;
 
 
+layout(std140, binding = 0) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 camera_position;
+    float time;
+} frame;
+
 uniform mat4 u_model;
-uniform mat4 u_view;
-uniform mat4 u_projection;
 
 
 void main() {
-    gl_Position = u_projection * u_view * u_model * vec4(position, 1.0);
+    gl_Position = frame.projection * frame.view * u_model * vec4(position, 1.0);
     out_uv = uv;
 }
\ No newline at end of file
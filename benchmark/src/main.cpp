@@ -0,0 +1,123 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "benchmarks.hpp"
+
+#include "core/src/module.hpp"
+#include "core/src/ref.hpp"
+#include "core/src/transform.hpp"
+#include "renderer/src/camera.hpp"
+#include "renderer/src/light.hpp"
+#include "renderer/src/mesh.hpp"
+#include "renderer/src/module.hpp"
+#include "renderer/src/renderer.hpp"
+#include "thirdparty/flecs/flecs.h"
+#include "thirdparty/glad/include/glad/glad.h"
+#include "thirdparty/glm/glm.hpp"
+#include "windowing/src/module.hpp"
+#include "windowing/src/window.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string_view>
+
+
+// Frame times of one rendering pipeline across point light counts, run it once per pipeline to compare them:
+// `Benchmark deferred` then `Benchmark forward`, optionally followed by the number of frames timed per light count.
+// The scene is a grid of shader balls on a plane of random lights, the lights are added between the measures.
+// `Benchmark parse` and `Benchmark weld` measure the OBJ parser and the vertex welding instead, see benchmarks.hpp.
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string_view(argv[1]) == "parse") return run_parse_benchmark(argc - 2, argv + 2);
+    if (argc > 1 && std::string_view(argv[1]) == "weld") return run_weld_benchmark(argc - 2, argv + 2);
+
+    bool forward = argc > 1 && std::string_view(argv[1]) == "forward";
+    uint32_t frame_count = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 100;
+    constexpr uint32_t WARMUP_FRAME_COUNT = 10; // Light buffers and cluster lists grow during the first frames
+    constexpr std::array<uint32_t, 5> LIGHT_COUNTS = { 0, 100, 1000, 5000, 10000 };
+
+    flecs::world world;
+    world.set<lixy::RendererOptions>({
+        .pipeline = forward ? lixy::Renderer::Pipeline::FORWARD_PLUS : lixy::Renderer::Pipeline::DEFERRED,
+    });
+    world.import<lixy::CoreModule>();
+    world.import<lixy::WindowingModule>();
+    world.import<lixy::RendererModule>();
+
+    lixy::Window *window = lixy::Window::get_singleton(world);
+    window->set_title("Lighting Benchmark");
+    window->set_vsync(false);
+
+    lixy::EntityRef shaderball_mesh = lixy::ObjMesh::load(world, "assets/models/shaderball.obj");
+    for (int z = 0; z < 6; z++) {
+        for (int x = 0; x < 6; x++) {
+            world.entity()
+                .emplace<lixy::Transform>(glm::vec3(-40.0 + 16.0 * x, 0.0, -40.0 + 16.0 * z))
+                .set<lixy::MeshInstance>({shaderball_mesh})
+                .add<lixy::Visible>();
+        }
+    }
+
+    flecs::entity camera = lixy::Camera::create(world, {.clip_far = 300.0, .type = lixy::Camera::Type::PERSPECTIVE});
+    camera.set<lixy::Transform>(lixy::Transform(glm::vec3(0.0, 40.0, 60.0), glm::quat(glm::vec3(-0.6, 0.0, 0.0)), glm::vec3(1.0)));
+    lixy::Renderer *renderer = lixy::Renderer::get_singleton(world);
+    renderer->set_current_camera(camera);
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(0.0, 1.0);
+    uint32_t light_count = 0;
+
+    std::cout << (forward ? "Forward+" : "Deferred") << " pipeline, " << window->get_width() << "x" << window->get_height() << std::endl;
+    for (uint32_t target_light_count : LIGHT_COUNTS) {
+        for (; light_count < target_light_count; light_count++) {
+            world.entity()
+                .set<lixy::Transform>(lixy::Transform(glm::vec3(-50.0 + 100.0 * unit(random), 0.5 + 6.0 * unit(random), -50.0 + 100.0 * unit(random))))
+                .set<lixy::PointLight>({ .color = glm::vec3(unit(random), unit(random), unit(random)), .energy = 0.5, .radius = 1.5f + 3.0f * unit(random) })
+                .add<lixy::Visible>();
+        }
+
+        for (uint32_t i = 0; i < WARMUP_FRAME_COUNT; i++) world.progress();
+        glFinish();
+
+        // Frames are finished one by one so that every measure holds the whole work of its frame
+        double total_time = 0.0, best_time = 1e30;
+        uint32_t measured_frame_count = 0, render_target_allocation_count = 0;
+        for (; measured_frame_count < frame_count && !window->should_close(); measured_frame_count++) {
+            auto start = std::chrono::steady_clock::now();
+            world.progress();
+            glFinish();
+            double frame_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            total_time += frame_time;
+            best_time = std::min(best_time, frame_time);
+            render_target_allocation_count += renderer->get_render_target_metrics().misses;
+        }
+
+        if (measured_frame_count == 0) break;
+        const lixy::RenderTargetPool::Metrics &render_targets = renderer->get_render_target_metrics();
+        std::cout << light_count << " lights: " << total_time / measured_frame_count << " ms per frame, best " << best_time << " ms, "
+            << render_targets.target_count << " render targets (" << render_targets.bytes / (1024 * 1024) << " MiB), "
+            << render_target_allocation_count << " allocated after warm-up" << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
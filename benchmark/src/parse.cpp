@@ -0,0 +1,71 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "benchmarks.hpp"
+
+#include "wavefront_loader/src/object.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <utility>
+
+
+// Parse throughput of the OBJ backends: `Benchmark parse [path] [runs]`. Compare it across commits on a triangle only
+// `v/vt/vn` file, the only form the STREAM backend reads, to measure the cost of the face forms the parsers accept.
+int run_parse_benchmark(int argc, char **argv) {
+    std::filesystem::path path = argc > 0 ? argv[0] : "assets/models/shaderball.obj";
+    uint32_t run_count = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 5;
+    constexpr std::array<std::pair<const char*, lixy::WavefrontMesh::ParseBackend>, 3> BACKENDS = {{
+        { "stream", lixy::WavefrontMesh::ParseBackend::STREAM },
+        { "mapped", lixy::WavefrontMesh::ParseBackend::MAPPED },
+        { "mapped parallel", lixy::WavefrontMesh::ParseBackend::MAPPED_PARALLEL },
+    }};
+
+    std::error_code error;
+    uintmax_t file_size = std::filesystem::file_size(path, error);
+    if (error) {
+        std::cerr << "Could not read `" << path.string() << "`" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << path.string() << ", " << file_size / (1024.0 * 1024.0) << " MiB, best of " << run_count << " runs" << std::endl;
+    for (const auto &[name, backend] : BACKENDS) {
+        double best_time = 1e30;
+        size_t triangle_count = 0;
+        for (uint32_t i = 0; i < run_count; i++) {
+            auto start = std::chrono::steady_clock::now();
+            lixy::WavefrontMesh mesh = lixy::WavefrontMesh::load(path, backend);
+            best_time = std::min(best_time, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+            triangle_count = 0;
+            for (const auto &[object_name, object] : mesh.objects) {
+                triangle_count += object.position_indices.size() / 3;
+            }
+        }
+
+        std::cout << name << ": " << best_time << " ms, " << file_size / (1024.0 * 1024.0) / (best_time / 1000.0) << " MiB/s, "
+            << triangle_count << " triangles" << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "benchmarks.hpp"
+
+#include "renderer/src/vertex_weld_table.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+
+struct FaceVertex {
+    uint32_t position;
+    uint32_t normal;
+    uint32_t uv;
+
+    bool operator==(const FaceVertex &p_other) const {
+        return position == p_other.position && normal == p_other.normal && uv == p_other.uv;
+    }
+};
+
+
+struct FaceVertexHash {
+    size_t operator()(const FaceVertex &p_vertex) const {
+        // boost::hash_combine, the standard hash of integers is the identity
+        size_t hash = 0;
+        for (uint32_t index : { p_vertex.position, p_vertex.normal, p_vertex.uv }) {
+            hash ^= std::hash<uint32_t>()(index) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        }
+        return hash;
+    }
+};
+
+
+enum class GridShading {
+    SMOOTH, // Every face vertex shares the normal of its position
+    FLAT, // Every face has its own normal, nothing is welded across faces
+    SHUFFLED, // Smooth, with the faces in random order
+};
+
+
+// Face vertices of a grid of about p_triangle_count triangles, as the OBJ loader gives them to the welding
+static std::vector<FaceVertex> _create_grid(size_t p_triangle_count, GridShading p_shading) {
+    uint32_t cell_count = std::max<uint32_t>(std::sqrt(p_triangle_count / 2.0), 1);
+    std::vector<FaceVertex> face_vertices;
+    face_vertices.reserve((size_t)cell_count * cell_count * 6);
+
+    uint32_t face = 0;
+    for (uint32_t y = 0; y < cell_count; y++) {
+        for (uint32_t x = 0; x < cell_count; x++) {
+            uint32_t a = y * (cell_count + 1) + x, b = a + 1, c = a + cell_count + 1, d = c + 1;
+            for (uint32_t position : { a, b, d, a, d, c }) {
+                uint32_t normal = p_shading == GridShading::FLAT ? face + (face_vertices.size() % 6) / 3 : position;
+                face_vertices.push_back({ position, normal, position / 2 });
+            }
+            face += 2;
+        }
+    }
+
+    if (p_shading == GridShading::SHUFFLED) {
+        std::vector<uint32_t> order(face_vertices.size() / 3);
+        for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+        std::shuffle(order.begin(), order.end(), std::mt19937(7));
+
+        std::vector<FaceVertex> shuffled;
+        shuffled.reserve(face_vertices.size());
+        for (uint32_t triangle : order) {
+            shuffled.insert(shuffled.end(), face_vertices.begin() + triangle * 3, face_vertices.begin() + triangle * 3 + 3);
+        }
+        face_vertices = std::move(shuffled);
+    }
+
+    return face_vertices;
+}
+
+
+// Vertex welding of ObjMesh cooking, VertexWeldTable against std::unordered_map: `Benchmark weld [triangles] [runs]`.
+// Without a triangle count, grids of 1M and 10M triangles are measured.
+int run_weld_benchmark(int argc, char **argv) {
+    std::vector<size_t> triangle_counts = { 1000000, 10000000 };
+    if (argc > 0) triangle_counts = { std::max<size_t>(std::strtoull(argv[0], nullptr, 10), 2) };
+    uint32_t run_count = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 3;
+
+    for (size_t triangle_count : triangle_counts) {
+        for (GridShading shading : { GridShading::SMOOTH, GridShading::FLAT, GridShading::SHUFFLED }) {
+            std::vector<FaceVertex> face_vertices = _create_grid(triangle_count, shading);
+
+            double best_map_time = 1e30, best_table_time = 1e30;
+            uint32_t map_vertex_count = 0, table_vertex_count = 0;
+            for (uint32_t i = 0; i < run_count; i++) {
+                // Both build the index buffer, so that neither lookup is optimized away
+                std::vector<uint32_t> indices(face_vertices.size());
+
+                // Each container is destroyed before the other one is measured, outside of the measure
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    std::unordered_map<FaceVertex, uint32_t, FaceVertexHash> map;
+                    map_vertex_count = 0;
+                    for (size_t j = 0; j < face_vertices.size(); j++) {
+                        auto [it, inserted] = map.try_emplace(face_vertices[j], map_vertex_count);
+                        if (inserted) map_vertex_count++;
+                        indices[j] = it->second;
+                    }
+                    best_map_time = std::min(best_map_time, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                }
+
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    lixy::VertexWeldTable table(face_vertices.size() / 3);
+                    table_vertex_count = 0;
+                    for (size_t j = 0; j < face_vertices.size(); j++) {
+                        const FaceVertex &vertex = face_vertices[j];
+                        indices[j] = table.find_or_insert(vertex.position, vertex.normal, vertex.uv, table_vertex_count);
+                        if (indices[j] == table_vertex_count) table_vertex_count++;
+                    }
+                    best_table_time = std::min(best_table_time, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                }
+            }
+
+            const char *shading_name = shading == GridShading::SMOOTH ? "smooth" : shading == GridShading::FLAT ? "flat" : "shuffled";
+            std::cout << face_vertices.size() / 3 << " triangles, " << shading_name << ": "
+                << "unordered_map " << best_map_time << " ms (" << map_vertex_count << " vertices), "
+                << "VertexWeldTable " << best_table_time << " ms (" << table_vertex_count << " vertices)" << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
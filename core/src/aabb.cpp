@@ -0,0 +1,50 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "aabb.hpp"
+
+#include "thirdparty/glm/glm.hpp"
+
+
+namespace lixy {
+
+    void AABB::merge(const glm::vec3 &p_point) {
+        min = glm::min(min, p_point);
+        max = glm::max(max, p_point);
+    }
+
+
+    void AABB::merge(const AABB &p_other) {
+        min = glm::min(min, p_other.min);
+        max = glm::max(max, p_other.max);
+    }
+
+
+    bool AABB::intersects(const AABB &p_other) const {
+        return glm::all(glm::lessThanEqual(min, p_other.max)) && glm::all(glm::lessThanEqual(p_other.min, max));
+    }
+
+
+    AABB AABB::transformed(const glm::mat4 &p_matrix) const {
+        if (is_empty()) return AABB();
+
+        // The extents of the new box are the extents projected on the absolute value of each axis
+        glm::vec3 center = glm::vec3(p_matrix * glm::vec4(get_center(), 1.0f));
+        glm::vec3 extents = get_extents();
+        extents = glm::abs(glm::vec3(p_matrix[0])) * extents.x + glm::abs(glm::vec3(p_matrix[1])) * extents.y + glm::abs(glm::vec3(p_matrix[2])) * extents.z;
+        return AABB{center - extents, center + extents};
+    }
+}
\ No newline at end of file
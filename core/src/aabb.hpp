@@ -0,0 +1,44 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+
+#include "thirdparty/glm/glm.hpp"
+
+#include <limits>
+
+
+namespace lixy {
+
+    // Axis aligned bounding box, empty while no point has been merged into it
+    struct AABB {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+        inline bool is_empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+        inline glm::vec3 get_center() const { return 0.5f * (min + max); }
+        inline glm::vec3 get_extents() const { return 0.5f * (max - min); } // Half size
+
+        void merge(const glm::vec3 &p_point);
+        void merge(const AABB &p_other);
+        bool intersects(const AABB &p_other) const;
+
+        // Bounds of the box once transformed, larger than the transformed box when it is rotated
+        AABB transformed(const glm::mat4 &p_matrix) const;
+    };
+}
\ No newline at end of file
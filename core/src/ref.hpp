@@ -28,6 +28,7 @@ namespace lixy {
     class EntityRef {
     public:
         inline flecs::entity get_entity() { return reference; };
+        inline flecs::entity_t get_id() const { return reference.id(); }
 
         template<typename Component>
         const Component *get() const {
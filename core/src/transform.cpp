@@ -21,18 +21,23 @@
 #include "thirdparty/flecs/flecs.h"
 #include "thirdparty/glm/glm.hpp"
 
+#include <atomic>
+#include <cstdint>
+
 
 namespace lixy {
 
     void Transform::set_position(const glm::vec3 &p_position) {
         position = p_position;
         dirty_matrix = true;
+        version = _next_version();
     }
 
 
     void Transform::translate(const glm::vec3 &p_vector) {
         position += p_vector;
         dirty_matrix = true;
+        version = _next_version();
     }
     
 
@@ -44,6 +49,12 @@ namespace lixy {
     }
 
 
+    uint64_t Transform::_next_version() {
+        static std::atomic<uint64_t> next_version = 1;
+        return next_version.fetch_add(1, std::memory_order_relaxed);
+    }
+
+
     void Transform::_calculate_matrix() {
         matrix = glm::translate(
             glm::scale(
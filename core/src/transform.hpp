@@ -25,6 +25,8 @@
 #include "thirdparty/glm/gtc/quaternion.hpp"
 #include "thirdparty/glm/glm.hpp"
 
+#include <cstdint>
+
 
 namespace lixy {
 
@@ -38,6 +40,9 @@ namespace lixy {
         inline glm::quat get_local_rotation() const { return rotation; }
         inline glm::vec3 get_local_scale() const { return scale; }
 
+        // Changes on every modification and is unique across transforms, copies keep the version of their source
+        inline uint64_t get_version() const { return version; }
+
         Transform() = default;
         Transform(const glm::vec3 &p_position);
         Transform(const glm::vec3 &p_position, const glm::quat &p_rotation, const glm::vec3 &p_scale);
@@ -47,8 +52,12 @@ namespace lixy {
     private:
         void _calculate_matrix();
     
+    private:
+        static uint64_t _next_version();
+
     private:
         bool dirty_matrix = false;
+        uint64_t version = _next_version();
 
         glm::vec3 position = glm::vec3(0.0);
         glm::quat rotation = glm::quat(1.0, 0.0, 0.0, 0.0);
@@ -71,4 +71,5 @@ include "thirdparty/build.lua"
 include "wavefront_loader/build.lua"
 include "renderer/build.lua"
 include "windowing/build.lua"
-include "demo/build.lua"
\ No newline at end of file
+include "demo/build.lua"
+include "benchmark/build.lua"
\ No newline at end of file
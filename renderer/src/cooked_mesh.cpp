@@ -0,0 +1,401 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+
+#include "cooked_mesh.hpp"
+
+#include "debug/debug.hpp"
+#include "wavefront_loader/src/mapped_file.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+
+namespace lixy {
+
+    static const char COOKED_MESH_MAGIC[4] = { 'L', 'X', 'C', 'M' };
+    static const uint32_t COOKED_MESH_VERSION = 3;
+
+
+    struct CookedMesh::Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t source_hash;
+        uint32_t import_flags;
+
+        uint32_t vertex_format;
+        uint32_t vertex_stride;
+        uint32_t vertex_count;
+        uint32_t index_count;
+        uint32_t surface_count;
+        uint32_t source_count;
+
+        float position_offset[3];
+        float position_scale[3];
+
+        // Byte offsets of every section from the start of the file
+        uint32_t surface_offset;
+        uint32_t source_offset;
+        uint32_t vertex_offset;
+        uint32_t index_offset;
+        uint32_t string_offset;
+        uint32_t total_size;
+    };
+
+
+    struct CookedMesh::StringRecord {
+        uint32_t offset; // From the start of the string section
+        uint32_t length;
+    };
+
+
+    struct CookedMesh::SurfaceRecord {
+        uint32_t first_index;
+        uint32_t index_count;
+
+        StringRecord diffuse_texture;
+        float diffuse_offset[3];
+        float diffuse_scale[3];
+    };
+
+
+    static uint32_t _align(uint32_t p_offset, uint32_t p_alignment) {
+        return (p_offset + p_alignment - 1) / p_alignment * p_alignment;
+    }
+
+
+    // Whether p_count elements of p_element_size bytes at p_offset are aligned and fit in p_size bytes
+    static bool _is_section_valid(uint64_t p_offset, uint64_t p_count, uint64_t p_element_size, uint64_t p_alignment, uint64_t p_size) {
+        return p_offset % p_alignment == 0 && p_offset <= p_size && p_count * p_element_size <= p_size - p_offset;
+    }
+
+
+    bool CookedMesh::is_valid() const {
+        return data != nullptr;
+    }
+
+
+    bool CookedMesh::save(const std::filesystem::path &p_path) const {
+        if (!is_valid()) return false;
+
+        std::filesystem::path temporary_path = p_path;
+        temporary_path += ".tmp";
+
+        {
+            std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+            if (file.good()) {
+                file.write(data, size);
+                file.close();
+            }
+
+            if (!file.good()) {
+                std::error_code error;
+                std::filesystem::remove(temporary_path, error);
+                return false;
+            }
+        }
+
+        // Replace the previous file only once the new one is complete
+        std::error_code error;
+        std::filesystem::rename(temporary_path, p_path, error);
+        if (error) {
+            std::filesystem::remove(temporary_path, error);
+            return false;
+        }
+
+        return true;
+    }
+
+
+    uint32_t CookedMesh::get_import_flags() const {
+        return _get_header()->import_flags;
+    }
+
+
+    CookedMesh::VertexFormat CookedMesh::get_vertex_format() const {
+        return (VertexFormat)_get_header()->vertex_format;
+    }
+
+
+    uint32_t CookedMesh::get_vertex_stride() const {
+        return _get_header()->vertex_stride;
+    }
+
+
+    uint32_t CookedMesh::get_vertex_count() const {
+        return _get_header()->vertex_count;
+    }
+
+
+    const void *CookedMesh::get_vertex_data() const {
+        return data + _get_header()->vertex_offset;
+    }
+
+
+    glm::vec3 CookedMesh::get_position_offset() const {
+        const Header *header = _get_header();
+        return glm::vec3(header->position_offset[0], header->position_offset[1], header->position_offset[2]);
+    }
+
+
+    glm::vec3 CookedMesh::get_position_scale() const {
+        const Header *header = _get_header();
+        return glm::vec3(header->position_scale[0], header->position_scale[1], header->position_scale[2]);
+    }
+
+
+    uint32_t CookedMesh::get_index_count() const {
+        return _get_header()->index_count;
+    }
+
+
+    const uint32_t *CookedMesh::get_index_data() const {
+        return reinterpret_cast<const uint32_t*>(data + _get_header()->index_offset);
+    }
+
+
+    uint32_t CookedMesh::get_surface_count() const {
+        return _get_header()->surface_count;
+    }
+
+
+    CookedMesh::Surface CookedMesh::get_surface(uint32_t p_index) const {
+        ASSERT_FATAL_ERROR(p_index < get_surface_count(), "Error index out of bounds");
+        const SurfaceRecord *record = reinterpret_cast<const SurfaceRecord*>(data + _get_header()->surface_offset) + p_index;
+
+        return Surface{
+            .first_index = record->first_index,
+            .index_count = record->index_count,
+            .diffuse_texture = _get_string(record->diffuse_texture),
+            .diffuse_offset = glm::vec3(record->diffuse_offset[0], record->diffuse_offset[1], record->diffuse_offset[2]),
+            .diffuse_scale = glm::vec3(record->diffuse_scale[0], record->diffuse_scale[1], record->diffuse_scale[2]),
+        };
+    }
+
+
+    CookedMesh CookedMesh::cook(
+        const std::vector<std::filesystem::path> &p_sources,
+        uint32_t p_import_flags,
+        VertexFormat p_vertex_format,
+        uint32_t p_vertex_stride,
+        const void *p_vertices,
+        uint32_t p_vertex_count,
+        const std::vector<uint32_t> &p_indices,
+        const std::vector<Surface> &p_surfaces,
+        const glm::vec3 &p_position_offset,
+        const glm::vec3 &p_position_scale
+    ) {
+        // Gather strings
+        std::string strings;
+        auto add_string = [&strings](std::string_view p_string) {
+            StringRecord record{ (uint32_t)strings.size(), (uint32_t)p_string.size() };
+            strings.append(p_string);
+            return record;
+        };
+
+        std::vector<StringRecord> source_records;
+        source_records.reserve(p_sources.size());
+        for (const std::filesystem::path &source : p_sources) {
+            source_records.push_back(add_string(source.string()));
+        }
+
+        std::vector<SurfaceRecord> surface_records;
+        surface_records.reserve(p_surfaces.size());
+        for (const Surface &surface : p_surfaces) {
+            surface_records.push_back(SurfaceRecord{
+                .first_index = surface.first_index,
+                .index_count = surface.index_count,
+                .diffuse_texture = add_string(surface.diffuse_texture),
+                .diffuse_offset = { surface.diffuse_offset.x, surface.diffuse_offset.y, surface.diffuse_offset.z },
+                .diffuse_scale = { surface.diffuse_scale.x, surface.diffuse_scale.y, surface.diffuse_scale.z },
+            });
+        }
+
+        // Compute the file layout
+        Header header{};
+        memcpy(header.magic, COOKED_MESH_MAGIC, sizeof(header.magic));
+        header.version = COOKED_MESH_VERSION;
+        header.source_hash = _hash_sources(p_sources);
+        header.import_flags = p_import_flags;
+        header.vertex_format = (uint32_t)p_vertex_format;
+        header.vertex_stride = p_vertex_stride;
+        header.vertex_count = p_vertex_count;
+        header.index_count = p_indices.size();
+        header.surface_count = surface_records.size();
+        header.source_count = source_records.size();
+        for (int i = 0; i < 3; i++) {
+            header.position_offset[i] = p_position_offset[i];
+            header.position_scale[i] = p_position_scale[i];
+        }
+
+        header.surface_offset = _align(sizeof(Header), 16);
+        header.source_offset = _align(header.surface_offset + surface_records.size() * sizeof(SurfaceRecord), 16);
+        header.vertex_offset = _align(header.source_offset + source_records.size() * sizeof(StringRecord), 16);
+        header.index_offset = _align(header.vertex_offset + p_vertex_count * p_vertex_stride, 16);
+        header.string_offset = _align(header.index_offset + p_indices.size() * sizeof(uint32_t), 16);
+        header.total_size = header.string_offset + strings.size();
+
+        // Write the image
+        CookedMesh cooked;
+        cooked.storage.resize(header.total_size, 0);
+        char *image = cooked.storage.data();
+
+        memcpy(image, &header, sizeof(Header));
+        memcpy(image + header.surface_offset, surface_records.data(), surface_records.size() * sizeof(SurfaceRecord));
+        memcpy(image + header.source_offset, source_records.data(), source_records.size() * sizeof(StringRecord));
+        memcpy(image + header.vertex_offset, p_vertices, p_vertex_count * p_vertex_stride);
+        memcpy(image + header.index_offset, p_indices.data(), p_indices.size() * sizeof(uint32_t));
+        memcpy(image + header.string_offset, strings.data(), strings.size());
+
+        cooked.data = image;
+        cooked.size = header.total_size;
+        return cooked;
+    }
+
+
+    CookedMesh CookedMesh::open(const std::filesystem::path &p_path) {
+        CookedMesh cooked;
+
+        std::error_code error;
+        if (!std::filesystem::exists(p_path, error)) return cooked;
+
+        MappedFile mapping(p_path);
+        if (!mapping.is_valid() || mapping.get_size() < sizeof(Header)) return cooked;
+
+        // Check that the file is a complete cooked mesh of the current version
+        const Header *header = reinterpret_cast<const Header*>(mapping.get_data());
+        if (memcmp(header->magic, COOKED_MESH_MAGIC, sizeof(header->magic)) != 0
+            || header->version != COOKED_MESH_VERSION
+            || header->total_size != mapping.get_size()
+            || !_is_image_valid(mapping.get_data(), mapping.get_size()))
+        {
+            return cooked;
+        }
+
+        cooked.data = mapping.get_data();
+        cooked.size = mapping.get_size();
+        cooked.mapping = std::move(mapping);
+
+        // Check that the sources did not change since the mesh was cooked
+        std::vector<std::filesystem::path> sources;
+        sources.reserve(header->source_count);
+        const StringRecord *source_records = reinterpret_cast<const StringRecord*>(cooked.data + header->source_offset);
+        for (uint32_t i = 0; i < header->source_count; i++) {
+            sources.push_back(std::filesystem::path(cooked._get_string(source_records[i])));
+        }
+
+        if (_hash_sources(sources) != header->source_hash) {
+            return CookedMesh();
+        }
+
+        return cooked;
+    }
+
+
+    std::filesystem::path CookedMesh::get_cooked_path(const std::filesystem::path &p_source_path) {
+        std::filesystem::path cooked_path = p_source_path;
+        cooked_path += ".cooked";
+        return cooked_path;
+    }
+
+
+    const CookedMesh::Header *CookedMesh::_get_header() const {
+        return reinterpret_cast<const Header*>(data);
+    }
+
+
+    bool CookedMesh::_is_image_valid(const char *p_data, size_t p_size) {
+        const Header *header = reinterpret_cast<const Header*>(p_data);
+        if (header->vertex_format > (uint32_t)VertexFormat::COMPACT || header->vertex_stride == 0) return false;
+
+        // Every section must lie inside the file
+        if (!_is_section_valid(header->surface_offset, header->surface_count, sizeof(SurfaceRecord), alignof(SurfaceRecord), p_size)
+            || !_is_section_valid(header->source_offset, header->source_count, sizeof(StringRecord), alignof(StringRecord), p_size)
+            || !_is_section_valid(header->vertex_offset, header->vertex_count, header->vertex_stride, 4, p_size)
+            || !_is_section_valid(header->index_offset, header->index_count, sizeof(uint32_t), alignof(uint32_t), p_size)
+            || !_is_section_valid(header->string_offset, 0, 1, 1, p_size))
+        {
+            return false;
+        }
+
+        // Every index must point inside the vertex section, they are read by the GPU without checks
+        const uint32_t *indices = reinterpret_cast<const uint32_t*>(p_data + header->index_offset);
+        for (uint32_t i = 0; i < header->index_count; i++) {
+            if (indices[i] >= header->vertex_count) return false;
+        }
+
+        // Every record must point inside its section
+        const uint64_t string_section_size = p_size - header->string_offset;
+        auto is_string_valid = [string_section_size](const StringRecord &p_record) {
+            return (uint64_t)p_record.offset + p_record.length <= string_section_size;
+        };
+
+        const StringRecord *source_records = reinterpret_cast<const StringRecord*>(p_data + header->source_offset);
+        for (uint32_t i = 0; i < header->source_count; i++) {
+            if (!is_string_valid(source_records[i])) return false;
+        }
+
+        const SurfaceRecord *surface_records = reinterpret_cast<const SurfaceRecord*>(p_data + header->surface_offset);
+        for (uint32_t i = 0; i < header->surface_count; i++) {
+            const SurfaceRecord &record = surface_records[i];
+            if (!is_string_valid(record.diffuse_texture)
+                || (uint64_t)record.first_index + record.index_count > header->index_count)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    std::string_view CookedMesh::_get_string(const StringRecord &p_record) const {
+        return std::string_view(data + _get_header()->string_offset + p_record.offset, p_record.length);
+    }
+
+
+    uint64_t CookedMesh::_hash_sources(const std::vector<std::filesystem::path> &p_sources) {
+        // FNV-1a over the path, size and modification time of every source, the content itself is never read
+        uint64_t hash = 0xcbf29ce484222325;
+        auto hash_bytes = [&hash](const void *p_data, size_t p_size) {
+            const uint8_t *bytes = static_cast<const uint8_t*>(p_data);
+            for (size_t i = 0; i < p_size; i++) {
+                hash = (hash ^ bytes[i]) * 0x100000001b3;
+            }
+        };
+
+        for (const std::filesystem::path &source : p_sources) {
+            std::string path = source.string();
+            hash_bytes(path.data(), path.size());
+
+            std::error_code error;
+            uint64_t file_size = std::filesystem::file_size(source, error);
+            if (error) file_size = UINT64_MAX;
+            hash_bytes(&file_size, sizeof(file_size));
+
+            std::filesystem::file_time_type write_time = std::filesystem::last_write_time(source, error);
+            int64_t write_time_count = error ? 0 : write_time.time_since_epoch().count();
+            hash_bytes(&write_time_count, sizeof(write_time_count));
+        }
+
+        return hash;
+    }
+}
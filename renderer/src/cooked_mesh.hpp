@@ -0,0 +1,113 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+
+#pragma once
+
+
+#include "thirdparty/glm/glm.hpp"
+#include "wavefront_loader/src/mapped_file.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+
+namespace lixy {
+
+    // Binary image of an imported mesh: interleaved vertices, indices and surface descriptions.
+    // Cooked meshes are saved next to their source and memory mapped on subsequent loads.
+    class CookedMesh {
+    public:
+        enum class VertexFormat : uint32_t {
+            POSITION_NORMAL_UV = 0, // vec3 position, vec3 normal, vec2 uv
+            COMPACT = 1, // unorm16x4 position quantized over the mesh bounds, snorm 10:10:10:2 normal, half float uv
+        };
+
+        struct Surface {
+            uint32_t first_index;
+            uint32_t index_count;
+
+            std::string_view diffuse_texture; // Empty if the surface has no diffuse texture
+            glm::vec3 diffuse_offset;
+            glm::vec3 diffuse_scale;
+        };
+
+    public:
+        bool is_valid() const;
+        bool save(const std::filesystem::path &p_path) const;
+
+        uint32_t get_import_flags() const; // Importer settings the mesh was cooked with
+
+        VertexFormat get_vertex_format() const;
+        uint32_t get_vertex_stride() const;
+        uint32_t get_vertex_count() const;
+        const void *get_vertex_data() const;
+
+        // Dequantization of COMPACT positions: position = offset + quantized * scale
+        glm::vec3 get_position_offset() const;
+        glm::vec3 get_position_scale() const;
+
+        uint32_t get_index_count() const;
+        const uint32_t *get_index_data() const;
+
+        uint32_t get_surface_count() const;
+        Surface get_surface(uint32_t p_index) const;
+
+        static CookedMesh cook(
+            const std::vector<std::filesystem::path> &p_sources,
+            uint32_t p_import_flags,
+            VertexFormat p_vertex_format,
+            uint32_t p_vertex_stride,
+            const void *p_vertices,
+            uint32_t p_vertex_count,
+            const std::vector<uint32_t> &p_indices,
+            const std::vector<Surface> &p_surfaces,
+            const glm::vec3 &p_position_offset = glm::vec3(0.0),
+            const glm::vec3 &p_position_scale = glm::vec3(1.0)
+        );
+        static CookedMesh open(const std::filesystem::path &p_path);
+        static std::filesystem::path get_cooked_path(const std::filesystem::path &p_source_path);
+
+        CookedMesh() = default;
+        CookedMesh(const CookedMesh&) = delete;
+        CookedMesh(CookedMesh&&) = default;
+        CookedMesh &operator=(CookedMesh&&) = default;
+        virtual ~CookedMesh() = default;
+
+    private:
+        struct Header;
+        struct SurfaceRecord;
+        struct StringRecord;
+
+    private:
+        const Header *_get_header() const;
+        std::string_view _get_string(const StringRecord &p_record) const;
+
+        static bool _is_image_valid(const char *p_data, size_t p_size); // Whether every section and record lies inside the image
+        static uint64_t _hash_sources(const std::vector<std::filesystem::path> &p_sources);
+
+    private:
+        MappedFile mapping;
+        std::vector<char> storage; // Used instead of the mapping for freshly cooked meshes
+
+        const char *data = nullptr;
+        size_t size = 0;
+    };
+}
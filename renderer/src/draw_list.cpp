@@ -0,0 +1,221 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "draw_list.hpp"
+
+#include "debug/debug.hpp"
+#include "renderer/src/geometry_arena.hpp"
+#include "renderer/src/material.hpp"
+#include "renderer/src/occlusion_culler.hpp"
+#include "renderer/src/primitives/vbuffer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+
+namespace lixy {
+
+    void DrawList::add(const Material *p_material, uint32_t p_pool, GLenum p_index_type, const opengl::DrawElementsIndirectCommand &p_command, const InstanceData *p_instances, float p_depth) {
+        uint64_t mesh = ((uint64_t)p_pool << 1 | (p_index_type == GL_UNSIGNED_INT)) & ((uint64_t(1) << MESH_BITS) - 1);
+        uint64_t material_key = _get_material_key(p_material);
+        uint64_t key = (uint64_t)pass << PASS_SHIFT | mesh << MESH_SHIFT;
+        if (pass == DrawPass::TRANSPARENT) {
+            // The material keeps the bits of its id below the depth, draws are still grouped by pointer
+            uint64_t back_to_front_depth = (uint64_t(1) << DEPTH_BITS) - 1 - _get_depth_bucket(p_depth);
+            key |= back_to_front_depth << BACK_TO_FRONT_DEPTH_SHIFT | (material_key & ((uint64_t(1) << BACK_TO_FRONT_DEPTH_SHIFT) - 1));
+        } else {
+            key |= material_key | _get_depth_bucket(p_depth) << DEPTH_SHIFT;
+        }
+
+        pass_draw_counts[(size_t)pass]++;
+        draws.push_back(Draw{
+            .key = key,
+            .material = p_material,
+            .pool = p_pool,
+            .index_type = p_index_type,
+            .command = p_command,
+            .instances = p_instances,
+        });
+    }
+
+
+    void DrawList::clear() {
+        pass = DrawPass::GEOMETRY;
+        draws.clear();
+        pass_draw_counts.fill(0);
+        material_keys.clear();
+        program_ids.clear();
+        last_material = nullptr;
+    }
+
+
+    void DrawList::submit(const GeometryArena &p_arena, const glm::mat4 &p_projection, const glm::mat4 &p_view, const opengl::ShaderStorageBuffer::Slice &p_instances, bool p_multi_draw_indirect, OcclusionCuller *p_occlusion_culler) {
+        if (draws.empty()) return;
+        ASSERT_FATAL_ERROR(!p_occlusion_culler || p_multi_draw_indirect, "Occlusion culling writes the commands of glMultiDrawElementsIndirect");
+
+        _sort_draws();
+
+        if (p_multi_draw_indirect) {
+            commands.resize(draws.size());
+            for (size_t i = 0; i < draws.size(); i++) commands[i] = draws[i].command;
+
+            uint32_t commands_size = commands.size() * sizeof(opengl::DrawElementsIndirectCommand);
+            uint32_t buffer_size = command_buffer.get_size();
+            if (buffer_size < commands_size) buffer_size = std::max(commands_size, 2 * buffer_size);
+            command_buffer.allocate(buffer_size); // Orphan the previous frame commands instead of waiting for them
+            command_buffer.write_data(0, commands_size, commands.data());
+
+            // The geometry pass comes first, its commands are the ones of the culled instances
+            if (p_occlusion_culler) p_occlusion_culler->write_instance_counts(command_buffer, get_draw_count(DrawPass::GEOMETRY));
+        }
+
+        _draw(DrawPass::GEOMETRY, p_arena, p_projection, p_view, p_instances, p_multi_draw_indirect);
+    }
+
+
+    void DrawList::redraw(DrawPass p_pass, const GeometryArena &p_arena, const glm::mat4 &p_projection, const glm::mat4 &p_view, const opengl::ShaderStorageBuffer::Slice &p_instances, bool p_multi_draw_indirect) {
+        if (get_draw_count(p_pass) == 0) return;
+
+        if (p_multi_draw_indirect) command_buffer.bind();
+        _draw(p_pass, p_arena, p_projection, p_view, p_instances, p_multi_draw_indirect);
+    }
+
+
+    size_t DrawList::_get_first_draw(DrawPass p_pass) const {
+        return std::partition_point(draws.begin(), draws.end(), [p_pass](const Draw &p_draw) { return p_draw.key >> PASS_SHIFT < (uint64_t)p_pass; }) - draws.begin();
+    }
+
+
+    void DrawList::_draw(DrawPass p_pass, const GeometryArena &p_arena, const glm::mat4 &p_projection, const glm::mat4 &p_view, const opengl::ShaderStorageBuffer::Slice &p_instances, bool p_multi_draw_indirect) const {
+        uint32_t bound_pool = UINT32_MAX;
+        const Material *bound_material = nullptr;
+        size_t end = _get_first_draw(p_pass) + get_draw_count(p_pass);
+        for (size_t first = _get_first_draw(p_pass); first < end;) {
+            const Draw &draw = draws[first];
+
+            // Only the depth may differ inside a run, the pointers are compared in case an id overflowed its segment
+            size_t last = first + 1;
+            while (last < end && draws[last].key >> MESH_SHIFT == draw.key >> MESH_SHIFT
+                && draws[last].material == draw.material && draws[last].pool == draw.pool && draws[last].index_type == draw.index_type) last++;
+
+            if (draw.pool != bound_pool) {
+                p_arena.bind_pool(draw.pool);
+                bound_pool = draw.pool;
+            }
+
+            bool material_changed = draw.material != bound_material;
+            if (material_changed) {
+                draw.material->bind_material();
+                bound_material = draw.material;
+            }
+
+            if (!draw.material->is_instanced()) {
+                for (size_t i = first; i < last; i++) _draw_uninstanced(p_arena, draws[i], p_projection, p_view);
+            } else {
+                if (material_changed) {
+                    draw.material->bind_view_projection(p_projection, p_view);
+                    draw.material->bind_instance_data(p_instances);
+                }
+
+                if (p_multi_draw_indirect) {
+                    p_arena.multi_draw_indirect(draw.index_type, first * sizeof(opengl::DrawElementsIndirectCommand), last - first);
+                } else {
+                    for (size_t i = first; i < last; i++) p_arena.draw(draws[i].index_type, draws[i].command);
+                }
+            }
+
+            first = last;
+        }
+
+        p_arena.unbind_pool();
+        if (p_multi_draw_indirect) command_buffer.unbind();
+    }
+
+
+    uint64_t DrawList::_get_material_key(const Material *p_material) {
+        if (p_material == last_material) return last_material_key;
+
+        auto material_key = material_keys.find(p_material);
+        if (material_key == material_keys.end()) {
+            auto program_id = program_ids.try_emplace(p_material->get_program(), program_ids.size()).first;
+            uint64_t program = program_id->second & ((uint64_t(1) << PROGRAM_BITS) - 1);
+            uint64_t material = material_keys.size() & ((uint64_t(1) << MATERIAL_BITS) - 1);
+            material_key = material_keys.emplace(p_material, program << PROGRAM_SHIFT | material << MATERIAL_SHIFT).first;
+        }
+
+        last_material = p_material;
+        last_material_key = material_key->second;
+        return last_material_key;
+    }
+
+
+    uint64_t DrawList::_get_depth_bucket(float p_depth) {
+        if (!(p_depth > 0.0f)) return 0; // Behind the camera or NaN
+
+        // The bits of a positive float are ordered like its value, the high bits give buckets of constant relative size
+        uint32_t bits;
+        memcpy(&bits, &p_depth, sizeof(bits));
+        return bits >> (32 - DEPTH_BITS);
+    }
+
+
+    void DrawList::_sort_draws() {
+        constexpr uint32_t DIGIT_BITS = 8;
+        constexpr uint32_t DIGIT_COUNT = 1 << DIGIT_BITS;
+        constexpr uint32_t PASS_COUNT = 64 / DIGIT_BITS;
+
+        std::array<std::array<uint32_t, DIGIT_COUNT>, PASS_COUNT> histograms{};
+        for (const Draw &draw : draws) {
+            for (uint32_t i = 0; i < PASS_COUNT; i++) histograms[i][(draw.key >> (i * DIGIT_BITS)) & (DIGIT_COUNT - 1)] += 1;
+        }
+
+        sorted_draws.resize(draws.size());
+        for (uint32_t i = 0; i < PASS_COUNT; i++) {
+            std::array<uint32_t, DIGIT_COUNT> &offsets = histograms[i];
+            uint32_t shift = i * DIGIT_BITS;
+
+            // Every key has the same digit, most passes are skipped as few bits of the segments are used
+            if (offsets[(draws[0].key >> shift) & (DIGIT_COUNT - 1)] == draws.size()) continue;
+
+            uint32_t offset = 0;
+            for (uint32_t &count : offsets) {
+                uint32_t digit_count = count;
+                count = offset;
+                offset += digit_count;
+            }
+
+            for (const Draw &draw : draws) sorted_draws[offsets[(draw.key >> shift) & (DIGIT_COUNT - 1)]++] = draw;
+            draws.swap(sorted_draws);
+        }
+    }
+
+
+    void DrawList::_draw_uninstanced(const GeometryArena &p_arena, const Draw &p_draw, const glm::mat4 &p_projection, const glm::mat4 &p_view) const {
+        for (uint32_t i = 0; i < p_draw.command.instance_count; i++) {
+            const InstanceData &instance = p_draw.instances[i];
+            p_draw.material->bind_pvm(p_projection, p_view, instance.model);
+            p_draw.material->bind_position_dequantization(glm::vec3(instance.position_offset), glm::vec3(instance.position_scale));
+
+            opengl::DrawElementsIndirectCommand command = p_draw.command;
+            command.instance_count = 1;
+            command.base_instance += i;
+            p_arena.draw(p_draw.index_type, command);
+        }
+    }
+}
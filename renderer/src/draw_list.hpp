@@ -0,0 +1,136 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include "renderer/src/geometry_arena.hpp"
+#include "renderer/src/material.hpp"
+#include "renderer/src/primitives/shader.hpp"
+#include "renderer/src/primitives/vbuffer.hpp"
+
+#include "thirdparty/glad/include/glad/glad.h"
+#include "thirdparty/glm/glm.hpp"
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+namespace lixy {
+
+    class OcclusionCuller;
+
+
+    // Per instance data read by instanced materials, matches the `InstanceData` storage buffer of the shaders
+    struct InstanceData {
+        glm::mat4 model;
+        glm::vec4 position_offset; // Dequantization of compact vertex positions, w is unused
+        glm::vec4 position_scale;
+    };
+
+
+    // Consecutive instances of a mesh, drawn together
+    struct InstanceBatch {
+        uint32_t first_instance; // Index of the first instance of the batch in the frame instance data
+        uint32_t instance_count;
+        const InstanceData *instances; // The batch instances, for materials that are not instanced
+        float depth; // View space distance of the closest instance, draws of a material are sorted front to back
+        // View space distance of every instance of the batch. When set, surfaces of blended materials are recorded in
+        // the transparent pass with one draw per instance.
+        const float *depths;
+    };
+
+
+    // Passes of the draw list, submitted in this order
+    enum class DrawPass : uint8_t {
+        GEOMETRY,
+        TRANSPARENT, // Sorted back to front, by depth before anything else
+    };
+
+
+    // Render queue of the surface draws of a frame. Every draw gets a 64 bit sort key, from the most to the least
+    // significant bits: pass, program, material, vertex pool and index type, depth bucket. Transparent draws move their
+    // inverted depth bucket right below the pass instead, so that they are drawn back to front. Keys are radix sorted, then
+    // runs sharing everything but the depth are submitted with a single glMultiDrawElementsIndirect call, or with
+    // one call per draw when it is disabled. Programs and vertex pools are only bound when their key segment changes.
+    class DrawList {
+    public:
+        void add(const Material *p_material, uint32_t p_pool, GLenum p_index_type, const opengl::DrawElementsIndirectCommand &p_command, const InstanceData *p_instances, float p_depth);
+        void clear();
+
+        // Pass of the draws added next, `clear` resets it to the geometry pass
+        inline void set_pass(DrawPass p_pass) { pass = p_pass; }
+
+        inline uint32_t get_draw_count() const { return draws.size(); }
+        inline uint32_t get_draw_count(DrawPass p_pass) const { return pass_draw_counts[(size_t)p_pass]; }
+
+        // Sorts and uploads the draws, then draws the geometry pass. With an occlusion culler, `p_instances` are its
+        // visible instances and it writes the instance counts of the geometry pass commands before they are drawn. It
+        // needs glMultiDrawElementsIndirect.
+        void submit(const GeometryArena &p_arena, const glm::mat4 &p_projection, const glm::mat4 &p_view, const opengl::ShaderStorageBuffer::Slice &p_instances, bool p_multi_draw_indirect, OcclusionCuller *p_occlusion_culler = nullptr);
+        // Draws a pass of the submitted list, the geometry pass again for another pass over the same surfaces. The
+        // draws are neither sorted nor uploaded again and the instance counts of the occlusion culler are kept. The
+        // transparent pass is not culled, it reads the instances given to the culler.
+        void redraw(DrawPass p_pass, const GeometryArena &p_arena, const glm::mat4 &p_projection, const glm::mat4 &p_view, const opengl::ShaderStorageBuffer::Slice &p_instances, bool p_multi_draw_indirect);
+
+    private:
+        struct Draw {
+            uint64_t key;
+            const Material *material;
+            uint32_t pool;
+            GLenum index_type;
+            opengl::DrawElementsIndirectCommand command;
+            const InstanceData *instances;
+        };
+
+        // Bit ranges of the sort key segments
+        static constexpr uint32_t DEPTH_SHIFT = 0, DEPTH_BITS = 16;
+        static constexpr uint32_t MESH_SHIFT = 16, MESH_BITS = 12; // Vertex pool and index type
+        static constexpr uint32_t MATERIAL_SHIFT = 28, MATERIAL_BITS = 20;
+        static constexpr uint32_t PROGRAM_SHIFT = 48, PROGRAM_BITS = 12;
+        static constexpr uint32_t PASS_SHIFT = 60, PASS_BITS = 4;
+        static constexpr uint32_t BACK_TO_FRONT_DEPTH_SHIFT = 44; // Of transparent draws, over the program and the high material bits
+        static constexpr uint32_t PASS_COUNT = 2;
+
+    private:
+        // Program and material segments of the key of the material. Ids are dense indices in order of first use
+        // this frame so that they fit in their segment, draws are still grouped by pointer if they do not.
+        uint64_t _get_material_key(const Material *p_material);
+        static uint64_t _get_depth_bucket(float p_depth);
+
+        void _sort_draws(); // LSD radix sort on the keys, 8 bits per pass
+        size_t _get_first_draw(DrawPass p_pass) const; // Of the pass in the sorted draws
+        void _draw(DrawPass p_pass, const GeometryArena &p_arena, const glm::mat4 &p_projection, const glm::mat4 &p_view, const opengl::ShaderStorageBuffer::Slice &p_instances, bool p_multi_draw_indirect) const;
+        void _draw_uninstanced(const GeometryArena &p_arena, const Draw &p_draw, const glm::mat4 &p_projection, const glm::mat4 &p_view) const;
+
+    private:
+        DrawPass pass = DrawPass::GEOMETRY;
+        std::vector<Draw> draws;
+        std::array<uint32_t, PASS_COUNT> pass_draw_counts = {};
+        std::vector<Draw> sorted_draws; // Radix sort scratch
+        std::vector<opengl::DrawElementsIndirectCommand> commands; // In submission order
+        opengl::DrawIndirectBuffer command_buffer;
+
+        std::unordered_map<const Material*, uint64_t> material_keys;
+        std::unordered_map<const opengl::ShaderProgram*, uint32_t> program_ids;
+        const Material *last_material = nullptr; // Consecutive draws mostly share their material
+        uint64_t last_material_key = 0;
+    };
+}
@@ -0,0 +1,405 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "dynamic_bvh.hpp"
+
+#include "core/src/aabb.hpp"
+#include "debug/debug.hpp"
+#include "renderer/src/frustum_culler.hpp"
+
+#include "thirdparty/glm/glm.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+
+namespace lixy {
+
+    static float _get_area(const AABB &p_bounds) {
+        glm::vec3 size = p_bounds.max - p_bounds.min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+
+    static AABB _merge(const AABB &p_a, const AABB &p_b) {
+        AABB merged = p_a;
+        merged.merge(p_b);
+        return merged;
+    }
+
+
+    static bool _contains(const AABB &p_outer, const AABB &p_inner) {
+        return glm::all(glm::lessThanEqual(p_outer.min, p_inner.min)) && glm::all(glm::lessThanEqual(p_inner.max, p_outer.max));
+    }
+
+
+    DynamicBVH::ProxyId DynamicBVH::create_proxy(const AABB &p_bounds, uint64_t p_user_data) {
+        uint32_t leaf = _allocate_node();
+        nodes[leaf].bounds = AABB{p_bounds.min - margin, p_bounds.max + margin};
+        nodes[leaf].user_data = p_user_data;
+        nodes[leaf].height = 0;
+
+        _insert_leaf(leaf);
+        proxy_count += 1;
+        return leaf;
+    }
+
+
+    void DynamicBVH::destroy_proxy(ProxyId p_proxy) {
+        ASSERT_FATAL_ERROR(p_proxy < nodes.size() && nodes[p_proxy].height == 0, "Invalid BVH proxy");
+
+        _remove_leaf(p_proxy);
+        _free_node(p_proxy);
+        proxy_count -= 1;
+    }
+
+
+    bool DynamicBVH::move_proxy(ProxyId p_proxy, const AABB &p_bounds) {
+        ASSERT_FATAL_ERROR(p_proxy < nodes.size() && nodes[p_proxy].height == 0, "Invalid BVH proxy");
+
+        // Reinsert when the box left its enlarged box, or when it shrank so much that the enlarged box is too loose
+        const AABB &fat_bounds = nodes[p_proxy].bounds;
+        AABB loose_bounds{p_bounds.min - 4.0f * margin, p_bounds.max + 4.0f * margin};
+        if (_contains(fat_bounds, p_bounds) && _contains(loose_bounds, fat_bounds)) return false;
+
+        _remove_leaf(p_proxy);
+        nodes[p_proxy].bounds = AABB{p_bounds.min - margin, p_bounds.max + margin};
+        _insert_leaf(p_proxy);
+        return true;
+    }
+
+
+    uint64_t DynamicBVH::get_user_data(ProxyId p_proxy) const {
+        return nodes[p_proxy].user_data;
+    }
+
+
+    const AABB &DynamicBVH::get_fat_bounds(ProxyId p_proxy) const {
+        return nodes[p_proxy].bounds;
+    }
+
+
+    uint32_t DynamicBVH::get_height() const {
+        return root == NO_NODE ? 0 : nodes[root].height;
+    }
+
+
+    void DynamicBVH::query(const AABB &p_bounds, std::vector<uint64_t> &p_results) const {
+        if (root == NO_NODE) return;
+
+        std::vector<uint32_t> stack = {root};
+        while (!stack.empty()) {
+            const Node &node = nodes[stack.back()];
+            stack.pop_back();
+
+            if (!node.bounds.intersects(p_bounds)) continue;
+            if (node.is_leaf()) {
+                p_results.push_back(node.user_data);
+            } else {
+                stack.push_back(node.child_1);
+                stack.push_back(node.child_2);
+            }
+        }
+    }
+
+
+    void DynamicBVH::query(const Frustum &p_frustum, std::vector<uint64_t> &p_results) const {
+        if (root == NO_NODE) return;
+
+        // Subtrees inside the frustum are appended without testing, leaves crossing its planes are tested in batches
+        FrustumCuller boundary_leaves;
+        std::vector<uint64_t> boundary_user_data;
+
+        struct Entry {
+            uint32_t node;
+            uint32_t plane_mask;
+        };
+        std::vector<Entry> stack = {{root, (1u << 6) - 1}};
+        while (!stack.empty()) {
+            Entry entry = stack.back();
+            stack.pop_back();
+
+            const Node &node = nodes[entry.node];
+            if (node.is_leaf()) {
+                boundary_leaves.add(node.bounds);
+                boundary_user_data.push_back(node.user_data);
+                continue;
+            }
+
+            switch (_test_frustum(p_frustum, node.bounds, entry.plane_mask)) {
+            case OUTSIDE: break;
+            case INSIDE: _append_leaves(entry.node, p_results); break;
+            case INTERSECTING:
+                stack.push_back({node.child_1, entry.plane_mask});
+                stack.push_back({node.child_2, entry.plane_mask});
+                break;
+            }
+        }
+
+        std::vector<uint32_t> visible;
+        boundary_leaves.cull(p_frustum, visible);
+        for (uint32_t index : visible) p_results.push_back(boundary_user_data[index]);
+    }
+
+
+    void DynamicBVH::query_sphere(const glm::vec3 &p_center, float p_radius, std::vector<uint64_t> &p_results) const {
+        if (root == NO_NODE) return;
+
+        float radius_squared = p_radius * p_radius;
+        std::vector<uint32_t> stack = {root};
+        while (!stack.empty()) {
+            const Node &node = nodes[stack.back()];
+            stack.pop_back();
+
+            glm::vec3 offset = p_center - glm::clamp(p_center, node.bounds.min, node.bounds.max);
+            if (glm::dot(offset, offset) > radius_squared) continue;
+            if (node.is_leaf()) {
+                p_results.push_back(node.user_data);
+            } else {
+                stack.push_back(node.child_1);
+                stack.push_back(node.child_2);
+            }
+        }
+    }
+
+
+    void DynamicBVH::query_ray(const glm::vec3 &p_origin, const glm::vec3 &p_direction, float p_max_distance, std::vector<uint64_t> &p_results) const {
+        if (root == NO_NODE) return;
+
+        glm::vec3 inverse_direction = 1.0f / p_direction; // Infinite on axes the ray is parallel to
+        std::vector<uint32_t> stack = {root};
+        while (!stack.empty()) {
+            const Node &node = nodes[stack.back()];
+            stack.pop_back();
+
+            // Slab test, the ray hits the box when the entry distance of every axis is before the exit distances
+            glm::vec3 distance_1 = (node.bounds.min - p_origin) * inverse_direction;
+            glm::vec3 distance_2 = (node.bounds.max - p_origin) * inverse_direction;
+            glm::vec3 near = glm::min(distance_1, distance_2), far = glm::max(distance_1, distance_2);
+            float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+            float exit = std::min(std::min(far.x, far.y), std::min(far.z, p_max_distance));
+            if (enter > exit) continue;
+
+            if (node.is_leaf()) {
+                p_results.push_back(node.user_data);
+            } else {
+                stack.push_back(node.child_1);
+                stack.push_back(node.child_2);
+            }
+        }
+    }
+
+
+    DynamicBVH::DynamicBVH(float p_margin)
+        : margin(p_margin) {}
+
+
+    uint32_t DynamicBVH::_allocate_node() {
+        uint32_t node;
+        if (free_list != NO_NODE) {
+            node = free_list;
+            free_list = nodes[node].parent;
+        } else {
+            node = nodes.size();
+            nodes.emplace_back();
+        }
+
+        nodes[node].parent = NO_NODE;
+        nodes[node].child_1 = NO_NODE;
+        nodes[node].child_2 = NO_NODE;
+        nodes[node].height = 0;
+        return node;
+    }
+
+
+    void DynamicBVH::_free_node(uint32_t p_node) {
+        nodes[p_node].parent = free_list;
+        nodes[p_node].height = -1;
+        free_list = p_node;
+    }
+
+
+    void DynamicBVH::_insert_leaf(uint32_t p_leaf) {
+        if (root == NO_NODE) {
+            root = p_leaf;
+            nodes[root].parent = NO_NODE;
+            return;
+        }
+
+        // Find the sibling whose merge with the leaf costs the least surface area, an internal node pays the area
+        // growth of its ancestors on top of its own area
+        const AABB leaf_bounds = nodes[p_leaf].bounds;
+        uint32_t index = root;
+        while (!nodes[index].is_leaf()) {
+            const Node &node = nodes[index];
+
+            float area = _get_area(node.bounds);
+            float merged_area = _get_area(_merge(node.bounds, leaf_bounds));
+            float cost = 2.0f * merged_area; // Of a new parent for this node and the leaf
+            float inheritance_cost = 2.0f * (merged_area - area); // Minimum cost of pushing the leaf further down
+
+            float child_costs[2];
+            uint32_t children[2] = {node.child_1, node.child_2};
+            for (uint32_t i = 0; i < 2; i++) {
+                const Node &child = nodes[children[i]];
+                float child_merged_area = _get_area(_merge(child.bounds, leaf_bounds));
+                child_costs[i] = (child.is_leaf() ? child_merged_area : child_merged_area - _get_area(child.bounds)) + inheritance_cost;
+            }
+
+            if (cost < child_costs[0] && cost < child_costs[1]) break;
+            index = child_costs[0] < child_costs[1] ? children[0] : children[1];
+        }
+        uint32_t sibling = index;
+
+        // Create a parent for the sibling and the leaf
+        uint32_t old_parent = nodes[sibling].parent;
+        uint32_t new_parent = _allocate_node();
+        nodes[new_parent].parent = old_parent;
+        nodes[new_parent].bounds = _merge(leaf_bounds, nodes[sibling].bounds);
+        nodes[new_parent].user_data = 0;
+        nodes[new_parent].height = nodes[sibling].height + 1;
+        nodes[new_parent].child_1 = sibling;
+        nodes[new_parent].child_2 = p_leaf;
+        nodes[sibling].parent = new_parent;
+        nodes[p_leaf].parent = new_parent;
+
+        if (old_parent == NO_NODE) {
+            root = new_parent;
+        } else if (nodes[old_parent].child_1 == sibling) {
+            nodes[old_parent].child_1 = new_parent;
+        } else {
+            nodes[old_parent].child_2 = new_parent;
+        }
+
+        _refit_ancestors(old_parent);
+    }
+
+
+    void DynamicBVH::_remove_leaf(uint32_t p_leaf) {
+        if (p_leaf == root) {
+            root = NO_NODE;
+            return;
+        }
+
+        uint32_t parent = nodes[p_leaf].parent;
+        uint32_t grandparent = nodes[parent].parent;
+        uint32_t sibling = nodes[parent].child_1 == p_leaf ? nodes[parent].child_2 : nodes[parent].child_1;
+
+        // The sibling takes the place of the parent
+        if (grandparent == NO_NODE) {
+            root = sibling;
+        } else if (nodes[grandparent].child_1 == parent) {
+            nodes[grandparent].child_1 = sibling;
+        } else {
+            nodes[grandparent].child_2 = sibling;
+        }
+        nodes[sibling].parent = grandparent;
+        _free_node(parent);
+
+        _refit_ancestors(grandparent);
+    }
+
+
+    uint32_t DynamicBVH::_balance(uint32_t p_node) {
+        Node &a = nodes[p_node];
+        if (a.is_leaf() || a.height < 2) return p_node;
+
+        uint32_t b_index = a.child_1, c_index = a.child_2;
+        int32_t balance = nodes[c_index].height - nodes[b_index].height;
+        if (balance >= -1 && balance <= 1) return p_node;
+
+        // Rotate the higher child up, `a` keeps its lower child and takes the lower grandchild
+        bool rotate_c = balance > 1;
+        uint32_t up_index = rotate_c ? c_index : b_index;
+        uint32_t low_index = rotate_c ? b_index : c_index;
+        Node &up = nodes[up_index];
+
+        uint32_t f_index = up.child_1, g_index = up.child_2;
+        if (nodes[f_index].height < nodes[g_index].height) std::swap(f_index, g_index); // `f` is the higher grandchild
+
+        up.child_1 = p_node;
+        up.parent = a.parent;
+        a.parent = up_index;
+        if (up.parent == NO_NODE) {
+            root = up_index;
+        } else if (nodes[up.parent].child_1 == p_node) {
+            nodes[up.parent].child_1 = up_index;
+        } else {
+            nodes[up.parent].child_2 = up_index;
+        }
+
+        up.child_2 = f_index;
+        if (rotate_c) {
+            a.child_2 = g_index;
+        } else {
+            a.child_1 = g_index;
+        }
+        nodes[g_index].parent = p_node;
+
+        a.bounds = _merge(nodes[low_index].bounds, nodes[g_index].bounds);
+        a.height = 1 + std::max(nodes[low_index].height, nodes[g_index].height);
+        up.bounds = _merge(a.bounds, nodes[f_index].bounds);
+        up.height = 1 + std::max(a.height, nodes[f_index].height);
+        return up_index;
+    }
+
+
+    void DynamicBVH::_refit_ancestors(uint32_t p_node) {
+        uint32_t index = p_node;
+        while (index != NO_NODE) {
+            index = _balance(index);
+
+            Node &node = nodes[index];
+            node.bounds = _merge(nodes[node.child_1].bounds, nodes[node.child_2].bounds);
+            node.height = 1 + std::max(nodes[node.child_1].height, nodes[node.child_2].height);
+            index = node.parent;
+        }
+    }
+
+
+    void DynamicBVH::_append_leaves(uint32_t p_node, std::vector<uint64_t> &p_results) const {
+        std::vector<uint32_t> stack = {p_node};
+        while (!stack.empty()) {
+            const Node &node = nodes[stack.back()];
+            stack.pop_back();
+
+            if (node.is_leaf()) {
+                p_results.push_back(node.user_data);
+            } else {
+                stack.push_back(node.child_1);
+                stack.push_back(node.child_2);
+            }
+        }
+    }
+
+
+    DynamicBVH::FrustumTest DynamicBVH::_test_frustum(const Frustum &p_frustum, const AABB &p_bounds, uint32_t &p_plane_mask) {
+        glm::vec3 center = p_bounds.get_center();
+        glm::vec3 extents = p_bounds.get_extents();
+
+        for (uint32_t i = 0; i < p_frustum.planes.size(); i++) {
+            if (!(p_plane_mask & (1u << i))) continue;
+
+            const glm::vec4 &plane = p_frustum.planes[i];
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+            if (distance + radius < 0.0f) return OUTSIDE;
+            if (distance - radius >= 0.0f) p_plane_mask &= ~(1u << i); // Children are in front of this plane too
+        }
+        return p_plane_mask == 0 ? INSIDE : INTERSECTING;
+    }
+}
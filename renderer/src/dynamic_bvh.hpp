@@ -0,0 +1,98 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+
+#include "core/src/aabb.hpp"
+#include "renderer/src/frustum_culler.hpp"
+
+#include "thirdparty/glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+namespace lixy {
+
+    // Dynamic bounding volume hierarchy of boxes tagged with user data. Leaves store the box enlarged by a margin, so
+    // that moving a proxy only touches the tree when it leaves its enlarged box. Insertions descend towards the
+    // sibling that least increases the surface area and the tree is kept balanced with rotations on the way up.
+    // Queries append the user data of every proxy whose enlarged box matches, in no particular order.
+    class DynamicBVH {
+    public:
+        using ProxyId = uint32_t;
+        static constexpr ProxyId INVALID_PROXY = UINT32_MAX;
+
+    public:
+        ProxyId create_proxy(const AABB &p_bounds, uint64_t p_user_data);
+        void destroy_proxy(ProxyId p_proxy);
+        // Returns true when the proxy had to be reinserted
+        bool move_proxy(ProxyId p_proxy, const AABB &p_bounds);
+
+        uint64_t get_user_data(ProxyId p_proxy) const;
+        const AABB &get_fat_bounds(ProxyId p_proxy) const;
+        inline uint32_t get_proxy_count() const { return proxy_count; }
+        uint32_t get_height() const;
+
+        void query(const AABB &p_bounds, std::vector<uint64_t> &p_results) const;
+        void query(const Frustum &p_frustum, std::vector<uint64_t> &p_results) const;
+        void query_sphere(const glm::vec3 &p_center, float p_radius, std::vector<uint64_t> &p_results) const;
+        // Proxies hit by the segment from `p_origin` along `p_direction` for `p_max_distance` times its length
+        void query_ray(const glm::vec3 &p_origin, const glm::vec3 &p_direction, float p_max_distance, std::vector<uint64_t> &p_results) const;
+
+        DynamicBVH(float p_margin = 0.1f);
+
+    private:
+        static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+        struct Node {
+            AABB bounds; // Enlarged by the margin for leaves
+            uint64_t user_data;
+            uint32_t parent; // Next free node while the node is free
+            uint32_t child_1;
+            uint32_t child_2;
+            int32_t height; // 0 for leaves, -1 for free nodes
+
+            inline bool is_leaf() const { return child_1 == NO_NODE; }
+        };
+
+        enum FrustumTest {
+            OUTSIDE, INTERSECTING, INSIDE,
+        };
+
+    private:
+        uint32_t _allocate_node();
+        void _free_node(uint32_t p_node);
+
+        void _insert_leaf(uint32_t p_leaf);
+        void _remove_leaf(uint32_t p_leaf);
+        uint32_t _balance(uint32_t p_node); // Returns the node now at the place of `p_node`
+        void _refit_ancestors(uint32_t p_node); // Balances and refits from `p_node` up to the root
+
+        void _append_leaves(uint32_t p_node, std::vector<uint64_t> &p_results) const;
+        // Planes of `p_plane_mask` are already known to contain the box and are not tested again
+        static FrustumTest _test_frustum(const Frustum &p_frustum, const AABB &p_bounds, uint32_t &p_plane_mask);
+
+    private:
+        std::vector<Node> nodes;
+        uint32_t root = NO_NODE;
+        uint32_t free_list = NO_NODE;
+        uint32_t proxy_count = 0;
+        float margin;
+    };
+}
@@ -0,0 +1,147 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "frustum_culler.hpp"
+
+#include "core/src/aabb.hpp"
+
+#include "thirdparty/glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define LIXY_FRUSTUM_CULLER_SSE
+#include <xmmintrin.h>
+#endif
+
+
+namespace lixy {
+
+    bool Frustum::intersects(const AABB &p_bounds) const {
+        glm::vec3 center = p_bounds.get_center();
+        glm::vec3 extents = p_bounds.get_extents();
+
+        for (const glm::vec4 &plane : planes) {
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+            if (!(distance + radius >= 0.0f)) return false; // Also rejects empty boxes, whose extents are not finite
+        }
+        return true;
+    }
+
+
+    Frustum Frustum::from_matrix(const glm::mat4 &p_matrix) {
+        glm::vec4 row_x(p_matrix[0][0], p_matrix[1][0], p_matrix[2][0], p_matrix[3][0]);
+        glm::vec4 row_y(p_matrix[0][1], p_matrix[1][1], p_matrix[2][1], p_matrix[3][1]);
+        glm::vec4 row_z(p_matrix[0][2], p_matrix[1][2], p_matrix[2][2], p_matrix[3][2]);
+        glm::vec4 row_w(p_matrix[0][3], p_matrix[1][3], p_matrix[2][3], p_matrix[3][3]);
+
+        Frustum frustum{{
+            row_w + row_x, row_w - row_x,
+            row_w + row_y, row_w - row_y,
+            row_w + row_z, row_w - row_z,
+        }};
+        for (glm::vec4 &plane : frustum.planes) plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+
+    void FrustumCuller::clear() {
+        center_x.clear();
+        center_y.clear();
+        center_z.clear();
+        extents_x.clear();
+        extents_y.clear();
+        extents_z.clear();
+        count = 0;
+    }
+
+
+    void FrustumCuller::add(const AABB &p_bounds) {
+        if (count % LANE_COUNT == 0) {
+            uint32_t padded_count = count + LANE_COUNT;
+            center_x.resize(padded_count);
+            center_y.resize(padded_count);
+            center_z.resize(padded_count);
+            extents_x.resize(padded_count);
+            extents_y.resize(padded_count);
+            extents_z.resize(padded_count);
+        }
+
+        glm::vec3 center = p_bounds.get_center();
+        glm::vec3 extents = p_bounds.get_extents();
+        center_x[count] = center.x;
+        center_y[count] = center.y;
+        center_z[count] = center.z;
+        extents_x[count] = extents.x;
+        extents_y[count] = extents.y;
+        extents_z[count] = extents.z;
+        count += 1;
+    }
+
+
+    void FrustumCuller::cull(const Frustum &p_frustum, std::vector<uint32_t> &p_visible) const {
+#ifdef LIXY_FRUSTUM_CULLER_SSE
+        __m128 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+        __m128 abs_plane_x[6], abs_plane_y[6], abs_plane_z[6];
+        for (uint32_t i = 0; i < 6; i++) {
+            const glm::vec4 &plane = p_frustum.planes[i];
+            plane_x[i] = _mm_set1_ps(plane.x);
+            plane_y[i] = _mm_set1_ps(plane.y);
+            plane_z[i] = _mm_set1_ps(plane.z);
+            plane_w[i] = _mm_set1_ps(plane.w);
+            abs_plane_x[i] = _mm_set1_ps(glm::abs(plane.x));
+            abs_plane_y[i] = _mm_set1_ps(glm::abs(plane.y));
+            abs_plane_z[i] = _mm_set1_ps(glm::abs(plane.z));
+        }
+        const __m128 zero = _mm_setzero_ps();
+
+        for (uint32_t first = 0; first < count; first += LANE_COUNT) {
+            __m128 x = _mm_loadu_ps(&center_x[first]);
+            __m128 y = _mm_loadu_ps(&center_y[first]);
+            __m128 z = _mm_loadu_ps(&center_z[first]);
+            __m128 extent_x = _mm_loadu_ps(&extents_x[first]);
+            __m128 extent_y = _mm_loadu_ps(&extents_y[first]);
+            __m128 extent_z = _mm_loadu_ps(&extents_z[first]);
+
+            // A box is outside when it is entirely behind one of the planes
+            __m128 inside = _mm_cmpeq_ps(zero, zero);
+            for (uint32_t i = 0; i < 6; i++) {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, plane_x[i]), _mm_mul_ps(y, plane_y[i])), _mm_add_ps(_mm_mul_ps(z, plane_z[i]), plane_w[i]));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(extent_x, abs_plane_x[i]), _mm_mul_ps(extent_y, abs_plane_y[i])), _mm_mul_ps(extent_z, abs_plane_z[i]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+            }
+
+            uint32_t mask = _mm_movemask_ps(inside);
+            if (count - first < LANE_COUNT) mask &= (1u << (count - first)) - 1; // Padding lanes
+            for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1) {
+                if (mask & 1) p_visible.push_back(first + lane);
+            }
+        }
+#else
+        for (uint32_t i = 0; i < count; i++) {
+            bool inside = true;
+            for (const glm::vec4 &plane : p_frustum.planes) {
+                float distance = center_x[i] * plane.x + center_y[i] * plane.y + center_z[i] * plane.z + plane.w;
+                float radius = extents_x[i] * glm::abs(plane.x) + extents_y[i] * glm::abs(plane.y) + extents_z[i] * glm::abs(plane.z);
+                inside = inside && distance + radius >= 0.0f;
+            }
+            if (inside) p_visible.push_back(i);
+        }
+#endif
+    }
+}
@@ -0,0 +1,63 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+
+#include "core/src/aabb.hpp"
+
+#include "thirdparty/glm/glm.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+
+namespace lixy {
+
+    // Planes of a view frustum, normals point inside and are normalized
+    struct Frustum {
+        std::array<glm::vec4, 6> planes; // Left, right, bottom, top, near, far
+
+        bool intersects(const AABB &p_bounds) const;
+
+        // Extracts the planes from an OpenGL projection matrix, world space planes with a view projection matrix
+        static Frustum from_matrix(const glm::mat4 &p_matrix);
+    };
+
+
+    // World space boxes tested against a frustum in batches. Boxes are stored as a structure of arrays and tested
+    // LANE_COUNT at a time with SSE, or one at a time on other architectures.
+    class FrustumCuller {
+    public:
+        static constexpr uint32_t LANE_COUNT = 4;
+
+    public:
+        void clear();
+        void add(const AABB &p_bounds); // The box index is its insertion order since the last `clear`
+        inline uint32_t get_count() const { return count; }
+
+        // Appends the indices of the boxes intersecting the frustum to `p_visible`, in increasing order
+        void cull(const Frustum &p_frustum, std::vector<uint32_t> &p_visible) const;
+
+    private:
+        // Padded to a multiple of LANE_COUNT
+        std::vector<float> center_x, center_y, center_z;
+        std::vector<float> extents_x, extents_y, extents_z;
+        uint32_t count = 0;
+    };
+}
@@ -0,0 +1,380 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "geometry_arena.hpp"
+
+#include "debug/debug.hpp"
+#include "renderer/src/primitives/context.hpp"
+#include "renderer/src/primitives/vbuffer.hpp"
+
+#include "thirdparty/glad/include/glad/glad.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+
+namespace lixy {
+
+    // Bytes of `p_count` elements, computed in 64 bits since buffers are sized in 32 bits
+    static uint32_t _get_byte_size(uint64_t p_count, uint32_t p_stride) {
+        uint64_t size = p_count * p_stride;
+        ASSERT_FATAL_ERROR(size <= UINT32_MAX, "Geometry arena buffer of " << size << " bytes is larger than 4 GiB");
+        return (uint32_t)size;
+    }
+
+
+    uint32_t RangeAllocator::allocate(uint32_t p_size) {
+        if (p_size == 0) return 0;
+
+        for (auto range = free_ranges.begin(); range != free_ranges.end(); range++) {
+            if (range->second < p_size) continue;
+
+            uint32_t offset = range->first;
+            uint32_t remaining = range->second - p_size;
+            free_ranges.erase(range);
+            if (remaining > 0) free_ranges[offset + p_size] = remaining;
+
+            used += p_size;
+            return offset;
+        }
+        return INVALID_OFFSET;
+    }
+
+
+    void RangeAllocator::free(uint32_t p_offset, uint32_t p_size) {
+        if (p_size == 0) return;
+        used -= p_size;
+
+        // Merge with the following and preceding free ranges
+        auto next = free_ranges.find(p_offset + p_size);
+        if (next != free_ranges.end()) {
+            p_size += next->second;
+            free_ranges.erase(next);
+        }
+
+        auto previous = free_ranges.lower_bound(p_offset);
+        if (previous != free_ranges.begin()) {
+            previous--;
+            if (previous->first + previous->second == p_offset) {
+                previous->second += p_size;
+                return;
+            }
+        }
+        free_ranges[p_offset] = p_size;
+    }
+
+
+    void RangeAllocator::reset(uint32_t p_capacity, uint32_t p_used) {
+        free_ranges.clear();
+        capacity = p_capacity;
+        used = p_used;
+        if (p_used < p_capacity) free_ranges[p_used] = p_capacity - p_used;
+    }
+
+
+    uint32_t RangeAllocator::get_largest_free_range() const {
+        uint32_t largest = 0;
+        for (const auto &[offset, size] : free_ranges) largest = std::max(largest, size);
+        return largest;
+    }
+
+
+    RangeAllocator::RangeAllocator(uint32_t p_capacity) {
+        reset(p_capacity, 0);
+    }
+
+
+    GeometryArena::Handle GeometryArena::allocate_vertices(const opengl::BufferLayout &p_layout, const void *p_vertices, uint32_t p_vertex_count) {
+        uint32_t pool = _get_or_create_pool(p_layout);
+        uint32_t offset = _allocate_range(pool, p_vertex_count);
+
+        uint32_t stride = pools[pool].layout.get_stride();
+        pools[pool].vertex_buffer->write_data(_get_byte_size(offset, stride), _get_byte_size(p_vertex_count, stride), p_vertices);
+
+        return _create_handle(Allocation{
+            .is_allocated = true,
+            .pool = pool,
+            .offset = offset,
+            .size = p_vertex_count,
+            .index_type = GL_NONE,
+        });
+    }
+
+
+    GeometryArena::Handle GeometryArena::allocate_indices(const uint32_t *p_indices, uint32_t p_index_count, uint32_t p_base_vertex) {
+        uint32_t max_index = 0;
+        for (uint32_t i = 0; i < p_index_count; i++) {
+            max_index = std::max(max_index, p_indices[i] - p_base_vertex);
+        }
+
+        GLenum index_type = max_index <= UINT16_MAX ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        uint32_t index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        uint32_t size = _get_byte_size((p_index_count * (uint64_t)index_size + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT, INDEX_ALIGNMENT);
+        uint32_t offset = _allocate_range(NO_POOL, size);
+
+        if (index_type == GL_UNSIGNED_SHORT) {
+            std::vector<uint16_t> indices(size / sizeof(uint16_t), 0);
+            for (uint32_t i = 0; i < p_index_count; i++) indices[i] = (uint16_t)(p_indices[i] - p_base_vertex);
+            index_buffer->write_data(offset, size, indices.data());
+        } else if (p_base_vertex != 0) {
+            std::vector<uint32_t> indices(p_indices, p_indices + p_index_count);
+            for (uint32_t &index : indices) index -= p_base_vertex;
+            index_buffer->write_data(offset, size, indices.data());
+        } else {
+            index_buffer->write_data(offset, size, p_indices);
+        }
+
+        return _create_handle(Allocation{
+            .is_allocated = true,
+            .pool = NO_POOL,
+            .offset = offset,
+            .size = size,
+            .index_type = index_type,
+        });
+    }
+
+
+    void GeometryArena::free(Handle p_handle) {
+        if (p_handle == INVALID_HANDLE) return;
+        Allocation &allocation = allocations[p_handle];
+        ASSERT_FATAL_ERROR(allocation.is_allocated, "Double free of a geometry allocation");
+
+        if (allocation.pool == NO_POOL) {
+            index_allocator.free(allocation.offset, allocation.size);
+        } else {
+            pools[allocation.pool].allocator.free(allocation.offset, allocation.size);
+        }
+
+        allocation.is_allocated = false;
+        free_handles.push_back(p_handle);
+    }
+
+
+    void GeometryArena::compact() {
+        for (uint32_t pool = 0; pool < pools.size(); pool++) {
+            _resize_pool(pool, pools[pool].allocator.get_capacity());
+        }
+        _resize_index_buffer(index_allocator.get_capacity());
+    }
+
+
+    uint32_t GeometryArena::get_pool(Handle p_vertices) const {
+        return allocations[p_vertices].pool;
+    }
+
+
+    int32_t GeometryArena::get_base_vertex(Handle p_vertices) const {
+        return (int32_t)allocations[p_vertices].offset;
+    }
+
+
+    uint32_t GeometryArena::get_index_offset(Handle p_indices) const {
+        return allocations[p_indices].offset;
+    }
+
+
+    GLenum GeometryArena::get_index_type(Handle p_indices) const {
+        return allocations[p_indices].index_type;
+    }
+
+
+    void GeometryArena::bind_pool(uint32_t p_pool) const {
+        pools[p_pool].vertex_array->bind();
+    }
+
+
+    void GeometryArena::unbind_pool() const {
+        opengl::OpenGLContext::get_state().bind_vertex_array(0);
+    }
+
+
+    opengl::DrawElementsIndirectCommand GeometryArena::get_draw_command(Handle p_vertices, Handle p_indices, uint32_t p_index_count, int32_t p_base_vertex, uint32_t p_first_instance, uint32_t p_instance_count) const {
+        const Allocation &indices = allocations[p_indices];
+        uint32_t index_size = indices.index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+
+        return opengl::DrawElementsIndirectCommand{
+            .count = p_index_count,
+            .instance_count = p_instance_count,
+            .first_index = indices.offset / index_size,
+            .base_vertex = get_base_vertex(p_vertices) + p_base_vertex,
+            .base_instance = p_first_instance,
+        };
+    }
+
+
+    void GeometryArena::draw(GLenum p_index_type, const opengl::DrawElementsIndirectCommand &p_command) const {
+        uint32_t index_size = p_index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        glDrawElementsInstancedBaseVertexBaseInstance(
+            GL_TRIANGLES,
+            p_command.count,
+            p_index_type,
+            reinterpret_cast<void*>((uintptr_t)p_command.first_index * index_size),
+            p_command.instance_count,
+            p_command.base_vertex,
+            p_command.base_instance
+        );
+    }
+
+
+    void GeometryArena::multi_draw_indirect(GLenum p_index_type, uint32_t p_command_offset, uint32_t p_command_count) const {
+        glMultiDrawElementsIndirect(
+            GL_TRIANGLES,
+            p_index_type,
+            reinterpret_cast<void*>((uintptr_t)p_command_offset),
+            p_command_count,
+            sizeof(opengl::DrawElementsIndirectCommand)
+        );
+    }
+
+
+    void GeometryArena::reserve_instances(uint32_t p_instance_count) {
+        if (p_instance_count <= instance_capacity) return;
+
+        uint32_t capacity = std::max(instance_capacity, INITIAL_INSTANCE_COUNT);
+        while (capacity < p_instance_count) capacity *= 2;
+
+        std::vector<uint32_t> instance_indices(capacity);
+        for (uint32_t i = 0; i < capacity; i++) instance_indices[i] = i;
+
+        instance_index_buffer = std::make_unique<opengl::Buffer>(_get_byte_size(capacity, sizeof(uint32_t)));
+        instance_index_buffer->write_data(0, _get_byte_size(capacity, sizeof(uint32_t)), instance_indices.data());
+        instance_capacity = capacity;
+
+        for (Pool &pool : pools) _rebuild_vertex_array(pool);
+    }
+
+
+    GeometryArena::GeometryArena()
+        : index_buffer(std::make_unique<opengl::Buffer>(INITIAL_INDEX_BUFFER_SIZE)),
+        index_allocator(INITIAL_INDEX_BUFFER_SIZE)
+    {
+        reserve_instances(INITIAL_INSTANCE_COUNT);
+    }
+
+
+    uint32_t GeometryArena::_get_or_create_pool(const opengl::BufferLayout &p_layout) {
+        for (uint32_t pool = 0; pool < pools.size(); pool++) {
+            if (pools[pool].layout == p_layout) return pool;
+        }
+
+        pools.push_back(Pool{
+            .layout = p_layout,
+            .vertex_buffer = std::make_unique<opengl::Buffer>(_get_byte_size(INITIAL_POOL_VERTEX_COUNT, p_layout.get_stride())),
+            .vertex_array = nullptr,
+            .allocator = RangeAllocator(INITIAL_POOL_VERTEX_COUNT),
+        });
+        _rebuild_vertex_array(pools.back());
+        return pools.size() - 1;
+    }
+
+
+    uint32_t GeometryArena::_allocate_range(uint32_t p_pool, uint32_t p_size) {
+        RangeAllocator &allocator = p_pool == NO_POOL ? index_allocator : pools[p_pool].allocator;
+
+        uint32_t offset = allocator.allocate(p_size);
+        if (offset != RangeAllocator::INVALID_OFFSET) return offset;
+
+        // Compact when the space is only fragmented, grow otherwise
+        uint32_t capacity = allocator.get_capacity();
+        if (capacity - allocator.get_used() < p_size) {
+            uint64_t grown_capacity = std::max((uint64_t)capacity * 2, (uint64_t)allocator.get_used() + p_size);
+            ASSERT_FATAL_ERROR(grown_capacity <= UINT32_MAX, "Geometry arena allocator of " << grown_capacity << " elements is too large");
+            capacity = (uint32_t)grown_capacity;
+        }
+
+        if (p_pool == NO_POOL) {
+            _resize_index_buffer(capacity);
+        } else {
+            _resize_pool(p_pool, capacity);
+        }
+
+        offset = allocator.allocate(p_size);
+        ASSERT_FATAL_ERROR(offset != RangeAllocator::INVALID_OFFSET, "Could not allocate geometry");
+        return offset;
+    }
+
+
+    void GeometryArena::_resize_pool(uint32_t p_pool, uint32_t p_capacity) {
+        Pool &pool = pools[p_pool];
+        uint32_t stride = pool.layout.get_stride();
+
+        // Copy every allocation of the pool to the start of a new buffer, in their current order
+        std::vector<Allocation*> pool_allocations;
+        for (Allocation &allocation : allocations) {
+            if (allocation.is_allocated && allocation.pool == p_pool) pool_allocations.push_back(&allocation);
+        }
+        std::sort(pool_allocations.begin(), pool_allocations.end(), [](const Allocation *a, const Allocation *b) { return a->offset < b->offset; });
+
+        std::unique_ptr<opengl::Buffer> vertex_buffer = std::make_unique<opengl::Buffer>(_get_byte_size(p_capacity, stride));
+        uint32_t used = 0;
+        for (Allocation *allocation : pool_allocations) {
+            vertex_buffer->copy_data(*pool.vertex_buffer, _get_byte_size(allocation->offset, stride), _get_byte_size(used, stride), _get_byte_size(allocation->size, stride));
+            allocation->offset = used;
+            used += allocation->size;
+        }
+
+        pool.vertex_buffer = std::move(vertex_buffer);
+        pool.allocator.reset(p_capacity, used);
+        _rebuild_vertex_array(pool);
+    }
+
+
+    void GeometryArena::_resize_index_buffer(uint32_t p_capacity) {
+        std::vector<Allocation*> index_allocations;
+        for (Allocation &allocation : allocations) {
+            if (allocation.is_allocated && allocation.pool == NO_POOL) index_allocations.push_back(&allocation);
+        }
+        std::sort(index_allocations.begin(), index_allocations.end(), [](const Allocation *a, const Allocation *b) { return a->offset < b->offset; });
+
+        std::unique_ptr<opengl::Buffer> new_index_buffer = std::make_unique<opengl::Buffer>(p_capacity);
+        uint32_t used = 0;
+        for (Allocation *allocation : index_allocations) {
+            new_index_buffer->copy_data(*index_buffer, allocation->offset, used, allocation->size);
+            allocation->offset = used;
+            used += allocation->size;
+        }
+
+        index_buffer = std::move(new_index_buffer);
+        index_allocator.reset(p_capacity, used);
+
+        // Every vertex array references the index buffer
+        for (Pool &pool : pools) _rebuild_vertex_array(pool);
+    }
+
+
+    void GeometryArena::_rebuild_vertex_array(Pool &p_pool) {
+        p_pool.vertex_array = std::make_unique<opengl::VertexArrayBuffer>();
+        p_pool.vertex_array->add_vertex_buffer(*p_pool.vertex_buffer, p_pool.layout);
+        p_pool.vertex_array->add_index_buffer(*index_buffer);
+        p_pool.vertex_array->add_instance_index_buffer(*instance_index_buffer, INSTANCE_INDEX_LOCATION);
+    }
+
+
+    GeometryArena::Handle GeometryArena::_create_handle(const Allocation &p_allocation) {
+        if (!free_handles.empty()) {
+            Handle handle = free_handles.back();
+            free_handles.pop_back();
+            allocations[handle] = p_allocation;
+            return handle;
+        }
+
+        allocations.push_back(p_allocation);
+        return allocations.size() - 1;
+    }
+}
@@ -0,0 +1,141 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include "renderer/src/primitives/vbuffer.hpp"
+
+#include "thirdparty/glad/include/glad/glad.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+
+namespace lixy {
+
+    // First fit allocator of ranges in a linear space, free ranges are merged with their neighbours
+    class RangeAllocator {
+    public:
+        static constexpr uint32_t INVALID_OFFSET = UINT32_MAX;
+
+    public:
+        uint32_t allocate(uint32_t p_size);
+        void free(uint32_t p_offset, uint32_t p_size);
+
+        void reset(uint32_t p_capacity, uint32_t p_used); // Everything before `p_used` is allocated, the rest is free
+
+        inline uint32_t get_capacity() const { return capacity; }
+        inline uint32_t get_used() const { return used; }
+        uint32_t get_largest_free_range() const;
+
+        RangeAllocator(uint32_t p_capacity = 0);
+
+    private:
+        std::map<uint32_t, uint32_t> free_ranges; // Offset to size
+        uint32_t capacity = 0;
+        uint32_t used = 0;
+    };
+
+
+    // Renderer owned vertex and index megabuffers that meshes sub-allocate their geometry from.
+    // Vertices are grouped in one pool per buffer layout, every pool shares the index buffer and has a single
+    // vertex array, so surfaces of a pool are drawn with base vertex / first index ranges and no buffer switch.
+    class GeometryArena {
+    public:
+        using Handle = uint32_t;
+        static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+        static constexpr uint32_t INSTANCE_INDEX_LOCATION = 8; // Attribute holding the index of the drawn instance
+
+    public:
+        Handle allocate_vertices(const opengl::BufferLayout &p_layout, const void *p_vertices, uint32_t p_vertex_count);
+        // Indices are stored relative to `p_base_vertex`, on 16 bits when they fit
+        Handle allocate_indices(const uint32_t *p_indices, uint32_t p_index_count, uint32_t p_base_vertex = 0);
+        void free(Handle p_handle);
+
+        // Moves every allocation to the start of its buffer, handles stay valid
+        void compact();
+
+        uint32_t get_pool(Handle p_vertices) const;
+        int32_t get_base_vertex(Handle p_vertices) const;
+        uint32_t get_index_offset(Handle p_indices) const; // In bytes, from the start of the index buffer
+        GLenum get_index_type(Handle p_indices) const;
+
+        void bind_pool(uint32_t p_pool) const;
+        void unbind_pool() const;
+        // Command drawing `p_index_count` indices, `p_base_vertex` is relative to the vertex allocation
+        opengl::DrawElementsIndirectCommand get_draw_command(Handle p_vertices, Handle p_indices, uint32_t p_index_count, int32_t p_base_vertex, uint32_t p_first_instance, uint32_t p_instance_count) const;
+
+        // Draw triangles from the bound pool. Instances read the index attribute from the command base instance.
+        void draw(GLenum p_index_type, const opengl::DrawElementsIndirectCommand &p_command) const;
+        // Submits the commands of the bound draw indirect buffer, `p_command_offset` is in bytes
+        void multi_draw_indirect(GLenum p_index_type, uint32_t p_command_offset, uint32_t p_command_count) const;
+
+        // Grows the instance index attribute so that instances up to `p_instance_count` can be drawn
+        void reserve_instances(uint32_t p_instance_count);
+
+        GeometryArena();
+        GeometryArena(const GeometryArena&) = delete;
+        virtual ~GeometryArena() = default;
+
+    private:
+        struct Allocation {
+            bool is_allocated;
+            uint32_t pool; // NO_POOL for index allocations
+            uint32_t offset; // In vertices for vertex allocations, in bytes for index allocations
+            uint32_t size;
+            GLenum index_type;
+        };
+
+        struct Pool {
+            opengl::BufferLayout layout;
+            std::unique_ptr<opengl::Buffer> vertex_buffer;
+            std::unique_ptr<opengl::VertexArrayBuffer> vertex_array;
+            RangeAllocator allocator; // In vertices
+        };
+
+    private:
+        static constexpr uint32_t NO_POOL = UINT32_MAX;
+        static constexpr uint32_t INITIAL_POOL_VERTEX_COUNT = 1 << 16;
+        static constexpr uint32_t INITIAL_INDEX_BUFFER_SIZE = 1 << 22;
+        static constexpr uint32_t INDEX_ALIGNMENT = 4;
+        static constexpr uint32_t INITIAL_INSTANCE_COUNT = 1 << 10;
+
+        uint32_t _get_or_create_pool(const opengl::BufferLayout &p_layout);
+        uint32_t _allocate_range(uint32_t p_pool, uint32_t p_size);
+        void _resize_pool(uint32_t p_pool, uint32_t p_capacity); // Also compacts the pool
+        void _resize_index_buffer(uint32_t p_capacity); // Also compacts the index buffer
+        void _rebuild_vertex_array(Pool &p_pool);
+
+        Handle _create_handle(const Allocation &p_allocation);
+
+    private:
+        std::vector<Pool> pools;
+
+        std::unique_ptr<opengl::Buffer> index_buffer;
+        RangeAllocator index_allocator; // In bytes
+
+        std::unique_ptr<opengl::Buffer> instance_index_buffer; // 0, 1, 2, ... shared by every pool
+        uint32_t instance_capacity = 0;
+
+        std::vector<Allocation> allocations;
+        std::vector<Handle> free_handles;
+    };
+}
@@ -0,0 +1,405 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "light_culler.hpp"
+
+#include "debug/debug.hpp"
+#include "renderer/src/primitives/context.hpp"
+#include "renderer/src/primitives/shader.hpp"
+#include "renderer/src/primitives/vbuffer.hpp"
+
+#include "thirdparty/glad/include/glad/glad.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+namespace lixy {
+
+    static constexpr uint32_t CULL_GROUP_SIZE = 64;
+
+    // Slice of a view depth, between the clip planes
+    static const std::string CLUSTER_SLICE =
+        "uniform ivec3 u_cluster_grid;"
+        "uniform vec3 u_cluster_depth;" // Near, slice scale and far
+        ""
+        "int get_slice(float p_depth) {"
+        "    return clamp(int(log(max(p_depth, u_cluster_depth.x) / u_cluster_depth.x) * u_cluster_depth.y), 0, u_cluster_grid.z - 1);"
+        "}";
+
+    // Declarations of the passes walking the clusters of every light. The clusters of a light are the tiles covered by
+    // the projection of its view space bounds, in the slices between the depths of its bounds. With tile bounds, only
+    // the slices of a tile holding surfaces are walked.
+    static const std::string CLUSTER_RANGE =
+        "struct PointLight {" // lixy::PointLight
+        "    float r;"
+        "    float g;"
+        "    float b;"
+        "    float energy;"
+        "    float radius;"
+        "};"
+        ""
+        "layout(std430, binding = 0) readonly buffer Lights { PointLight lights[]; };"
+        "layout(std430, binding = 1) readonly buffer Positions { vec4 positions[]; };"
+        "layout(std430, binding = 2) buffer Counts { uint counts[]; };"
+        "layout(std430, binding = 6) readonly buffer TileSlices { ivec2 tile_slices[]; };"
+        ""
+        "uniform int u_light_count;"
+        "uniform mat4 u_projection;"
+        "uniform mat4 u_view;"
+        "uniform ivec2 u_screen_size;"
+        "uniform bool u_tile_bounds;"
+        ""
+        + CLUSTER_SLICE +
+        ""
+        "ivec2 get_tile_slices(int p_x, int p_y, ivec2 p_slices) {" // Slices of the light range in the tile
+        "    if (!u_tile_bounds) return p_slices;"
+        "    ivec2 tile = tile_slices[p_y * u_cluster_grid.x + p_x];"
+        "    return ivec2(max(p_slices.x, tile.x), min(p_slices.y, tile.y));"
+        "}"
+        ""
+        "bool get_cluster_range(int p_light, out ivec3 p_first, out ivec3 p_last) {"
+        "    float radius = lights[p_light].radius;"
+        "    if (!(radius > 0.0)) return false;"
+        ""
+        "    vec3 center = (u_view * vec4(positions[p_light].xyz, 1.0)).xyz;"
+        "    float depth_min = -center.z - radius;"
+        "    float depth_max = -center.z + radius;"
+        "    if (depth_max < u_cluster_depth.x || depth_min > u_cluster_depth.z) return false;"
+        ""
+        "    p_first = ivec3(0, 0, get_slice(depth_min));"
+        "    p_last = ivec3(u_cluster_grid.xy - 1, get_slice(depth_max));"
+        ""
+        "    vec2 ndc_min = vec2(1e30);"
+        "    vec2 ndc_max = vec2(-1e30);"
+        "    for (int i = 0; i < 8; i++) {"
+        "        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);"
+        "        vec4 clip = u_projection * vec4(corner, 1.0);"
+        "        if (clip.w <= 0.0) return true;" // Behind the camera, the light may cover the whole screen
+        "        ndc_min = min(ndc_min, clip.xy / clip.w);"
+        "        ndc_max = max(ndc_max, clip.xy / clip.w);"
+        "    }"
+        "    if (any(lessThan(ndc_max, vec2(-1.0))) || any(greaterThan(ndc_min, vec2(1.0)))) return false;"
+        ""
+        "    ivec2 pixel_min = ivec2((clamp(ndc_min, -1.0, 1.0) * 0.5 + 0.5) * vec2(u_screen_size));"
+        "    ivec2 pixel_max = ivec2((clamp(ndc_max, -1.0, 1.0) * 0.5 + 0.5) * vec2(u_screen_size));"
+        "    p_first.xy = min(pixel_min / 32, u_cluster_grid.xy - 1);" // LightCuller::TILE_SIZE
+        "    p_last.xy = min(pixel_max / 32, u_cluster_grid.xy - 1);"
+        "    return true;"
+        "}";
+
+    static const std::string COUNT_SHADER =
+        "#version 430 core\n"
+        "layout(local_size_x = 64) in;" // CULL_GROUP_SIZE
+        + CLUSTER_RANGE +
+        ""
+        "void main() {"
+        "    int index = int(gl_GlobalInvocationID.x);"
+        "    ivec3 first, last;"
+        "    if (index >= u_light_count || !get_cluster_range(index, first, last)) return;"
+        ""
+        "    for (int y = first.y; y <= last.y; y++) {"
+        "        for (int x = first.x; x <= last.x; x++) {"
+        "            ivec2 slices = get_tile_slices(x, y, ivec2(first.z, last.z));"
+        "            for (int z = slices.x; z <= slices.y; z++) atomicAdd(counts[(z * u_cluster_grid.y + y) * u_cluster_grid.x + x], 1u);"
+        "        }"
+        "    }"
+        "}";
+
+    static const std::string ASSIGN_SHADER =
+        "#version 430 core\n"
+        "layout(local_size_x = 64) in;" // CULL_GROUP_SIZE
+        ""
+        "struct Cluster {" // LightCuller::Cluster
+        "    uint offset;"
+        "    uint count;"
+        "};"
+        ""
+        "layout(std430, binding = 2) readonly buffer Counts { uint counts[]; };"
+        "layout(std430, binding = 3) writeonly buffer Clusters { Cluster clusters[]; };"
+        "layout(std430, binding = 5) buffer Totals { uint totals[]; };"
+        ""
+        "uniform int u_cluster_count;"
+        "uniform int u_capacity;" // Of the light index list
+        "uniform int u_total_slot;"
+        ""
+        "void main() {"
+        "    int index = int(gl_GlobalInvocationID.x);"
+        "    if (index >= u_cluster_count) return;"
+        ""
+        "    uint count = counts[index];"
+        "    uint offset = count > 0u ? atomicAdd(totals[u_total_slot], count) : 0u;"
+        "    uint capacity = uint(u_capacity);"
+        "    clusters[index] = Cluster(offset, offset < capacity ? min(count, capacity - offset) : 0u);"
+        "}";
+
+    static const std::string FILL_SHADER =
+        "#version 430 core\n"
+        "layout(local_size_x = 64) in;" // CULL_GROUP_SIZE
+        + CLUSTER_RANGE +
+        ""
+        "struct Cluster {"
+        "    uint offset;"
+        "    uint count;"
+        "};"
+        ""
+        "layout(std430, binding = 3) readonly buffer Clusters { Cluster clusters[]; };"
+        "layout(std430, binding = 4) writeonly buffer LightIndices { uint light_indices[]; };"
+        ""
+        "void main() {"
+        "    int index = int(gl_GlobalInvocationID.x);"
+        "    ivec3 first, last;"
+        "    if (index >= u_light_count || !get_cluster_range(index, first, last)) return;"
+        ""
+        // Counting down leaves the counts at zero for the next frame
+        "    for (int y = first.y; y <= last.y; y++) {"
+        "        for (int x = first.x; x <= last.x; x++) {"
+        "            ivec2 slices = get_tile_slices(x, y, ivec2(first.z, last.z));"
+        "            for (int z = slices.x; z <= slices.y; z++) {"
+        "                int cluster = (z * u_cluster_grid.y + y) * u_cluster_grid.x + x;"
+        "                uint slot = atomicAdd(counts[cluster], 0xFFFFFFFFu) - 1u;"
+        "                if (slot < clusters[cluster].count) light_indices[clusters[cluster].offset + slot] = uint(index);"
+        "            }"
+        "        }"
+        "    }"
+        "}";
+
+
+    // Range of the slices holding the surfaces of every tile, from the depth of a prepass. Surfaces may be placed one
+    // slice off by the lighting shaders, which compute their depth from a position of lower precision, the range
+    // is widened by one slice on both sides. Empty tiles get an empty range.
+    static const std::string TILE_BOUNDS_SHADER =
+        "#version 430 core\n"
+        "layout(local_size_x = 16, local_size_y = 16) in;" // One group per tile, every invocation reads 2x2 pixels
+        ""
+        "layout(std430, binding = 6) writeonly buffer TileSlices { ivec2 tile_slices[]; };"
+        ""
+        "uniform sampler2D u_depth;"
+        "uniform mat4 u_inverse_projection;"
+        "uniform ivec2 u_screen_size;"
+        + CLUSTER_SLICE +
+        ""
+        "shared uint depth_min;" // Bits of positive floats are ordered like their value
+        "shared uint depth_max;"
+        ""
+        "float get_view_depth(uint p_depth) {"
+        "    vec4 position = u_inverse_projection * vec4(0.0, 0.0, uintBitsToFloat(p_depth) * 2.0 - 1.0, 1.0);"
+        "    return -position.z / position.w;"
+        "}"
+        ""
+        "void main() {"
+        "    if (gl_LocalInvocationIndex == 0u) {"
+        "        depth_min = 0xFFFFFFFFu;"
+        "        depth_max = 0u;"
+        "    }"
+        "    barrier();"
+        ""
+        "    ivec2 tile = ivec2(gl_WorkGroupID.xy);"
+        "    for (int i = 0; i < 4; i++) {"
+        "        ivec2 pixel = tile * 32 + ivec2(gl_LocalInvocationID.xy) * 2 + ivec2(i & 1, i >> 1);" // LightCuller::TILE_SIZE
+        "        if (any(greaterThanEqual(pixel, u_screen_size))) continue;"
+        "        float depth = texelFetch(u_depth, pixel, 0).r;"
+        "        if (depth >= 1.0) continue;" // Cleared, nothing was drawn
+        "        atomicMin(depth_min, floatBitsToUint(depth));"
+        "        atomicMax(depth_max, floatBitsToUint(depth));"
+        "    }"
+        "    barrier();"
+        ""
+        "    if (gl_LocalInvocationIndex != 0u) return;"
+        "    int index = tile.y * u_cluster_grid.x + tile.x;"
+        "    if (depth_min > depth_max) {"
+        "        tile_slices[index] = ivec2(1, 0);"
+        "        return;"
+        "    }"
+        "    tile_slices[index] = ivec2(get_slice(get_view_depth(depth_min)) - 1, get_slice(get_view_depth(depth_max)) + 1);"
+        "}";
+
+
+    static uint32_t _get_group_count(uint32_t p_count, uint32_t p_group_size) {
+        return (p_count + p_group_size - 1) / p_group_size;
+    }
+
+
+    void LightCuller::cull(const opengl::ShaderStorageBuffer::Slice &p_lights, const opengl::ShaderStorageBuffer::Slice &p_positions, uint32_t p_light_count, const glm::mat4 &p_projection, const glm::mat4 &p_view, uint32_t p_width, uint32_t p_height, float p_near, float p_far, uint32_t p_depth_texture) {
+        _read_total();
+        if (p_width != width || p_height != height) _resize_grid(p_width, p_height);
+
+        uint32_t cluster_count = cluster_grid.x * cluster_grid.y * cluster_grid.z;
+        if (cluster_count == 0) return;
+
+        slice_near = std::max(p_near, 1e-4f); // Orthographic cameras may start at the camera plane
+        slice_far = std::max(p_far, 2.0f * slice_near);
+        slice_scale = SLICE_COUNT / std::log(slice_far / slice_near);
+
+        total_slot ^= 1;
+        if (total_fences[total_slot]) { // Not signaled in time, its total is overwritten
+            glDeleteSync(total_fences[total_slot]);
+            total_fences[total_slot] = nullptr;
+        }
+        uint32_t zero = 0;
+        total_storage.write_data(total_slot * sizeof(uint32_t), sizeof(uint32_t), &zero);
+
+        if (p_light_count) {
+            p_lights.bind_to_location(LIGHTS_BINDING);
+            p_positions.bind_to_location(POSITIONS_BINDING);
+        }
+        count_storage.slice(0, cluster_count * sizeof(uint32_t)).bind_to_location(COUNTS_BINDING);
+        cluster_storage.slice(0, cluster_count * sizeof(Cluster)).bind_to_location(CLUSTERS_BINDING);
+        light_index_storage.slice(0, light_index_capacity * sizeof(uint32_t)).bind_to_location(LIGHT_INDICES_BINDING);
+        total_storage.slice(0, total_storage.get_size()).bind_to_location(TOTALS_BINDING);
+        tile_slice_storage.slice(0, cluster_grid.x * cluster_grid.y * sizeof(glm::ivec2)).bind_to_location(TILE_SLICES_BINDING);
+
+        tile_bounds = p_depth_texture != 0;
+        if (tile_bounds && p_light_count) {
+            opengl::OpenGLContext::get_state().bind_texture(0, p_depth_texture);
+            tile_bounds_program->bind();
+            tile_bounds_program->bind_uniform(tile_bounds_depth, 0);
+            tile_bounds_program->bind_uniform(tile_bounds_inverse_projection, glm::inverse(p_projection));
+            tile_bounds_program->bind_uniform(tile_bounds_screen_size, glm::ivec2(width, height));
+            tile_bounds_program->bind_uniform(tile_bounds_cluster_grid, cluster_grid);
+            tile_bounds_program->bind_uniform(tile_bounds_cluster_depth, glm::vec3(slice_near, slice_scale, slice_far));
+            tile_bounds_program->dispatch(cluster_grid.x, cluster_grid.y);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+
+        if (p_light_count) {
+            _dispatch_lights(*count_program, count_uniforms, p_light_count, p_projection, p_view);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+
+        assign_program->bind();
+        assign_program->bind_uniform(assign_cluster_count, (int)cluster_count);
+        assign_program->bind_uniform(assign_capacity, (int)light_index_capacity);
+        assign_program->bind_uniform(assign_total_slot, (int)total_slot);
+        assign_program->dispatch(_get_group_count(cluster_count, CULL_GROUP_SIZE));
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        if (p_light_count) _dispatch_lights(*fill_program, fill_uniforms, p_light_count, p_projection, p_view);
+
+        total_fences[total_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+
+    opengl::ShaderStorageBuffer::Slice LightCuller::get_clusters() const {
+        return cluster_storage.slice(0, cluster_grid.x * cluster_grid.y * cluster_grid.z * sizeof(Cluster));
+    }
+
+
+    opengl::ShaderStorageBuffer::Slice LightCuller::get_light_indices() const {
+        return light_index_storage.slice(0, light_index_capacity * sizeof(uint32_t));
+    }
+
+
+    LightCuller::LightCuller() {
+        count_program = std::make_unique<opengl::ShaderProgram>(COUNT_SHADER);
+        ASSERT_FATAL_ERROR(count_program->is_valid(), "The light counting shader is invalid: " << count_program->get_errors());
+        assign_program = std::make_unique<opengl::ShaderProgram>(ASSIGN_SHADER);
+        ASSERT_FATAL_ERROR(assign_program->is_valid(), "The cluster range shader is invalid: " << assign_program->get_errors());
+        fill_program = std::make_unique<opengl::ShaderProgram>(FILL_SHADER);
+        ASSERT_FATAL_ERROR(fill_program->is_valid(), "The light index shader is invalid: " << fill_program->get_errors());
+        tile_bounds_program = std::make_unique<opengl::ShaderProgram>(TILE_BOUNDS_SHADER);
+        ASSERT_FATAL_ERROR(tile_bounds_program->is_valid(), "The tile bounds shader is invalid: " << tile_bounds_program->get_errors());
+
+        count_uniforms = _get_range_uniforms(*count_program);
+        fill_uniforms = _get_range_uniforms(*fill_program);
+        assign_cluster_count = assign_program->get_uniform_handle<int>("u_cluster_count");
+        assign_capacity = assign_program->get_uniform_handle<int>("u_capacity");
+        assign_total_slot = assign_program->get_uniform_handle<int>("u_total_slot");
+        tile_bounds_depth = tile_bounds_program->get_uniform_handle<int>("u_depth");
+        tile_bounds_inverse_projection = tile_bounds_program->get_uniform_handle<glm::mat4>("u_inverse_projection");
+        tile_bounds_screen_size = tile_bounds_program->get_uniform_handle<glm::ivec2>("u_screen_size");
+        tile_bounds_cluster_grid = tile_bounds_program->get_uniform_handle<glm::ivec3>("u_cluster_grid");
+        tile_bounds_cluster_depth = tile_bounds_program->get_uniform_handle<glm::vec3>("u_cluster_depth");
+
+        uint32_t totals[2] = {0, 0};
+        total_storage.allocate(sizeof(totals));
+        total_storage.write_data(0, sizeof(totals), totals);
+    }
+
+
+    LightCuller::~LightCuller() {
+        for (GLsync fence : total_fences) {
+            if (fence) glDeleteSync(fence);
+        }
+    }
+
+
+    LightCuller::RangeUniforms LightCuller::_get_range_uniforms(const opengl::ShaderProgram &p_program) {
+        return RangeUniforms{
+            .light_count = p_program.get_uniform_handle<int>("u_light_count"),
+            .projection = p_program.get_uniform_handle<glm::mat4>("u_projection"),
+            .view = p_program.get_uniform_handle<glm::mat4>("u_view"),
+            .screen_size = p_program.get_uniform_handle<glm::ivec2>("u_screen_size"),
+            .cluster_grid = p_program.get_uniform_handle<glm::ivec3>("u_cluster_grid"),
+            .cluster_depth = p_program.get_uniform_handle<glm::vec3>("u_cluster_depth"),
+            .tile_bounds = p_program.get_uniform_handle<int>("u_tile_bounds"),
+        };
+    }
+
+
+    void LightCuller::_dispatch_lights(opengl::ShaderProgram &p_program, const RangeUniforms &p_uniforms, uint32_t p_light_count, const glm::mat4 &p_projection, const glm::mat4 &p_view) const {
+        p_program.bind();
+        p_program.bind_uniform(p_uniforms.light_count, (int)p_light_count);
+        p_program.bind_uniform(p_uniforms.projection, p_projection);
+        p_program.bind_uniform(p_uniforms.view, p_view);
+        p_program.bind_uniform(p_uniforms.screen_size, glm::ivec2(width, height));
+        p_program.bind_uniform(p_uniforms.cluster_grid, cluster_grid);
+        p_program.bind_uniform(p_uniforms.cluster_depth, glm::vec3(slice_near, slice_scale, slice_far));
+        p_program.bind_uniform(p_uniforms.tile_bounds, (int)tile_bounds);
+        p_program.dispatch(_get_group_count(p_light_count, CULL_GROUP_SIZE));
+    }
+
+
+    void LightCuller::_resize_grid(uint32_t p_width, uint32_t p_height) {
+        width = p_width;
+        height = p_height;
+        cluster_grid = glm::ivec3(_get_group_count(p_width, TILE_SIZE), _get_group_count(p_height, TILE_SIZE), SLICE_COUNT);
+
+        uint32_t cluster_count = cluster_grid.x * cluster_grid.y * cluster_grid.z;
+        if (cluster_count == 0) return;
+
+        std::vector<uint32_t> counts(cluster_count, 0);
+        count_storage.allocate(cluster_count * sizeof(uint32_t));
+        count_storage.write_data(0, cluster_count * sizeof(uint32_t), counts.data());
+        cluster_storage.allocate(cluster_count * sizeof(Cluster));
+        tile_slice_storage.allocate(cluster_grid.x * cluster_grid.y * sizeof(glm::ivec2));
+
+        if (light_index_capacity < 8 * cluster_count) {
+            light_index_capacity = 8 * cluster_count;
+            light_index_storage.allocate(light_index_capacity * sizeof(uint32_t));
+        }
+    }
+
+
+    void LightCuller::_read_total() {
+        for (uint32_t slot = 0; slot < total_fences.size(); slot++) {
+            if (!total_fences[slot]) continue;
+
+            GLenum status = glClientWaitSync(total_fences[slot], 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+            glDeleteSync(total_fences[slot]);
+            total_fences[slot] = nullptr;
+
+            uint32_t total = 0;
+            total_storage.read_data(slot * sizeof(uint32_t), sizeof(uint32_t), &total);
+            if (total > light_index_capacity) {
+                light_index_capacity = std::max(total, 2 * light_index_capacity);
+                light_index_storage.allocate(light_index_capacity * sizeof(uint32_t));
+            }
+        }
+    }
+}
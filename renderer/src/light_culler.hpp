@@ -0,0 +1,132 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+
+#include "renderer/src/primitives/shader.hpp"
+#include "renderer/src/primitives/vbuffer.hpp"
+
+#include "thirdparty/glad/include/glad/glad.h"
+#include "thirdparty/glm/glm.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+
+namespace lixy {
+
+    // Clustered culling of point lights. The view is split into screen tiles of `TILE_SIZE` pixels and `SLICE_COUNT`
+    // depth slices spaced exponentially between the clip planes. A compute pass counts the clusters overlapped by the
+    // bounds of every light, a second one gives each cluster a range of the light index list and a third one writes the
+    // lights into the ranges. Lighting shaders then only walk the lights of the cluster of their pixel.
+    // Given the depth of the frame, a first pass reduces every tile to the slices holding its surfaces and lights skip
+    // the other clusters of the tile.
+    class LightCuller {
+    public:
+        static constexpr uint32_t TILE_SIZE = 32; // In pixels
+        static constexpr uint32_t SLICE_COUNT = 24;
+
+        // Range of the light index list, matches the `Cluster` structure of the lighting shaders
+        struct Cluster {
+            uint32_t offset;
+            uint32_t count;
+        };
+
+    public:
+        // Bins the lights, `p_lights` holds their `PointLight` and `p_positions` their world position in a vec4.
+        // `p_depth_texture` is the depth of the surfaces to light, 0 to bin the lights in every slice. The clusters and
+        // light indices are written by shaders, they are read after a GL_SHADER_STORAGE_BARRIER_BIT barrier.
+        void cull(const opengl::ShaderStorageBuffer::Slice &p_lights, const opengl::ShaderStorageBuffer::Slice &p_positions, uint32_t p_light_count, const glm::mat4 &p_projection, const glm::mat4 &p_view, uint32_t p_width, uint32_t p_height, float p_near, float p_far, uint32_t p_depth_texture = 0);
+
+        // Uniforms of the lighting shaders locating the cluster of a pixel: the slice of a view depth is
+        // `int(log(depth / near) * slice_scale)`
+        inline glm::ivec3 get_cluster_grid() const { return cluster_grid; } // Tiles along x and y, then slices
+        inline glm::vec2 get_cluster_depth() const { return glm::vec2(slice_near, slice_scale); } // Near and slice scale
+
+        opengl::ShaderStorageBuffer::Slice get_clusters() const; // One `Cluster` per tile and slice, x major
+        opengl::ShaderStorageBuffer::Slice get_light_indices() const;
+
+        // Light indices are written up to the capacity, which grows from the count needed by an earlier frame. Lights
+        // past it are dropped from their cluster for the frames it takes to read that count back.
+        inline uint32_t get_light_index_capacity() const { return light_index_capacity; }
+
+        LightCuller();
+        LightCuller(const LightCuller&) = delete;
+        virtual ~LightCuller();
+
+    private:
+        // Storage buffer bindings of the culling passes
+        static constexpr uint32_t LIGHTS_BINDING = 0;
+        static constexpr uint32_t POSITIONS_BINDING = 1;
+        static constexpr uint32_t COUNTS_BINDING = 2;
+        static constexpr uint32_t CLUSTERS_BINDING = 3;
+        static constexpr uint32_t LIGHT_INDICES_BINDING = 4;
+        static constexpr uint32_t TOTALS_BINDING = 5;
+        static constexpr uint32_t TILE_SLICES_BINDING = 6;
+
+    private:
+        struct RangeUniforms { // Of the passes walking the clusters of every light
+            opengl::UniformHandle<int> light_count;
+            opengl::UniformHandle<glm::mat4> projection;
+            opengl::UniformHandle<glm::mat4> view;
+            opengl::UniformHandle<glm::ivec2> screen_size;
+            opengl::UniformHandle<glm::ivec3> cluster_grid;
+            opengl::UniformHandle<glm::vec3> cluster_depth;
+            opengl::UniformHandle<int> tile_bounds;
+        };
+
+    private:
+        static RangeUniforms _get_range_uniforms(const opengl::ShaderProgram &p_program);
+        void _dispatch_lights(opengl::ShaderProgram &p_program, const RangeUniforms &p_uniforms, uint32_t p_light_count, const glm::mat4 &p_projection, const glm::mat4 &p_view) const;
+        void _resize_grid(uint32_t p_width, uint32_t p_height);
+        void _read_total();
+
+    private:
+        std::unique_ptr<opengl::ShaderProgram> count_program; // Light counts of the clusters
+        std::unique_ptr<opengl::ShaderProgram> assign_program; // Ranges of the clusters
+        std::unique_ptr<opengl::ShaderProgram> fill_program; // Light indices of the ranges
+        std::unique_ptr<opengl::ShaderProgram> tile_bounds_program; // Slices holding the surfaces of the tiles
+        RangeUniforms count_uniforms;
+        RangeUniforms fill_uniforms;
+        opengl::UniformHandle<int> assign_cluster_count;
+        opengl::UniformHandle<int> assign_capacity;
+        opengl::UniformHandle<int> assign_total_slot;
+        opengl::UniformHandle<int> tile_bounds_depth;
+        opengl::UniformHandle<glm::mat4> tile_bounds_inverse_projection;
+        opengl::UniformHandle<glm::ivec2> tile_bounds_screen_size;
+        opengl::UniformHandle<glm::ivec3> tile_bounds_cluster_grid;
+        opengl::UniformHandle<glm::vec3> tile_bounds_cluster_depth;
+
+        glm::ivec3 cluster_grid = glm::ivec3(0);
+        uint32_t width = 0, height = 0;
+        float slice_near = 0.0, slice_scale = 0.0, slice_far = 0.0;
+
+        opengl::ShaderStorageBuffer count_storage; // Zero between frames, the fill pass counts back down
+        opengl::ShaderStorageBuffer cluster_storage;
+        opengl::ShaderStorageBuffer light_index_storage;
+        opengl::ShaderStorageBuffer tile_slice_storage; // First and last slice of every tile, an ivec2
+        bool tile_bounds = false;
+        uint32_t light_index_capacity = 0;
+
+        // Every frame allocates the cluster ranges from one of two totals, the other one is read back once the fence of
+        // the frame that wrote it is signaled
+        opengl::ShaderStorageBuffer total_storage;
+        std::array<GLsync, 2> total_fences = {nullptr, nullptr};
+        uint32_t total_slot = 0;
+    };
+}
@@ -0,0 +1,259 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "light_manager.hpp"
+
+#include "debug/debug.hpp"
+#include "renderer/src/renderer.hpp"
+
+#include "thirdparty/glad/include/glad/glad.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace lixy {
+
+    static constexpr uint32_t INITIAL_CAPACITY = 64;
+    static constexpr GLuint64 FENCE_TIMEOUT = 1000000000; // In nanoseconds
+
+    static uint32_t _align(uint32_t p_size, uint32_t p_alignment) {
+        return (p_size + p_alignment - 1) / p_alignment * p_alignment;
+    }
+
+
+    LightSlot::LightSlot(std::shared_ptr<std::vector<uint32_t>> p_released_slots, uint32_t p_slot)
+        : released_slots(std::move(p_released_slots)),
+        slot(p_slot) {}
+
+
+    LightSlot::LightSlot(LightSlot &&p_other)
+        : released_slots(std::move(p_other.released_slots)),
+        slot(p_other.slot)
+    {
+        p_other.slot = INVALID_SLOT;
+    }
+
+
+    LightSlot &LightSlot::operator=(LightSlot &&p_other) {
+        if (this == &p_other) return *this;
+        if (slot != INVALID_SLOT) released_slots->push_back(slot);
+
+        released_slots = std::move(p_other.released_slots);
+        slot = p_other.slot;
+
+        p_other.slot = INVALID_SLOT;
+        return *this;
+    }
+
+
+    LightSlot::~LightSlot() {
+        if (slot != INVALID_SLOT) released_slots->push_back(slot);
+    }
+
+
+    void LightManager::update(flecs::world &p_world) {
+        p_world.defer_begin(); // Slots are added and removed while iterating
+
+        _release_slots(p_world);
+
+        light_query.run([&](flecs::iter &it) {
+            while (it.next()) {
+                auto point_lights = it.field<const PointLight>(0);
+                auto transforms = it.field<const Transform>(1);
+                auto slots = it.field<const LightSlot>(2);
+                bool has_slots = it.is_set(2);
+
+                for (size_t i : it) {
+                    uint32_t slot = has_slots ? slots[i].slot : LightSlot::INVALID_SLOT;
+                    uint64_t transform_version = transforms[i].get_version();
+
+                    if (slot == LightSlot::INVALID_SLOT) {
+                        slot = light_count++;
+                        slot_entities.push_back(it.entity(i).id());
+                        lights.push_back(point_lights[i]);
+                        positions.push_back(glm::vec4(transforms[i].get_local_position(), 1.0));
+                        transform_versions.push_back(transform_version);
+                        changed_regions.push_back(0);
+                        it.entity(i).set<LightSlot>(LightSlot(released_slots, slot));
+                    } else if (transform_versions[slot] == transform_version && std::memcmp(&lights[slot], &point_lights[i], sizeof(PointLight)) == 0) {
+                        continue;
+                    } else {
+                        lights[slot] = point_lights[i];
+                        positions[slot] = glm::vec4(transforms[i].get_local_position(), 1.0);
+                        transform_versions[slot] = transform_version;
+                    }
+                    _mark_changed(slot);
+                }
+            }
+        });
+
+        p_world.defer_end();
+
+        _write_region();
+    }
+
+
+    void LightManager::end_frame() {
+        if (region_fences[region]) glDeleteSync(region_fences[region]);
+        region_fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region = (region + 1) % FRAME_COUNT;
+    }
+
+
+    opengl::ShaderStorageBuffer::Slice LightManager::get_lights() const {
+        return storage.slice(region * region_size + lights_offset, capacity * sizeof(PointLight));
+    }
+
+
+    opengl::ShaderStorageBuffer::Slice LightManager::get_positions() const {
+        return storage.slice(region * region_size, capacity * sizeof(glm::vec4));
+    }
+
+
+    LightManager::LightManager(flecs::world &p_world) {
+        GLint alignment = 0;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        offset_alignment = std::max<uint32_t>(alignment, sizeof(glm::vec4));
+
+        light_query = p_world.query_builder<const PointLight, const Transform, const LightSlot*>()
+            .with<Visible>()
+            .cached()
+            .build();
+        stale_slot_queries = {
+            p_world.query_builder<LightSlot>().without<Visible>().cached().build(),
+            p_world.query_builder<LightSlot>().without<PointLight>().cached().build(),
+            p_world.query_builder<LightSlot>().without<Transform>().cached().build(),
+        };
+
+        released_slots = std::make_shared<std::vector<uint32_t>>();
+        _allocate_storage(INITIAL_CAPACITY);
+    }
+
+
+    LightManager::~LightManager() {
+        for (GLsync fence : region_fences) {
+            if (fence) glDeleteSync(fence);
+        }
+    }
+
+
+    void LightManager::_release_slots(flecs::world &p_world) {
+        for (flecs::query<LightSlot> &query : stale_slot_queries) {
+            query.each([](flecs::entity p_entity, LightSlot &p_slot) {
+                if (p_slot.slot != LightSlot::INVALID_SLOT) {
+                    p_slot.released_slots->push_back(p_slot.slot);
+                    p_slot.slot = LightSlot::INVALID_SLOT;
+                }
+                p_entity.remove<LightSlot>();
+            });
+        }
+
+        // Keep the lights packed, the last light takes every released slot
+        std::vector<uint32_t> &released = *released_slots;
+        for (uint32_t slot : released) {
+            slot_entities[slot] = 0;
+        }
+        for (uint32_t slot : released) {
+            while (light_count && !slot_entities[light_count - 1]) {
+                light_count--;
+            }
+            if (slot >= light_count) continue;
+
+            uint32_t last = --light_count;
+            slot_entities[slot] = slot_entities[last];
+            lights[slot] = lights[last];
+            positions[slot] = positions[last];
+            transform_versions[slot] = transform_versions[last];
+            slot_entities[last] = 0;
+            flecs::entity(p_world, slot_entities[slot]).get_mut<LightSlot>()->slot = slot;
+            _mark_changed(slot);
+        }
+        while (light_count && !slot_entities[light_count - 1]) {
+            light_count--;
+        }
+        released.clear();
+
+        slot_entities.resize(light_count);
+        lights.resize(light_count);
+        positions.resize(light_count);
+        transform_versions.resize(light_count);
+        changed_regions.resize(light_count);
+    }
+
+
+    void LightManager::_mark_changed(uint32_t p_slot) {
+        for (uint32_t i = 0; i < FRAME_COUNT; i++) {
+            if (changed_regions[p_slot] & (1 << i)) continue;
+            changed_regions[p_slot] |= 1 << i;
+            changed_slots[i].push_back(p_slot);
+        }
+    }
+
+
+    void LightManager::_allocate_storage(uint32_t p_capacity) {
+        capacity = p_capacity;
+        lights_offset = _align(capacity * sizeof(glm::vec4), offset_alignment);
+        region_size = lights_offset + _align(capacity * sizeof(PointLight), offset_alignment);
+        storage.allocate_mapped(FRAME_COUNT * region_size);
+
+        // The new buffer is not read yet, every region is written from the slots
+        for (GLsync &fence : region_fences) {
+            if (fence) glDeleteSync(fence);
+            fence = nullptr;
+        }
+        for (uint32_t i = 0; i < FRAME_COUNT; i++) {
+            changed_slots[i].clear();
+        }
+        std::fill(changed_regions.begin(), changed_regions.end(), 0);
+        for (uint32_t slot = 0; slot < light_count; slot++) {
+            _mark_changed(slot);
+        }
+    }
+
+
+    void LightManager::_write_region() {
+        if (light_count > capacity) {
+            _allocate_storage(std::max(light_count, 2 * capacity));
+        }
+
+        written_light_count = 0;
+        std::vector<uint32_t> &slots = changed_slots[region];
+        if (slots.empty()) return;
+
+        if (region_fences[region]) {
+            GLenum status = glClientWaitSync(region_fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+            if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+                LOG_WARNING("Writing the lights of a frame the GPU may still be reading");
+            }
+            glDeleteSync(region_fences[region]);
+            region_fences[region] = nullptr;
+        }
+
+        uint8_t *mapping = (uint8_t*)storage.get_mapping() + region * region_size;
+        glm::vec4 *region_positions = (glm::vec4*)mapping;
+        PointLight *region_lights = (PointLight*)(mapping + lights_offset);
+        for (uint32_t slot : slots) {
+            if (slot >= light_count) continue; // Released since
+            changed_regions[slot] &= ~(1 << region);
+
+            region_positions[slot] = positions[slot];
+            region_lights[slot] = lights[slot];
+            written_light_count++;
+        }
+        slots.clear();
+    }
+}
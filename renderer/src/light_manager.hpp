@@ -0,0 +1,115 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+
+#include "core/src/transform.hpp"
+#include "renderer/src/light.hpp"
+#include "renderer/src/primitives/vbuffer.hpp"
+
+#include "thirdparty/flecs/flecs.h"
+#include "thirdparty/glad/include/glad/glad.h"
+#include "thirdparty/glm/glm.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+namespace lixy {
+
+    // Slot of a visible point light in the buffers of the light manager, which adds it. The slot is released on
+    // destruction and given to another light by the next update.
+    class LightSlot {
+    public:
+        static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+
+    public:
+        LightSlot() = default;
+        LightSlot(std::shared_ptr<std::vector<uint32_t>> p_released_slots, uint32_t p_slot);
+        LightSlot(LightSlot &&p_other);
+        LightSlot &operator=(LightSlot &&p_other);
+        virtual ~LightSlot();
+
+    private:
+        friend class LightManager;
+
+        std::shared_ptr<std::vector<uint32_t>> released_slots; // Shared with the manager, which may be destroyed first
+        uint32_t slot = INVALID_SLOT;
+    };
+
+
+    // Point light data of the visible lights, packed in slots that they keep while they stay visible. The buffers are a
+    // ring of `FRAME_COUNT` persistently mapped regions, every frame writes the next region once the GPU is done with
+    // it. Every update compares the lights with their slot, a `Transform` through its version, and only the lights
+    // that differ from what the region holds are written.
+    class LightManager {
+    public:
+        static constexpr uint32_t FRAME_COUNT = 3;
+
+    public:
+        // Gathers the changed lights and writes the region of this frame, waiting for the GPU if it still reads it
+        void update(flecs::world &p_world);
+        // Called after the last command reading the region of this frame
+        void end_frame();
+
+        inline uint32_t get_light_count() const { return light_count; }
+        // Lights written to the region of the last update, the cost of the upload
+        inline uint32_t get_written_light_count() const { return written_light_count; }
+
+        // Regions of the frame, `PointLight`s and their world position in a vec4. They hold at least one light so that
+        // they can be bound when there is none.
+        opengl::ShaderStorageBuffer::Slice get_lights() const;
+        opengl::ShaderStorageBuffer::Slice get_positions() const;
+
+        LightManager(flecs::world &p_world);
+        LightManager(const LightManager&) = delete;
+        virtual ~LightManager();
+
+    private:
+        void _release_slots(flecs::world &p_world);
+        void _mark_changed(uint32_t p_slot);
+        void _allocate_storage(uint32_t p_capacity);
+        void _write_region();
+
+    private:
+        // Visible lights, their slot is only missing during the frame they become visible
+        flecs::query<const PointLight, const Transform, const LightSlot*> light_query;
+        std::array<flecs::query<LightSlot>, 3> stale_slot_queries; // Slots of entities that are no longer visible lights
+
+        // Data of the slots, the regions are written from them
+        std::shared_ptr<std::vector<uint32_t>> released_slots;
+        std::vector<flecs::entity_t> slot_entities;
+        std::vector<PointLight> lights;
+        std::vector<glm::vec4> positions;
+        std::vector<uint64_t> transform_versions; // Of the transform the position was read from
+        uint32_t light_count = 0;
+
+        // Slots changed since every region was last written, bit `i` of a slot flags its presence in the list of region `i`
+        std::array<std::vector<uint32_t>, FRAME_COUNT> changed_slots;
+        std::vector<uint8_t> changed_regions;
+        uint32_t written_light_count = 0;
+
+        opengl::ShaderStorageBuffer storage;
+        std::array<GLsync, FRAME_COUNT> region_fences = {nullptr, nullptr, nullptr};
+        uint32_t region = 0;
+        uint32_t capacity = 0; // In lights, per region
+        uint32_t region_size = 0, lights_offset = 0; // In bytes, the positions start the region
+        uint32_t offset_alignment = 0; // Of storage buffer bindings
+    };
+}
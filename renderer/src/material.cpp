@@ -23,6 +23,7 @@
 
 #include "renderer/src/primitives/shader.hpp"
 #include "renderer/src/primitives/vbuffer.hpp"
+#include "renderer/src/material_table.hpp"
 #include "renderer/src/texture.hpp"
 
 #include <filesystem>
@@ -35,6 +36,11 @@ namespace lixy {
     const std::string Material::MODEL_UNIFORM = "u_model";
     const std::string Material::VIEW_UNIFORM = "u_view";
     const std::string Material::PROJECTION_UNIFORM = "u_projection";
+    const std::string Material::POSITION_OFFSET_UNIFORM = "u_position_offset";
+    const std::string Material::POSITION_SCALE_UNIFORM = "u_position_scale";
+    const std::string Material::INSTANCE_DATA_BUFFER = "InstanceData";
+    const std::string Material::MATERIAL_DATA_BUFFER = "MaterialData";
+    const std::string Material::MATERIAL_INDEX_UNIFORM = "u_material_index";
 
 
     std::string _read_file(const std::filesystem::path &file_path) {
@@ -48,36 +54,37 @@ namespace lixy {
 
 
     void Material::bind_material() const {
-        if (program->is_bound()) return; // This function can be ignored because shader programs are currently unique
-        program->bind();
+        program->bind(); // Skipped by the state cache when materials share their program
+
+        if (material_data.is_valid()) {
+            material_data.bind_table(material_data_buffer.binding);
+            program->bind_uniform(material_index_uniform, (int)material_data.get_index());
+        }
 
         for (const auto &[name, uniform] : uniforms) {
             switch (uniform.type) {
-            case opengl::ShaderDataType::Float: program->bind_uniform(name, *reinterpret_cast<const float*>(uniform.data)); break;
-            case opengl::ShaderDataType::Vec2 :  program->bind_uniform(name, *reinterpret_cast<const glm::vec2*>(uniform.data)); break;
-            case opengl::ShaderDataType::Vec3 :  program->bind_uniform(name, *reinterpret_cast<const glm::vec3*>(uniform.data)); break;
-            case opengl::ShaderDataType::Vec4 :  program->bind_uniform(name, *reinterpret_cast<const glm::vec4*>(uniform.data)); break;
-            case opengl::ShaderDataType::Mat2 :  program->bind_uniform(name, *reinterpret_cast<const glm::mat2*>(uniform.data)); break;
-            case opengl::ShaderDataType::Mat3 :  program->bind_uniform(name, *reinterpret_cast<const glm::mat3*>(uniform.data)); break;
-            case opengl::ShaderDataType::Mat4 :  program->bind_uniform(name, *reinterpret_cast<const glm::mat4*>(uniform.data)); break;
-            case opengl::ShaderDataType::Int  :   program->bind_uniform(name, *reinterpret_cast<const int*>(uniform.data)); break;
-            case opengl::ShaderDataType::IVec2: program->bind_uniform(name, *reinterpret_cast<const glm::ivec2*>(uniform.data)); break;
-            case opengl::ShaderDataType::IVec3: program->bind_uniform(name, *reinterpret_cast<const glm::ivec3*>(uniform.data)); break;
-            case opengl::ShaderDataType::IVec4: program->bind_uniform(name, *reinterpret_cast<const glm::ivec4*>(uniform.data)); break;
+            case opengl::ShaderDataType::Float: program->bind_uniform(opengl::UniformHandle<float>{uniform.location}, *reinterpret_cast<const float*>(uniform.data)); break;
+            case opengl::ShaderDataType::Vec2 :  program->bind_uniform(opengl::UniformHandle<glm::vec2>{uniform.location}, *reinterpret_cast<const glm::vec2*>(uniform.data)); break;
+            case opengl::ShaderDataType::Vec3 :  program->bind_uniform(opengl::UniformHandle<glm::vec3>{uniform.location}, *reinterpret_cast<const glm::vec3*>(uniform.data)); break;
+            case opengl::ShaderDataType::Vec4 :  program->bind_uniform(opengl::UniformHandle<glm::vec4>{uniform.location}, *reinterpret_cast<const glm::vec4*>(uniform.data)); break;
+            case opengl::ShaderDataType::Mat2 :  program->bind_uniform(opengl::UniformHandle<glm::mat2>{uniform.location}, *reinterpret_cast<const glm::mat2*>(uniform.data)); break;
+            case opengl::ShaderDataType::Mat3 :  program->bind_uniform(opengl::UniformHandle<glm::mat3>{uniform.location}, *reinterpret_cast<const glm::mat3*>(uniform.data)); break;
+            case opengl::ShaderDataType::Mat4 :  program->bind_uniform(opengl::UniformHandle<glm::mat4>{uniform.location}, *reinterpret_cast<const glm::mat4*>(uniform.data)); break;
+            case opengl::ShaderDataType::Int  :   program->bind_uniform(opengl::UniformHandle<int>{uniform.location}, *reinterpret_cast<const int*>(uniform.data)); break;
+            case opengl::ShaderDataType::IVec2: program->bind_uniform(opengl::UniformHandle<glm::ivec2>{uniform.location}, *reinterpret_cast<const glm::ivec2*>(uniform.data)); break;
+            case opengl::ShaderDataType::IVec3: program->bind_uniform(opengl::UniformHandle<glm::ivec3>{uniform.location}, *reinterpret_cast<const glm::ivec3*>(uniform.data)); break;
+            case opengl::ShaderDataType::IVec4: program->bind_uniform(opengl::UniformHandle<glm::ivec4>{uniform.location}, *reinterpret_cast<const glm::ivec4*>(uniform.data)); break;
             default:
                 LOG_WARNING("Unimplemented uniform type");
             }
         }
 
-        int texture_location = 0;
         for (const auto &[name, uniform] : resource_uniform) {
             switch (uniform.type) {
             case opengl::ShaderDataType::Sampler2D:
             {
                 if (!(uniform.resource.is_alive() && uniform.resource.has<Texture>())) continue;
-                uniform.resource.get<Texture>()->bind(texture_location);
-                program->bind_uniform(name, texture_location);
-                texture_location += 1;
+                uniform.resource.get<Texture>()->bind(uniform.unit);
                 break;
             }
             default:
@@ -85,8 +92,8 @@ namespace lixy {
             }
         }
 
-        for (const auto &[name, ssb_slice] : shader_storage_buffer) {
-            program->bind_storage_buffer(name, ssb_slice);
+        for (const auto &[name, storage_buffer] : shader_storage_buffer) {
+            program->bind_storage_buffer(storage_buffer.handle, storage_buffer.slice);
         }
     }
 
@@ -94,9 +101,32 @@ namespace lixy {
     void Material::bind_pvm(const glm::mat4 &p_projection, const glm::mat4 &p_view, const glm::mat4 &p_model) const {
         if (!program->is_bound()) program->bind();
 
-        program->bind_uniform(Material::PROJECTION_UNIFORM, p_projection);
-        program->bind_uniform(Material::VIEW_UNIFORM, p_view);
-        program->bind_uniform(Material::MODEL_UNIFORM, p_model);
+        program->bind_uniform(projection_uniform, p_projection);
+        program->bind_uniform(view_uniform, p_view);
+        program->bind_uniform(model_uniform, p_model);
+    }
+
+
+    void Material::bind_position_dequantization(const glm::vec3 &p_offset, const glm::vec3 &p_scale) const {
+        if (!program->is_bound()) program->bind();
+
+        program->bind_uniform(position_offset_uniform, p_offset);
+        program->bind_uniform(position_scale_uniform, p_scale);
+    }
+
+
+    void Material::bind_view_projection(const glm::mat4 &p_projection, const glm::mat4 &p_view) const {
+        if (!program->is_bound()) program->bind();
+
+        program->bind_uniform(projection_uniform, p_projection);
+        program->bind_uniform(view_uniform, p_view);
+    }
+
+
+    void Material::bind_instance_data(const opengl::ShaderStorageBuffer::Slice &p_instances) const {
+        if (!program->is_bound()) program->bind();
+
+        program->bind_storage_buffer(instance_data_buffer, p_instances);
     }
 
 
@@ -111,11 +141,24 @@ namespace lixy {
     template<>
     void Material::set_uniform<opengl::ShaderStorageBuffer::Slice>(const std::string &p_uniform_name, const opengl::ShaderStorageBuffer::Slice &p_slice) {
         try {
-            shader_storage_buffer.at(p_uniform_name) = p_slice;
+            shader_storage_buffer.at(p_uniform_name).slice = p_slice;
         } catch (std::out_of_range) { LOG_WARNING("Non existant uniform " << p_uniform_name); }
     }
 
 
+    void Material::_write_material_data(const MaterialDataUniform &p_uniform, const void *p_value, uint32_t p_size) {
+        if (p_uniform.type != opengl::ShaderDataType::Mat3) {
+            material_data.write_data(p_uniform.offset, p_size, p_value);
+            return;
+        }
+
+        // std430 aligns the vec3 columns of mat3 on 16 bytes
+        for (uint32_t column = 0; column < 3; column++) {
+            material_data.write_data(p_uniform.offset + column * sizeof(glm::vec4), sizeof(glm::vec3), reinterpret_cast<const glm::vec3*>(p_value) + column);
+        }
+    }
+
+
     bool Material::is_valid() const {
         return program->is_valid();
     }
@@ -139,12 +182,50 @@ namespace lixy {
     Material::Material(const std::string &p_vertex_source, const std::string &p_fragment_source) {
         program = std::make_shared<opengl::ShaderProgram>(p_vertex_source, p_fragment_source);
 
+        // Resolve the uniforms bound on every draw
+        projection_uniform = program->get_uniform_handle<glm::mat4>(Material::PROJECTION_UNIFORM);
+        view_uniform = program->get_uniform_handle<glm::mat4>(Material::VIEW_UNIFORM);
+        model_uniform = program->get_uniform_handle<glm::mat4>(Material::MODEL_UNIFORM);
+        position_offset_uniform = program->get_uniform_handle<glm::vec3>(Material::POSITION_OFFSET_UNIFORM);
+        position_scale_uniform = program->get_uniform_handle<glm::vec3>(Material::POSITION_SCALE_UNIFORM);
+        instance_data_buffer = program->get_storage_buffer_handle(Material::INSTANCE_DATA_BUFFER);
+
+        material_index_uniform = program->get_uniform_handle<int>(Material::MATERIAL_INDEX_UNIFORM);
+
+        // Get the members of the material data array, the table is created for the program and shared by copies
+        int material_data_index = program->get_storage_buffer_index(Material::MATERIAL_DATA_BUFFER);
+        uint32_t material_data_stride = 0;
+        for (int i = 0; i < program->get_buffer_variable_count(); i++) {
+            if (program->get_buffer_variable_storage_buffer(i) != material_data_index) continue;
+
+            // Members are named after the first element of the array, `materials[0].u_name`
+            const std::string &name = program->get_buffer_variable_name(i);
+            material_data_uniforms[name.substr(name.find('.') + 1)] = MaterialDataUniform{
+                .type = program->get_buffer_variable_type(i),
+                .offset = program->get_buffer_variable_offset(i),
+            };
+            material_data_stride = program->get_buffer_variable_array_stride(i);
+        }
+
+        if (material_data_index != -1 && material_data_stride == 0) {
+            LOG_WARNING("The `" << Material::MATERIAL_DATA_BUFFER << "` storage buffer must hold an array with one structure per material");
+            material_data_uniforms.clear();
+        } else if (material_data_index != -1) {
+            material_data_buffer = program->get_storage_buffer_handle(Material::MATERIAL_DATA_BUFFER);
+            material_data = MaterialSlot(std::make_shared<MaterialTable>(material_data_stride));
+        }
+
         // Get uniforms
+        int texture_unit = 0;
         for (int i = 0; i < program->get_uniform_count(); i++) {
             opengl::ShaderDataType type = program->get_uniform_type(i);
             std::string name = program->get_uniform_name(i);
 
+            if (program->get_uniform_block(i) != -1) continue; // Uniform blocks, such as the frame data, are bound by the renderer
+            if (name == Material::MATERIAL_INDEX_UNIFORM) continue;
+
             if (name == Material::MODEL_UNIFORM || name == Material::VIEW_UNIFORM || name == Material::PROJECTION_UNIFORM) continue;
+            if (name == Material::POSITION_OFFSET_UNIFORM || name == Material::POSITION_SCALE_UNIFORM) continue;
 
             switch (type) {
             case opengl::ShaderDataType::Float:
@@ -160,13 +241,23 @@ namespace lixy {
             case opengl::ShaderDataType::IVec4:
             case opengl::ShaderDataType::Bool:
                 uniforms[name] = Uniform{
-                    .type = type
+                    .type = type,
+                    .location = program->get_uniform_handle<int>(name).location,
                 };
                 break;
             case opengl::ShaderDataType::Sampler2D:
                 resource_uniform[name] = ResourceUniform{
-                    .type = type
+                    .type = type,
+                    .unit = texture_unit,
                 };
+                program->bind();
+                program->bind_uniform(program->get_uniform_handle<int>(name), texture_unit);
+                texture_unit += 1;
+                break;
+            case opengl::ShaderDataType::HalfVec2:
+            case opengl::ShaderDataType::UShort4Norm:
+            case opengl::ShaderDataType::Int2101010Norm:
+                LOG_WARNING("Uniform `" << name << "` has a vertex attribute only type, it is skipped");
                 break;
             case opengl::ShaderDataType::Unknown:
                 LOG_WARNING("Unknown uniform type named: `" << name << "` in shader");
@@ -176,7 +267,15 @@ namespace lixy {
         // Get Shader Storage Buffers
         shader_storage_buffer.reserve(program->get_storage_buffer_count());
         for (int i = 0; i < program->get_storage_buffer_count(); i++) {
-            shader_storage_buffer[program->get_storage_buffer_name(i)] = opengl::ShaderStorageBuffer::Slice();
+            std::string name = program->get_storage_buffer_name(i);
+            if (name == Material::INSTANCE_DATA_BUFFER) {
+                instanced = true;
+                continue;
+            }
+            if (name == Material::MATERIAL_DATA_BUFFER) continue;
+            shader_storage_buffer[name] = StorageBuffer{
+                .handle = program->get_storage_buffer_handle(name),
+            };
         }
     }
 }
\ No newline at end of file
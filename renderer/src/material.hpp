@@ -22,6 +22,7 @@
 #include "core/src/ref.hpp"
 #include "renderer/src/primitives/shader.hpp"
 #include "renderer/src/primitives/vbuffer.hpp"
+#include "renderer/src/material_table.hpp"
 #include "thirdparty/flecs/flecs.h"
 
 #include <cstring>
@@ -37,13 +38,33 @@ namespace lixy {
     public:
         bool is_valid() const;
         const std::string &get_errors() const;
+        inline const opengl::ShaderProgram *get_program() const { return program.get(); }
 
         void bind_material() const;
         void bind_pvm(const glm::mat4 &p_projection, const glm::mat4 &p_view, const glm::mat4 &p_model) const;
+        void bind_position_dequantization(const glm::vec3 &p_offset, const glm::vec3 &p_scale) const; // For meshes with quantized positions
 
+        // Instanced materials read their model matrix and position dequantization from the `InstanceData` storage
+        // buffer, indexed by the instance index attribute, others are drawn once per instance with uniforms
+        inline bool is_instanced() const { return instanced; }
+        void bind_view_projection(const glm::mat4 &p_projection, const glm::mat4 &p_view) const;
+        void bind_instance_data(const opengl::ShaderStorageBuffer::Slice &p_instances) const;
+
+        // Blended materials are drawn once the opaque surfaces of the forward pipeline are shaded, back to front and
+        // without writing the depth. The deferred pipeline draws them into the gbuffer like the others.
+        inline bool is_blended() const { return blended; }
+        inline void set_blended(bool p_blended) { blended = p_blended; }
+
+        // Members of the shader `MaterialData` array are stored in the material table of the program, which the
+        // shader indexes with `u_material_index`. Other uniforms are uploaded one by one every time the material is bound.
         template<class T>
         void set_uniform(const std::string &p_uniform_name, const T &p_value) {
             static_assert(sizeof(T) <= 16 * sizeof(uint32_t), "Incorrect uniform size");
+            auto material_data_uniform = material_data_uniforms.find(p_uniform_name);
+            if (material_data_uniform != material_data_uniforms.end()) {
+                _write_material_data(material_data_uniform->second, &p_value, sizeof(p_value));
+                return;
+            }
             try {
                 memcpy(uniforms.at(p_uniform_name).data, &p_value, sizeof(p_value));
             } catch (std::out_of_range) { LOG_WARNING("Non existant uniform " << p_uniform_name); }
@@ -63,24 +84,57 @@ namespace lixy {
     private:
         struct Uniform {
             opengl::ShaderDataType type;
+            int32_t location;
             uint32_t data[16];
         };
 
         struct ResourceUniform {
             opengl::ShaderDataType type;
+            int32_t unit; // Texture unit, assigned to the sampler once when the material is created
             EntityRef resource;
         };
 
+        struct MaterialDataUniform {
+            opengl::ShaderDataType type;
+            uint32_t offset; // In bytes, from the start of the material element
+        };
+
+        struct StorageBuffer {
+            opengl::StorageBufferHandle handle;
+            opengl::ShaderStorageBuffer::Slice slice;
+        };
+
+    private:
+        void _write_material_data(const MaterialDataUniform &p_uniform, const void *p_value, uint32_t p_size);
+
     private:
         std::shared_ptr<opengl::ShaderProgram> program;
         std::unordered_map<std::string, Uniform> uniforms;
         std::unordered_map<std::string, ResourceUniform> resource_uniform; // Resources need to be implemented apart from other uniforms as they require cleanup
-        std::unordered_map<std::string, opengl::ShaderStorageBuffer::Slice> shader_storage_buffer;
+        std::unordered_map<std::string, StorageBuffer> shader_storage_buffer;
+        std::unordered_map<std::string, MaterialDataUniform> material_data_uniforms;
+        MaterialSlot material_data; // Shares the table of the materials created from the same program
+        opengl::StorageBufferHandle material_data_buffer;
+        opengl::UniformHandle<int> material_index_uniform;
+        bool instanced = false;
+        bool blended = false;
+
+        opengl::UniformHandle<glm::mat4> projection_uniform;
+        opengl::UniformHandle<glm::mat4> view_uniform;
+        opengl::UniformHandle<glm::mat4> model_uniform;
+        opengl::UniformHandle<glm::vec3> position_offset_uniform;
+        opengl::UniformHandle<glm::vec3> position_scale_uniform;
+        opengl::StorageBufferHandle instance_data_buffer;
 
     private:
         static const std::string MODEL_UNIFORM;
         static const std::string VIEW_UNIFORM;
         static const std::string PROJECTION_UNIFORM;
+        static const std::string POSITION_OFFSET_UNIFORM;
+        static const std::string POSITION_SCALE_UNIFORM;
+        static const std::string INSTANCE_DATA_BUFFER;
+        static const std::string MATERIAL_DATA_BUFFER;
+        static const std::string MATERIAL_INDEX_UNIFORM;
     };
 
 
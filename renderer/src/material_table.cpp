@@ -0,0 +1,151 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "material_table.hpp"
+
+#include "debug/debug.hpp"
+#include "renderer/src/primitives/vbuffer.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+
+namespace lixy {
+
+    MaterialTable::Handle MaterialTable::allocate() {
+        Handle handle;
+        if (!free_handles.empty()) {
+            handle = free_handles.back();
+            free_handles.pop_back();
+        } else {
+            handle = count;
+            count += 1;
+            if (data.size() < count * stride) data.resize(2 * data.size());
+        }
+
+        uint32_t offset = handle * stride;
+        memset(data.data() + offset, 0, stride);
+        dirty_begin = std::min(dirty_begin, offset);
+        dirty_end = std::max(dirty_end, offset + stride);
+        return handle;
+    }
+
+
+    MaterialTable::Handle MaterialTable::duplicate(Handle p_source) {
+        Handle handle = allocate();
+        write_data(handle, 0, stride, data.data() + p_source * stride);
+        return handle;
+    }
+
+
+    void MaterialTable::free(Handle p_handle) {
+        if (p_handle == INVALID_HANDLE) return;
+        free_handles.push_back(p_handle);
+    }
+
+
+    void MaterialTable::write_data(Handle p_handle, uint32_t p_offset, uint32_t p_size, const void *p_data) {
+        ASSERT_FATAL_ERROR(p_offset + p_size <= stride, "Material data write out of bounds");
+
+        uint32_t offset = p_handle * stride + p_offset;
+        memcpy(data.data() + offset, p_data, p_size);
+        dirty_begin = std::min(dirty_begin, offset);
+        dirty_end = std::max(dirty_end, offset + p_size);
+    }
+
+
+    void MaterialTable::bind_to_location(uint32_t p_bind_location) {
+        if (buffer.get_size() < data.size()) {
+            buffer.allocate(data.size());
+            buffer.write_data(0, data.size(), data.data());
+        } else if (dirty_begin < dirty_end) {
+            buffer.write_data(dirty_begin, dirty_end - dirty_begin, data.data() + dirty_begin);
+        }
+        dirty_begin = UINT32_MAX;
+        dirty_end = 0;
+
+        buffer.slice(0, buffer.get_size()).bind_to_location(p_bind_location);
+    }
+
+
+    MaterialTable::MaterialTable(uint32_t p_stride)
+        : data(INITIAL_CAPACITY * p_stride),
+        stride(p_stride) {}
+
+
+    void MaterialSlot::write_data(uint32_t p_offset, uint32_t p_size, const void *p_data) {
+        if (!is_valid()) return;
+        table->write_data(handle, p_offset, p_size, p_data);
+    }
+
+
+    void MaterialSlot::bind_table(uint32_t p_bind_location) const {
+        if (!is_valid()) return;
+        table->bind_to_location(p_bind_location);
+    }
+
+
+    MaterialSlot::MaterialSlot(std::shared_ptr<MaterialTable> p_table)
+        : table(std::move(p_table))
+    {
+        handle = table->allocate();
+    }
+
+
+    MaterialSlot::MaterialSlot(const MaterialSlot &p_other)
+        : table(p_other.table)
+    {
+        if (p_other.is_valid()) handle = table->duplicate(p_other.handle);
+    }
+
+
+    MaterialSlot &MaterialSlot::operator=(const MaterialSlot &p_other) {
+        if (this == &p_other) return *this;
+        if (is_valid()) table->free(handle);
+
+        table = p_other.table;
+        handle = p_other.is_valid() ? table->duplicate(p_other.handle) : MaterialTable::INVALID_HANDLE;
+
+        return *this;
+    }
+
+
+    MaterialSlot::MaterialSlot(MaterialSlot &&p_other)
+        : table(std::move(p_other.table)),
+        handle(p_other.handle)
+    {
+        p_other.handle = MaterialTable::INVALID_HANDLE;
+    }
+
+
+    MaterialSlot &MaterialSlot::operator=(MaterialSlot &&p_other) {
+        if (this == &p_other) return *this;
+        if (is_valid()) table->free(handle);
+
+        table = std::move(p_other.table);
+        handle = p_other.handle;
+
+        p_other.handle = MaterialTable::INVALID_HANDLE;
+        return *this;
+    }
+
+
+    MaterialSlot::~MaterialSlot() {
+        if (is_valid()) table->free(handle);
+    }
+}
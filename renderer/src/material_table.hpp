@@ -0,0 +1,88 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+
+#include "renderer/src/primitives/vbuffer.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+namespace lixy {
+
+    // Storage buffer holding the constants of every material sharing a shader program, one element of the shader
+    // `MaterialData` array per material. Values are written to a CPU copy and uploaded when the table is bound, so
+    // switching materials only changes the index read by the shader and never rebinds a buffer.
+    class MaterialTable {
+    public:
+        using Handle = uint32_t; // Index of the material in the table
+        static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+    public:
+        Handle allocate(); // Zero initialized
+        Handle duplicate(Handle p_source);
+        void free(Handle p_handle);
+
+        void write_data(Handle p_handle, uint32_t p_offset, uint32_t p_size, const void *p_data);
+        // Uploads the data written since the last bind
+        void bind_to_location(uint32_t p_bind_location);
+
+        inline uint32_t get_stride() const { return stride; }
+
+        MaterialTable(uint32_t p_stride);
+        MaterialTable(const MaterialTable&) = delete;
+        virtual ~MaterialTable() = default;
+
+    private:
+        static constexpr uint32_t INITIAL_CAPACITY = 1 << 6;
+
+    private:
+        opengl::ShaderStorageBuffer buffer;
+        std::vector<uint8_t> data; // CPU copy of every element
+        std::vector<Handle> free_handles;
+        uint32_t stride; // Array stride of the shader `MaterialData` elements
+        uint32_t count = 0;
+
+        uint32_t dirty_begin = UINT32_MAX; // Byte range written since the last upload
+        uint32_t dirty_end = 0;
+    };
+
+
+    // Element owned in a MaterialTable, copies get their own element with the same content
+    class MaterialSlot {
+    public:
+        void write_data(uint32_t p_offset, uint32_t p_size, const void *p_data);
+        void bind_table(uint32_t p_bind_location) const;
+
+        inline bool is_valid() const { return handle != MaterialTable::INVALID_HANDLE; }
+        inline MaterialTable::Handle get_index() const { return handle; }
+
+        MaterialSlot() = default;
+        MaterialSlot(std::shared_ptr<MaterialTable> p_table);
+        MaterialSlot(const MaterialSlot &p_other);
+        MaterialSlot &operator=(const MaterialSlot &p_other);
+        MaterialSlot(MaterialSlot &&p_other);
+        MaterialSlot &operator=(MaterialSlot &&p_other);
+        virtual ~MaterialSlot();
+
+    private:
+        std::shared_ptr<MaterialTable> table;
+        MaterialTable::Handle handle = MaterialTable::INVALID_HANDLE;
+    };
+}
@@ -19,18 +19,25 @@
 #include "mesh.hpp"
 
 #include "core/src/ref.hpp"
+#include "renderer/src/cooked_mesh.hpp"
 #include "debug/debug.hpp"
 #include "renderer/src/material.hpp"
+#include "renderer/src/mesh_optimizer.hpp"
 #include "renderer/src/primitives/shader.hpp"
 #include "renderer/src/primitives/vbuffer.hpp"
 #include "renderer/src/renderer.hpp"
 #include "renderer/src/texture.hpp"
+#include "renderer/src/vertex_weld_table.hpp"
 #include "thirdparty/flecs/flecs.h"
+#include "thirdparty/glm/gtc/packing.hpp"
+#include "thirdparty/glm/gtc/type_ptr.hpp"
 #include "wavefront_loader/src/object.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cstring>
+#include <limits>
 #include <memory>
-#include <unordered_map>
 #include <vector>
 
 
@@ -45,94 +52,301 @@ namespace lixy {
     }
 
 
-    void ArrayMesh::record_draw(const glm::mat4 &p_projection, const glm::mat4 &p_view, const glm::mat4 &p_model) const {
-        for (const Surface &surface : surfaces) {
-            const Material *material = surface.material.get<Material>();
-            material->bind_material();
-            material->bind_pvm(p_projection, p_view, p_model);
+    // Records one instanced draw of the surface for the whole batch, or one draw per instance in the transparent pass
+    static void _record_surface_draw(const GeometryArena &p_arena, const MeshSurface &p_surface, const InstanceBatch &p_batch, DrawList &p_draw_list) {
+        const Material *material = p_surface.material.get<Material>();
+        uint32_t pool = p_arena.get_pool(p_surface.vertices);
+        GLenum index_type = p_arena.get_index_type(p_surface.indices);
 
-            surface.vertex_array.bind();
-            glDrawElements(GL_TRIANGLES, surface.index_count, GL_UNSIGNED_INT, nullptr);
-            surface.vertex_array.unbind();
+        if (material->is_blended() && p_batch.depths) {
+            // Instances are sorted back to front with the other transparent draws
+            p_draw_list.set_pass(DrawPass::TRANSPARENT);
+            for (uint32_t i = 0; i < p_batch.instance_count; i++) {
+                opengl::DrawElementsIndirectCommand command = p_arena.get_draw_command(p_surface.vertices, p_surface.indices, p_surface.index_count, p_surface.base_vertex, p_batch.first_instance + i, 1);
+                p_draw_list.add(material, pool, index_type, command, p_batch.instances + i, p_batch.depths[i]);
+            }
+            p_draw_list.set_pass(DrawPass::GEOMETRY);
+            return;
+        }
+
+        p_draw_list.add(
+            material,
+            pool,
+            index_type,
+            p_arena.get_draw_command(p_surface.vertices, p_surface.indices, p_surface.index_count, p_surface.base_vertex, p_batch.first_instance, p_batch.instance_count),
+            p_batch.instances,
+            p_batch.depth
+        );
+    }
+
+
+    void ArrayMesh::record_draws(const InstanceBatch &p_batch, DrawList &p_draw_list) const {
+        for (const MeshSurface &surface : surfaces) {
+            _record_surface_draw(*geometry_arena, surface, p_batch, p_draw_list);
         }
     }
 
 
-    void ArrayMesh::add_surface(const std::vector<Vertex> &p_vertices, const std::vector<uint32_t> &p_indices, const EntityRef &p_material) {
-        std::shared_ptr<opengl::VertexBuffer> vertex_buffer = std::make_shared<opengl::VertexBuffer>(p_vertices.data(), p_vertices.size() * sizeof(Vertex));
-        std::shared_ptr<opengl::IndexBuffer> index_buffer = std::make_shared<opengl::IndexBuffer>(p_indices.data(), p_indices.size());
-        opengl::VertexArrayBuffer vertex_array;
-        vertex_array.bind();
-        vertex_array.add_vertex_buffer(vertex_buffer, Vertex::get_layout());
-        vertex_array.add_index_buffer(index_buffer);
-        vertex_array.unbind();
+    void ArrayMesh::add_surface(const std::vector<Vertex> &p_vertices, const std::vector<uint32_t> &p_indices, const EntityRef &p_material, bool p_optimize) {
+        ASSERT_FATAL_ERROR(geometry_arena, "ArrayMesh has no geometry arena, it must be created with ArrayMesh::create");
+
+        if (p_optimize && !p_vertices.empty()) {
+            std::vector<Vertex> vertices = p_vertices;
+            std::vector<uint32_t> indices = p_indices;
 
-        surfaces.push_back(Surface{
-            vertex_buffer,
-            index_buffer,
-            std::move(vertex_array),
-            (uint32_t)p_indices.size(),
-            p_material
+            MeshOptimizer::optimize_vertex_cache(indices.data(), indices.size(), vertices.size());
+            MeshOptimizer::optimize_overdraw(indices.data(), indices.size(), &vertices[0].vertex_pos.x, sizeof(Vertex), vertices.size());
+            vertices.resize(MeshOptimizer::optimize_vertex_fetch(vertices.data(), sizeof(Vertex), vertices.size(), indices.data(), indices.size()));
+
+            add_surface(vertices, indices, p_material);
+            return;
+        }
+
+        for (const Vertex &vertex : p_vertices) bounds.merge(vertex.vertex_pos);
+
+        surfaces.push_back(MeshSurface{
+            .vertices = geometry_arena->allocate_vertices(Vertex::get_layout(), p_vertices.data(), p_vertices.size()),
+            .indices = geometry_arena->allocate_indices(p_indices.data(), p_indices.size()),
+            .index_count = (uint32_t)p_indices.size(),
+            .base_vertex = 0,
+            .material = p_material,
         });
     }
 
 
     EntityRef ArrayMesh::create(flecs::world &p_world) {
-        return EntityRef::create_reference(p_world).add<ArrayMesh>();
+        EntityRef entity = EntityRef::create_reference(p_world).add<ArrayMesh>();
+        entity.get_mut<ArrayMesh>()->geometry_arena = Renderer::get_singleton(p_world)->get_geometry_arena();
+        return entity;
+    }
+
+
+    ArrayMesh::ArrayMesh(ArrayMesh &&p_other)
+        : geometry_arena(std::move(p_other.geometry_arena)),
+        surfaces(std::move(p_other.surfaces)),
+        bounds(p_other.bounds)
+    {
+        p_other.surfaces.clear();
+    }
+
+
+    ArrayMesh &ArrayMesh::operator=(ArrayMesh &&p_other) {
+        _free_geometry();
+
+        geometry_arena = std::move(p_other.geometry_arena);
+        surfaces = std::move(p_other.surfaces);
+        bounds = p_other.bounds;
+        p_other.surfaces.clear();
+        return *this;
     }
 
 
-    void ObjMesh::record_draw(const glm::mat4 &p_projection, const glm::mat4 &p_view, const glm::mat4 &p_model) const {
-        vertex_array->bind();
-        for (const Surface &surface : surfaces) {
-            const Material *material = surface.material.get<Material>();
-            material->bind_material();
-            material->bind_pvm(p_projection, p_view, p_model);
-            surface.indices->bind();
+    ArrayMesh::~ArrayMesh() {
+        _free_geometry();
+    }
+
 
-            glDrawElements(GL_TRIANGLES, surface.index_count, GL_UNSIGNED_INT, nullptr);
+    void ArrayMesh::_free_geometry() {
+        for (const MeshSurface &surface : surfaces) {
+            geometry_arena->free(surface.vertices);
+            geometry_arena->free(surface.indices);
         }
-        vertex_array->unbind();
+        surfaces.clear();
     }
 
 
-    EntityRef ObjMesh::load(flecs::world &p_world, const std::filesystem::path &p_path) {
-        EntityRef entity = EntityRef::create_reference(p_world).add<ObjMesh>();
-        ObjMesh *mesh = entity.get_mut<ObjMesh>();
+    void ObjMesh::record_draws(const InstanceBatch &p_batch, DrawList &p_draw_list) const {
+        for (const MeshSurface &surface : surfaces) {
+            _record_surface_draw(*geometry_arena, surface, p_batch, p_draw_list);
+        }
+    }
+
+
+    ObjMesh::ObjMesh(ObjMesh &&p_other)
+        : geometry_arena(std::move(p_other.geometry_arena)),
+        vertices(p_other.vertices),
+        surfaces(std::move(p_other.surfaces)),
+        position_offset(p_other.position_offset),
+        position_scale(p_other.position_scale),
+        bounds(p_other.bounds)
+    {
+        p_other.vertices = GeometryArena::INVALID_HANDLE;
+        p_other.surfaces.clear();
+    }
+
+
+    ObjMesh &ObjMesh::operator=(ObjMesh &&p_other) {
+        _free_geometry();
+
+        geometry_arena = std::move(p_other.geometry_arena);
+        vertices = p_other.vertices;
+        surfaces = std::move(p_other.surfaces);
+        position_offset = p_other.position_offset;
+        position_scale = p_other.position_scale;
+        bounds = p_other.bounds;
+
+        p_other.vertices = GeometryArena::INVALID_HANDLE;
+        p_other.surfaces.clear();
+        return *this;
+    }
+
+
+    ObjMesh::~ObjMesh() {
+        _free_geometry();
+    }
+
+
+    void ObjMesh::_free_geometry() {
+        if (!geometry_arena) return;
+
+        for (const MeshSurface &surface : surfaces) {
+            geometry_arena->free(surface.indices);
+        }
+        geometry_arena->free(vertices);
+
+        vertices = GeometryArena::INVALID_HANDLE;
+        surfaces.clear();
+    }
+
+
+    EntityRef ObjMesh::load(flecs::world &p_world, const std::filesystem::path &p_path, const ObjImportOptions &p_options) {
+        std::filesystem::path cooked_path = CookedMesh::get_cooked_path(p_path);
+
+        CookedMesh cooked;
+        if (p_options.use_cache) {
+            cooked = CookedMesh::open(cooked_path);
+        }
+
+        // Meshes cooked with other settings or another vertex layout are cooked again
+        if (cooked.is_valid()) {
+            const opengl::BufferLayout &layout = cooked.get_vertex_format() == CookedMesh::VertexFormat::COMPACT
+                ? ObjMesh::get_compact_vertex_buffer_layout()
+                : ObjMesh::get_vertex_buffer_layout();
+
+            if (cooked.get_import_flags() != ObjMesh::_get_import_flags(p_options) || cooked.get_vertex_stride() != layout.get_stride()) {
+                cooked = CookedMesh();
+            }
+        }
+
+        if (!cooked.is_valid()) {
+            cooked = ObjMesh::_cook(p_path, p_options);
+
+            if (p_options.use_cache && cooked.get_surface_count() > 0 && !cooked.save(cooked_path)) {
+                LOG_WARNING("Could not save cooked mesh at `" << cooked_path << "`");
+            }
+        }
+
+        return ObjMesh::_create(p_world, cooked, p_path);
+    }
+
+
+    // Vertex of the COMPACT cooked mesh format
+    struct CompactVertex {
+        uint64_t position; // unorm16x4, the last component is unused
+        uint32_t normal; // snorm 10:10:10:2
+        uint32_t uv; // Two half floats
+    };
 
-        mesh->vertex_array = std::make_unique<opengl::VertexArrayBuffer>();
 
+    uint32_t ObjMesh::_get_import_flags(const ObjImportOptions &p_options) {
+        return (p_options.optimize ? 0x1 : 0) | (p_options.compact_vertices ? 0x2 : 0);
+    }
+
+
+    CookedMesh ObjMesh::_cook(const std::filesystem::path &p_path, const ObjImportOptions &p_options) {
         // Load mesh from the file
-        WavefrontMesh wavefront = WavefrontMesh::load(p_path);
+        WavefrontMesh wavefront = WavefrontMesh::load(p_path, WavefrontMesh::ParseBackend::MAPPED_PARALLEL);
+
+        // Faces without normals use smooth normals generated per position, appended after the file normals
+        const uint32_t generated_normals_offset = (uint32_t)wavefront.normals.size();
+        bool has_missing_normals = false;
+        for (auto &[name, object] : wavefront.objects) {
+            for (size_t i = 0; i + 2 < object.position_indices.size(); i += 3) {
+                if (object.normal_indices[i] != WavefrontObject::NO_INDEX && object.normal_indices[i + 1] != WavefrontObject::NO_INDEX && object.normal_indices[i + 2] != WavefrontObject::NO_INDEX) continue;
+
+                if (!has_missing_normals) {
+                    wavefront.normals.resize(generated_normals_offset + wavefront.positions.size(), glm::vec3(0.0));
+                    has_missing_normals = true;
+                }
+
+                uint32_t a = object.position_indices[i], b = object.position_indices[i + 1], c = object.position_indices[i + 2];
+                if (a >= wavefront.positions.size() || b >= wavefront.positions.size() || c >= wavefront.positions.size()) continue;
+
+                // Area weighted face normal
+                glm::vec3 face_normal = glm::cross(wavefront.positions[b] - wavefront.positions[a], wavefront.positions[c] - wavefront.positions[a]);
+                for (int j = 0; j < 3; j++) {
+                    if (object.normal_indices[i + j] != WavefrontObject::NO_INDEX) continue;
+                    wavefront.normals[generated_normals_offset + object.position_indices[i + j]] += face_normal;
+                    object.normal_indices[i + j] = generated_normals_offset + object.position_indices[i + j];
+                }
+            }
+        }
+        for (size_t i = generated_normals_offset; i < wavefront.normals.size(); i++) {
+            float length = glm::length(wavefront.normals[i]);
+            wavefront.normals[i] = length > 0.0f ? wavefront.normals[i] / length : glm::vec3(0.0, 1.0, 0.0);
+        }
+
+        // Faces without uvs all share a zero uv, appended after the file uvs
+        const uint32_t missing_uv_index = (uint32_t)wavefront.uvs.size();
+        wavefront.uvs.push_back(glm::vec2(0.0));
 
         // Create vertex data suited for single index buffer for positions, normals and uvs
         std::vector<float> vertex_buffer;
         vertex_buffer.reserve((sizeof(wavefront.positions[0]) + sizeof(wavefront.normals[0]) + sizeof(wavefront.uvs[0])) * wavefront.positions.size() / sizeof(float));
         uint32_t vertex_count = 0;
 
-        std::unordered_map<uint64_t, uint32_t> index_map;
-
-        int object_index_buffer_size = 0;
-        std::vector<uint32_t> object_indices;
-
-        for (auto element : wavefront.objects) {
-            WavefrontObject object = element.second;
-            WavefrontMaterial mat = wavefront.materials[object.material];
-
-            object_indices.reserve(object.position_indices.size());
-            object_index_buffer_size = 0;
+        // Most meshes share each vertex between several triangles, size the table from the triangle count
+        size_t total_index_count = 0;
+        for (const auto &[name, object] : wavefront.objects) total_index_count += object.position_indices.size();
+        VertexWeldTable weld_table(total_index_count / 3);
+
+        std::vector<uint32_t> indices;
+        std::vector<CookedMesh::Surface> surfaces;
+        std::vector<std::string> texture_paths; // Storage for the surfaces texture paths
+        size_t invalid_triangle_count = 0;
+        surfaces.reserve(wavefront.objects.size());
+        texture_paths.reserve(wavefront.objects.size());
+
+        for (const auto &[name, object] : wavefront.objects) {
+            CookedMesh::Surface surface{
+                .first_index = (uint32_t)indices.size(),
+                .index_count = 0,
+                .diffuse_texture = "",
+                .diffuse_offset = glm::vec3(0.0),
+                .diffuse_scale = glm::vec3(1.0),
+            };
+
+            auto material = wavefront.materials.find(object.material);
+            if (material != wavefront.materials.end() && material->second.has_diffuse_texture()) {
+                surface.diffuse_texture = texture_paths.emplace_back(material->second.diffuse_texture.path.string());
+                surface.diffuse_offset = material->second.diffuse_texture.origin_offset;
+                surface.diffuse_scale = material->second.diffuse_texture.scale;
+            }
 
             // Build index buffer
-            for (int i = 0; i < object.position_indices.size(); i++) {
-                uint64_t position_index = object.position_indices[i];
-                uint64_t normal_index = object.normal_indices[i];
-                uint64_t uv_index = object.uv_indices[i];
+            indices.reserve(indices.size() + object.position_indices.size());
+            for (size_t i = 0; i < object.position_indices.size(); i++) {
+                // Skip whole triangles referencing attributes the file does not define
+                if (i % 3 == 0) {
+                    bool is_valid_triangle = i + 2 < object.position_indices.size();
+                    for (size_t j = i; is_valid_triangle && j < i + 3; j++) {
+                        is_valid_triangle = object.position_indices[j] < wavefront.positions.size()
+                            && object.normal_indices[j] < wavefront.normals.size()
+                            && (object.uv_indices[j] == WavefrontObject::NO_INDEX || object.uv_indices[j] < wavefront.uvs.size());
+                    }
+                    if (!is_valid_triangle) {
+                        invalid_triangle_count += 1;
+                        i += 2;
+                        continue;
+                    }
+                }
 
-                // Assume that indices hold in a 16 bit number
-                uint64_t index_id = position_index + (normal_index << 0x10) + (uv_index << 0x20);
+                uint32_t position_index = object.position_indices[i];
+                uint32_t normal_index = object.normal_indices[i];
+                uint32_t uv_index = object.uv_indices[i] == WavefrontObject::NO_INDEX ? missing_uv_index : object.uv_indices[i];
 
-                auto mapped_index = index_map.find(index_id);
-                if (mapped_index == index_map.end()) {
+                uint32_t vertex = weld_table.find_or_insert(position_index, normal_index, uv_index, vertex_count);
+                if (vertex == vertex_count) {
                     // Add the new vertex
                     glm::vec3 position = wavefront.positions[position_index];
                     glm::vec3 normal = wavefront.normals[normal_index];
@@ -147,57 +361,150 @@ namespace lixy {
                         uv.x,
                         uv.y,
                     });
+                    vertex_count += 1;
+                }
+                indices.push_back(vertex);
+            }
 
-                    if (object_indices.size() > object_index_buffer_size) {
-                        object_indices[object_index_buffer_size] = vertex_count;
-                    } else {
-                        object_indices.push_back(vertex_count);
-                    }
-                    object_index_buffer_size += 1;
+            surface.index_count = (uint32_t)indices.size() - surface.first_index;
+            surfaces.push_back(surface);
+        }
 
-                    index_map[index_id] = vertex_count;
-                    vertex_count += 1;
-                } else {
-                    if (object_indices.size() > object_index_buffer_size) {
-                        object_indices[object_index_buffer_size] = mapped_index->second;
-                    } else {
-                        object_indices.push_back(mapped_index->second);
-                    }
-                    object_index_buffer_size += 1;
+        if (invalid_triangle_count > 0) {
+            LOG_WARNING("Skipped " << invalid_triangle_count << " triangles with out of range indices in mesh at: `" << p_path << "`");
+        }
+
+        // Optimize every surface for the GPU, vertices are shared between surfaces and reordered once for all of them
+        const uint32_t vertex_stride = ObjMesh::get_vertex_buffer_layout().get_stride();
+        if (p_options.optimize) {
+            for (CookedMesh::Surface &surface : surfaces) {
+                uint32_t *surface_indices = indices.data() + surface.first_index;
+                VertexCacheStatistics before;
+                if (p_options.report_statistics) {
+                    before = MeshOptimizer::analyze_vertex_cache(surface_indices, surface.index_count, vertex_count);
+                }
+
+                MeshOptimizer::optimize_vertex_cache(surface_indices, surface.index_count, vertex_count);
+                MeshOptimizer::optimize_overdraw(surface_indices, surface.index_count, vertex_buffer.data(), vertex_stride, vertex_count);
+
+                if (p_options.report_statistics) {
+                    VertexCacheStatistics after = MeshOptimizer::analyze_vertex_cache(surface_indices, surface.index_count, vertex_count);
+                    LOG_WARNING("Surface " << &surface - surfaces.data() << " of `" << p_path.string() << "`: "
+                        << surface.index_count / 3 << " triangles, "
+                        << "ACMR " << before.acmr << " -> " << after.acmr << ", "
+                        << "ATVR " << before.atvr << " -> " << after.atvr);
                 }
             }
 
+            vertex_count = MeshOptimizer::optimize_vertex_fetch(vertex_buffer.data(), vertex_stride, vertex_count, indices.data(), indices.size());
+            vertex_buffer.resize(vertex_count * vertex_stride / sizeof(float));
+        }
+
+        // Every file the mesh was built from invalidates the cooked mesh when modified
+        std::vector<std::filesystem::path> sources = { p_path };
+        sources.insert(sources.end(), wavefront.material_libraries.begin(), wavefront.material_libraries.end());
+
+        if (!p_options.compact_vertices) {
+            return CookedMesh::cook(
+                sources,
+                ObjMesh::_get_import_flags(p_options),
+                CookedMesh::VertexFormat::POSITION_NORMAL_UV,
+                vertex_stride,
+                vertex_buffer.data(),
+                vertex_count,
+                indices,
+                surfaces
+            );
+        }
+
+        // Quantize positions over the bounds of the mesh
+        glm::vec3 bounds_min(std::numeric_limits<float>::max()), bounds_max(std::numeric_limits<float>::lowest());
+        for (uint32_t i = 0; i < vertex_count; i++) {
+            glm::vec3 position = glm::make_vec3(&vertex_buffer[i * 8]);
+            bounds_min = glm::min(bounds_min, position);
+            bounds_max = glm::max(bounds_max, position);
+        }
+        glm::vec3 position_offset = vertex_count > 0 ? bounds_min : glm::vec3(0.0);
+        glm::vec3 position_scale = glm::max(bounds_max - bounds_min, glm::vec3(std::numeric_limits<float>::min()));
+
+        std::vector<CompactVertex> compact_vertices(vertex_count);
+        for (uint32_t i = 0; i < vertex_count; i++) {
+            const float *vertex = &vertex_buffer[i * 8];
+            compact_vertices[i] = CompactVertex{
+                .position = glm::packUnorm4x16(glm::vec4((glm::make_vec3(vertex) - position_offset) / position_scale, 0.0)),
+                .normal = glm::packSnorm3x10_1x2(glm::vec4(glm::make_vec3(vertex + 3), 0.0)),
+                .uv = glm::packHalf2x16(glm::make_vec2(vertex + 6)),
+            };
+        }
+
+        return CookedMesh::cook(
+            sources,
+            ObjMesh::_get_import_flags(p_options),
+            CookedMesh::VertexFormat::COMPACT,
+            sizeof(CompactVertex),
+            compact_vertices.data(),
+            vertex_count,
+            indices,
+            surfaces,
+            position_offset,
+            position_scale
+        );
+    }
+
+
+    EntityRef ObjMesh::_create(flecs::world &p_world, const CookedMesh &p_cooked, const std::filesystem::path &p_path) {
+        EntityRef entity = EntityRef::create_reference(p_world).add<ObjMesh>();
+        ObjMesh *mesh = entity.get_mut<ObjMesh>();
+
+        mesh->geometry_arena = Renderer::get_singleton(p_world)->get_geometry_arena();
+
+        // Geometry is uploaded straight from the cooked mesh, which may be memory mapped
+        if (p_cooked.get_vertex_format() == CookedMesh::VertexFormat::COMPACT) {
+            mesh->vertices = mesh->geometry_arena->allocate_vertices(ObjMesh::get_compact_vertex_buffer_layout(), p_cooked.get_vertex_data(), p_cooked.get_vertex_count());
+            mesh->position_offset = p_cooked.get_position_offset();
+            mesh->position_scale = p_cooked.get_position_scale();
+            if (p_cooked.get_vertex_count() > 0) mesh->bounds = AABB{mesh->position_offset, mesh->position_offset + mesh->position_scale};
+        } else {
+            mesh->vertices = mesh->geometry_arena->allocate_vertices(ObjMesh::get_vertex_buffer_layout(), p_cooked.get_vertex_data(), p_cooked.get_vertex_count());
+
+            // Positions are the first member of every vertex
+            const char *vertex_data = static_cast<const char*>(p_cooked.get_vertex_data());
+            for (uint32_t i = 0; i < p_cooked.get_vertex_count(); i++) {
+                glm::vec3 position;
+                memcpy(&position, vertex_data + i * p_cooked.get_vertex_stride(), sizeof(position));
+                mesh->bounds.merge(position);
+            }
+        }
+
+        for (uint32_t i = 0; i < p_cooked.get_surface_count(); i++) {
+            CookedMesh::Surface cooked_surface = p_cooked.get_surface(i);
+
             // Create surface
-            Surface surface{};
+            MeshSurface surface{};
             
             surface.material = Renderer::get_singleton(p_world)->create_default_material(p_world);
             Material *material_component = surface.material.get_mut<Material>();
 
-            if (mat.has_diffuse_texture()) {
-                EntityRef texture = Texture::load_texture2d(p_world, mat.diffuse_texture.path);
+            if (!cooked_surface.diffuse_texture.empty()) {
+                EntityRef texture = Texture::load_texture2d(p_world, std::filesystem::path(cooked_surface.diffuse_texture));
                 material_component->set_uniform("u_albedo_texture", texture);
-                material_component->set_uniform("u_albedo_offset", mat.diffuse_texture.origin_offset);
-                material_component->set_uniform("u_albedo_scale", mat.diffuse_texture.scale);
+                material_component->set_uniform("u_albedo_offset", cooked_surface.diffuse_offset);
+                material_component->set_uniform("u_albedo_scale", cooked_surface.diffuse_scale);
             } else {
                 LOG_WARNING("No diffuse texture for mesh at: `" << p_path << "`");
             }
 
+            // Indices are rebased on the first vertex of the surface so that they fit on 16 bits more often
+            const uint32_t *surface_indices = p_cooked.get_index_data() + cooked_surface.first_index;
+            uint32_t base_vertex = cooked_surface.index_count > 0 ? *std::min_element(surface_indices, surface_indices + cooked_surface.index_count) : 0;
 
-            surface.indices = std::make_shared<opengl::IndexBuffer>(
-                object_indices.data(),
-                object_index_buffer_size
-            );
-            // mesh->vertex_array->add_index_buffer(surface.indices);
-            surface.index_count = object_index_buffer_size;
+            surface.vertices = mesh->vertices;
+            surface.indices = mesh->geometry_arena->allocate_indices(surface_indices, cooked_surface.index_count, base_vertex);
+            surface.index_count = cooked_surface.index_count;
+            surface.base_vertex = base_vertex;
             mesh->surfaces.push_back(std::move(surface));
         }
 
-        mesh->vertex_buffer = std::make_shared<opengl::VertexBuffer>(
-            vertex_buffer.data(),
-            vertex_buffer.size() * sizeof(float)
-        );
-        mesh->vertex_array->add_vertex_buffer(mesh->vertex_buffer, ObjMesh::get_vertex_buffer_layout());
-
         return entity;
     }
 
@@ -211,4 +518,15 @@ namespace lixy {
         static const opengl::BufferLayout vertex_buffer_layout(vertex_buffer_layout_array.data(), vertex_buffer_layout_array.size());
         return vertex_buffer_layout;
     }
-}
\ No newline at end of file
+
+
+    const opengl::BufferLayout &ObjMesh::get_compact_vertex_buffer_layout() {
+        static const std::array<opengl::ShaderDataType, 3> vertex_buffer_layout_array = {
+            opengl::ShaderDataType::UShort4Norm,
+            opengl::ShaderDataType::Int2101010Norm,
+            opengl::ShaderDataType::HalfVec2,
+        };
+        static const opengl::BufferLayout vertex_buffer_layout(vertex_buffer_layout_array.data(), vertex_buffer_layout_array.size());
+        return vertex_buffer_layout;
+    }
+}
@@ -18,8 +18,12 @@
 
 #pragma once
 
+#include "core/src/aabb.hpp"
 #include "core/src/ref.hpp"
 
+#include "renderer/src/draw_list.hpp"
+#include "renderer/src/geometry_arena.hpp"
+
 #include "primitives/shader.hpp"
 #include "primitives/vbuffer.hpp"
 
@@ -32,6 +36,9 @@
 
 namespace lixy {
 
+    class CookedMesh;
+
+
     struct Vertex {
         glm::vec3 vertex_pos;
         glm::vec2 uv;
@@ -40,57 +47,80 @@ namespace lixy {
     };
 
 
+    // Range of a mesh geometry drawn with one material
+    struct MeshSurface {
+        GeometryArena::Handle vertices; // May be shared with the other surfaces of the mesh
+        GeometryArena::Handle indices;
+        uint32_t index_count;
+        int32_t base_vertex; // Relative to the vertex allocation
+
+        EntityRef material;
+    };
+
+
     class ArrayMesh {
     public:
-        void record_draw(const glm::mat4 &p_projection, const glm::mat4 &p_view, const glm::mat4 &p_model) const;
-        void add_surface(const std::vector<Vertex> &p_vertices, const std::vector<uint32_t> &p_indices, const EntityRef &p_material);
+        void record_draws(const InstanceBatch &p_batch, DrawList &p_draw_list) const;
+        void add_surface(const std::vector<Vertex> &p_vertices, const std::vector<uint32_t> &p_indices, const EntityRef &p_material, bool p_optimize = false);
+        inline const AABB &get_bounds() const { return bounds; } // Local space, of every surface
 
         static EntityRef create(flecs::world &p_world);
 
         ArrayMesh() = default;
-        ArrayMesh(ArrayMesh&&) = default;
-        ArrayMesh &operator=(ArrayMesh&&) = default;
-        virtual ~ArrayMesh() = default;
+        ArrayMesh(ArrayMesh &&p_other);
+        ArrayMesh &operator=(ArrayMesh &&p_other);
+        virtual ~ArrayMesh();
 
     private:
-        struct Surface {
-            std::shared_ptr<opengl::VertexBuffer> vertex_buffer;
-            std::shared_ptr<opengl::IndexBuffer> index_buffer;
-            opengl::VertexArrayBuffer vertex_array;
-            uint32_t index_count;
-
-            EntityRef material;
-        };
+        void _free_geometry();
 
     private:
-        std::vector<Surface> surfaces;
+        std::shared_ptr<GeometryArena> geometry_arena;
+        std::vector<MeshSurface> surfaces;
+        AABB bounds;
+    };
+
+
+    struct ObjImportOptions {
+        bool use_cache = true; // Load from and save to a cooked mesh next to the source file
+        bool optimize = true; // Reorder triangles and vertices for the vertex cache, overdraw and vertex fetch
+        bool compact_vertices = true; // Quantize positions and pack normals and uvs, halving the vertex size
+        bool report_statistics = false; // Log the vertex cache statistics of every surface when cooking
     };
 
 
     class ObjMesh {
     public:
-        void record_draw(const glm::mat4 &p_projection, const glm::mat4 &p_view, const glm::mat4 &p_model) const;
+        void record_draws(const InstanceBatch &p_batch, DrawList &p_draw_list) const;
+
+        inline const glm::vec3 &get_position_offset() const { return position_offset; }
+        inline const glm::vec3 &get_position_scale() const { return position_scale; }
+        inline const AABB &get_bounds() const { return bounds; } // Local space, computed at load time
 
-        static EntityRef load(flecs::world &p_world, const std::filesystem::path &p_path);
+        static EntityRef load(flecs::world &p_world, const std::filesystem::path &p_path, const ObjImportOptions &p_options = ObjImportOptions());
 
         ObjMesh() = default;
-        ObjMesh(ObjMesh&&) = default;
-        ObjMesh &operator=(ObjMesh&&) = default;
-        virtual ~ObjMesh() = default;
+        ObjMesh(ObjMesh &&p_other);
+        ObjMesh &operator=(ObjMesh &&p_other);
+        virtual ~ObjMesh();
 
-    private:
-        struct Surface {
-            EntityRef material;
-            std::shared_ptr<opengl::IndexBuffer> indices;
-            uint32_t index_count;
-        };
-    
     private:
         static const opengl::BufferLayout &get_vertex_buffer_layout();
+        static const opengl::BufferLayout &get_compact_vertex_buffer_layout();
+
+        static uint32_t _get_import_flags(const ObjImportOptions &p_options);
+        static CookedMesh _cook(const std::filesystem::path &p_path, const ObjImportOptions &p_options);
+        static EntityRef _create(flecs::world &p_world, const CookedMesh &p_cooked, const std::filesystem::path &p_path);
+
+        void _free_geometry();
 
     private:
-        std::unique_ptr<opengl::VertexArrayBuffer> vertex_array;
-        std::shared_ptr<opengl::VertexBuffer> vertex_buffer;
-        std::vector<Surface> surfaces;
+        std::shared_ptr<GeometryArena> geometry_arena;
+        GeometryArena::Handle vertices = GeometryArena::INVALID_HANDLE; // Shared by every surface
+        std::vector<MeshSurface> surfaces;
+
+        glm::vec3 position_offset = glm::vec3(0.0); // Dequantization of compact vertex positions
+        glm::vec3 position_scale = glm::vec3(1.0);
+        AABB bounds;
     };
 }
\ No newline at end of file
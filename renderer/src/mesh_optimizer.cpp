@@ -0,0 +1,295 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "mesh_optimizer.hpp"
+
+#include "thirdparty/glm/glm.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+
+namespace lixy {
+
+    // Triangles using every vertex, stored contiguously per vertex
+    struct TriangleAdjacency {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> counts;
+        std::vector<uint32_t> triangles;
+
+        TriangleAdjacency(const uint32_t *p_indices, size_t p_index_count, size_t p_vertex_count)
+            : offsets(p_vertex_count), counts(p_vertex_count, 0), triangles(p_index_count)
+        {
+            for (size_t i = 0; i < p_index_count; i++) counts[p_indices[i]]++;
+
+            uint32_t offset = 0;
+            for (size_t v = 0; v < p_vertex_count; v++) {
+                offsets[v] = offset;
+                offset += counts[v];
+            }
+
+            std::vector<uint32_t> fill = offsets;
+            for (size_t i = 0; i < p_index_count; i++) {
+                triangles[fill[p_indices[i]]++] = (uint32_t)(i / 3);
+            }
+        }
+    };
+
+
+    // Picks the next fanning vertex of Tipsify: the candidate that will still be in the cache after its remaining
+    // triangles are emitted and entered the cache the earliest, otherwise a dead end or the next vertex with triangles left
+    static int64_t _get_next_fanning_vertex(
+        const std::vector<uint32_t> &p_candidates,
+        const std::vector<uint32_t> &p_live_triangles,
+        const std::vector<uint32_t> &p_cache_time,
+        uint32_t p_time,
+        std::vector<uint32_t> &p_dead_ends,
+        size_t &p_scan_cursor
+    ) {
+        int64_t best_vertex = -1;
+        int64_t best_priority = -1;
+        for (uint32_t vertex : p_candidates) {
+            if (p_live_triangles[vertex] == 0) continue;
+
+            int64_t priority = 0;
+            if (p_time - p_cache_time[vertex] + 2 * p_live_triangles[vertex] <= MeshOptimizer::CACHE_SIZE) {
+                priority = p_time - p_cache_time[vertex];
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                best_vertex = vertex;
+            }
+        }
+        if (best_vertex >= 0) return best_vertex;
+
+        while (!p_dead_ends.empty()) {
+            uint32_t vertex = p_dead_ends.back();
+            p_dead_ends.pop_back();
+            if (p_live_triangles[vertex] > 0) return vertex;
+        }
+
+        for (; p_scan_cursor < p_live_triangles.size(); p_scan_cursor++) {
+            if (p_live_triangles[p_scan_cursor] > 0) return p_scan_cursor;
+        }
+        return -1;
+    }
+
+
+    void MeshOptimizer::optimize_vertex_cache(uint32_t *p_indices, size_t p_index_count, size_t p_vertex_count) {
+        size_t triangle_count = p_index_count / 3;
+        if (triangle_count == 0) return;
+
+        TriangleAdjacency adjacency(p_indices, triangle_count * 3, p_vertex_count);
+        std::vector<uint32_t> live_triangles = adjacency.counts;
+        std::vector<uint32_t> cache_time(p_vertex_count, 0);
+        std::vector<bool> is_emitted(triangle_count, false);
+        std::vector<uint32_t> dead_ends;
+        std::vector<uint32_t> candidates;
+
+        std::vector<uint32_t> output;
+        output.reserve(triangle_count * 3);
+
+        uint32_t time = CACHE_SIZE + 1;
+        size_t scan_cursor = 0;
+        int64_t fanning_vertex = p_indices[0];
+
+        while (fanning_vertex >= 0) {
+            candidates.clear();
+
+            const uint32_t *triangles = adjacency.triangles.data() + adjacency.offsets[fanning_vertex];
+            for (uint32_t i = 0; i < adjacency.counts[fanning_vertex]; i++) {
+                uint32_t triangle = triangles[i];
+                if (is_emitted[triangle]) continue;
+
+                for (int j = 0; j < 3; j++) {
+                    uint32_t vertex = p_indices[triangle * 3 + j];
+                    output.push_back(vertex);
+                    dead_ends.push_back(vertex);
+                    candidates.push_back(vertex);
+                    live_triangles[vertex]--;
+
+                    if (time - cache_time[vertex] > CACHE_SIZE) {
+                        cache_time[vertex] = time++;
+                    }
+                }
+                is_emitted[triangle] = true;
+            }
+
+            fanning_vertex = _get_next_fanning_vertex(candidates, live_triangles, cache_time, time, dead_ends, scan_cursor);
+        }
+
+        memcpy(p_indices, output.data(), output.size() * sizeof(uint32_t));
+    }
+
+
+    void MeshOptimizer::optimize_overdraw(
+        uint32_t *p_indices,
+        size_t p_index_count,
+        const float *p_positions,
+        size_t p_vertex_stride,
+        size_t p_vertex_count,
+        float p_threshold
+    ) {
+        size_t triangle_count = p_index_count / 3;
+        if (triangle_count == 0) return;
+
+        auto get_position = [&](uint32_t p_vertex) {
+            const float *position = reinterpret_cast<const float*>(reinterpret_cast<const char*>(p_positions) + p_vertex * p_vertex_stride);
+            return glm::vec3(position[0], position[1], position[2]);
+        };
+
+        // Hard boundaries: triangles missing all three vertices start a new strip in the vertex cache order
+        std::vector<uint32_t> cache_time(p_vertex_count, 0);
+        uint32_t time = CACHE_SIZE + 1;
+        auto count_misses = [&](size_t p_triangle) {
+            uint32_t misses = 0;
+            for (int j = 0; j < 3; j++) {
+                uint32_t vertex = p_indices[p_triangle * 3 + j];
+                if (time - cache_time[vertex] > CACHE_SIZE) {
+                    cache_time[vertex] = time++;
+                    misses++;
+                }
+            }
+            return misses;
+        };
+
+        std::vector<size_t> hard_boundaries;
+        for (size_t t = 0; t < triangle_count; t++) {
+            if (count_misses(t) == 3) hard_boundaries.push_back(t);
+        }
+        hard_boundaries.push_back(triangle_count);
+
+        // Soft boundaries: split a hard cluster once the part drawn so far is about as cache efficient as the whole
+        std::vector<size_t> clusters; // First triangle of every cluster
+        for (size_t h = 0; h + 1 < hard_boundaries.size(); h++) {
+            size_t begin = hard_boundaries[h], end = hard_boundaries[h + 1];
+
+            time += CACHE_SIZE + 1;
+            uint32_t cluster_misses = 0;
+            for (size_t t = begin; t < end; t++) cluster_misses += count_misses(t);
+            float cluster_acmr = (float)cluster_misses / (end - begin);
+
+            time += CACHE_SIZE + 1;
+            clusters.push_back(begin);
+            uint32_t misses = 0;
+            for (size_t t = begin, start = begin; t < end; t++) {
+                misses += count_misses(t);
+                if (t + 1 < end && (float)misses / (t + 1 - start) <= cluster_acmr * p_threshold) {
+                    start = t + 1;
+                    misses = 0;
+                    clusters.push_back(start);
+                    time += CACHE_SIZE + 1; // The next cluster may be drawn anywhere, start with a cold cache
+                }
+            }
+        }
+        clusters.push_back(triangle_count);
+
+        // Sort clusters by how far out they face from the center of the mesh
+        size_t cluster_count = clusters.size() - 1;
+        std::vector<glm::vec3> centroids(cluster_count), normals(cluster_count);
+        glm::vec3 mesh_centroid(0.0f);
+        float mesh_area = 0.0f;
+
+        for (size_t c = 0; c < cluster_count; c++) {
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+                glm::vec3 p0 = get_position(p_indices[t * 3]), p1 = get_position(p_indices[t * 3 + 1]), p2 = get_position(p_indices[t * 3 + 2]);
+                glm::vec3 face_normal = glm::cross(p1 - p0, p2 - p0);
+                float face_area = glm::length(face_normal);
+
+                centroid += (p0 + p1 + p2) * (face_area / 3.0f);
+                normal += face_normal;
+                area += face_area;
+            }
+
+            centroids[c] = area > 0.0f ? centroid / area : get_position(p_indices[clusters[c] * 3]);
+            float normal_length = glm::length(normal);
+            normals[c] = normal_length > 0.0f ? normal / normal_length : glm::vec3(0.0f);
+
+            mesh_centroid += centroid;
+            mesh_area += area;
+        }
+        if (mesh_area > 0.0f) mesh_centroid /= mesh_area;
+
+        std::vector<float> sort_keys(cluster_count);
+        for (size_t c = 0; c < cluster_count; c++) {
+            sort_keys[c] = glm::dot(centroids[c] - mesh_centroid, normals[c]);
+        }
+
+        std::vector<uint32_t> order(cluster_count);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&sort_keys](uint32_t a, uint32_t b) { return sort_keys[a] > sort_keys[b]; });
+
+        std::vector<uint32_t> output;
+        output.reserve(triangle_count * 3);
+        for (uint32_t c : order) {
+            output.insert(output.end(), p_indices + clusters[c] * 3, p_indices + clusters[c + 1] * 3);
+        }
+        memcpy(p_indices, output.data(), output.size() * sizeof(uint32_t));
+    }
+
+
+    size_t MeshOptimizer::optimize_vertex_fetch(void *p_vertices, size_t p_vertex_stride, size_t p_vertex_count, uint32_t *p_indices, size_t p_index_count) {
+        std::vector<uint32_t> remap(p_vertex_count, UINT32_MAX);
+        std::vector<char> vertices(p_vertex_count * p_vertex_stride);
+        const char *source = static_cast<const char*>(p_vertices);
+
+        uint32_t vertex_count = 0;
+        for (size_t i = 0; i < p_index_count; i++) {
+            uint32_t &vertex = remap[p_indices[i]];
+            if (vertex == UINT32_MAX) {
+                vertex = vertex_count++;
+                memcpy(vertices.data() + vertex * p_vertex_stride, source + p_indices[i] * p_vertex_stride, p_vertex_stride);
+            }
+            p_indices[i] = vertex;
+        }
+
+        memcpy(p_vertices, vertices.data(), vertex_count * p_vertex_stride);
+        return vertex_count;
+    }
+
+
+    VertexCacheStatistics MeshOptimizer::analyze_vertex_cache(const uint32_t *p_indices, size_t p_index_count, size_t p_vertex_count, uint32_t p_cache_size) {
+        VertexCacheStatistics statistics;
+        if (p_index_count < 3) return statistics;
+
+        std::vector<uint32_t> cache_time(p_vertex_count, 0);
+        std::vector<bool> is_referenced(p_vertex_count, false);
+        uint32_t time = p_cache_size + 1;
+        uint32_t referenced_count = 0;
+
+        for (size_t i = 0; i < p_index_count; i++) {
+            uint32_t vertex = p_indices[i];
+            if (time - cache_time[vertex] > p_cache_size) {
+                cache_time[vertex] = time++;
+                statistics.vertices_transformed++;
+            }
+            if (!is_referenced[vertex]) {
+                is_referenced[vertex] = true;
+                referenced_count++;
+            }
+        }
+
+        statistics.acmr = (float)statistics.vertices_transformed / (p_index_count / 3);
+        statistics.atvr = (float)statistics.vertices_transformed / referenced_count;
+        return statistics;
+    }
+}
@@ -0,0 +1,63 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace lixy {
+
+    // Post-transform vertex cache behaviour of an index buffer, simulated with a FIFO cache
+    struct VertexCacheStatistics {
+        uint32_t vertices_transformed = 0; // Cache misses
+        float acmr = 0.0f; // Average cache miss ratio, transformed vertices per triangle, 0.5 at best
+        float atvr = 0.0f; // Average transform to vertex ratio, transformed vertices per referenced vertex, 1.0 at best
+    };
+
+
+    // Reorders triangle lists for the GPU, every function works in place on an index buffer referencing
+    // `p_vertex_count` vertices. Run optimize_vertex_cache, then optimize_overdraw, then optimize_vertex_fetch.
+    class MeshOptimizer {
+    public:
+        static constexpr uint32_t CACHE_SIZE = 16;
+        static constexpr float OVERDRAW_THRESHOLD = 1.05f; // Tolerated vertex cache degradation when splitting clusters
+
+    public:
+        // Orders triangles to maximise post-transform vertex cache hits, using Tipsify
+        static void optimize_vertex_cache(uint32_t *p_indices, size_t p_index_count, size_t p_vertex_count);
+
+        // Splits an optimize_vertex_cache output into clusters and draws the outward facing clusters first,
+        // so that they occlude the rest of the mesh. `p_positions` points to the first vertex position.
+        static void optimize_overdraw(
+            uint32_t *p_indices,
+            size_t p_index_count,
+            const float *p_positions,
+            size_t p_vertex_stride,
+            size_t p_vertex_count,
+            float p_threshold = OVERDRAW_THRESHOLD
+        );
+
+        // Reorders vertices by first use and drops the unreferenced ones, returns the new vertex count
+        static size_t optimize_vertex_fetch(void *p_vertices, size_t p_vertex_stride, size_t p_vertex_count, uint32_t *p_indices, size_t p_index_count);
+
+        static VertexCacheStatistics analyze_vertex_cache(const uint32_t *p_indices, size_t p_index_count, size_t p_vertex_count, uint32_t p_cache_size = CACHE_SIZE);
+    };
+}
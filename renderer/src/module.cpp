@@ -19,7 +19,6 @@
 #include "module.hpp"
 
 #include "core/src/module.hpp"
-#include "renderer/src/framebuffer.hpp"
 #include "renderer/src/light.hpp"
 #include "renderer/src/material.hpp"
 #include "renderer/src/mesh.hpp"
@@ -44,12 +43,15 @@ namespace lixy {
         p_world.add<Texture>();
         p_world.add<MeshInstance>();
         p_world.add<Visible>();
-        p_world.add<Framebuffer>();
         p_world.add<PointLight>();
+        p_world.component<SceneTreeProxy>(); // Not added to the world, it would be a proxy without tree
+        p_world.component<LightSlot>(); // Not added either, slots are given by the light manager
 
-        // Initialize renderer singleton
-        flecs::entity rd = p_world.entity<Renderer>();
+        p_world.component<RendererOptions>();
+
+        // Initialize renderer singleton, registered as a component first so that flecs constructs it before assigning it
+        p_world.component<Renderer>();
         p_world.set<Renderer>(Renderer());
-        p_world.get_mut<Renderer>()->_initialize(p_world, rd);
+        p_world.get_mut<Renderer>()->_initialize(p_world);
     }
 }
\ No newline at end of file
@@ -0,0 +1,342 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "occlusion_culler.hpp"
+
+#include "debug/debug.hpp"
+#include "renderer/src/draw_list.hpp"
+#include "renderer/src/primitives/context.hpp"
+#include "renderer/src/primitives/shader.hpp"
+#include "renderer/src/primitives/vbuffer.hpp"
+
+#include "thirdparty/glad/include/glad/glad.h"
+
+#include <algorithm>
+
+
+namespace lixy {
+
+    static constexpr uint32_t PYRAMID_GROUP_SIZE = 8; // Work groups of the reductions are 8x8 texels
+    static constexpr uint32_t CULL_GROUP_SIZE = 64;
+
+    // Body of the reductions, `fetch` reads the source level and clamps to its size. Every texel takes the maximum of
+    // the 2x2 source texels it covers, the last row and column also take the texels left over by odd source sizes.
+    static const std::string REDUCE_MAIN =
+        "void main() {"
+        "    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);"
+        "    ivec2 size = imageSize(u_destination);"
+        "    if (any(greaterThanEqual(texel, size))) return;"
+        ""
+        "    ivec2 first = texel * 2;"
+        "    ivec2 last = first + 1;"
+        "    if (texel.x == size.x - 1) last.x = u_source_size.x - 1;"
+        "    if (texel.y == size.y - 1) last.y = u_source_size.y - 1;"
+        ""
+        "    float depth = 0.0;"
+        "    for (int y = first.y; y <= last.y; y++) {"
+        "        for (int x = first.x; x <= last.x; x++) depth = max(depth, fetch(ivec2(x, y)));"
+        "    }"
+        "    imageStore(u_destination, texel, vec4(depth));"
+        "}";
+
+    static const std::string REDUCE_DEPTH_SHADER =
+        "#version 430 core\n"
+        "layout(local_size_x = 8, local_size_y = 8) in;" // PYRAMID_GROUP_SIZE
+        ""
+        "uniform sampler2D u_depth;"
+        "uniform ivec2 u_source_size;"
+        "layout(r32f, binding = 0) writeonly uniform image2D u_destination;"
+        ""
+        "float fetch(ivec2 p_texel) {"
+        "    return texelFetch(u_depth, min(p_texel, u_source_size - 1), 0).r;"
+        "}"
+        + REDUCE_MAIN;
+
+    static const std::string REDUCE_PYRAMID_SHADER =
+        "#version 430 core\n"
+        "layout(local_size_x = 8, local_size_y = 8) in;" // PYRAMID_GROUP_SIZE
+        ""
+        "uniform ivec2 u_source_size;"
+        "layout(r32f, binding = 0) writeonly uniform image2D u_destination;"
+        "layout(r32f, binding = 1) readonly uniform image2D u_source;"
+        ""
+        "float fetch(ivec2 p_texel) {"
+        "    return imageLoad(u_source, min(p_texel, u_source_size - 1)).r;"
+        "}"
+        + REDUCE_MAIN;
+
+    static const std::string CULL_SHADER =
+        "#version 430 core\n"
+        "layout(local_size_x = 64) in;" // CULL_GROUP_SIZE
+        ""
+        "struct Instance {" // InstanceData
+        "    mat4 model;"
+        "    vec4 position_offset;"
+        "    vec4 position_scale;"
+        "};"
+        ""
+        "struct Batch {" // OcclusionCuller::Batch
+        "    vec3 bounds_min;"
+        "    uint first_instance;"
+        "    vec3 bounds_max;"
+        "    uint visible_count;"
+        "};"
+        ""
+        "layout(std430, binding = 0) readonly buffer Instances { Instance instances[]; };"
+        "layout(std430, binding = 1) writeonly buffer VisibleInstances { Instance visible_instances[]; };"
+        "layout(std430, binding = 2) buffer Batches { Batch batches[]; };"
+        "layout(std430, binding = 3) readonly buffer InstanceBatches { uint instance_batches[]; };"
+        ""
+        "uniform int u_instance_count;"
+        "uniform mat4 u_view_projection;" // Of the frame the pyramid was built from
+        "uniform ivec2 u_depth_size;"
+        "uniform int u_pyramid_level_count;" // 0 when there is no pyramid to test against
+        "uniform sampler2D u_pyramid;"
+        ""
+        "bool is_occluded(mat4 p_model, vec3 p_min, vec3 p_max) {"
+        "    if (u_pyramid_level_count == 0 || any(greaterThan(p_min, p_max))) return false;"
+        ""
+        "    mat4 model_view_projection = u_view_projection * p_model;"
+        "    vec3 ndc_min = vec3(1e30);"
+        "    vec3 ndc_max = vec3(-1e30);"
+        "    for (int i = 0; i < 8; i++) {"
+        "        vec3 corner = vec3((i & 1) != 0 ? p_max.x : p_min.x, (i & 2) != 0 ? p_max.y : p_min.y, (i & 4) != 0 ? p_max.z : p_min.z);"
+        "        vec4 clip = model_view_projection * vec4(corner, 1.0);"
+        "        if (clip.w <= 0.0) return false;" // Behind the camera, the projected box would be wrong
+        "        vec3 ndc = clip.xyz / clip.w;"
+        "        ndc_min = min(ndc_min, ndc);"
+        "        ndc_max = max(ndc_max, ndc);"
+        "    }"
+        ""
+        "    if (ndc_min.z < -1.0) return false;" // Crosses the near plane
+        "    if (any(lessThan(ndc_max.xy, vec2(-1.0))) || any(greaterThan(ndc_min.xy, vec2(1.0)))) return false;" // Out of the view of the pyramid
+        ""
+        "    ivec2 pixel_min = clamp(ivec2((ndc_min.xy * 0.5 + 0.5) * vec2(u_depth_size)), ivec2(0), u_depth_size - 1);"
+        "    ivec2 pixel_max = clamp(ivec2((ndc_max.xy * 0.5 + 0.5) * vec2(u_depth_size)), ivec2(0), u_depth_size - 1);"
+        ""
+        // Texels of level n cover 2^(n + 1) depth pixels, take the first level where the box covers at most 2x2 texels
+        "    int level = 0;"
+        "    while (level < u_pyramid_level_count - 1 && any(greaterThan((pixel_max >> (level + 1)) - (pixel_min >> (level + 1)), ivec2(1)))) level++;"
+        ""
+        // Level sizes are not queried with textureSize, llvmpipe returns the size of a single level for the whole
+        // group when the level differs between invocations
+        "    ivec2 level_size = max((u_depth_size / 2) >> level, ivec2(1));"
+        "    ivec2 texel_min = min(pixel_min >> (level + 1), level_size - 1);"
+        "    ivec2 texel_max = min(pixel_max >> (level + 1), level_size - 1);"
+        "    float depth = max("
+        "        max(texelFetch(u_pyramid, texel_min, level).r, texelFetch(u_pyramid, ivec2(texel_max.x, texel_min.y), level).r),"
+        "        max(texelFetch(u_pyramid, ivec2(texel_min.x, texel_max.y), level).r, texelFetch(u_pyramid, texel_max, level).r)"
+        "    );"
+        ""
+        // The bias keeps surfaces lying on their bounds, like the faces of a box, from occluding themselves
+        "    return ndc_min.z * 0.5 + 0.5 > depth + 1e-6;"
+        "}"
+        ""
+        "void main() {"
+        "    int index = int(gl_GlobalInvocationID.x);"
+        "    if (index >= u_instance_count) return;"
+        ""
+        "    uint batch = instance_batches[index];"
+        "    Instance instance = instances[index];"
+        "    if (is_occluded(instance.model, batches[batch].bounds_min, batches[batch].bounds_max)) return;"
+        ""
+        "    uint slot = atomicAdd(batches[batch].visible_count, 1u);"
+        "    visible_instances[batches[batch].first_instance + slot] = instance;"
+        "}";
+
+    static const std::string WRITE_COUNTS_SHADER =
+        "#version 430 core\n"
+        "layout(local_size_x = 64) in;" // CULL_GROUP_SIZE
+        ""
+        "struct Command {" // opengl::DrawElementsIndirectCommand
+        "    uint count;"
+        "    uint instance_count;"
+        "    uint first_index;"
+        "    int base_vertex;"
+        "    uint base_instance;"
+        "};"
+        ""
+        "struct Batch {"
+        "    vec3 bounds_min;"
+        "    uint first_instance;"
+        "    vec3 bounds_max;"
+        "    uint visible_count;"
+        "};"
+        ""
+        "layout(std430, binding = 2) readonly buffer Batches { Batch batches[]; };"
+        "layout(std430, binding = 3) readonly buffer InstanceBatches { uint instance_batches[]; };"
+        "layout(std430, binding = 4) buffer Commands { Command commands[]; };"
+        ""
+        "uniform int u_command_count;"
+        ""
+        "void main() {"
+        "    int index = int(gl_GlobalInvocationID.x);"
+        "    if (index >= u_command_count) return;"
+        ""
+        "    commands[index].instance_count = batches[instance_batches[commands[index].base_instance]].visible_count;"
+        "}";
+
+
+    static void _delete_texture(uint32_t p_texture) {
+        if (opengl::StateCache *state = opengl::OpenGLContext::find_state()) state->forget_texture(p_texture);
+        glDeleteTextures(1, &p_texture);
+    }
+
+
+    static uint32_t _get_group_count(uint32_t p_count, uint32_t p_group_size) {
+        return (p_count + p_group_size - 1) / p_group_size;
+    }
+
+
+    void OcclusionCuller::build_pyramid(uint32_t p_depth_texture, uint32_t p_width, uint32_t p_height, const glm::mat4 &p_view_projection) {
+        if (p_width == 0 || p_height == 0) {
+            clear_pyramid();
+            return;
+        }
+
+        if (p_width != depth_width || p_height != depth_height) _resize_pyramid(p_width, p_height);
+
+        opengl::StateCache &state = opengl::OpenGLContext::get_state();
+        uint32_t source_width = p_width, source_height = p_height;
+        for (uint32_t level = 0; level < pyramid_level_count; level++) {
+            uint32_t width = std::max(source_width / 2, 1u), height = std::max(source_height / 2, 1u);
+
+            glBindImageTexture(0, pyramid_texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            if (level == 0) {
+                reduce_depth_program->bind();
+                state.bind_texture(0, p_depth_texture);
+                reduce_depth_program->bind_uniform(reduce_depth_texture, 0);
+                reduce_depth_program->bind_uniform(reduce_depth_size, glm::ivec2(source_width, source_height));
+                reduce_depth_program->dispatch(_get_group_count(width, PYRAMID_GROUP_SIZE), _get_group_count(height, PYRAMID_GROUP_SIZE));
+            } else {
+                glBindImageTexture(1, pyramid_texture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+                reduce_pyramid_program->bind();
+                reduce_pyramid_program->bind_uniform(reduce_pyramid_size, glm::ivec2(source_width, source_height));
+                reduce_pyramid_program->dispatch(_get_group_count(width, PYRAMID_GROUP_SIZE), _get_group_count(height, PYRAMID_GROUP_SIZE));
+            }
+            if (level + 1 < pyramid_level_count) glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+            source_width = width;
+            source_height = height;
+        }
+
+        pyramid_view_projection = p_view_projection;
+        pyramid_valid = true;
+    }
+
+
+    void OcclusionCuller::clear_pyramid() {
+        pyramid_valid = false;
+    }
+
+
+    opengl::ShaderStorageBuffer::Slice OcclusionCuller::cull(const opengl::ShaderStorageBuffer::Slice &p_instances, const std::vector<Batch> &p_batches, const std::vector<uint32_t> &p_instance_batches) {
+        uint32_t instance_count = p_instance_batches.size();
+        uint32_t visible_size = instance_count * sizeof(InstanceData);
+
+        _upload(batch_storage, p_batches.size() * sizeof(Batch), p_batches.data());
+        _upload(instance_batch_storage, instance_count * sizeof(uint32_t), p_instance_batches.data());
+        _upload(visible_instance_storage, visible_size, nullptr);
+        if (instance_count == 0) return visible_instance_storage.slice(0, 0);
+
+        p_instances.bind_to_location(INSTANCES_BINDING);
+        visible_instance_storage.slice(0, visible_size).bind_to_location(VISIBLE_INSTANCES_BINDING);
+        batch_storage.slice(0, p_batches.size() * sizeof(Batch)).bind_to_location(BATCHES_BINDING);
+        instance_batch_storage.slice(0, instance_count * sizeof(uint32_t)).bind_to_location(INSTANCE_BATCHES_BINDING);
+
+        cull_program->bind();
+        if (pyramid_valid) opengl::OpenGLContext::get_state().bind_texture(0, pyramid_texture);
+        cull_program->bind_uniform(cull_instance_count, (int)instance_count);
+        cull_program->bind_uniform(cull_view_projection, pyramid_view_projection);
+        cull_program->bind_uniform(cull_depth_size, glm::ivec2(depth_width, depth_height));
+        cull_program->bind_uniform(cull_pyramid_level_count, pyramid_valid ? (int)pyramid_level_count : 0);
+        cull_program->bind_uniform(cull_pyramid, 0);
+        cull_program->dispatch(_get_group_count(instance_count, CULL_GROUP_SIZE));
+
+        // The counts are read by the next pass, the instances by the vertex shaders
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        return visible_instance_storage.slice(0, visible_size);
+    }
+
+
+    void OcclusionCuller::write_instance_counts(const opengl::DrawIndirectBuffer &p_commands, uint32_t p_command_count) {
+        if (p_command_count == 0) return;
+
+        p_commands.bind_to_storage_location(COMMANDS_BINDING);
+
+        write_counts_program->bind();
+        write_counts_program->bind_uniform(write_counts_command_count, (int)p_command_count);
+        write_counts_program->dispatch(_get_group_count(p_command_count, CULL_GROUP_SIZE));
+
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+    }
+
+
+    OcclusionCuller::OcclusionCuller() {
+        reduce_depth_program = std::make_unique<opengl::ShaderProgram>(REDUCE_DEPTH_SHADER);
+        ASSERT_FATAL_ERROR(reduce_depth_program->is_valid(), "The depth reduction shader is invalid: " << reduce_depth_program->get_errors());
+        reduce_pyramid_program = std::make_unique<opengl::ShaderProgram>(REDUCE_PYRAMID_SHADER);
+        ASSERT_FATAL_ERROR(reduce_pyramid_program->is_valid(), "The pyramid reduction shader is invalid: " << reduce_pyramid_program->get_errors());
+        cull_program = std::make_unique<opengl::ShaderProgram>(CULL_SHADER);
+        ASSERT_FATAL_ERROR(cull_program->is_valid(), "The occlusion culling shader is invalid: " << cull_program->get_errors());
+        write_counts_program = std::make_unique<opengl::ShaderProgram>(WRITE_COUNTS_SHADER);
+        ASSERT_FATAL_ERROR(write_counts_program->is_valid(), "The instance count shader is invalid: " << write_counts_program->get_errors());
+
+        reduce_depth_size = reduce_depth_program->get_uniform_handle<glm::ivec2>("u_source_size");
+        reduce_depth_texture = reduce_depth_program->get_uniform_handle<int>("u_depth");
+        reduce_pyramid_size = reduce_pyramid_program->get_uniform_handle<glm::ivec2>("u_source_size");
+        cull_instance_count = cull_program->get_uniform_handle<int>("u_instance_count");
+        cull_view_projection = cull_program->get_uniform_handle<glm::mat4>("u_view_projection");
+        cull_depth_size = cull_program->get_uniform_handle<glm::ivec2>("u_depth_size");
+        cull_pyramid_level_count = cull_program->get_uniform_handle<int>("u_pyramid_level_count");
+        cull_pyramid = cull_program->get_uniform_handle<int>("u_pyramid");
+        write_counts_command_count = write_counts_program->get_uniform_handle<int>("u_command_count");
+    }
+
+
+    OcclusionCuller::~OcclusionCuller() {
+        if (pyramid_texture) _delete_texture(pyramid_texture);
+    }
+
+
+    void OcclusionCuller::_upload(opengl::ShaderStorageBuffer &p_storage, uint32_t p_size, const void *p_data) {
+        uint32_t storage_size = p_storage.get_size();
+        if (storage_size < p_size) storage_size = std::max(p_size, 2 * storage_size);
+        if (storage_size == 0) return;
+
+        p_storage.allocate(storage_size); // Orphan the previous frame storage instead of waiting for it
+        if (p_data && p_size) p_storage.write_data(0, p_size, p_data);
+    }
+
+
+    void OcclusionCuller::_resize_pyramid(uint32_t p_width, uint32_t p_height) {
+        if (pyramid_texture) _delete_texture(pyramid_texture);
+
+        uint32_t width = std::max(p_width / 2, 1u), height = std::max(p_height / 2, 1u);
+        pyramid_level_count = 1;
+        for (uint32_t size = std::max(width, height); size > 1; size /= 2) pyramid_level_count++;
+
+        glCreateTextures(GL_TEXTURE_2D, 1, &pyramid_texture);
+        glTextureStorage2D(pyramid_texture, pyramid_level_count, GL_R32F, width, height);
+        glTextureParameteri(pyramid_texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTextureParameteri(pyramid_texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        depth_width = p_width;
+        depth_height = p_height;
+        pyramid_valid = false;
+    }
+}
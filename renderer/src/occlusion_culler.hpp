@@ -0,0 +1,105 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+
+#include "renderer/src/primitives/shader.hpp"
+#include "renderer/src/primitives/vbuffer.hpp"
+
+#include "thirdparty/glm/glm.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+namespace lixy {
+
+    // GPU occlusion culling of instanced draws against a hierarchical depth buffer. After the geometry pass, the depth
+    // buffer is reduced into a pyramid whose texels hold the farthest depth they cover. The next frame, a compute pass
+    // projects the bounds of every instance with the view projection of the pyramid and compares their closest depth
+    // with the level where they cover at most 2x2 texels. Instances that pass are compacted per batch, then a second
+    // pass writes the visible count of each batch into the indirect draw commands.
+    // Culling lags one frame behind: an instance revealed by a camera or occluder move appears a frame late.
+    class OcclusionCuller {
+    public:
+        // Consecutive instances of a mesh, matches the `Batch` structure of the culling shader
+        struct Batch {
+            glm::vec3 bounds_min; // Local bounds of the mesh
+            uint32_t first_instance;
+            glm::vec3 bounds_max;
+            uint32_t visible_count; // Written by the culling pass, zero when uploaded
+        };
+
+    public:
+        // Reduces the depth texture into the pyramid tested by the next culling pass, which samples it after a
+        // GL_TEXTURE_FETCH_BARRIER_BIT barrier
+        void build_pyramid(uint32_t p_depth_texture, uint32_t p_width, uint32_t p_height, const glm::mat4 &p_view_projection);
+        void clear_pyramid(); // Nothing is occluded until the next build
+        inline bool has_pyramid() const { return pyramid_valid; }
+        inline uint32_t get_pyramid_level_count() const { return pyramid_level_count; }
+
+        // Compacts the instances of each batch that are not occluded and returns them, in the layout of `InstanceData`.
+        // `p_instance_batches` holds the batch index of every instance.
+        opengl::ShaderStorageBuffer::Slice cull(const opengl::ShaderStorageBuffer::Slice &p_instances, const std::vector<Batch> &p_batches, const std::vector<uint32_t> &p_instance_batches);
+
+        // Sets the instance count of the commands to the visible count of the batch of their base instance
+        void write_instance_counts(const opengl::DrawIndirectBuffer &p_commands, uint32_t p_command_count);
+
+        OcclusionCuller();
+        OcclusionCuller(const OcclusionCuller&) = delete;
+        virtual ~OcclusionCuller();
+
+    private:
+        // Storage buffer bindings of the culling passes
+        static constexpr uint32_t INSTANCES_BINDING = 0;
+        static constexpr uint32_t VISIBLE_INSTANCES_BINDING = 1;
+        static constexpr uint32_t BATCHES_BINDING = 2;
+        static constexpr uint32_t INSTANCE_BATCHES_BINDING = 3;
+        static constexpr uint32_t COMMANDS_BINDING = 4;
+
+    private:
+        static void _upload(opengl::ShaderStorageBuffer &p_storage, uint32_t p_size, const void *p_data);
+        void _resize_pyramid(uint32_t p_width, uint32_t p_height);
+
+    private:
+        std::unique_ptr<opengl::ShaderProgram> reduce_depth_program; // Depth buffer to the first level
+        std::unique_ptr<opengl::ShaderProgram> reduce_pyramid_program; // Level to the next one
+        std::unique_ptr<opengl::ShaderProgram> cull_program;
+        std::unique_ptr<opengl::ShaderProgram> write_counts_program;
+
+        opengl::UniformHandle<glm::ivec2> reduce_depth_size;
+        opengl::UniformHandle<int> reduce_depth_texture;
+        opengl::UniformHandle<glm::ivec2> reduce_pyramid_size;
+        opengl::UniformHandle<int> cull_instance_count;
+        opengl::UniformHandle<glm::mat4> cull_view_projection;
+        opengl::UniformHandle<glm::ivec2> cull_depth_size;
+        opengl::UniformHandle<int> cull_pyramid_level_count;
+        opengl::UniformHandle<int> cull_pyramid;
+        opengl::UniformHandle<int> write_counts_command_count;
+
+        uint32_t pyramid_texture = 0; // R32F, the first level is half the size of the depth buffer
+        uint32_t pyramid_level_count = 0;
+        uint32_t depth_width = 0, depth_height = 0; // Of the depth buffer the pyramid is built from
+        glm::mat4 pyramid_view_projection = glm::mat4(1.0);
+        bool pyramid_valid = false;
+
+        opengl::ShaderStorageBuffer batch_storage;
+        opengl::ShaderStorageBuffer instance_batch_storage;
+        opengl::ShaderStorageBuffer visible_instance_storage;
+    };
+}
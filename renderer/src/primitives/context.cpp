@@ -22,6 +22,7 @@
 
 namespace lixy::opengl {
     int OpenGLContext::instance_count = 0;
+    StateCache *OpenGLContext::current_state = nullptr;
 
 
     void OpenGLContext::initialize(GetProcAddress get_proc_address) {
@@ -44,16 +45,31 @@ namespace lixy::opengl {
         glDebugMessageCallback(&OpenGLContext::_gl_debug_context, nullptr);
         glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
 
+        state = std::make_unique<StateCache>();
+        current_state = state.get();
+
         // Other configs
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glEnable(GL_BLEND);
+        state->set_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        state->set_enabled(GL_BLEND, true);
 
-        glEnable(GL_DEPTH_TEST);
+        state->set_enabled(GL_DEPTH_TEST, true);
 
+        initialized = true;
         instance_count += 1;
     }
 
 
+    StateCache &OpenGLContext::get_state() {
+        ASSERT_FATAL_ERROR(current_state, "No OpenGL context has been initialized");
+        return *current_state;
+    }
+
+
+    StateCache *OpenGLContext::find_state() {
+        return current_state;
+    }
+
+
     void APIENTRY OpenGLContext::_gl_debug_context(GLenum p_source, GLenum p_type, GLuint p_id, GLenum p_severity, GLsizei p_length, const char *p_message, const void *p_user_param) {
         // ignore non-significant error/warning codes
         if(p_id == 131169 || p_id == 131185 || p_id == 131218 || p_id == 131204) return; // TODO: check
@@ -111,7 +127,8 @@ namespace lixy::opengl {
 
 
     OpenGLContext::OpenGLContext(OpenGLContext &&p_other)
-        : initialized(p_other.initialized)
+        : initialized(p_other.initialized),
+        state(std::move(p_other.state))
     {
         p_other.initialized = false;
     }
@@ -121,7 +138,10 @@ namespace lixy::opengl {
             instance_count -= 1;
         }
         
+        if (current_state && current_state == state.get()) current_state = nullptr;
+
         initialized = p_other.initialized;
+        state = std::move(p_other.state);
         p_other.initialized = false;
 
         return *this;
@@ -129,6 +149,7 @@ namespace lixy::opengl {
 
 
     OpenGLContext::~OpenGLContext() {
+        if (current_state && current_state == state.get()) current_state = nullptr;
         if (!initialized) return;
         instance_count -= 1;
     }
@@ -20,8 +20,11 @@
 
 
 #include <functional>
+#include <memory>
 #include <string>
 
+#include "renderer/src/primitives/state_cache.hpp"
+
 #include "thirdparty/glad/include/glad/glad.h"
 #include <GL/gl.h>
 #include <GL/glext.h>
@@ -36,6 +39,11 @@ namespace lixy::opengl {
     public:
         void initialize(GetProcAddress get_proc_address);
 
+        // State cache of the last initialized context, used by every OpenGL object to bind itself
+        static StateCache &get_state();
+        // Same as `get_state`, but null when there is no context, for objects released after their context
+        static StateCache *find_state();
+
         OpenGLContext() = default;
         OpenGLContext(const OpenGLContext&) = delete;
         OpenGLContext(OpenGLContext &&p_other);
@@ -47,7 +55,9 @@ namespace lixy::opengl {
 
     private:
         static int instance_count;
+        static StateCache *current_state;
 
         bool initialized = false;
+        std::unique_ptr<StateCache> state; // Allocated apart so that it does not move with the context
     };
 }
\ No newline at end of file
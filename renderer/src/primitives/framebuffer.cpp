@@ -17,20 +17,32 @@
 
 
 #include "framebuffer.hpp"
+#include "renderer/src/primitives/context.hpp"
 #include "debug/debug.hpp"
 
 #include "thirdparty/glad/include/glad/glad.h"
 
 
 namespace lixy::opengl {
-    
+
+    static void _delete_framebuffer(uint32_t p_framebuffer) {
+        if (StateCache *state = OpenGLContext::find_state()) state->forget_framebuffer(p_framebuffer);
+        glDeleteFramebuffers(1, &p_framebuffer);
+    }
+
+
+    static void _delete_renderbuffer(uint32_t p_renderbuffer) {
+        if (StateCache *state = OpenGLContext::find_state()) state->forget_renderbuffer(p_renderbuffer);
+        glDeleteRenderbuffers(1, &p_renderbuffer);
+    }
+
     void Framebuffer::bind() const {
-        glBindFramebuffer(GL_FRAMEBUFFER, buffer_id);
+        OpenGLContext::get_state().bind_framebuffer(buffer_id);
     }
 
 
     void Framebuffer::unbind() const {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        OpenGLContext::get_state().bind_framebuffer(0);
     }
 
 
@@ -45,58 +57,57 @@ namespace lixy::opengl {
 
 
     void Framebuffer::set_size(uint32_t p_width, uint32_t p_height) {
-        depth_stensil_attachment.set_size(p_width, p_height);
+        if (!external_depth_stencil_attachment) depth_stencil_attachment.resize(p_width, p_height);
         width = p_width;
         height = p_height;
     }
 
 
     Framebuffer::Framebuffer(uint32_t p_width, uint32_t p_height, const std::vector<uint32_t> &p_texture_attachments)
-        : depth_stensil_attachment(p_width, p_height, RenderBufferObject::RenderBufferFormat::DEPTH_STENSIL),
+        : depth_stencil_attachment(p_width, p_height, TextureFormat::DEPTH24_STENCIL8),
         width(p_width),
         height(p_height),
         texture_attachments(p_texture_attachments)
     {
-        glGenFramebuffers(1, &buffer_id);
-
-        bind();
-
-        std::vector<uint32_t> attachment_indices(texture_attachments.size());
-        for (int i = 0; i < texture_attachments.size(); i++) {
-            attachment_indices[i] = GL_COLOR_ATTACHMENT0 + i;
-            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment_indices[i], GL_TEXTURE_2D, texture_attachments[i], 0);
-        }
-        glDrawBuffers(attachment_indices.size(), attachment_indices.data());
+        _attach(depth_stencil_attachment.get_texture_id());
+    }
 
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_stensil_attachment.buffer_id);
 
-        unbind();
+    Framebuffer::Framebuffer(uint32_t p_width, uint32_t p_height, const std::vector<uint32_t> &p_texture_attachments, uint32_t p_depth_stencil_attachment)
+        : width(p_width),
+        height(p_height),
+        texture_attachments(p_texture_attachments),
+        external_depth_stencil_attachment(p_depth_stencil_attachment)
+    {
+        _attach(external_depth_stencil_attachment);
     }
 
 
     Framebuffer::Framebuffer(Framebuffer &&p_other) {
         if (buffer_id) {
-            glDeleteFramebuffers(1, &buffer_id);
+            _delete_framebuffer(buffer_id);
         }
 
         buffer_id = p_other.buffer_id;
         width = p_other.width;
         height = p_other.height;
         texture_attachments = std::move(p_other.texture_attachments);
-        depth_stensil_attachment = std::move(p_other.depth_stensil_attachment);
+        depth_stencil_attachment = std::move(p_other.depth_stencil_attachment);
+        external_depth_stencil_attachment = p_other.external_depth_stencil_attachment;
         p_other.buffer_id = 0;
     }
     
     Framebuffer &Framebuffer::operator=(Framebuffer &&p_other) {
         if (buffer_id) {
-            glDeleteFramebuffers(1, &buffer_id);
+            _delete_framebuffer(buffer_id);
         }
 
         buffer_id = p_other.buffer_id;
         width = p_other.width;
         height = p_other.height;
         texture_attachments = std::move(p_other.texture_attachments);
-        depth_stensil_attachment = std::move(p_other.depth_stensil_attachment);
+        depth_stencil_attachment = std::move(p_other.depth_stencil_attachment);
+        external_depth_stencil_attachment = p_other.external_depth_stencil_attachment;
         p_other.buffer_id = 0;
 
         return *this;
@@ -104,17 +115,35 @@ namespace lixy::opengl {
 
 
     Framebuffer::~Framebuffer() {
-        if (buffer_id) glDeleteFramebuffers(1, &buffer_id);
+        if (buffer_id) _delete_framebuffer(buffer_id);
+    }
+
+
+    void Framebuffer::_attach(uint32_t p_depth_stencil_attachment) {
+        glGenFramebuffers(1, &buffer_id);
+
+        bind();
+
+        std::vector<uint32_t> attachment_indices(texture_attachments.size());
+        for (int i = 0; i < texture_attachments.size(); i++) {
+            attachment_indices[i] = GL_COLOR_ATTACHMENT0 + i;
+            glFramebufferTexture(GL_FRAMEBUFFER, attachment_indices[i], texture_attachments[i], 0); // Of any target, multisampled or not
+        }
+        glDrawBuffers(attachment_indices.size(), attachment_indices.data());
+
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, p_depth_stencil_attachment, 0);
+
+        unbind();
     }
 
 
     void RenderBufferObject::bind() const {
-        glBindRenderbuffer(GL_RENDERBUFFER, buffer_id);
+        OpenGLContext::get_state().bind_renderbuffer(buffer_id);
     }
 
 
     void RenderBufferObject::unbind() const {
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        OpenGLContext::get_state().bind_renderbuffer(0);
     }
 
 
@@ -135,7 +164,7 @@ namespace lixy::opengl {
 
     RenderBufferObject::RenderBufferObject(RenderBufferObject &&p_other) {
         if (buffer_id) {
-            glDeleteRenderbuffers(1, &buffer_id);
+            _delete_renderbuffer(buffer_id);
         }
 
         buffer_id = p_other.buffer_id;
@@ -145,7 +174,7 @@ namespace lixy::opengl {
     
     RenderBufferObject &RenderBufferObject::operator=(RenderBufferObject &&p_other) {
         if (buffer_id) {
-            glDeleteRenderbuffers(1, &buffer_id);
+            _delete_renderbuffer(buffer_id);
         }
 
         buffer_id = p_other.buffer_id;
@@ -157,7 +186,7 @@ namespace lixy::opengl {
 
 
     RenderBufferObject::~RenderBufferObject() {
-        if (buffer_id) glDeleteRenderbuffers(1, &buffer_id);
+        if (buffer_id) _delete_renderbuffer(buffer_id);
     }
 
 
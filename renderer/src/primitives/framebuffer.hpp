@@ -67,26 +67,34 @@ namespace lixy::opengl {
 
             bool is_complete() const;
 
+            inline uint32_t get_id() const { return buffer_id; }
             inline uint32_t get_width() const { return width; };
             inline uint32_t get_height() const { return height; };
 
             inline int get_attachment_count() { return texture_attachments.size(); };
             uint32_t get_texture_attachment(int p_index);
+            inline uint32_t get_depth_stencil_attachment() const { return external_depth_stencil_attachment ? external_depth_stencil_attachment : depth_stencil_attachment.get_texture_id(); }
 
             void set_size(uint32_t p_width, uint32_t p_height);
 
             Framebuffer() = default;
             Framebuffer(uint32_t p_width, uint32_t p_height, const std::vector<uint32_t> &p_texture_attachments);
+            // Attaches a depth stencil texture of the caller, which resizes it and keeps it alive as long as this framebuffer
+            Framebuffer(uint32_t p_width, uint32_t p_height, const std::vector<uint32_t> &p_texture_attachments, uint32_t p_depth_stencil_attachment);
             Framebuffer(const Framebuffer &p_other) = delete;
             Framebuffer(Framebuffer &&p_other);
             Framebuffer &operator=(Framebuffer &&p_other);
             virtual ~Framebuffer();
 
+        private:
+            void _attach(uint32_t p_depth_stencil_attachment);
+
         private:
             uint32_t buffer_id = 0;
             uint32_t width, height;
 
             std::vector<uint32_t> texture_attachments;
-            RenderBufferObject depth_stensil_attachment;
+            Texture2D depth_stencil_attachment; // Sampled by the passes reusing the depth of the frame
+            uint32_t external_depth_stencil_attachment = 0; // Owned by the caller
     };
 }
\ No newline at end of file
@@ -32,127 +32,122 @@
 
 
 namespace lixy::opengl {
+    static void _delete_program(uint32_t p_program) {
+        if (StateCache *state = OpenGLContext::find_state()) state->forget_program(p_program);
+        glDeleteProgram(p_program);
+    }
+
+
     void ShaderProgram::bind() const {
-        glUseProgram(program_id);
+        OpenGLContext::get_state().use_program(program_id);
     }
 
 
     bool ShaderProgram::is_bound() const {
-        int pid;
-        glGetIntegerv(GL_CURRENT_PROGRAM, &pid);
-        return ((uint32_t)pid) == program_id;
+        return OpenGLContext::get_state().get_program() == program_id;
     }
 
 
-    void ShaderProgram::bind_uniform(const std::string &p_uniform_name, const float &p_value) {
-        int32_t location = _get_uniform_location(p_uniform_name);
-        if (location == -1) return;
-        glUniform1f(location, p_value);
+    void ShaderProgram::bind_uniform(UniformHandle<float> p_uniform, const float &p_value) {
+        if (p_uniform.location == -1) return;
+        glUniform1f(p_uniform.location, p_value);
     }
     
     
-    void ShaderProgram::bind_uniform(const std::string &p_uniform_name, const glm::vec2 &p_value) {
-        int32_t location = _get_uniform_location(p_uniform_name);
-        if (location == -1) return;
-        glUniform2f(location, p_value.x, p_value.y);
+    void ShaderProgram::bind_uniform(UniformHandle<glm::vec2> p_uniform, const glm::vec2 &p_value) {
+        if (p_uniform.location == -1) return;
+        glUniform2f(p_uniform.location, p_value.x, p_value.y);
     }
     
     
-    void ShaderProgram::bind_uniform(const std::string &p_uniform_name, const glm::vec3 &p_value) {
-        int32_t location = _get_uniform_location(p_uniform_name);
-        if (location == -1) return;
-        glUniform3f(location, p_value.x, p_value.y, p_value.z);
+    void ShaderProgram::bind_uniform(UniformHandle<glm::vec3> p_uniform, const glm::vec3 &p_value) {
+        if (p_uniform.location == -1) return;
+        glUniform3f(p_uniform.location, p_value.x, p_value.y, p_value.z);
     }
     
     
-    void ShaderProgram::bind_uniform(const std::string &p_uniform_name, const glm::vec4 &p_value) {
-        int32_t location = _get_uniform_location(p_uniform_name);
-        if (location == -1) return;
-        glUniform4f(location, p_value.x, p_value.y, p_value.z, p_value.w);
+    void ShaderProgram::bind_uniform(UniformHandle<glm::vec4> p_uniform, const glm::vec4 &p_value) {
+        if (p_uniform.location == -1) return;
+        glUniform4f(p_uniform.location, p_value.x, p_value.y, p_value.z, p_value.w);
     }
     
     
-    void ShaderProgram::bind_uniform(const std::string &p_uniform_name, const int &p_value) {
-        int32_t location = _get_uniform_location(p_uniform_name);
-        if (location == -1) return;
-        glUniform1i(location, p_value);
+    void ShaderProgram::bind_uniform(UniformHandle<int> p_uniform, const int &p_value) {
+        if (p_uniform.location == -1) return;
+        glUniform1i(p_uniform.location, p_value);
     }
     
     
-    void ShaderProgram::bind_uniform(const std::string &p_uniform_name, const glm::ivec2 &p_value) {
-        int32_t location = _get_uniform_location(p_uniform_name);
-        if (location == -1) return;
-        glUniform2i(location, p_value.x, p_value.y);
+    void ShaderProgram::bind_uniform(UniformHandle<glm::ivec2> p_uniform, const glm::ivec2 &p_value) {
+        if (p_uniform.location == -1) return;
+        glUniform2i(p_uniform.location, p_value.x, p_value.y);
     }
     
     
-    void ShaderProgram::bind_uniform(const std::string &p_uniform_name, const glm::ivec3 &p_value) {
-        int32_t location = _get_uniform_location(p_uniform_name);
-        if (location == -1) return;
-        glUniform3i(location, p_value.x, p_value.y, p_value.z);
+    void ShaderProgram::bind_uniform(UniformHandle<glm::ivec3> p_uniform, const glm::ivec3 &p_value) {
+        if (p_uniform.location == -1) return;
+        glUniform3i(p_uniform.location, p_value.x, p_value.y, p_value.z);
     }
     
     
-    void ShaderProgram::bind_uniform(const std::string &p_uniform_name, const glm::ivec4 &p_value) {
-        int32_t location = _get_uniform_location(p_uniform_name);
-        if (location == -1) return;
-        glUniform4i(location, p_value.x, p_value.y, p_value.z, p_value.w);
+    void ShaderProgram::bind_uniform(UniformHandle<glm::ivec4> p_uniform, const glm::ivec4 &p_value) {
+        if (p_uniform.location == -1) return;
+        glUniform4i(p_uniform.location, p_value.x, p_value.y, p_value.z, p_value.w);
     }
     
     
-    void ShaderProgram::bind_uniform(const std::string &p_uniform_name, const glm::mat2 &p_value) {
-        int32_t location = _get_uniform_location(p_uniform_name);
-        if (location == -1) return;
-        glUniformMatrix2fv(location, 1, GL_FALSE, &p_value[0][0]);
+    void ShaderProgram::bind_uniform(UniformHandle<glm::mat2> p_uniform, const glm::mat2 &p_value) {
+        if (p_uniform.location == -1) return;
+        glUniformMatrix2fv(p_uniform.location, 1, GL_FALSE, &p_value[0][0]);
     }
     
     
-    void ShaderProgram::bind_uniform(const std::string &p_uniform_name, const glm::mat3 &p_value) {
-        int32_t location = _get_uniform_location(p_uniform_name);
-        if (location == -1) return;
-        glUniformMatrix3fv(location, 1, GL_FALSE, &p_value[0][0]);
+    void ShaderProgram::bind_uniform(UniformHandle<glm::mat3> p_uniform, const glm::mat3 &p_value) {
+        if (p_uniform.location == -1) return;
+        glUniformMatrix3fv(p_uniform.location, 1, GL_FALSE, &p_value[0][0]);
     }
     
     
-    void ShaderProgram::bind_uniform(const std::string &p_uniform_name, const glm::mat4 &p_value) {
-        int32_t location = _get_uniform_location(p_uniform_name);
-        if (location == -1) return;
-        glUniformMatrix4fv(location, 1, GL_FALSE, &p_value[0][0]);
+    void ShaderProgram::bind_uniform(UniformHandle<glm::mat4> p_uniform, const glm::mat4 &p_value) {
+        if (p_uniform.location == -1) return;
+        glUniformMatrix4fv(p_uniform.location, 1, GL_FALSE, &p_value[0][0]);
+    }
+
+
+    void ShaderProgram::bind_storage_buffer(StorageBufferHandle p_storage_buffer, const ShaderStorageBuffer::Slice &p_slice) {
+        if (p_storage_buffer.binding == -1) return;
+        p_slice.bind_to_location(p_storage_buffer.binding);
     }
 
 
     void ShaderProgram::bind_storage_buffer(const std::string &p_storage_buffer_name, const ShaderStorageBuffer::Slice &p_slice) {
-        int32_t location = _get_storage_buffer_location(p_storage_buffer_name);
-        if (location == -1) return;
-        p_slice.bind_to_location(location);
+        bind_storage_buffer(get_storage_buffer_handle(p_storage_buffer_name), p_slice);
     }
 
 
-    int32_t ShaderProgram::_get_uniform_location(const std::string &p_name) {
-        return glGetUniformLocation(program_id, p_name.c_str());
+    StorageBufferHandle ShaderProgram::get_storage_buffer_handle(const std::string &p_storage_buffer_name) const {
+        int index = get_storage_buffer_index(p_storage_buffer_name);
+        return StorageBufferHandle{ .binding = index == -1 ? -1 : storage_buffers[index].binding };
     }
 
 
-    int32_t ShaderProgram::_get_storage_buffer_location(const std::string &p_storage_buffer_name) {
-        int32_t resource_index = glGetProgramResourceIndex(program_id, GL_SHADER_STORAGE_BLOCK, p_storage_buffer_name.data());
-        uint32_t prop = GL_BUFFER_BINDING;
-        int32_t location;
-        glGetProgramResourceiv(program_id, GL_SHADER_STORAGE_BLOCK, resource_index, 1, &prop, 1, nullptr, &location);
-        return location;
+    UniformBlockHandle ShaderProgram::get_uniform_block_handle(const std::string &p_uniform_block_name) const {
+        int index = get_uniform_block_index(p_uniform_block_name);
+        return UniformBlockHandle{ .binding = index == -1 ? -1 : uniform_blocks[index].binding };
     }
 
 
     void ShaderProgram::unbind() const {
-        glUseProgram(0);
+        OpenGLContext::get_state().use_program(0);
     }
 
 
-    int ShaderProgram::get_uniform_count() {
+    int ShaderProgram::get_uniform_count() const {
         return uniforms.size();
     }
     
     
-    int ShaderProgram::get_uniform_index(const std::string &p_uniform_name) {
+    int ShaderProgram::get_uniform_index(const std::string &p_uniform_name) const {
         for (int i = 0; i < uniforms.size(); i++) {
             if (uniforms[i].name == p_uniform_name) return i;
         }
@@ -160,24 +155,49 @@ namespace lixy::opengl {
     }
     
     
-    const std::string &ShaderProgram::get_uniform_name(int index) {
+    const std::string &ShaderProgram::get_uniform_name(int index) const {
         ASSERT_FATAL_ERROR(index >= 0 && index < get_uniform_count(), "Error index out of bounds");
         return uniforms[index].name;
     }
 
 
-    ShaderDataType ShaderProgram::get_uniform_type(int index) {
+    ShaderDataType ShaderProgram::get_uniform_type(int index) const {
         ASSERT_FATAL_ERROR(index >= 0 && index < get_uniform_count(), "Error index out of bounds");
         return uniforms[index].type;
     }
 
 
-    int ShaderProgram::get_storage_buffer_count() {
+    int ShaderProgram::get_uniform_block(int p_index) const {
+        ASSERT_FATAL_ERROR(p_index >= 0 && p_index < get_uniform_count(), "Error index out of bounds");
+        return uniforms[p_index].block;
+    }
+
+
+    int ShaderProgram::get_uniform_block_count() const {
+        return uniform_blocks.size();
+    }
+
+
+    int ShaderProgram::get_uniform_block_index(const std::string &p_uniform_block_name) const {
+        for (int i = 0; i < uniform_blocks.size(); i++) {
+            if (uniform_blocks[i].name == p_uniform_block_name) return i;
+        }
+        return -1;
+    }
+
+
+    const std::string &ShaderProgram::get_uniform_block_name(int p_index) const {
+        ASSERT_FATAL_ERROR(p_index >= 0 && p_index < get_uniform_block_count(), "Error index out of bounds");
+        return uniform_blocks[p_index].name;
+    }
+
+
+    int ShaderProgram::get_storage_buffer_count() const {
         return storage_buffers.size();
     }
     
     
-    int ShaderProgram::get_storage_buffer_index(const std::string &p_storage_buffer_name) {
+    int ShaderProgram::get_storage_buffer_index(const std::string &p_storage_buffer_name) const {
         for (int i = 0; i < storage_buffers.size(); i++) {
             if (storage_buffers[i].name == p_storage_buffer_name) return i;
         }
@@ -185,12 +205,47 @@ namespace lixy::opengl {
     }
     
     
-    const std::string &ShaderProgram::get_storage_buffer_name(int p_index) {
+    const std::string &ShaderProgram::get_storage_buffer_name(int p_index) const {
         ASSERT_FATAL_ERROR(p_index >= 0 && p_index < get_storage_buffer_count(), "Error index out of bounds");
         return storage_buffers[p_index].name;
     }
 
 
+    int ShaderProgram::get_buffer_variable_count() const {
+        return buffer_variables.size();
+    }
+
+
+    const std::string &ShaderProgram::get_buffer_variable_name(int p_index) const {
+        ASSERT_FATAL_ERROR(p_index >= 0 && p_index < get_buffer_variable_count(), "Error index out of bounds");
+        return buffer_variables[p_index].name;
+    }
+
+
+    ShaderDataType ShaderProgram::get_buffer_variable_type(int p_index) const {
+        ASSERT_FATAL_ERROR(p_index >= 0 && p_index < get_buffer_variable_count(), "Error index out of bounds");
+        return buffer_variables[p_index].type;
+    }
+
+
+    int ShaderProgram::get_buffer_variable_storage_buffer(int p_index) const {
+        ASSERT_FATAL_ERROR(p_index >= 0 && p_index < get_buffer_variable_count(), "Error index out of bounds");
+        return buffer_variables[p_index].storage_buffer;
+    }
+
+
+    uint32_t ShaderProgram::get_buffer_variable_offset(int p_index) const {
+        ASSERT_FATAL_ERROR(p_index >= 0 && p_index < get_buffer_variable_count(), "Error index out of bounds");
+        return buffer_variables[p_index].offset;
+    }
+
+
+    uint32_t ShaderProgram::get_buffer_variable_array_stride(int p_index) const {
+        ASSERT_FATAL_ERROR(p_index >= 0 && p_index < get_buffer_variable_count(), "Error index out of bounds");
+        return buffer_variables[p_index].array_stride;
+    }
+
+
     bool ShaderProgram::is_valid() const {
         return !creation_error;
     }
@@ -204,47 +259,55 @@ namespace lixy::opengl {
     ShaderProgram::ShaderProgram(const std::string &p_vertex_source, const std::string &p_fragment_source) {
         std::stringstream error_stream;
 
-        // Compile vertex shader
-        const char *cvertex_source = p_vertex_source.c_str();
-        uint32_t vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex_shader, 1, &cvertex_source, nullptr);
-        glCompileShader(vertex_shader);
+        uint32_t vertex_shader = _compile_shader(GL_VERTEX_SHADER, p_vertex_source, "vertex", error_stream);
+        uint32_t fragment_shader = _compile_shader(GL_FRAGMENT_SHADER, p_fragment_source, "fragment", error_stream);
+        _link_program({ vertex_shader, fragment_shader }, error_stream);
+    }
+
+
+    ShaderProgram::ShaderProgram(const std::string &p_compute_source) {
+        std::stringstream error_stream;
+
+        uint32_t compute_shader = _compile_shader(GL_COMPUTE_SHADER, p_compute_source, "compute", error_stream);
+        _link_program({ compute_shader }, error_stream);
+    }
+
+
+    void ShaderProgram::dispatch(uint32_t p_group_count_x, uint32_t p_group_count_y, uint32_t p_group_count_z) const {
+        bind();
+        glDispatchCompute(p_group_count_x, p_group_count_y, p_group_count_z);
+    }
+
+
+    uint32_t ShaderProgram::_compile_shader(uint32_t p_type, const std::string &p_source, const char *p_stage_name, std::stringstream &p_error_stream) {
+        const char *csource = p_source.c_str();
+        uint32_t shader = glCreateShader(p_type);
+        glShaderSource(shader, 1, &csource, nullptr);
+        glCompileShader(shader);
 
         int32_t ok;
-        glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &ok);
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
         if (!ok) {
             creation_error = true;
             int32_t max_length;
-            glGetShaderiv(vertex_shader, GL_INFO_LOG_LENGTH, &max_length);
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &max_length);
             std::vector<GLchar> error_logs(max_length);
-            glGetShaderInfoLog(vertex_shader, max_length, &max_length, error_logs.data());
-            error_stream << "Error while compiling vertex shader:" << std::endl;
-            error_stream << error_logs.data() << std::endl;
+            glGetShaderInfoLog(shader, max_length, &max_length, error_logs.data());
+            p_error_stream << "Error while compiling " << p_stage_name << " shader:" << std::endl;
+            p_error_stream << error_logs.data() << std::endl;
         }
 
-        // Compile fragment shader
-        const char *cfragment_source = p_fragment_source.c_str();
-        uint32_t fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment_shader, 1, &cfragment_source, nullptr);
-        glCompileShader(fragment_shader);
+        return shader;
+    }
 
-        glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &ok);
-        if (!ok) {
-            creation_error = true;
-            int32_t max_length;
-            glGetShaderiv(fragment_shader, GL_INFO_LOG_LENGTH, &max_length);
-            std::vector<GLchar> error_logs(max_length);
-            glGetShaderInfoLog(fragment_shader, max_length, &max_length, error_logs.data());
-            error_stream << "Error while compiling fragment shader:" << std::endl;
-            error_stream << error_logs.data() << std::endl;
-        }
 
+    void ShaderProgram::_link_program(std::initializer_list<uint32_t> p_shaders, std::stringstream &p_error_stream) {
         // Create shader program
         program_id = glCreateProgram();
-        glAttachShader(program_id, vertex_shader);
-        glAttachShader(program_id, fragment_shader);
+        for (uint32_t shader : p_shaders) glAttachShader(program_id, shader);
         glLinkProgram(program_id);
 
+        int32_t ok;
         glGetProgramiv(program_id, GL_LINK_STATUS, &ok);
         if (!ok) {
             creation_error = true;
@@ -252,13 +315,12 @@ namespace lixy::opengl {
             glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &max_length);
             std::vector<GLchar> error_logs(max_length);
             glGetProgramInfoLog(program_id, max_length, &max_length, error_logs.data());
-            error_stream << "Error while linking shader program:" << std::endl;
-            error_stream << error_logs.data() << std::endl;        
+            p_error_stream << "Error while linking shader program:" << std::endl;
+            p_error_stream << error_logs.data() << std::endl;        
         }
 
         // Free used shaders
-        glDeleteShader(fragment_shader);
-        glDeleteShader(vertex_shader);
+        for (uint32_t shader : p_shaders) glDeleteShader(shader);
 
         // Get shader inputs information
         int32_t uniform_count;
@@ -273,17 +335,47 @@ namespace lixy::opengl {
         int32_t max_ssb_name_length;
         glGetProgramInterfaceiv(program_id, GL_SHADER_STORAGE_BLOCK, GL_MAX_NAME_LENGTH, &max_ssb_name_length);
 
-        int32_t max_name_length = glm::max(max_uniform_name_length, max_ssb_name_length);
+        int32_t uniform_block_count;
+        glGetProgramiv(program_id, GL_ACTIVE_UNIFORM_BLOCKS, &uniform_block_count);
+        uniform_blocks.reserve(uniform_block_count);
+        int32_t max_uniform_block_name_length;
+        glGetProgramiv(program_id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_uniform_block_name_length);
+
+        int32_t buffer_variable_count;
+        glGetProgramInterfaceiv(program_id, GL_BUFFER_VARIABLE, GL_ACTIVE_RESOURCES, &buffer_variable_count);
+        buffer_variables.reserve(buffer_variable_count);
+        int32_t max_buffer_variable_name_length;
+        glGetProgramInterfaceiv(program_id, GL_BUFFER_VARIABLE, GL_MAX_NAME_LENGTH, &max_buffer_variable_name_length);
+
+        int32_t max_name_length = glm::max(glm::max(max_uniform_name_length, max_ssb_name_length), glm::max(max_uniform_block_name_length, max_buffer_variable_name_length));
         std::vector<GLchar> name(max_name_length);
 
         for (int i = 0; i < uniform_count; i++) {
             int32_t size;
             uint32_t type;
             glGetActiveUniform(program_id, i, max_name_length, nullptr, &size, &type, name.data());
+
+            uint32_t index = i;
+            int32_t block;
+            glGetActiveUniformsiv(program_id, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block);
             
             uniforms.push_back(Uniform{
                 .type = shader_data_type_from_gl_type(type),
-                .name = std::string(name.data())
+                .name = std::string(name.data()),
+                .location = glGetUniformLocation(program_id, name.data()),
+                .block = block,
+            });
+        }
+
+        for (int i = 0; i < uniform_block_count; i++) {
+            glGetActiveUniformBlockName(program_id, i, max_name_length, nullptr, name.data());
+
+            int32_t binding;
+            glGetActiveUniformBlockiv(program_id, i, GL_UNIFORM_BLOCK_BINDING, &binding);
+
+            uniform_blocks.push_back(UniformBlock{
+                .name = std::string(name.data()),
+                .binding = binding,
             });
         }
 
@@ -291,19 +383,44 @@ namespace lixy::opengl {
             int32_t size;
             glGetProgramResourceName(program_id, GL_SHADER_STORAGE_BLOCK, i, max_name_length, &size, name.data());
 
+            uint32_t prop = GL_BUFFER_BINDING;
+            int32_t binding;
+            glGetProgramResourceiv(program_id, GL_SHADER_STORAGE_BLOCK, i, 1, &prop, 1, nullptr, &binding);
+
             storage_buffers.push_back(StorageBuffer{
-                .name = std::string(name.data())
+                .name = std::string(name.data()),
+                .binding = binding,
+            });
+        }
+
+        for (int i = 0; i < buffer_variable_count; i++) {
+            glGetProgramResourceName(program_id, GL_BUFFER_VARIABLE, i, max_name_length, nullptr, name.data());
+
+            uint32_t props[] = { GL_TYPE, GL_BLOCK_INDEX, GL_OFFSET, GL_TOP_LEVEL_ARRAY_STRIDE };
+            int32_t values[4];
+            glGetProgramResourceiv(program_id, GL_BUFFER_VARIABLE, i, 4, props, 4, nullptr, values);
+
+            buffer_variables.push_back(BufferVariable{
+                .type = shader_data_type_from_gl_type(values[0]),
+                .name = std::string(name.data()),
+                .storage_buffer = values[1],
+                .offset = (uint32_t)values[2],
+                .array_stride = (uint32_t)values[3],
             });
         }
 
 
         // Record possible errors
-        if (creation_error) errors = error_stream.str();
+        if (creation_error) errors = p_error_stream.str();
     }
 
 
     ShaderProgram::ShaderProgram(ShaderProgram &&p_other)
         : program_id(p_other.program_id),
+        uniforms(std::move(p_other.uniforms)),
+        storage_buffers(std::move(p_other.storage_buffers)),
+        uniform_blocks(std::move(p_other.uniform_blocks)),
+        buffer_variables(std::move(p_other.buffer_variables)),
         creation_error(p_other.creation_error),
         errors(std::move(p_other.errors))
     {
@@ -313,10 +430,16 @@ namespace lixy::opengl {
 
     ShaderProgram &ShaderProgram::operator=(ShaderProgram &&p_other) {
         if (program_id != 0) {
-            glDeleteProgram(program_id);
+            _delete_program(program_id);
         }
 
         program_id = p_other.program_id;
+        uniforms = std::move(p_other.uniforms);
+        storage_buffers = std::move(p_other.storage_buffers);
+        uniform_blocks = std::move(p_other.uniform_blocks);
+        buffer_variables = std::move(p_other.buffer_variables);
+        creation_error = p_other.creation_error;
+        errors = std::move(p_other.errors);
         p_other.program_id = 0;
         
         return *this;
@@ -325,7 +448,7 @@ namespace lixy::opengl {
 
     ShaderProgram::~ShaderProgram() {
         if (program_id == 0) return;
-        glDeleteProgram(program_id);
+        _delete_program(program_id);
     }
 
 
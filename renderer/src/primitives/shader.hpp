@@ -25,6 +25,8 @@
 #include "thirdparty/glad/include/glad/glad.h"
 
 #include <cstdint>
+#include <initializer_list>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -33,7 +35,12 @@ namespace lixy::opengl {
 
     enum class ShaderDataType {
         Unknown = 0, Float, Vec2, Vec3, Vec4, Mat2, Mat3, Mat4, Int, IVec2, IVec3, IVec4, Bool,
-        Sampler2D
+        Sampler2D,
+
+        // Packed vertex attribute formats, read as floating point vectors by shaders
+        HalfVec2, // Two half floats
+        UShort4Norm, // Four unsigned shorts normalized to [0, 1]
+        Int2101010Norm, // Three signed 10 bit and one signed 2 bit integers normalized to [-1, 1]
     };
     
 
@@ -45,6 +52,8 @@ namespace lixy::opengl {
             return ShaderDataType::Vec2;
         case GL_FLOAT_VEC3:
             return ShaderDataType::Vec3;
+        case GL_FLOAT_VEC4:
+            return ShaderDataType::Vec4;
         case GL_FLOAT_MAT2:
             return ShaderDataType::Mat2;
         case GL_FLOAT_MAT3:
@@ -84,6 +93,9 @@ namespace lixy::opengl {
         case ShaderDataType::IVec3: return 3 * 4;
         case ShaderDataType::IVec4: return 4 * 4;
         case ShaderDataType::Bool: return 1;
+        case ShaderDataType::HalfVec2: return 2 * 2;
+        case ShaderDataType::UShort4Norm: return 4 * 2;
+        case ShaderDataType::Int2101010Norm: return 4;
         default:
             ASSERT_FATAL_ERROR(false, "Unknown ShaderDataType");
             return 0;
@@ -110,6 +122,12 @@ namespace lixy::opengl {
             return GL_BOOL;
         case ShaderDataType::Sampler2D:
             return GL_SAMPLER_2D;
+        case ShaderDataType::HalfVec2:
+            return GL_HALF_FLOAT;
+        case ShaderDataType::UShort4Norm:
+            return GL_UNSIGNED_SHORT;
+        case ShaderDataType::Int2101010Norm:
+            return GL_INT_2_10_10_10_REV;
         default:
             ASSERT_FATAL_ERROR(false, "Unknown ShaderDataType");
             return 0;
@@ -126,6 +144,7 @@ namespace lixy::opengl {
             return 1;
         case ShaderDataType::Vec2:
         case ShaderDataType::IVec2:
+        case ShaderDataType::HalfVec2:
             return 2;
         case ShaderDataType::Vec3:
         case ShaderDataType::IVec3:
@@ -133,6 +152,8 @@ namespace lixy::opengl {
         case ShaderDataType::Vec4:
         case ShaderDataType::Mat2:
         case ShaderDataType::IVec4:
+        case ShaderDataType::UShort4Norm:
+        case ShaderDataType::Int2101010Norm:
             return 4;
         case ShaderDataType::Mat3:
             return 9;
@@ -145,32 +166,103 @@ namespace lixy::opengl {
     }
     
     
+    // Whether integer vertex attributes of this type are normalized when read as floats
+    static bool shader_data_type_is_normalized(ShaderDataType p_type) {
+        switch (p_type) {
+        case ShaderDataType::UShort4Norm:
+        case ShaderDataType::Int2101010Norm:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+
+    // Uniform location resolved when the program is linked, binding through it does no string lookup or GL query.
+    // The value type is part of the handle so that a uniform can only be bound with the type it was resolved for.
+    template<class T>
+    struct UniformHandle {
+        int32_t location = -1; // -1 when the uniform is not active in the program
+
+        inline bool is_valid() const { return location != -1; }
+    };
+
+
+    // Binding point of a shader storage block, resolved when the program is linked
+    struct StorageBufferHandle {
+        int32_t binding = -1; // -1 when the block is not active in the program
+
+        inline bool is_valid() const { return binding != -1; }
+    };
+
+
+    // Binding point of a uniform block, resolved when the program is linked
+    struct UniformBlockHandle {
+        int32_t binding = -1; // -1 when the block is not active in the program
+
+        inline bool is_valid() const { return binding != -1; }
+    };
+
+
     class ShaderProgram {
     public:
         void bind() const;
         bool is_bound() const;
-        void bind_uniform(const std::string &p_uniform_name, const float &p_value);
-        void bind_uniform(const std::string &p_uniform_name, const glm::vec2 &p_value);
-        void bind_uniform(const std::string &p_uniform_name, const glm::vec3 &p_value);
-        void bind_uniform(const std::string &p_uniform_name, const glm::vec4 &p_value);
-        void bind_uniform(const std::string &p_uniform_name, const int &p_value);
-        void bind_uniform(const std::string &p_uniform_name, const glm::ivec2 &p_value);
-        void bind_uniform(const std::string &p_uniform_name, const glm::ivec3 &p_value);
-        void bind_uniform(const std::string &p_uniform_name, const glm::ivec4 &p_value);
-        void bind_uniform(const std::string &p_uniform_name, const glm::mat2 &p_value);
-        void bind_uniform(const std::string &p_uniform_name, const glm::mat3 &p_value);
-        void bind_uniform(const std::string &p_uniform_name, const glm::mat4 &p_value);
+
+        template<class T>
+        UniformHandle<T> get_uniform_handle(const std::string &p_uniform_name) const {
+            int index = get_uniform_index(p_uniform_name);
+            return UniformHandle<T>{ .location = index == -1 ? -1 : uniforms[index].location };
+        }
+        StorageBufferHandle get_storage_buffer_handle(const std::string &p_storage_buffer_name) const;
+        UniformBlockHandle get_uniform_block_handle(const std::string &p_uniform_block_name) const;
+
+        void bind_uniform(UniformHandle<float> p_uniform, const float &p_value);
+        void bind_uniform(UniformHandle<glm::vec2> p_uniform, const glm::vec2 &p_value);
+        void bind_uniform(UniformHandle<glm::vec3> p_uniform, const glm::vec3 &p_value);
+        void bind_uniform(UniformHandle<glm::vec4> p_uniform, const glm::vec4 &p_value);
+        void bind_uniform(UniformHandle<int> p_uniform, const int &p_value);
+        void bind_uniform(UniformHandle<glm::ivec2> p_uniform, const glm::ivec2 &p_value);
+        void bind_uniform(UniformHandle<glm::ivec3> p_uniform, const glm::ivec3 &p_value);
+        void bind_uniform(UniformHandle<glm::ivec4> p_uniform, const glm::ivec4 &p_value);
+        void bind_uniform(UniformHandle<glm::mat2> p_uniform, const glm::mat2 &p_value);
+        void bind_uniform(UniformHandle<glm::mat3> p_uniform, const glm::mat3 &p_value);
+        void bind_uniform(UniformHandle<glm::mat4> p_uniform, const glm::mat4 &p_value);
+        void bind_storage_buffer(StorageBufferHandle p_storage_buffer, const ShaderStorageBuffer::Slice &p_slice);
+
+        // Resolve the handle by name on every call, prefer keeping handles on hot paths
+        template<class T>
+        void bind_uniform(const std::string &p_uniform_name, const T &p_value) {
+            bind_uniform(get_uniform_handle<T>(p_uniform_name), p_value);
+        }
         void bind_storage_buffer(const std::string &p_storage_buffer_name, const ShaderStorageBuffer::Slice &p_slice);
+
+        // Binds the compute program and runs the work groups, results are only visible after a glMemoryBarrier
+        void dispatch(uint32_t p_group_count_x, uint32_t p_group_count_y = 1, uint32_t p_group_count_z = 1) const;
+
         void unbind() const;
 
-        int get_uniform_count();
-        int get_uniform_index(const std::string &p_uniform_name);
-        const std::string &get_uniform_name(int p_index);
-        ShaderDataType get_uniform_type(int p_index);
+        int get_uniform_count() const;
+        int get_uniform_index(const std::string &p_uniform_name) const;
+        const std::string &get_uniform_name(int p_index) const;
+        ShaderDataType get_uniform_type(int p_index) const;
+        int get_uniform_block(int p_index) const; // Block declaring the uniform, -1 for uniforms outside of blocks
+
+        int get_uniform_block_count() const;
+        int get_uniform_block_index(const std::string &p_uniform_block_name) const;
+        const std::string &get_uniform_block_name(int p_index) const;
 
-        int get_storage_buffer_count();
-        int get_storage_buffer_index(const std::string &p_ssb);
-        const std::string &get_storage_buffer_name(int p_index);
+        int get_storage_buffer_count() const;
+        int get_storage_buffer_index(const std::string &p_ssb) const;
+        const std::string &get_storage_buffer_name(int p_index) const;
+
+        // Variables declared in shader storage blocks, arrays of structures report the members of their first element
+        int get_buffer_variable_count() const;
+        const std::string &get_buffer_variable_name(int p_index) const;
+        ShaderDataType get_buffer_variable_type(int p_index) const;
+        int get_buffer_variable_storage_buffer(int p_index) const; // Index of the declaring storage buffer
+        uint32_t get_buffer_variable_offset(int p_index) const; // In bytes, from the start of the block
+        uint32_t get_buffer_variable_array_stride(int p_index) const; // Stride of the top level array, 0 outside of arrays
 
         bool is_valid() const;
         const std::string &get_errors() const;
@@ -178,6 +270,7 @@ namespace lixy::opengl {
         // static ShaderProgram load_shader_program(const std::string &p_vertex_path, const std::string &p_fragment_path);
     
         ShaderProgram(const std::string &p_vertex_source, const std::string &p_fragment_source);
+        explicit ShaderProgram(const std::string &p_compute_source);
         ShaderProgram(const ShaderProgram&) = delete;
         ShaderProgram(ShaderProgram &&p_other);
         ShaderProgram &operator=(ShaderProgram &&p_other);
@@ -187,21 +280,39 @@ namespace lixy::opengl {
         struct Uniform {
             ShaderDataType type;
             std::string name;
+            int32_t location;
+            int32_t block;
+        };
+
+        struct UniformBlock {
+            std::string name;
+            int32_t binding;
+        };
+
+        struct BufferVariable {
+            ShaderDataType type;
+            std::string name;
+            int32_t storage_buffer;
+            uint32_t offset;
+            uint32_t array_stride;
         };
 
         struct StorageBuffer {
             std::string name;
+            int32_t binding;
         };
 
     private:
-        int32_t _get_uniform_location(const std::string &p_uniform_name);
-        int32_t _get_storage_buffer_location(const std::string &p_storage_buffer_name);
+        uint32_t _compile_shader(uint32_t p_type, const std::string &p_source, const char *p_stage_name, std::stringstream &p_error_stream);
+        void _link_program(std::initializer_list<uint32_t> p_shaders, std::stringstream &p_error_stream); // Also deletes the shaders
 
     private:
         uint32_t program_id;
 
         std::vector<Uniform> uniforms;
         std::vector<StorageBuffer> storage_buffers;
+        std::vector<UniformBlock> uniform_blocks;
+        std::vector<BufferVariable> buffer_variables;
     
         bool creation_error = false;
         std::string errors;
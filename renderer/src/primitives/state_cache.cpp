@@ -0,0 +1,234 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "state_cache.hpp"
+
+#include "thirdparty/glad/include/glad/glad.h"
+
+
+namespace lixy::opengl {
+
+    void StateCache::use_program(uint32_t p_program) {
+        if (!_update(program, p_program)) return;
+        glUseProgram(p_program);
+        counters.program_switches += 1;
+    }
+
+
+    void StateCache::bind_vertex_array(uint32_t p_vertex_array) {
+        if (!_update(vertex_array, p_vertex_array)) return;
+        glBindVertexArray(p_vertex_array);
+        counters.vertex_array_switches += 1;
+        buffers[ELEMENT_ARRAY_BUFFER] = UNKNOWN; // The index buffer binding is part of the vertex array state
+    }
+
+
+    void StateCache::bind_buffer(GLenum p_target, uint32_t p_buffer) {
+        int target = _get_buffer_target(p_target);
+        if (target == -1) {
+            counters.issued += 1;
+            glBindBuffer(p_target, p_buffer);
+            return;
+        }
+        if (_update(buffers[target], p_buffer)) glBindBuffer(p_target, p_buffer);
+    }
+
+
+    void StateCache::bind_buffer_range(GLenum p_target, uint32_t p_index, uint32_t p_buffer, uint32_t p_offset, uint32_t p_size) {
+        int target = _get_indexed_buffer_target(p_target);
+        if (target != -1 && p_index < INDEXED_BUFFER_BINDING_COUNT) {
+            if (!_update(indexed_buffers[target][p_index], BufferRange{ p_buffer, p_offset, p_size })) return;
+        } else {
+            counters.issued += 1;
+        }
+
+        glBindBufferRange(p_target, p_index, p_buffer, p_offset, p_size);
+
+        int generic_target = _get_buffer_target(p_target);
+        if (generic_target != -1) buffers[generic_target] = p_buffer;
+    }
+
+
+    void StateCache::bind_texture(uint32_t p_unit, uint32_t p_texture) {
+        if (p_unit >= TEXTURE_UNIT_COUNT) {
+            counters.issued += 2;
+            glActiveTexture(GL_TEXTURE0 + p_unit);
+            glBindTexture(GL_TEXTURE_2D, p_texture);
+            active_texture_unit = p_unit;
+            counters.texture_switches += 1;
+            return;
+        }
+
+        if (textures[p_unit] == p_texture) {
+            counters.elided += 1;
+            return;
+        }
+        if (_update(active_texture_unit, p_unit)) glActiveTexture(GL_TEXTURE0 + p_unit);
+        if (!_update(textures[p_unit], p_texture)) return;
+        glBindTexture(GL_TEXTURE_2D, p_texture);
+        counters.texture_switches += 1;
+    }
+
+
+    void StateCache::bind_framebuffer(uint32_t p_framebuffer) {
+        if (_update(framebuffer, p_framebuffer)) glBindFramebuffer(GL_FRAMEBUFFER, p_framebuffer);
+    }
+
+
+    void StateCache::bind_renderbuffer(uint32_t p_renderbuffer) {
+        if (_update(renderbuffer, p_renderbuffer)) glBindRenderbuffer(GL_RENDERBUFFER, p_renderbuffer);
+    }
+
+
+    void StateCache::set_enabled(GLenum p_capability, bool p_enabled) {
+        int capability = _get_capability(p_capability);
+        if (capability != -1 && !_update(capabilities[capability], (int8_t)p_enabled)) return;
+        if (capability == -1) counters.issued += 1;
+
+        if (p_enabled) glEnable(p_capability);
+        else glDisable(p_capability);
+    }
+
+
+    void StateCache::set_blend_func(GLenum p_source_factor, GLenum p_destination_factor) {
+        if (_update(blend_func, { p_source_factor, p_destination_factor })) glBlendFunc(p_source_factor, p_destination_factor);
+    }
+
+
+    void StateCache::set_depth_func(GLenum p_function) {
+        if (_update(depth_func, p_function)) glDepthFunc(p_function);
+    }
+
+
+    void StateCache::set_depth_mask(bool p_enabled) {
+        if (_update(depth_mask, (int8_t)p_enabled)) glDepthMask(p_enabled ? GL_TRUE : GL_FALSE);
+    }
+
+
+    void StateCache::set_viewport(int32_t p_x, int32_t p_y, int32_t p_width, int32_t p_height) {
+        if (_update(viewport, { p_x, p_y, p_width, p_height })) glViewport(p_x, p_y, p_width, p_height);
+    }
+
+
+    void StateCache::forget_program(uint32_t p_program) {
+        if (program == p_program) program = UNKNOWN;
+    }
+
+
+    void StateCache::forget_vertex_array(uint32_t p_vertex_array) {
+        if (vertex_array != p_vertex_array) return;
+        vertex_array = 0; // Deleting the bound vertex array binds the default one
+        buffers[ELEMENT_ARRAY_BUFFER] = UNKNOWN;
+    }
+
+
+    void StateCache::forget_buffer(uint32_t p_buffer) {
+        for (uint32_t &buffer : buffers) {
+            if (buffer == p_buffer) buffer = 0;
+        }
+        for (auto &target_ranges : indexed_buffers) {
+            for (BufferRange &range : target_ranges) {
+                if (range.buffer == p_buffer) range = BufferRange{ 0, 0, 0 };
+            }
+        }
+    }
+
+
+    void StateCache::forget_texture(uint32_t p_texture) {
+        for (uint32_t &texture : textures) {
+            if (texture == p_texture) texture = 0;
+        }
+    }
+
+
+    void StateCache::forget_framebuffer(uint32_t p_framebuffer) {
+        if (framebuffer == p_framebuffer) framebuffer = 0;
+    }
+
+
+    void StateCache::forget_renderbuffer(uint32_t p_renderbuffer) {
+        if (renderbuffer == p_renderbuffer) renderbuffer = 0;
+    }
+
+
+    void StateCache::invalidate() {
+        program = UNKNOWN;
+        vertex_array = UNKNOWN;
+        buffers.fill(UNKNOWN);
+        for (auto &target_ranges : indexed_buffers) target_ranges.fill(BufferRange{ UNKNOWN, UNKNOWN, UNKNOWN });
+
+        active_texture_unit = UNKNOWN;
+        textures.fill(UNKNOWN);
+
+        framebuffer = UNKNOWN;
+        renderbuffer = UNKNOWN;
+
+        capabilities.fill(-1);
+        blend_func.fill(UNKNOWN);
+        depth_func = UNKNOWN;
+        depth_mask = -1;
+        viewport.fill(-1);
+    }
+
+
+    void StateCache::reset_counters() {
+        counters = Counters();
+    }
+
+
+    StateCache::StateCache() {
+        invalidate();
+    }
+
+
+    int StateCache::_get_buffer_target(GLenum p_target) {
+        switch (p_target) {
+        case GL_ARRAY_BUFFER: return ARRAY_BUFFER;
+        case GL_ELEMENT_ARRAY_BUFFER: return ELEMENT_ARRAY_BUFFER;
+        case GL_COPY_READ_BUFFER: return COPY_READ_BUFFER;
+        case GL_COPY_WRITE_BUFFER: return COPY_WRITE_BUFFER;
+        case GL_SHADER_STORAGE_BUFFER: return SHADER_STORAGE_BUFFER;
+        case GL_UNIFORM_BUFFER: return UNIFORM_BUFFER;
+        case GL_DRAW_INDIRECT_BUFFER: return DRAW_INDIRECT_BUFFER;
+        case GL_PIXEL_PACK_BUFFER: return PIXEL_PACK_BUFFER;
+        case GL_PIXEL_UNPACK_BUFFER: return PIXEL_UNPACK_BUFFER;
+        default: return -1;
+        }
+    }
+
+
+    int StateCache::_get_indexed_buffer_target(GLenum p_target) {
+        switch (p_target) {
+        case GL_SHADER_STORAGE_BUFFER: return INDEXED_SHADER_STORAGE_BUFFER;
+        case GL_UNIFORM_BUFFER: return INDEXED_UNIFORM_BUFFER;
+        default: return -1;
+        }
+    }
+
+
+    int StateCache::_get_capability(GLenum p_capability) {
+        switch (p_capability) {
+        case GL_BLEND: return BLEND;
+        case GL_DEPTH_TEST: return DEPTH_TEST;
+        case GL_CULL_FACE: return CULL_FACE;
+        case GL_STENCIL_TEST: return STENCIL_TEST;
+        case GL_SCISSOR_TEST: return SCISSOR_TEST;
+        default: return -1;
+        }
+    }
+}
@@ -0,0 +1,151 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include "thirdparty/glad/include/glad/glad.h"
+
+#include <array>
+#include <cstdint>
+
+
+namespace lixy::opengl {
+
+    // Client side shadow of the OpenGL binding and fixed function state. Changes to a state that is already set
+    // are skipped, so that the renderer never has to query OpenGL to know what is bound.
+    // Every binding in the renderer must go through the cache, otherwise `invalidate` has to be called.
+    class StateCache {
+    public:
+        struct Counters {
+            uint32_t issued = 0; // State changes sent to OpenGL
+            uint32_t elided = 0; // State changes skipped because the state was already set
+
+            // Issued changes of the most expensive bindings, included in `issued`
+            uint32_t program_switches = 0;
+            uint32_t texture_switches = 0;
+            uint32_t vertex_array_switches = 0;
+        };
+
+        static constexpr uint32_t TEXTURE_UNIT_COUNT = 32;
+        static constexpr uint32_t INDEXED_BUFFER_BINDING_COUNT = 16; // Per indexed target, higher bindings are not cached
+
+    public:
+        void use_program(uint32_t p_program);
+        inline uint32_t get_program() const { return program; }
+
+        void bind_vertex_array(uint32_t p_vertex_array);
+        void bind_buffer(GLenum p_target, uint32_t p_buffer);
+        // Binds a range of the buffer to an indexed target binding, also binds the buffer to the generic target
+        void bind_buffer_range(GLenum p_target, uint32_t p_index, uint32_t p_buffer, uint32_t p_offset, uint32_t p_size);
+
+        void bind_texture(uint32_t p_unit, uint32_t p_texture); // GL_TEXTURE_2D
+        inline uint32_t get_active_texture_unit() const { return active_texture_unit; }
+
+        void bind_framebuffer(uint32_t p_framebuffer); // Draw and read framebuffers
+        void bind_renderbuffer(uint32_t p_renderbuffer);
+
+        void set_enabled(GLenum p_capability, bool p_enabled);
+        void set_blend_func(GLenum p_source_factor, GLenum p_destination_factor);
+        void set_depth_func(GLenum p_function);
+        void set_depth_mask(bool p_enabled);
+        void set_viewport(int32_t p_x, int32_t p_y, int32_t p_width, int32_t p_height);
+
+        // OpenGL unbinds deleted objects, the cache must do the same before their name is reused
+        void forget_program(uint32_t p_program);
+        void forget_vertex_array(uint32_t p_vertex_array);
+        void forget_buffer(uint32_t p_buffer);
+        void forget_texture(uint32_t p_texture);
+        void forget_framebuffer(uint32_t p_framebuffer);
+        void forget_renderbuffer(uint32_t p_renderbuffer);
+
+        // Forgets every state, the next changes are all issued
+        void invalidate();
+
+        inline const Counters &get_counters() const { return counters; }
+        void reset_counters();
+
+        StateCache();
+
+    private:
+        static constexpr uint32_t UNKNOWN = UINT32_MAX;
+
+        enum BufferTarget {
+            ARRAY_BUFFER, ELEMENT_ARRAY_BUFFER, COPY_READ_BUFFER, COPY_WRITE_BUFFER, SHADER_STORAGE_BUFFER,
+            UNIFORM_BUFFER, DRAW_INDIRECT_BUFFER, PIXEL_PACK_BUFFER, PIXEL_UNPACK_BUFFER,
+            BUFFER_TARGET_COUNT,
+        };
+
+        enum IndexedBufferTarget {
+            INDEXED_SHADER_STORAGE_BUFFER, INDEXED_UNIFORM_BUFFER,
+            INDEXED_BUFFER_TARGET_COUNT,
+        };
+
+        enum Capability {
+            BLEND, DEPTH_TEST, CULL_FACE, STENCIL_TEST, SCISSOR_TEST,
+            CAPABILITY_COUNT,
+        };
+
+        struct BufferRange {
+            uint32_t buffer;
+            uint32_t offset;
+            uint32_t size;
+
+            inline bool operator==(const BufferRange &p_other) const {
+                return buffer == p_other.buffer && offset == p_other.offset && size == p_other.size;
+            }
+        };
+
+    private:
+        static int _get_buffer_target(GLenum p_target);
+        static int _get_indexed_buffer_target(GLenum p_target);
+        static int _get_capability(GLenum p_capability);
+
+        // Returns true when the state has to be issued
+        template<class T>
+        inline bool _update(T &p_state, const T &p_value) {
+            if (p_state == p_value) {
+                counters.elided += 1;
+                return false;
+            }
+            p_state = p_value;
+            counters.issued += 1;
+            return true;
+        }
+
+    private:
+        uint32_t program;
+        uint32_t vertex_array;
+        std::array<uint32_t, BUFFER_TARGET_COUNT> buffers;
+        std::array<std::array<BufferRange, INDEXED_BUFFER_BINDING_COUNT>, INDEXED_BUFFER_TARGET_COUNT> indexed_buffers;
+
+        uint32_t active_texture_unit;
+        std::array<uint32_t, TEXTURE_UNIT_COUNT> textures;
+
+        uint32_t framebuffer;
+        uint32_t renderbuffer;
+
+        std::array<int8_t, CAPABILITY_COUNT> capabilities; // -1 when unknown
+        std::array<GLenum, 2> blend_func;
+        GLenum depth_func;
+        int8_t depth_mask;
+        std::array<int32_t, 4> viewport;
+
+        Counters counters;
+    };
+}
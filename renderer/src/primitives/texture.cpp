@@ -17,6 +17,7 @@
 
 
 #include "texture.hpp"
+#include "renderer/src/primitives/context.hpp"
 
 #include "debug/debug.hpp"
 
@@ -28,16 +29,23 @@
 
 namespace lixy::opengl {
 
+    static void _delete_texture(uint32_t p_texture) {
+        if (StateCache *state = OpenGLContext::find_state()) state->forget_texture(p_texture);
+        glDeleteTextures(1, &p_texture);
+    }
+
 
     void Texture2D::bind(uint32_t p_location) const {
         ASSERT_FATAL_ERROR(p_location < 32, "There is a maximum of 32 opengl texture slots");
-        glActiveTexture(GL_TEXTURE0 + p_location);
-        glBindTexture(GL_TEXTURE_2D, texture_id);
+        ASSERT_FATAL_ERROR(samples == 1, "Multisampled textures can not be bound");
+        OpenGLContext::get_state().bind_texture(p_location, texture_id);
     }
 
 
     void Texture2D::unbind() const {
-        glBindTexture(GL_TEXTURE_2D, 0);
+        StateCache &state = OpenGLContext::get_state();
+        uint32_t unit = state.get_active_texture_unit();
+        state.bind_texture(unit < StateCache::TEXTURE_UNIT_COUNT ? unit : 0, 0);
     }
 
 
@@ -52,11 +60,13 @@ namespace lixy::opengl {
 
 
     void Texture2D::resize(uint32_t p_width, uint32_t p_height) {
-        uint32_t internal_format, gl_format;
-        Texture2D::get_opengl_format(format, &internal_format, &gl_format);
+        ASSERT_FATAL_ERROR(samples == 1, "Multisampled textures can not be resized");
+
+        uint32_t internal_format, gl_format, gl_type;
+        Texture2D::get_opengl_format(format, &internal_format, &gl_format, &gl_type);
 
         bind();
-        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, p_width, p_height, 0, gl_format, GL_UNSIGNED_BYTE, nullptr);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, p_width, p_height, 0, gl_format, gl_type, nullptr);
         unbind();
 
         width = p_width;
@@ -102,16 +112,23 @@ namespace lixy::opengl {
     }
 
 
-    Texture2D::Texture2D(int p_width, int p_height, TextureFormat p_format)
+    Texture2D::Texture2D(int p_width, int p_height, TextureFormat p_format, uint32_t p_samples)
         : format(p_format),
         width(p_width),
-        height(p_height)
+        height(p_height),
+        samples(p_samples)
     {
-        glGenTextures(1, &texture_id);
-
-        uint32_t internal_format, gl_format;
-        Texture2D::get_opengl_format(p_format, &internal_format, &gl_format);
+        uint32_t internal_format, gl_format, gl_type;
+        Texture2D::get_opengl_format(p_format, &internal_format, &gl_format, &gl_type);
+
+        if (p_samples > 1) {
+            glCreateTextures(GL_TEXTURE_2D_MULTISAMPLE, 1, &texture_id);
+            glTextureStorage2DMultisample(texture_id, p_samples, internal_format, p_width, p_height, GL_TRUE);
+            valid = true;
+            return;
+        }
 
+        glGenTextures(1, &texture_id);
         bind();
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -119,7 +136,7 @@ namespace lixy::opengl {
         // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
         // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 
-        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, p_width, p_height, 0, gl_format, GL_UNSIGNED_BYTE, nullptr);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, p_width, p_height, 0, gl_format, gl_type, nullptr);
 
         unbind();
         valid = true;
@@ -133,8 +150,8 @@ namespace lixy::opengl {
     {
         glGenTextures(1, &texture_id);
 
-        uint32_t internal_format, gl_format;
-        Texture2D::get_opengl_format(p_format, &internal_format, &gl_format);
+        uint32_t internal_format, gl_format, gl_type;
+        Texture2D::get_opengl_format(p_format, &internal_format, &gl_format, &gl_type);
 
         bind();
 
@@ -143,7 +160,7 @@ namespace lixy::opengl {
         // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
         // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 
-        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, p_width, p_height, 0, gl_format, GL_UNSIGNED_BYTE, p_data);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, p_width, p_height, 0, gl_format, gl_type, p_data);
 
         unbind();
         valid = true;
@@ -155,7 +172,8 @@ namespace lixy::opengl {
         valid(p_other.valid),
         format(p_other.format),
         width(p_other.width),
-        height(p_other.height)
+        height(p_other.height),
+        samples(p_other.samples)
     {
         p_other.texture_id = 0;
         p_other.valid = false;
@@ -164,7 +182,7 @@ namespace lixy::opengl {
     
     Texture2D &Texture2D::operator=(Texture2D &&p_other) {
         if (valid) {
-            glDeleteTextures(1, &texture_id);
+            _delete_texture(texture_id);
         }
 
         texture_id = p_other.texture_id;
@@ -172,6 +190,7 @@ namespace lixy::opengl {
         format = p_other.format;
         width = p_other.width;
         height = p_other.height;
+        samples = p_other.samples;
 
         p_other.texture_id = 0;
         p_other.valid = 0;
@@ -179,7 +198,9 @@ namespace lixy::opengl {
         return *this;
     }
 
-    void Texture2D::get_opengl_format(TextureFormat p_tex_format, uint32_t *p_internal_format, uint32_t *p_format) {
+    void Texture2D::get_opengl_format(TextureFormat p_tex_format, uint32_t *p_internal_format, uint32_t *p_format, uint32_t *p_type) {
+        *p_type = GL_UNSIGNED_BYTE;
+
         switch (p_tex_format) {
         case TextureFormat::R8:
             *p_internal_format = GL_R8;
@@ -217,12 +238,17 @@ namespace lixy::opengl {
             *p_internal_format = GL_RGBA16F;
             *p_format = GL_RGBA;
             break;
+        case TextureFormat::DEPTH24_STENCIL8:
+            *p_internal_format = GL_DEPTH24_STENCIL8;
+            *p_format = GL_DEPTH_STENCIL;
+            *p_type = GL_UNSIGNED_INT_24_8;
+            break;
         }
     }
     
     
     Texture2D::~Texture2D() {
-        if (valid) glDeleteTextures(1, &texture_id);
+        if (valid) _delete_texture(texture_id);
     }
 
 }
\ No newline at end of file
@@ -32,7 +32,8 @@ namespace lixy::opengl {
     enum class TextureFormat {
         R8, RG8, RGB8, RGBA8,
         R16, RG16, RGB16, RGBA16,
-        RGBA16F
+        RGBA16F,
+        DEPTH24_STENCIL8, // Depth and stencil attachment of framebuffers, samplers read the depth
     };
 
     
@@ -52,20 +53,22 @@ namespace lixy::opengl {
 
         virtual bool is_valid() const override;
         virtual uint32_t get_texture_id() const override;
+        inline uint32_t get_samples() const { return samples; }
 
         void resize(uint32_t p_width, uint32_t p_height);
 
         static Texture2D load(const std::filesystem::path &p_path);
 
         Texture2D() = default;
-        Texture2D(int p_width, int p_height, TextureFormat p_format);
+        // Multisampled textures are framebuffer attachments resolved by blits, they can not be bound nor resized
+        Texture2D(int p_width, int p_height, TextureFormat p_format, uint32_t p_samples = 1);
         Texture2D(const void *p_data, int p_width, int p_height, TextureFormat p_format);
         Texture2D(Texture2D &&p_other);
         Texture2D &operator=(Texture2D &&p_other);
         virtual ~Texture2D();
 
     private:
-        void get_opengl_format(TextureFormat p_tex_format, uint32_t *p_internal_format, uint32_t *p_format);
+        void get_opengl_format(TextureFormat p_tex_format, uint32_t *p_internal_format, uint32_t *p_format, uint32_t *p_type);
 
     private:
         uint32_t texture_id;
@@ -73,6 +76,7 @@ namespace lixy::opengl {
 
         TextureFormat format;
         uint32_t width, height;
+        uint32_t samples = 1;
 
         friend Framebuffer;
     };
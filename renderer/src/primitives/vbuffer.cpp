@@ -18,14 +18,30 @@
 
 #include "vbuffer.hpp"
 #include "shader.hpp"
+#include "renderer/src/primitives/context.hpp"
 
 #include "thirdparty/glad/include/glad/glad.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <vector>
 
 
 namespace lixy::opengl {
 
+    // Deleted names have to be forgotten by the state cache, which is already gone when buffers outlive the context
+    static void _delete_buffer(uint32_t p_buffer) {
+        if (StateCache *state = OpenGLContext::find_state()) state->forget_buffer(p_buffer);
+        glDeleteBuffers(1, &p_buffer);
+    }
+
+
+    static void _delete_vertex_array(uint32_t p_vertex_array) {
+        if (StateCache *state = OpenGLContext::find_state()) state->forget_vertex_array(p_vertex_array);
+        glDeleteVertexArrays(1, &p_vertex_array);
+    }
+
+
     uint32_t BufferLayout::get_attribute_offset(uint32_t index) const {
         return attributes[index].offset;
     }
@@ -46,6 +62,20 @@ namespace lixy::opengl {
     }
 
 
+    bool BufferLayout::is_attribute_normalized(uint32_t index) const {
+        return shader_data_type_is_normalized(attributes[index].data_type);
+    }
+
+
+    bool BufferLayout::operator==(const BufferLayout &p_other) const {
+        if (layout_length != p_other.layout_length) return false;
+        for (uint32_t i = 0; i < layout_length; i++) {
+            if (attributes[i].data_type != p_other.attributes[i].data_type) return false;
+        }
+        return true;
+    }
+
+
     BufferLayout::BufferLayout(const ShaderDataType *p_layout, uint32_t p_layout_length)
         : attributes(p_layout_length),
         layout_length(p_layout_length)
@@ -61,12 +91,12 @@ namespace lixy::opengl {
 
 
     void VertexBuffer::bind() const {
-        glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+        OpenGLContext::get_state().bind_buffer(GL_ARRAY_BUFFER, buffer_id);
     }
 
 
     void VertexBuffer::unbind() const {
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        OpenGLContext::get_state().bind_buffer(GL_ARRAY_BUFFER, 0);
     }
 
 
@@ -78,69 +108,169 @@ namespace lixy::opengl {
 
 
     VertexBuffer::~VertexBuffer() {
-        glDeleteBuffers(1, &buffer_id);
+        _delete_buffer(buffer_id);
     }
 
 
     void IndexBuffer::bind() const {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer_id);
+        OpenGLContext::get_state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, buffer_id);
     }
 
 
     void IndexBuffer::unbind() const {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        OpenGLContext::get_state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
 
 
-    IndexBuffer::IndexBuffer(const uint32_t *p_indices, uint32_t p_size) {
+    IndexBuffer::IndexBuffer(const uint32_t *p_indices, uint32_t p_size, uint32_t p_base_vertex) {
+        uint32_t max_index = 0;
+        for (uint32_t i = 0; i < p_size; i++) {
+            max_index = std::max(max_index, p_indices[i] - p_base_vertex);
+        }
+
         glGenBuffers(1, &buffer_id);
         bind();
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, p_size * sizeof(uint32_t), p_indices, GL_STATIC_DRAW);
+
+        if (max_index <= UINT16_MAX) {
+            std::vector<uint16_t> short_indices(p_size);
+            for (uint32_t i = 0; i < p_size; i++) {
+                short_indices[i] = (uint16_t)(p_indices[i] - p_base_vertex);
+            }
+
+            gl_type = GL_UNSIGNED_SHORT;
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, p_size * sizeof(uint16_t), short_indices.data(), GL_STATIC_DRAW);
+        } else if (p_base_vertex != 0) {
+            std::vector<uint32_t> rebased_indices(p_indices, p_indices + p_size);
+            for (uint32_t &index : rebased_indices) index -= p_base_vertex;
+
+            gl_type = GL_UNSIGNED_INT;
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, p_size * sizeof(uint32_t), rebased_indices.data(), GL_STATIC_DRAW);
+        } else {
+            gl_type = GL_UNSIGNED_INT;
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, p_size * sizeof(uint32_t), p_indices, GL_STATIC_DRAW);
+        }
     }
 
 
     IndexBuffer::~IndexBuffer() {
-        glDeleteBuffers(1, &buffer_id);
+        _delete_buffer(buffer_id);
     }
 
 
     void VertexArrayBuffer::bind() const {
-        glBindVertexArray(array_index);
+        OpenGLContext::get_state().bind_vertex_array(array_index);
     }
 
 
     void VertexArrayBuffer::unbind() const {
-        glBindVertexArray(0);
+        OpenGLContext::get_state().bind_vertex_array(0);
+    }
+
+
+    void Buffer::write_data(uint32_t p_offset, uint32_t p_size, const void *p_data) {
+        OpenGLContext::get_state().bind_buffer(GL_COPY_WRITE_BUFFER, buffer_id);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, p_offset, p_size, p_data);
+    }
+
+
+    void Buffer::copy_data(const Buffer &p_source, uint32_t p_source_offset, uint32_t p_offset, uint32_t p_size) {
+        OpenGLContext::get_state().bind_buffer(GL_COPY_READ_BUFFER, p_source.buffer_id);
+        OpenGLContext::get_state().bind_buffer(GL_COPY_WRITE_BUFFER, buffer_id);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, p_source_offset, p_offset, p_size);
+    }
+
+
+    Buffer::Buffer(uint32_t p_size)
+        : size(p_size)
+    {
+        glGenBuffers(1, &buffer_id);
+        OpenGLContext::get_state().bind_buffer(GL_COPY_WRITE_BUFFER, buffer_id);
+        glBufferData(GL_COPY_WRITE_BUFFER, p_size, nullptr, GL_STATIC_DRAW);
+    }
+
+
+    Buffer::Buffer(Buffer &&p_other)
+        : buffer_id(p_other.buffer_id),
+        size(p_other.size)
+    {
+        p_other.buffer_id = 0;
+    }
+
+
+    Buffer &Buffer::operator=(Buffer &&p_other) {
+        if (buffer_id) {
+            _delete_buffer(buffer_id);
+        }
+
+        buffer_id = p_other.buffer_id;
+        size = p_other.size;
+
+        p_other.buffer_id = 0;
+        return *this;
+    }
+
+
+    Buffer::~Buffer() {
+        if (buffer_id) _delete_buffer(buffer_id);
     }
 
 
     void VertexArrayBuffer::add_vertex_buffer(std::shared_ptr<VertexBuffer> p_vertex_buffer, const BufferLayout &p_buffer_layout) {
         bind();
         p_vertex_buffer->bind();
-        
+        _add_attributes(p_buffer_layout);
+        unbind();
+        vertex_buffers.push_back(p_vertex_buffer);
+    }
+
+
+    void VertexArrayBuffer::add_index_buffer(std::shared_ptr<IndexBuffer> p_index_buffer) {
+        bind();
+        p_index_buffer->bind();
+        unbind();
+        index_buffers.push_back(p_index_buffer);
+    }
+
+
+    void VertexArrayBuffer::add_vertex_buffer(const Buffer &p_vertex_buffer, const BufferLayout &p_buffer_layout) {
+        bind();
+        OpenGLContext::get_state().bind_buffer(GL_ARRAY_BUFFER, p_vertex_buffer.get_id());
+        _add_attributes(p_buffer_layout);
+        unbind();
+    }
+
+
+    void VertexArrayBuffer::add_index_buffer(const Buffer &p_index_buffer) {
+        bind();
+        OpenGLContext::get_state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, p_index_buffer.get_id());
+        unbind();
+    }
+
+
+    void VertexArrayBuffer::add_instance_index_buffer(const Buffer &p_instance_index_buffer, uint32_t p_location) {
+        bind();
+        OpenGLContext::get_state().bind_buffer(GL_ARRAY_BUFFER, p_instance_index_buffer.get_id());
+        glVertexAttribIPointer(p_location, 1, GL_UNSIGNED_INT, sizeof(uint32_t), nullptr);
+        glVertexAttribDivisor(p_location, 1);
+        glEnableVertexAttribArray(p_location);
+        unbind();
+    }
+
+
+    void VertexArrayBuffer::_add_attributes(const BufferLayout &p_buffer_layout) {
         for (uint32_t i = 0; i < p_buffer_layout.get_layout_length(); i++) {
             uint32_t index = vertex_attrib_count + i;
             glVertexAttribPointer(
                 index,
                 p_buffer_layout.get_attribute_component_count(i),
                 p_buffer_layout.get_attribute_gl_type(i),
-                GL_FALSE,
+                p_buffer_layout.is_attribute_normalized(i) ? GL_TRUE : GL_FALSE,
                 p_buffer_layout.get_stride(),
                 reinterpret_cast<void*>(p_buffer_layout.get_attribute_offset(i))
             );
             glEnableVertexAttribArray(index);
         }
         vertex_attrib_count += p_buffer_layout.get_layout_length();
-        unbind();
-        vertex_buffers.push_back(p_vertex_buffer);
-    }
-
-
-    void VertexArrayBuffer::add_index_buffer(std::shared_ptr<IndexBuffer> p_index_buffer) {
-        bind();
-        p_index_buffer->bind();
-        unbind();
-        index_buffers.push_back(p_index_buffer);
     }
 
 
@@ -163,7 +293,7 @@ namespace lixy::opengl {
 
     VertexArrayBuffer &VertexArrayBuffer::operator=(VertexArrayBuffer &&p_other) {
         if (array_index) {
-            glDeleteVertexArrays(1, &array_index);
+            _delete_vertex_array(array_index);
         }
 
         array_index = p_other.array_index;
@@ -179,24 +309,24 @@ namespace lixy::opengl {
 
     VertexArrayBuffer::~VertexArrayBuffer() {
         if (!array_index) return;
-        glDeleteVertexArrays(1, &array_index);
+        _delete_vertex_array(array_index);
     }
 
 
     void ShaderStorageBuffer::Slice::bind_to_location(uint32_t p_bind_location) const {
         if (buffer_id) {
-            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, p_bind_location, buffer_id, offset, size);
+            OpenGLContext::get_state().bind_buffer_range(GL_SHADER_STORAGE_BUFFER, p_bind_location, buffer_id, offset, size);
         }
     }
 
 
     void ShaderStorageBuffer::bind() const {
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer_id);
+        OpenGLContext::get_state().bind_buffer(GL_SHADER_STORAGE_BUFFER, buffer_id);
     }
 
 
     void ShaderStorageBuffer::unbind() const {
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        OpenGLContext::get_state().bind_buffer(GL_SHADER_STORAGE_BUFFER, 0);
     }
 
 
@@ -206,6 +336,12 @@ namespace lixy::opengl {
 
 
     void ShaderStorageBuffer::allocate(uint32_t p_size) {
+        if (mapping) { // Immutable storage cannot be allocated again
+            _delete_buffer(buffer_id);
+            buffer_id = 0;
+            mapping = nullptr;
+        }
+
         size = p_size;
         if (!buffer_id) glCreateBuffers(1, &buffer_id);
         bind();
@@ -218,38 +354,188 @@ namespace lixy::opengl {
     }
 
 
-    void ShaderStorageBuffer::write_data(uint32_t p_offset, uint32_t p_size, void *p_data) {
+    void ShaderStorageBuffer::allocate_mapped(uint32_t p_size) {
+        if (buffer_id) _delete_buffer(buffer_id);
+
+        size = p_size;
+        glCreateBuffers(1, &buffer_id);
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glNamedBufferStorage(buffer_id, p_size, nullptr, flags);
+        mapping = glMapNamedBufferRange(buffer_id, 0, p_size, flags);
+    }
+
+
+    void ShaderStorageBuffer::write_data(uint32_t p_offset, uint32_t p_size, const void *p_data) {
         bind();
         glBufferSubData(GL_SHADER_STORAGE_BUFFER, p_offset, p_size, p_data);
     }
 
 
+    void ShaderStorageBuffer::read_data(uint32_t p_offset, uint32_t p_size, void *p_data) const {
+        bind();
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, p_offset, p_size, p_data);
+    }
+
+
     ShaderStorageBuffer::ShaderStorageBuffer(ShaderStorageBuffer &&p_other) {
         if (buffer_id) {
-            glDeleteBuffers(1, &buffer_id);
+            _delete_buffer(buffer_id);
         }
 
         buffer_id = p_other.buffer_id;
         size = p_other.size;
+        mapping = p_other.mapping;
 
         p_other.buffer_id = 0;
+        p_other.mapping = nullptr;
     }
 
 
     ShaderStorageBuffer &ShaderStorageBuffer::operator=(ShaderStorageBuffer &&p_other) {
         if (buffer_id) {
-            glDeleteBuffers(1, &buffer_id);
+            _delete_buffer(buffer_id);
         }
 
         buffer_id = p_other.buffer_id;
         size = p_other.size;
+        mapping = p_other.mapping;
 
         p_other.buffer_id = 0;
+        p_other.mapping = nullptr;
         return *this;
     }
 
 
     ShaderStorageBuffer::~ShaderStorageBuffer() {
-        if (buffer_id) glDeleteBuffers(1, &buffer_id);
+        if (buffer_id) _delete_buffer(buffer_id);
+    }
+
+
+    void UniformBuffer::Slice::bind_to_location(uint32_t p_bind_location) const {
+        if (buffer_id) {
+            OpenGLContext::get_state().bind_buffer_range(GL_UNIFORM_BUFFER, p_bind_location, buffer_id, offset, size);
+        }
+    }
+
+
+    void UniformBuffer::bind() const {
+        OpenGLContext::get_state().bind_buffer(GL_UNIFORM_BUFFER, buffer_id);
+    }
+
+
+    void UniformBuffer::unbind() const {
+        OpenGLContext::get_state().bind_buffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+
+    UniformBuffer::Slice UniformBuffer::slice(uint32_t p_offset, uint32_t p_size) const {
+        return Slice(buffer_id, p_offset, p_size);
+    }
+
+
+    void UniformBuffer::allocate(uint32_t p_size) {
+        size = p_size;
+        if (!buffer_id) glCreateBuffers(1, &buffer_id);
+        bind();
+        glBufferData(GL_UNIFORM_BUFFER, p_size, nullptr, GL_STREAM_DRAW);
+    }
+
+
+    uint32_t UniformBuffer::get_size() const {
+        return size;
+    }
+
+
+    void UniformBuffer::write_data(uint32_t p_offset, uint32_t p_size, const void *p_data) {
+        bind();
+        glBufferSubData(GL_UNIFORM_BUFFER, p_offset, p_size, p_data);
+    }
+
+
+    UniformBuffer::UniformBuffer(UniformBuffer &&p_other)
+        : buffer_id(p_other.buffer_id),
+        size(p_other.size)
+    {
+        p_other.buffer_id = 0;
+    }
+
+
+    UniformBuffer &UniformBuffer::operator=(UniformBuffer &&p_other) {
+        if (buffer_id) {
+            _delete_buffer(buffer_id);
+        }
+
+        buffer_id = p_other.buffer_id;
+        size = p_other.size;
+
+        p_other.buffer_id = 0;
+        return *this;
+    }
+
+
+    UniformBuffer::~UniformBuffer() {
+        if (buffer_id) _delete_buffer(buffer_id);
+    }
+
+
+    void DrawIndirectBuffer::bind() const {
+        OpenGLContext::get_state().bind_buffer(GL_DRAW_INDIRECT_BUFFER, buffer_id);
+    }
+
+
+    void DrawIndirectBuffer::unbind() const {
+        OpenGLContext::get_state().bind_buffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+
+    void DrawIndirectBuffer::allocate(uint32_t p_size) {
+        size = p_size;
+        if (!buffer_id) glGenBuffers(1, &buffer_id); // Created by its first bind, through the state cache
+        bind();
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, p_size, nullptr, GL_STREAM_DRAW);
+    }
+
+
+    uint32_t DrawIndirectBuffer::get_size() const {
+        return size;
+    }
+
+
+    void DrawIndirectBuffer::write_data(uint32_t p_offset, uint32_t p_size, const void *p_data) {
+        bind();
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, p_offset, p_size, p_data);
+    }
+
+
+    void DrawIndirectBuffer::bind_to_storage_location(uint32_t p_bind_location) const {
+        if (buffer_id) {
+            OpenGLContext::get_state().bind_buffer_range(GL_SHADER_STORAGE_BUFFER, p_bind_location, buffer_id, 0, size);
+        }
+    }
+
+
+    DrawIndirectBuffer::DrawIndirectBuffer(DrawIndirectBuffer &&p_other)
+        : buffer_id(p_other.buffer_id),
+        size(p_other.size)
+    {
+        p_other.buffer_id = 0;
+    }
+
+
+    DrawIndirectBuffer &DrawIndirectBuffer::operator=(DrawIndirectBuffer &&p_other) {
+        if (buffer_id) {
+            _delete_buffer(buffer_id);
+        }
+
+        buffer_id = p_other.buffer_id;
+        size = p_other.size;
+
+        p_other.buffer_id = 0;
+        return *this;
+    }
+
+
+    DrawIndirectBuffer::~DrawIndirectBuffer() {
+        if (buffer_id) _delete_buffer(buffer_id);
     }
 }
@@ -36,10 +36,13 @@ namespace lixy::opengl {
         uint32_t get_attribute_size(uint32_t index) const;
         GLint get_attribute_gl_type(uint32_t index) const;
         uint32_t get_attribute_component_count(uint32_t index) const;
+        bool is_attribute_normalized(uint32_t index) const;
 
         inline uint32_t get_stride() const { return stride; }
         inline uint32_t get_layout_length() const { return layout_length; }
 
+        bool operator==(const BufferLayout &p_other) const;
+
         BufferLayout(const ShaderDataType *p_layout, uint32_t p_layout_length);
 
     private:
@@ -74,12 +77,38 @@ namespace lixy::opengl {
         void bind() const;
         void unbind() const;
 
-        IndexBuffer(const uint32_t *p_indices, uint32_t p_size);
+        inline GLenum get_gl_type() const { return gl_type; } // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        inline uint32_t get_index_size() const { return gl_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t); }
+
+        // `p_base_vertex` is subtracted from every index, indices are stored on 16 bits when the result fits
+        IndexBuffer(const uint32_t *p_indices, uint32_t p_size, uint32_t p_base_vertex = 0);
         IndexBuffer(const IndexBuffer &p_other) = delete;
         virtual ~IndexBuffer();
 
     private:
         uint32_t buffer_id;
+        GLenum gl_type;
+    };
+
+
+    // Untyped buffer, written and copied through the copy targets so that no vertex array state is modified
+    class Buffer {
+    public:
+        inline uint32_t get_id() const { return buffer_id; }
+        inline uint32_t get_size() const { return size; }
+
+        void write_data(uint32_t p_offset, uint32_t p_size, const void *p_data);
+        void copy_data(const Buffer &p_source, uint32_t p_source_offset, uint32_t p_offset, uint32_t p_size);
+
+        Buffer(uint32_t p_size);
+        Buffer(const Buffer&) = delete;
+        Buffer(Buffer &&p_other);
+        Buffer &operator=(Buffer &&p_other);
+        virtual ~Buffer();
+
+    private:
+        uint32_t buffer_id = 0;
+        uint32_t size = 0;
     };
 
 
@@ -91,12 +120,21 @@ namespace lixy::opengl {
         void add_vertex_buffer(std::shared_ptr<VertexBuffer> p_vertex_buffer, const BufferLayout &p_buffer_layout);
         void add_index_buffer(std::shared_ptr<IndexBuffer> p_index_buffer);
 
+        // The vertex array does not own these buffers, they must outlive it
+        void add_vertex_buffer(const Buffer &p_vertex_buffer, const BufferLayout &p_buffer_layout);
+        void add_index_buffer(const Buffer &p_index_buffer);
+        // Integer attribute advancing once per instance, it starts at the base instance of instanced draws
+        void add_instance_index_buffer(const Buffer &p_instance_index_buffer, uint32_t p_location);
+
         VertexArrayBuffer();
         VertexArrayBuffer(const VertexArrayBuffer&) = delete;
         VertexArrayBuffer(VertexArrayBuffer &&p_other);
         VertexArrayBuffer &operator=(VertexArrayBuffer &&p_other);
         virtual ~VertexArrayBuffer();
 
+    private:
+        void _add_attributes(const BufferLayout &p_buffer_layout);
+
     private:
         uint32_t array_index;
         uint32_t vertex_attrib_count;
@@ -137,13 +175,99 @@ namespace lixy::opengl {
         void allocate(uint32_t p_size);
         uint32_t get_size() const;
 
-        void write_data(uint32_t p_offset, uint32_t p_size, void *p_data);
+        // Immutable storage mapped for writing until the buffer is allocated again or destroyed. The mapping is coherent,
+        // commands issued after a write see it, keeping the GPU from reading the bytes being written is up to the caller.
+        void allocate_mapped(uint32_t p_size);
+        inline void *get_mapping() const { return mapping; }
+
+        void write_data(uint32_t p_offset, uint32_t p_size, const void *p_data);
+        void read_data(uint32_t p_offset, uint32_t p_size, void *p_data) const; // Waits for the commands writing the buffer
 
         ShaderStorageBuffer() = default;
         ShaderStorageBuffer(ShaderStorageBuffer &&p_other);
         ShaderStorageBuffer &operator=(ShaderStorageBuffer &&p_other);
         virtual ~ShaderStorageBuffer();
     
+    private:
+        uint32_t buffer_id = 0;
+        uint32_t size = 0;
+        void *mapping = nullptr;
+    };
+
+
+    class UniformBuffer {
+    public:
+        class Slice {
+        public:
+            void bind_to_location(uint32_t p_bind_location) const;
+
+            Slice() = default;
+        private:
+            inline Slice(uint32_t p_buffer_id, uint32_t p_offset, uint32_t p_size)
+                : buffer_id(p_buffer_id),
+                offset(p_offset),
+                size(p_size) {}
+
+        private:
+            uint32_t buffer_id = 0;
+            uint32_t offset;
+            uint32_t size;
+            
+            friend UniformBuffer;
+        };
+
+    public:
+        void bind() const;
+        void unbind() const;
+
+        // Offsets of bound slices must be a multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+        Slice slice(uint32_t p_offset, uint32_t p_size) const;
+
+        void allocate(uint32_t p_size);
+        uint32_t get_size() const;
+
+        void write_data(uint32_t p_offset, uint32_t p_size, const void *p_data);
+
+        UniformBuffer() = default;
+        UniformBuffer(UniformBuffer &&p_other);
+        UniformBuffer &operator=(UniformBuffer &&p_other);
+        virtual ~UniformBuffer();
+    
+    private:
+        uint32_t buffer_id = 0;
+        uint32_t size = 0;
+    };
+
+
+    // Layout of the commands read by glMultiDrawElementsIndirect
+    struct DrawElementsIndirectCommand {
+        uint32_t count;
+        uint32_t instance_count;
+        uint32_t first_index;
+        int32_t base_vertex;
+        uint32_t base_instance;
+    };
+
+
+    class DrawIndirectBuffer {
+    public:
+        void bind() const;
+        void unbind() const;
+
+        void allocate(uint32_t p_size);
+        uint32_t get_size() const;
+
+        void write_data(uint32_t p_offset, uint32_t p_size, const void *p_data);
+
+        // Binds the whole buffer as a shader storage buffer, for compute passes writing the commands
+        void bind_to_storage_location(uint32_t p_bind_location) const;
+
+        DrawIndirectBuffer() = default;
+        DrawIndirectBuffer(const DrawIndirectBuffer&) = delete;
+        DrawIndirectBuffer(DrawIndirectBuffer &&p_other);
+        DrawIndirectBuffer &operator=(DrawIndirectBuffer &&p_other);
+        virtual ~DrawIndirectBuffer();
+
     private:
         uint32_t buffer_id = 0;
         uint32_t size = 0;
@@ -0,0 +1,349 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "render_graph.hpp"
+
+#include "debug/debug.hpp"
+#include "renderer/src/primitives/context.hpp"
+
+#include "thirdparty/glad/include/glad/glad.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+
+namespace lixy {
+
+    RenderGraph::PassBuilder::PassBuilder(RenderGraph &p_graph, uint32_t p_pass)
+        : graph(&p_graph),
+        pass(p_pass) {}
+
+
+    RenderGraph::PassBuilder &RenderGraph::PassBuilder::read(Resource p_resource, Access p_access) {
+        ASSERT_FATAL_ERROR(p_resource < graph->versions.size(), "Pass " << graph->passes[pass].name << " reads an invalid resource");
+
+        Pass &graph_pass = graph->passes[pass];
+        graph_pass.reads.push_back(ResourceAccess{ .version = p_resource, .access = p_access });
+        if (p_access == Access::ATTACHMENT) graph_pass.attachments.push_back(graph_pass.reads.back());
+        return *this;
+    }
+
+
+    RenderGraph::Resource RenderGraph::PassBuilder::write(Resource p_resource, Access p_access) {
+        ASSERT_FATAL_ERROR(p_resource < graph->versions.size(), "Pass " << graph->passes[pass].name << " writes an invalid resource");
+        ASSERT_FATAL_ERROR(p_access != Access::SAMPLED && p_access != Access::INDIRECT, "Pass " << graph->passes[pass].name << " writes through a read only access");
+
+        Version &previous = graph->versions[p_resource];
+        ASSERT_FATAL_ERROR(!previous.written, "Pass " << graph->passes[pass].name << " writes a version of " << graph->resources[previous.resource].name << " that was already written");
+        previous.written = true;
+
+        Resource version = graph->versions.size();
+        graph->versions.push_back(Version{
+            .resource = previous.resource,
+            .writer = pass,
+            .write_access = p_access,
+            .previous = p_resource,
+        });
+
+        Pass &graph_pass = graph->passes[pass];
+        graph_pass.writes.push_back(ResourceAccess{ .version = version, .access = p_access });
+        if (p_access == Access::ATTACHMENT) graph_pass.attachments.push_back(graph_pass.writes.back());
+        return version;
+    }
+
+
+    RenderGraph::RenderGraph(RenderTargetPool &p_pool)
+        : pool(&p_pool) {}
+
+
+    RenderGraph::Resource RenderGraph::create_texture(const std::string &p_name, const TextureDesc &p_desc) {
+        return _add_resource(p_name, ResourceType::TEXTURE, p_desc, NO_PASS, Access::ATTACHMENT);
+    }
+
+
+    RenderGraph::Resource RenderGraph::import_backbuffer(uint32_t p_width, uint32_t p_height) {
+        return _add_resource("Backbuffer", ResourceType::BACKBUFFER, TextureDesc{ p_width, p_height, opengl::TextureFormat::RGBA8 }, NO_PASS, Access::ATTACHMENT);
+    }
+
+
+    RenderGraph::Resource RenderGraph::import_resource(const std::string &p_name) {
+        auto imported_write = imported_writes.find(p_name);
+        if (imported_write == imported_writes.end()) return _add_resource(p_name, ResourceType::IMPORTED, TextureDesc{}, NO_PASS, Access::ATTACHMENT);
+        return _add_resource(p_name, ResourceType::IMPORTED, TextureDesc{}, PREVIOUS_FRAME, imported_write->second);
+    }
+
+
+    RenderGraph::PassBuilder RenderGraph::add_pass(const std::string &p_name, std::function<void(RenderGraph &p_graph)> p_execute) {
+        passes.push_back(Pass{ .name = p_name, .execute = std::move(p_execute) });
+        return PassBuilder(*this, passes.size() - 1);
+    }
+
+
+    EntityRef RenderGraph::get_texture(Resource p_resource) const {
+        const ResourceNode &resource = resources[versions[p_resource].resource];
+        ASSERT_FATAL_ERROR(resource.type == ResourceType::TEXTURE && resource.target != RenderTargetPool::INVALID_TARGET, "No texture holds " << resource.name);
+        return pool->get_texture(resource.target);
+    }
+
+
+    uint32_t RenderGraph::get_texture_id(Resource p_resource) const {
+        const ResourceNode &resource = resources[versions[p_resource].resource];
+        ASSERT_FATAL_ERROR(resource.type == ResourceType::TEXTURE && resource.target != RenderTargetPool::INVALID_TARGET, "No texture holds " << resource.name);
+        return pool->get_texture_id(resource.target);
+    }
+
+
+    const RenderGraph::TextureDesc &RenderGraph::get_texture_desc(Resource p_resource) const {
+        return resources[versions[p_resource].resource].desc;
+    }
+
+
+    void RenderGraph::blit(Resource p_source, Resource p_destination) {
+        const ResourceNode &source = resources[versions[p_source].resource];
+        const ResourceNode &destination = resources[versions[p_destination].resource];
+
+        ASSERT_FATAL_ERROR(source.type == ResourceType::TEXTURE && source.target != RenderTargetPool::INVALID_TARGET, "No texture holds " << source.name);
+        bool depth_stencil = source.desc.format == opengl::TextureFormat::DEPTH24_STENCIL8;
+        bool same_size = source.desc.width == destination.desc.width && source.desc.height == destination.desc.height;
+        ASSERT_FATAL_ERROR(same_size || (!depth_stencil && source.desc.samples == 1), "Blit of " << source.name << " to " << destination.name << " can not be scaled");
+
+        uint32_t read_framebuffer = depth_stencil ? pool->get_framebuffer({}, source.target) : pool->get_framebuffer({ source.target });
+        uint32_t draw_framebuffer = 0;
+        if (destination.type != ResourceType::BACKBUFFER) {
+            ASSERT_FATAL_ERROR(destination.type == ResourceType::TEXTURE && destination.target != RenderTargetPool::INVALID_TARGET, "No texture holds " << destination.name);
+            draw_framebuffer = depth_stencil ? pool->get_framebuffer({}, destination.target) : pool->get_framebuffer({ destination.target });
+        }
+
+        glBlitNamedFramebuffer(read_framebuffer, draw_framebuffer,
+            0, 0, source.desc.width, source.desc.height,
+            0, 0, destination.desc.width, destination.desc.height,
+            depth_stencil ? GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT : GL_COLOR_BUFFER_BIT, same_size ? GL_NEAREST : GL_LINEAR);
+    }
+
+
+    void RenderGraph::execute(flecs::world &p_world) {
+        _compile(p_world);
+
+        opengl::StateCache &state = opengl::OpenGLContext::get_state();
+        for (uint32_t pass_index : order) {
+            Pass &pass = passes[pass_index];
+            if (pass.barrier_bits) glMemoryBarrier(pass.barrier_bits);
+            if (pass.binds_framebuffer) {
+                state.bind_framebuffer(pass.framebuffer);
+                state.set_viewport(0, 0, pass.width, pass.height);
+            }
+            pass.execute(*this);
+        }
+
+        _reset();
+    }
+
+
+    RenderGraph::Resource RenderGraph::_add_resource(const std::string &p_name, ResourceType p_type, const TextureDesc &p_desc, uint32_t p_writer, Access p_write_access) {
+        resources.push_back(ResourceNode{ .name = p_name, .type = p_type, .desc = p_desc });
+        versions.push_back(Version{
+            .resource = (uint32_t)resources.size() - 1,
+            .writer = p_writer,
+            .write_access = p_write_access,
+            .previous = INVALID_RESOURCE,
+        });
+        return versions.size() - 1;
+    }
+
+
+    void RenderGraph::_compile(flecs::world &p_world) {
+        std::vector<std::vector<uint32_t>> readers(versions.size()); // Passes reading every version
+        for (uint32_t pass = 0; pass < passes.size(); pass++) {
+            for (const ResourceAccess &read : passes[pass].reads) readers[read.version].push_back(pass);
+        }
+
+        _sort_passes(readers);
+        _cull_passes(readers);
+        _assign_textures(p_world);
+        _prepare_passes();
+    }
+
+
+    void RenderGraph::_sort_passes(const std::vector<std::vector<uint32_t>> &p_readers) {
+        std::vector<std::vector<uint32_t>> successors(passes.size());
+        std::vector<uint32_t> predecessor_counts(passes.size(), 0);
+        auto add_dependency = [&](uint32_t p_before, uint32_t p_after) {
+            if (p_before >= passes.size() || p_before == p_after) return; // Written before the graph, or read and written by the pass
+            successors[p_before].push_back(p_after);
+            predecessor_counts[p_after]++;
+        };
+
+        for (uint32_t pass = 0; pass < passes.size(); pass++) {
+            for (const ResourceAccess &read : passes[pass].reads) add_dependency(versions[read.version].writer, pass);
+
+            // Writes run after the previous writer and the passes reading the previous version
+            for (const ResourceAccess &write : passes[pass].writes) {
+                Resource previous = versions[write.version].previous;
+                add_dependency(versions[previous].writer, pass);
+                for (uint32_t reader : p_readers[previous]) add_dependency(reader, pass);
+            }
+        }
+
+        // Passes that are ready run in declaration order
+        std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+        for (uint32_t pass = 0; pass < passes.size(); pass++) {
+            if (predecessor_counts[pass] == 0) ready.push(pass);
+        }
+
+        order.clear();
+        while (!ready.empty()) {
+            uint32_t pass = ready.top();
+            ready.pop();
+            order.push_back(pass);
+
+            for (uint32_t successor : successors[pass]) {
+                if (--predecessor_counts[successor] == 0) ready.push(successor);
+            }
+        }
+        ASSERT_FATAL_ERROR(order.size() == passes.size(), "The passes of the render graph depend on each other");
+    }
+
+
+    void RenderGraph::_cull_passes(const std::vector<std::vector<uint32_t>> &p_readers) {
+        // Readers run after writers, live readers are known when their writers are reached backwards
+        for (auto it = order.rbegin(); it != order.rend(); it++) {
+            Pass &pass = passes[*it];
+            for (const ResourceAccess &write : pass.writes) {
+                if (resources[versions[write.version].resource].type != ResourceType::TEXTURE) pass.live = true;
+                for (uint32_t reader : p_readers[write.version]) pass.live |= passes[reader].live;
+            }
+        }
+
+        order.erase(std::remove_if(order.begin(), order.end(), [&](uint32_t p_pass) { return !passes[p_pass].live; }), order.end());
+    }
+
+
+    void RenderGraph::_assign_textures(flecs::world &p_world) {
+        for (ResourceNode &resource : resources) {
+            resource.first_access = UINT32_MAX;
+            resource.last_access = 0;
+        }
+        for (uint32_t index = 0; index < order.size(); index++) {
+            const Pass &pass = passes[order[index]];
+            for (const std::vector<ResourceAccess> *accesses : { &pass.reads, &pass.writes }) {
+                for (const ResourceAccess &access : *accesses) {
+                    ResourceNode &resource = resources[versions[access.version].resource];
+                    resource.first_access = std::min(resource.first_access, index);
+                    resource.last_access = std::max(resource.last_access, index);
+                }
+            }
+        }
+
+        // A target released after the last access of a transient is acquired again by the transients accessed later
+        for (uint32_t index = 0; index < order.size(); index++) {
+            for (ResourceNode &resource : resources) {
+                if (resource.type == ResourceType::TEXTURE && resource.first_access == index) resource.target = pool->acquire(p_world, resource.desc);
+            }
+            for (const ResourceNode &resource : resources) {
+                if (resource.type == ResourceType::TEXTURE && resource.last_access == index && resource.first_access != UINT32_MAX) pool->release(resource.target);
+            }
+        }
+    }
+
+
+    void RenderGraph::_prepare_passes() {
+        for (uint32_t pass_index : order) {
+            Pass &pass = passes[pass_index];
+
+            pass.barrier_bits = 0;
+            for (const ResourceAccess &read : pass.reads) {
+                const Version &version = versions[read.version];
+                if (version.writer == NO_PASS) continue;
+                pass.barrier_bits |= _get_barrier_bits(version.write_access, read.access);
+                if (version.writer == PREVIOUS_FRAME) imported_writes.erase(resources[version.resource].name);
+            }
+
+            // Remember the shader writes of imported resources for the next execution
+            for (const ResourceAccess &write : pass.writes) {
+                const ResourceNode &resource = resources[versions[write.version].resource];
+                if (resource.type != ResourceType::IMPORTED || versions[write.version].written) continue;
+                if (write.access == Access::IMAGE || write.access == Access::STORAGE) {
+                    imported_writes[resource.name] = write.access;
+                } else {
+                    imported_writes.erase(resource.name);
+                }
+            }
+
+            if (pass.attachments.empty()) continue;
+
+            std::vector<RenderTargetPool::Target> color_targets;
+            RenderTargetPool::Target depth_stencil_target = RenderTargetPool::INVALID_TARGET;
+            bool backbuffer = false;
+            for (const ResourceAccess &attachment : pass.attachments) {
+                const ResourceNode &resource = resources[versions[attachment.version].resource];
+                ASSERT_FATAL_ERROR(resource.type != ResourceType::IMPORTED, "Pass " << pass.name << " attaches the imported resource " << resource.name);
+                if (!pass.binds_framebuffer) {
+                    pass.binds_framebuffer = true;
+                    pass.width = resource.desc.width;
+                    pass.height = resource.desc.height;
+                }
+                ASSERT_FATAL_ERROR(resource.desc.width == pass.width && resource.desc.height == pass.height, "The attachments of pass " << pass.name << " differ in size");
+
+                if (resource.type == ResourceType::BACKBUFFER) {
+                    backbuffer = true;
+                    continue;
+                }
+                if (resource.desc.format == opengl::TextureFormat::DEPTH24_STENCIL8) {
+                    depth_stencil_target = resource.target;
+                } else if (std::find(color_targets.begin(), color_targets.end(), resource.target) == color_targets.end()) {
+                    color_targets.push_back(resource.target);
+                }
+            }
+
+            if (backbuffer) {
+                ASSERT_FATAL_ERROR(color_targets.empty() && depth_stencil_target == RenderTargetPool::INVALID_TARGET, "Pass " << pass.name << " attaches textures with the backbuffer");
+                pass.framebuffer = 0;
+            } else {
+                pass.framebuffer = pool->get_framebuffer(color_targets, depth_stencil_target);
+            }
+        }
+    }
+
+
+    void RenderGraph::_reset() {
+        resources.clear();
+        versions.clear();
+        passes.clear();
+        order.clear();
+    }
+
+
+    uint32_t RenderGraph::_get_barrier_bits(Access p_write, Access p_read) {
+        // Framebuffer writes are ordered with the commands that follow them
+        if (p_write == Access::IMAGE) {
+            switch (p_read) {
+                case Access::SAMPLED: return GL_TEXTURE_FETCH_BARRIER_BIT;
+                case Access::IMAGE: return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+                case Access::ATTACHMENT: case Access::BLIT: return GL_FRAMEBUFFER_BARRIER_BIT;
+                default: return 0;
+            }
+        }
+        if (p_write == Access::STORAGE) {
+            switch (p_read) {
+                case Access::STORAGE: return GL_SHADER_STORAGE_BARRIER_BIT;
+                case Access::INDIRECT: return GL_COMMAND_BARRIER_BIT;
+                default: return 0;
+            }
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,169 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+
+#include "core/src/ref.hpp"
+#include "renderer/src/primitives/texture.hpp"
+#include "renderer/src/render_target_pool.hpp"
+
+#include "thirdparty/flecs/flecs.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace lixy {
+
+    // Passes of a frame and the resources they read and write, declared again every frame. Executing the graph runs
+    // every pass after the ones writing what it reads, culls the passes whose writes are never read, binds the
+    // framebuffer of the attachments of each pass and issues the memory barriers between shader writes and the passes
+    // reading them. The textures of transients are render targets of the pool, acquired before the first pass accessing
+    // them and released after the last one, so transients whose accesses do not overlap share a target.
+    // Writing a resource creates a new version of it: the passes reading the previous version run before the writer,
+    // the passes reading the new one after it. Imported resources outlive the frame, the passes writing them are never
+    // culled and the barrier of their last write is issued before the first read of the next frame.
+    class RenderGraph {
+    public:
+        typedef uint32_t Resource; // Version of a resource
+        static constexpr Resource INVALID_RESOURCE = UINT32_MAX;
+
+        // How a pass accesses a resource. Writes through image stores and storage buffers are only visible after a
+        // barrier, whose bits follow how the next pass reads the resource.
+        enum class Access {
+            ATTACHMENT, // Attached to the framebuffer of the pass, drawn or depth and stencil tested
+            BLIT, // Source or destination of `blit`
+            SAMPLED, // Fetched through a sampler
+            IMAGE, // Loaded or stored through an image unit
+            STORAGE, // Shader storage buffer
+            INDIRECT, // Draw or dispatch commands
+        };
+
+        typedef RenderTargetDesc TextureDesc;
+
+        // Declares the accesses of a pass
+        class PassBuilder {
+        public:
+            PassBuilder &read(Resource p_resource, Access p_access);
+            // Returns the new version of the resource, the passes depending on this write read it
+            Resource write(Resource p_resource, Access p_access);
+
+        private:
+            PassBuilder(RenderGraph &p_graph, uint32_t p_pass);
+            friend RenderGraph;
+
+            RenderGraph *graph;
+            uint32_t pass;
+        };
+
+    public:
+        // The texture is allocated when the graph is executed, its content is undefined until a pass writes it
+        Resource create_texture(const std::string &p_name, const TextureDesc &p_desc);
+        // The window framebuffer, attached alone
+        Resource import_backbuffer(uint32_t p_width, uint32_t p_height);
+        // Texture or buffer of the caller, declared for the order of the passes and their barriers. Resources imported
+        // with the same name in consecutive frames are the same.
+        Resource import_resource(const std::string &p_name);
+
+        // `p_execute` runs with the framebuffer of the attachments of the pass bound and the viewport set to their size
+        PassBuilder add_pass(const std::string &p_name, std::function<void(RenderGraph &p_graph)> p_execute);
+
+        // Texture of a transient during the execution, its entity can be bound to materials
+        EntityRef get_texture(Resource p_resource) const;
+        uint32_t get_texture_id(Resource p_resource) const;
+        const TextureDesc &get_texture_desc(Resource p_resource) const;
+        // Copies the color of a texture to another one or the backbuffer, scaled with linear filtering when they differ
+        // in size. Depth stencil textures are copied to textures of the same size. Multisampled textures are resolved,
+        // which needs a destination of the same size.
+        void blit(Resource p_source, Resource p_destination);
+
+        // Compiles and runs the passes, which are then declared again for the next execution
+        void execute(flecs::world &p_world);
+
+        RenderGraph(RenderTargetPool &p_pool);
+        RenderGraph(const RenderGraph&) = delete;
+        virtual ~RenderGraph() = default;
+
+    private:
+        static constexpr uint32_t NO_PASS = UINT32_MAX;
+        static constexpr uint32_t PREVIOUS_FRAME = UINT32_MAX - 1; // Writer of imported resources written by the last execution
+
+        enum class ResourceType {
+            TEXTURE,
+            BACKBUFFER,
+            IMPORTED,
+        };
+
+        struct ResourceNode {
+            std::string name;
+            ResourceType type;
+            TextureDesc desc;
+            RenderTargetPool::Target target = RenderTargetPool::INVALID_TARGET; // Acquired for the transients of live passes
+            uint32_t first_access, last_access; // Execution indices of the passes accessing it
+        };
+
+        struct Version {
+            uint32_t resource;
+            uint32_t writer; // Pass creating the version
+            Access write_access;
+            Resource previous;
+            bool written = false; // A pass created the next version
+        };
+
+        struct ResourceAccess {
+            Resource version;
+            Access access;
+        };
+
+        struct Pass {
+            std::string name;
+            std::function<void(RenderGraph &p_graph)> execute;
+            std::vector<ResourceAccess> reads;
+            std::vector<ResourceAccess> writes;
+            std::vector<ResourceAccess> attachments; // Read or written, colors are attached in this order
+
+            // Compiled
+            bool live = false;
+            uint32_t barrier_bits = 0;
+            bool binds_framebuffer = false;
+            uint32_t framebuffer = 0;
+            uint32_t width = 0, height = 0;
+        };
+
+    private:
+        Resource _add_resource(const std::string &p_name, ResourceType p_type, const TextureDesc &p_desc, uint32_t p_writer, Access p_write_access);
+        void _compile(flecs::world &p_world);
+        void _sort_passes(const std::vector<std::vector<uint32_t>> &p_readers);
+        void _cull_passes(const std::vector<std::vector<uint32_t>> &p_readers);
+        void _assign_textures(flecs::world &p_world);
+        void _prepare_passes();
+        void _reset();
+        static uint32_t _get_barrier_bits(Access p_write, Access p_read);
+
+    private:
+        std::vector<ResourceNode> resources;
+        std::vector<Version> versions;
+        std::vector<Pass> passes;
+        std::vector<uint32_t> order; // Live passes in execution order
+
+        RenderTargetPool *pool;
+        std::unordered_map<std::string, Access> imported_writes; // Last write of imported resources not read since
+    };
+}
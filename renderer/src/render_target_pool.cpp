@@ -0,0 +1,165 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "render_target_pool.hpp"
+
+#include "debug/debug.hpp"
+#include "renderer/src/texture.hpp"
+
+#include <algorithm>
+
+
+namespace lixy {
+
+    RenderTargetPool::Target RenderTargetPool::acquire(flecs::world &p_world, const RenderTargetDesc &p_desc) {
+        for (Target target = 0; target < targets.size(); target++) {
+            RenderTarget &render_target = targets[target];
+            if (render_target.held || !render_target.texture.is_alive() || !(render_target.desc == p_desc)) continue;
+
+            render_target.held = true;
+            render_target.acquired = true;
+            frame_metrics.hits++;
+            return target;
+        }
+
+        // Entities of new targets are used right away, systems acquiring them must be immediate
+        bool deferred = p_world.is_deferred();
+        if (deferred) p_world.defer_suspend();
+        EntityRef texture = Texture::create_texture2d(p_world, p_desc.width, p_desc.height, p_desc.format, p_desc.samples);
+        if (deferred) p_world.defer_resume();
+
+        Target target;
+        if (free_slots.empty()) {
+            target = targets.size();
+            targets.emplace_back();
+        } else {
+            // The lowest slot, acquisitions of the next frames find the targets in the order this frame allocated them
+            auto slot = std::min_element(free_slots.begin(), free_slots.end());
+            target = *slot;
+            free_slots.erase(slot);
+        }
+        targets[target] = RenderTarget{ .desc = p_desc, .texture = texture, .held = true, .acquired = true };
+        frame_metrics.misses++;
+        return target;
+    }
+
+
+    void RenderTargetPool::release(Target p_target) {
+        ASSERT_FATAL_ERROR(p_target < targets.size() && targets[p_target].held, "Released a render target that is not held");
+        targets[p_target].held = false;
+    }
+
+
+    EntityRef RenderTargetPool::get_texture(Target p_target) const {
+        return targets[p_target].texture;
+    }
+
+
+    uint32_t RenderTargetPool::get_texture_id(Target p_target) const {
+        return targets[p_target].texture.get<Texture>()->get_texture_id();
+    }
+
+
+    const RenderTargetDesc &RenderTargetPool::get_desc(Target p_target) const {
+        return targets[p_target].desc;
+    }
+
+
+    uint32_t RenderTargetPool::get_framebuffer(const std::vector<Target> &p_color_targets, Target p_depth_stencil_target) {
+        std::vector<Target> key = p_color_targets;
+        key.push_back(p_depth_stencil_target);
+
+        auto framebuffer = framebuffers.find(key);
+        if (framebuffer == framebuffers.end()) {
+            const RenderTargetDesc &desc = targets[p_color_targets.empty() ? p_depth_stencil_target : p_color_targets[0]].desc;
+
+            std::vector<uint32_t> color_textures;
+            for (Target target : p_color_targets) color_textures.push_back(get_texture_id(target));
+            uint32_t depth_stencil_texture = p_depth_stencil_target == INVALID_TARGET ? 0 : get_texture_id(p_depth_stencil_target);
+
+            framebuffer = framebuffers.emplace(key, opengl::Framebuffer(desc.width, desc.height, color_textures, depth_stencil_texture)).first;
+            ASSERT_FATAL_ERROR(framebuffer->second.is_complete(), "Incomplete render target framebuffer");
+        }
+        return framebuffer->second.get_id();
+    }
+
+
+    void RenderTargetPool::end_frame() {
+        frame_metrics.target_count = 0;
+        frame_metrics.bytes = 0;
+
+        for (Target target = 0; target < targets.size(); target++) {
+            RenderTarget &render_target = targets[target];
+            if (!render_target.texture.is_alive()) continue;
+
+            render_target.idle_frames = render_target.acquired ? 0 : render_target.idle_frames + 1;
+            render_target.acquired = render_target.held;
+            if (render_target.idle_frames >= IDLE_FRAME_LIMIT && !render_target.held) {
+                _destroy_target(target);
+                continue;
+            }
+
+            frame_metrics.target_count++;
+            frame_metrics.bytes += _get_size(render_target.desc);
+        }
+
+        metrics = frame_metrics;
+        frame_metrics = Metrics{};
+    }
+
+
+    void RenderTargetPool::destroy_targets(uint32_t p_width, uint32_t p_height) {
+        for (Target target = 0; target < targets.size(); target++) {
+            const RenderTarget &render_target = targets[target];
+            if (render_target.texture.is_alive() && !render_target.held && render_target.desc.width == p_width && render_target.desc.height == p_height) {
+                _destroy_target(target);
+            }
+        }
+    }
+
+
+    const RenderTargetPool::Metrics &RenderTargetPool::get_metrics() const {
+        return metrics;
+    }
+
+
+    void RenderTargetPool::_destroy_target(Target p_target) {
+        for (auto framebuffer = framebuffers.begin(); framebuffer != framebuffers.end();) {
+            const std::vector<Target> &attached = framebuffer->first;
+            framebuffer = std::find(attached.begin(), attached.end(), p_target) != attached.end() ? framebuffers.erase(framebuffer) : std::next(framebuffer);
+        }
+        targets[p_target].texture.drop();
+        free_slots.push_back(p_target);
+    }
+
+
+    uint64_t RenderTargetPool::_get_size(const RenderTargetDesc &p_desc) {
+        uint64_t pixel_size = 0;
+        switch (p_desc.format) {
+            case opengl::TextureFormat::R8: pixel_size = 1; break;
+            case opengl::TextureFormat::RG8: pixel_size = 2; break;
+            case opengl::TextureFormat::RGB8: pixel_size = 3; break;
+            case opengl::TextureFormat::RGBA8: pixel_size = 4; break;
+            case opengl::TextureFormat::R16: pixel_size = 2; break;
+            case opengl::TextureFormat::RG16: pixel_size = 4; break;
+            case opengl::TextureFormat::RGB16: pixel_size = 6; break;
+            case opengl::TextureFormat::RGBA16: pixel_size = 8; break;
+            case opengl::TextureFormat::RGBA16F: pixel_size = 8; break;
+            case opengl::TextureFormat::DEPTH24_STENCIL8: pixel_size = 4; break;
+        }
+        return (uint64_t)p_desc.width * p_desc.height * pixel_size * p_desc.samples;
+    }
+}
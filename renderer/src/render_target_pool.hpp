@@ -0,0 +1,103 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+
+#include "core/src/ref.hpp"
+#include "renderer/src/primitives/framebuffer.hpp"
+#include "renderer/src/primitives/texture.hpp"
+
+#include "thirdparty/flecs/flecs.h"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+
+namespace lixy {
+
+    struct RenderTargetDesc {
+        uint32_t width, height;
+        opengl::TextureFormat format;
+        uint32_t samples = 1; // Multisampled targets are attached and resolved by blits, not sampled
+
+        inline bool operator==(const RenderTargetDesc &p_other) const {
+            return width == p_other.width && height == p_other.height && format == p_other.format && samples == p_other.samples;
+        }
+    };
+
+
+    // Render targets recycled between the users of a frame and across frames. A target acquired and not yet released
+    // is held by a single user, released targets are handed out again to acquisitions of the same size, format and
+    // sample count, so intermediate targets are only allocated until the pool holds enough of them. Targets that no
+    // acquisition used for `IDLE_FRAME_LIMIT` frames are destroyed with the framebuffers attaching them.
+    class RenderTargetPool {
+    public:
+        typedef uint32_t Target;
+        static constexpr Target INVALID_TARGET = UINT32_MAX;
+        static constexpr uint32_t IDLE_FRAME_LIMIT = 2;
+
+        struct Metrics {
+            uint32_t hits = 0; // Acquisitions of the frame served by a pooled target
+            uint32_t misses = 0; // Acquisitions of the frame that allocated a target
+            uint32_t target_count = 0;
+            uint64_t bytes = 0; // Video memory of the targets, estimated from their size and format
+        };
+
+    public:
+        Target acquire(flecs::world &p_world, const RenderTargetDesc &p_desc);
+        void release(Target p_target); // Its content is undefined for the next acquisition
+
+        // The texture entity can be bound to materials
+        EntityRef get_texture(Target p_target) const;
+        uint32_t get_texture_id(Target p_target) const;
+        const RenderTargetDesc &get_desc(Target p_target) const;
+        // Framebuffer attaching the targets, created on first use and kept as long as they are
+        uint32_t get_framebuffer(const std::vector<Target> &p_color_targets, Target p_depth_stencil_target = INVALID_TARGET);
+
+        // Destroys the idle targets, then the metrics of the frame are read by `get_metrics`
+        void end_frame();
+        // Destroys the targets of this size that are not held, once it is not acquired anymore
+        void destroy_targets(uint32_t p_width, uint32_t p_height);
+        const Metrics &get_metrics() const; // Of the last frame
+
+        RenderTargetPool() = default;
+        RenderTargetPool(const RenderTargetPool&) = delete;
+        virtual ~RenderTargetPool() = default;
+
+    private:
+        struct RenderTarget {
+            RenderTargetDesc desc;
+            EntityRef texture; // Not alive for free slots
+            uint32_t idle_frames = 0;
+            bool held = false;
+            bool acquired = false; // During the current frame
+        };
+
+    private:
+        void _destroy_target(Target p_target);
+        static uint64_t _get_size(const RenderTargetDesc &p_desc);
+
+    private:
+        std::vector<RenderTarget> targets;
+        std::vector<Target> free_slots;
+        std::map<std::vector<Target>, opengl::Framebuffer> framebuffers; // By attached targets, the depth stencil last
+
+        Metrics frame_metrics;
+        Metrics metrics;
+    };
+}
@@ -22,7 +22,7 @@
 #include "core/src/transform.hpp"
 #include "debug/debug.hpp"
 #include "renderer/src/camera.hpp"
-#include "renderer/src/framebuffer.hpp"
+#include "renderer/src/geometry_arena.hpp"
 #include "renderer/src/light.hpp"
 #include "renderer/src/material.hpp"
 #include "renderer/src/mesh.hpp"
@@ -31,13 +31,19 @@
 #include "renderer/src/primitives/shader.hpp"
 #include "renderer/src/primitives/texture.hpp"
 #include "renderer/src/primitives/vbuffer.hpp"
+#include "renderer/src/render_graph.hpp"
 #include "thirdparty/flecs/flecs.h"
 #include "thirdparty/glm/ext/matrix_clip_space.hpp"
+#include "thirdparty/glm/gtc/constants.hpp"
 #include "thirdparty/glm/matrix.hpp"
 #include "windowing/src/window.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cfloat>
+#include <cmath>
 #include <memory>
+#include <vector>
 
 
 namespace lixy {
@@ -48,41 +54,85 @@ namespace lixy {
         "layout(location = 0) in vec3 position;"
         "layout(location = 1) in vec3 normal;"
         "layout(location = 2) in vec2 tex_coord;"
+        "layout(location = 8) in uint instance_index;" // GeometryArena::INSTANCE_INDEX_LOCATION
         ""
-        "uniform mat4 u_model;"
-        "uniform mat4 u_view;"
-        "uniform mat4 u_projection;"
+        "struct Instance {"
+        "    mat4 model;"
+        "    vec4 position_offset;" // Dequantization of compact vertex positions
+        "    vec4 position_scale;"
+        "};"
+        ""
+        "layout(std430, binding = 2) readonly buffer InstanceData {"
+        "    Instance instances[];"
+        "};"
+        ""
+        "layout(std140, binding = 0) uniform FrameData {" // Renderer::FRAME_DATA_BINDING
+        "    mat4 view;"
+        "    mat4 projection;"
+        "    mat4 inverse_view;"
+        "    mat4 inverse_projection;"
+        "    vec4 camera_position;"
+        "    float time;"
+        "} frame;"
         ""
         "layout(location = 0) out vec4 out_position;"
         "layout(location = 1) out vec3 out_normal;"
         "layout(location = 2) out vec2 out_tex_coord;"
         ""
         "void main() {"
-        "    out_position = u_model * vec4(position, 1.0);"
-        "    gl_Position = u_projection * u_view * out_position;"
-        "    out_normal = mat3(transpose(inverse(u_model))) * normal;"
+        "    Instance instance = instances[instance_index];"
+        "    mat4 model = instance.model;"
+        "    out_position = model * vec4(instance.position_offset.xyz + position * instance.position_scale.xyz, 1.0);"
+        "    gl_Position = frame.projection * frame.view * out_position;"
+        "    out_normal = mat3(transpose(inverse(model))) * normal;"
         "    out_tex_coord = tex_coord;"
         "}";
     
-    static const std::string DEFAULT_FRAGMENT_SHADER =
-        "#version 430 core\n"
+    // Outputs of the geometry pass for every gbuffer layout, material fragment shaders write them with `write_surface`
+    static const std::string FULL_SURFACE_OUTPUT =
+        "layout(location = 0) out vec4 out_position;"
+        "layout(location = 1) out vec4 out_color;"
+        "layout(location = 2) out vec4 out_normal;"
+        ""
+        "void write_surface(vec3 position, vec4 color, vec3 normal) {"
+        "    out_position = vec4(position, 1.0);"
+        "    out_color = color;"
+        "    out_normal = vec4(normal, 1.0);"
+        "}";
+
+    static const std::string COMPACT_SURFACE_OUTPUT =
+        "layout(location = 0) out vec4 out_color;"
+        "layout(location = 1) out vec4 out_normal;" // Opaque, the geometry pass blends
         ""
+        "void write_surface(vec3 position, vec4 color, vec3 normal) {" // The position is read back from the depth
+        "    normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);" // Octahedral mapping, the lower half is folded out
+        "    vec2 folded = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);"
+        "    out_color = color;"
+        "    out_normal = vec4((normal.z >= 0.0 ? normal.xy : folded) * 0.5 + 0.5, 0.0, 1.0);"
+        "}";
+
+    // Follows the surface outputs
+    static const std::string DEFAULT_FRAGMENT_SHADER =
         "layout(location = 0) in vec4 position;"
         "layout(location = 1) in vec3 normal;"
         "layout(location = 2) in vec2 tex_coord;"
         ""
-        "layout(location = 0) out vec4 out_position;"
-        "layout(location = 1) out vec4 out_color;"
-        "layout(location = 2) out vec4 out_normal;"
-        ""
         "uniform sampler2D u_albedo_texture;"
-        "uniform vec3 u_albedo_offset = vec3(0.0, 0.0, 0.0);"
-        "uniform vec3 u_albedo_scale = vec3(1.0, 1.0, 1.0);"
+        ""
+        "struct Material {"
+        "    vec3 u_albedo_offset;"
+        "    vec3 u_albedo_scale;"
+        "};"
+        ""
+        "layout(std430, binding = 3) readonly buffer MaterialData {" // One element per material of the program
+        "    Material materials[];"
+        "};"
+        "uniform int u_material_index;"
         ""
         "void main() {"
-        "    out_position = position;"
-        "    out_color = texture(u_albedo_texture, u_albedo_offset.xy + tex_coord * u_albedo_scale.xy);"
-        "    out_normal = vec4(normalize(normal), 1.0);"
+        "    Material material = materials[u_material_index];"
+        "    vec4 color = texture(u_albedo_texture, material.u_albedo_offset.xy + tex_coord * material.u_albedo_scale.xy);"
+        "    write_surface(position.xyz, color, normalize(normal));"
         "}";
 
 
@@ -99,11 +149,8 @@ namespace lixy {
         "    out_uv = uv;"
         "}";
 
-    static const std::string SCREEN_FRAGMENT_SHADER =
-        "#version 430 core\n"
-        ""
-        "layout(location = 0) in vec2 uv;"
-        ""
+    // Point light buffers and the diffuse lighting of a surface by one of them, shared by the lighting paths
+    static const std::string POINT_LIGHT_SHADING =
         "struct PointLight {"
         "    float r;" // Separate the color elements for better struct alignment
         "    float g;"
@@ -120,39 +167,203 @@ namespace lixy {
         "    vec4 point_lights_position[];"
         "};"
         ""
-        "layout(location = 0) out vec4 out_color;"
+        "vec3 shade_point_light(uint i, vec3 position, vec3 color, vec3 normal) {"
+        "    float radius = point_lights_data[i].radius;"
+        "    float energy = point_lights_data[i].energy;"
+        "    vec3 light_color = vec3(point_lights_data[i].r, point_lights_data[i].g, point_lights_data[i].b);"
         ""
+        "    vec3 light_screen_position = point_lights_position[i].xyz;"
+        "    vec3 light_direction = normalize(light_screen_position - position);"
+        ""
+        "    float light_influence = max(radius - length(light_screen_position - position), 0.0) / radius;"
+        "    light_influence *= light_influence;"
+        ""
+        "    return max(dot(normal, light_direction), 0.0) * light_color * color * light_influence * energy;"
+        "}";
+
+    static const std::string FRAME_DATA_BLOCK =
+        "layout(std140, binding = 0) uniform FrameData {" // Renderer::FRAME_DATA_BINDING
+        "    mat4 view;"
+        "    mat4 projection;"
+        "    mat4 inverse_view;"
+        "    mat4 inverse_projection;"
+        "    vec4 camera_position;"
+        "    float time;"
+        "} frame;";
+
+    // Surface of a pixel in every gbuffer layout, after the frame data
+    static const std::string FULL_GBUFFER_INPUT =
         "uniform sampler2D u_position;"
         "uniform sampler2D u_color;"
         "uniform sampler2D u_normal;"
         ""
-        "void main() {"
-        "    vec3 position = texture(u_position, uv).rgb;"
-        "    vec3 color = texture(u_color, uv).rgb;"
-        "    vec3 normal = texture(u_normal, uv).rgb;"
+        "void read_gbuffer(ivec2 texel, out vec3 position, out vec3 color, out vec3 normal) {"
+        "    position = texelFetch(u_position, texel, 0).rgb;"
+        "    color = texelFetch(u_color, texel, 0).rgb;"
+        "    normal = texelFetch(u_normal, texel, 0).rgb;"
+        "}";
+
+    static const std::string COMPACT_GBUFFER_INPUT =
+        "uniform sampler2D u_depth;"
+        "uniform sampler2D u_color;"
+        "uniform sampler2D u_normal;"
         ""
-        "    vec3 lighting = 0.1 * color;"
+        "void read_gbuffer(ivec2 texel, out vec3 position, out vec3 color, out vec3 normal) {"
+        "    vec2 uv = (vec2(texel) + 0.5) / vec2(textureSize(u_depth, 0));"
+        "    vec4 view_position = frame.inverse_projection * vec4(vec3(uv, texelFetch(u_depth, texel, 0).r) * 2.0 - 1.0, 1.0);"
+        "    position = (frame.inverse_view * vec4(view_position.xyz / view_position.w, 1.0)).xyz;"
+        "    color = texelFetch(u_color, texel, 0).rgb;"
+        ""
+        "    vec2 encoded = texelFetch(u_normal, texel, 0).rg * 2.0 - 1.0;"
+        "    normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));"
+        "    float fold = max(-normal.z, 0.0);"
+        "    normal.xy -= vec2(normal.x >= 0.0 ? fold : -fold, normal.y >= 0.0 ? fold : -fold);"
+        "    normal = normalize(normal);"
+        "}";
+
+    // Ambient and point lights of the cluster holding a surface, after the point light shading and the frame data. Its
+    // buffers are bound once per frame after the lights are binned.
+    static const std::string CLUSTERED_SHADING =
+        "struct Cluster {" // LightCuller::Cluster
+        "    uint offset;"
+        "    uint count;"
+        "};"
         ""
-        "    for (int i = 0; i < point_lights_data.length(); i++) {"
-        "        float radius = point_lights_data[i].radius;"
-        "        float energy = point_lights_data[i].energy;"
-        "        vec3 light_color = vec3(point_lights_data[i].r, point_lights_data[i].g, point_lights_data[i].b);"
+        "layout(std430, binding = 4) readonly buffer LightClusters {" // Renderer::LIGHT_CLUSTERS_BINDING
+        "    Cluster clusters[];"
+        "};"
         ""
-        "        vec3 light_screen_position = point_lights_position[i].xyz;"
-        "        vec3 light_direction = normalize(light_screen_position - position);"
+        "layout(std430, binding = 5) readonly buffer LightIndices {" // Renderer::LIGHT_INDICES_BINDING
+        "    uint light_indices[];"
+        "};"
         ""
-        "        float light_influence = max(radius - length(light_screen_position - position), 0.0) / radius;"
-        "        light_influence *= light_influence;"
+        "layout(std140, binding = 1) uniform ClusterData {" // Renderer::CLUSTER_DATA_BINDING
+        "    ivec4 grid;" // LightCuller::get_cluster_grid, w is set during the depth prepass
+        "    vec4 depth;" // LightCuller::get_cluster_depth
+        "} cluster_data;"
         ""
-        "        vec3 diffuse = max(dot(normal, light_direction), 0.0) * light_color * color * light_influence * energy;"
+        "vec3 shade_clustered(ivec2 pixel, vec3 position, vec3 color, vec3 normal) {"
+        "    vec3 lighting = 0.1 * color;"
         ""
-        "        lighting += diffuse;"
+        "    float depth = -(frame.view * vec4(position, 1.0)).z;"
+        "    ivec2 tile = min(pixel / 32, cluster_data.grid.xy - 1);" // LightCuller::TILE_SIZE
+        "    int slice = clamp(int(log(max(depth, cluster_data.depth.x) / cluster_data.depth.x) * cluster_data.depth.y), 0, cluster_data.grid.z - 1);"
+        "    Cluster cluster = clusters[(slice * cluster_data.grid.y + tile.y) * cluster_data.grid.x + tile.x];"
+        ""
+        "    for (uint light = 0u; light < cluster.count; light++) {"
+        "        lighting += shade_point_light(light_indices[cluster.offset + light], position, color, normal);"
         "    }"
+        "    return lighting;"
+        "}";
+
+    // Follows the point light shading, the frame data, the clustered shading and the gbuffer input
+    static const std::string SCREEN_FRAGMENT_SHADER =
+        "layout(location = 0) out vec4 out_color;"
+        ""
+        "void main() {"
+        "    vec3 position, color, normal;"
+        "    read_gbuffer(ivec2(gl_FragCoord.xy), position, color, normal);"
+        "    out_color = vec4(shade_clustered(ivec2(gl_FragCoord.xy), position, color, normal), 1.0);"
+        "}";
+
+    // Surfaces of the forward pipeline are shaded as they are drawn, the depth prepass runs the same shaders and only
+    // keeps their depth
+    static const std::string FORWARD_SURFACE_OUTPUT =
+        POINT_LIGHT_SHADING + FRAME_DATA_BLOCK + CLUSTERED_SHADING +
+        ""
+        "layout(location = 0) out vec4 out_color;"
+        ""
+        "void write_surface(vec3 position, vec4 color, vec3 normal) {"
+        "    if (cluster_data.grid.w != 0) return;"
+        "    out_color = vec4(shade_clustered(ivec2(gl_FragCoord.xy), position, color.rgb, normal), color.a);"
+        "}";
+
+
+    // Light volumes: the lit buffer starts with the ambient term, then every light adds its diffuse term
+    static const std::string AMBIENT_FRAGMENT_SHADER =
+        "#version 430 core\n"
+        ""
+        "layout(location = 0) in vec2 uv;"
+        ""
+        "layout(location = 0) out vec4 out_color;"
+        ""
+        "uniform sampler2D u_color;"
+        ""
+        "void main() {"
+        "    out_color = vec4(0.1 * texture(u_color, uv).rgb, 1.0);"
+        "}";
+
+    static const std::string LIGHT_VOLUME_VERTEX_SHADER =
+        "#version 430 core\n"
+        ""
+        "layout(location = 0) in vec3 position;" // Of a mesh enclosing the unit sphere
+        ""
+        + POINT_LIGHT_SHADING + FRAME_DATA_BLOCK +
+        ""
+        "layout(location = 0) flat out uint out_light;"
+        ""
+        "void main() {"
+        "    uint light = uint(gl_InstanceID);"
+        "    vec3 world_position = point_lights_position[light].xyz + position * point_lights_data[light].radius;"
+        "    gl_Position = frame.projection * frame.view * vec4(world_position, 1.0);"
+        "    out_light = light;"
+        "}";
+
+    static const std::string LIGHT_STENCIL_FRAGMENT_SHADER =
+        "#version 430 core\n"
+        ""
+        "void main() {}";
+
+    // Follows the point light shading, the frame data and the gbuffer input
+    static const std::string LIGHT_VOLUME_FRAGMENT_SHADER =
+        "layout(location = 0) flat in uint light;"
+        ""
+        "layout(location = 0) out vec4 out_color;"
+        ""
+        "void main() {"
+        "    vec3 position, color, normal;"
+        "    read_gbuffer(ivec2(gl_FragCoord.xy), position, color, normal);"
         ""
-        "    out_color = vec4(lighting, 1.0);"
+        "    out_color = vec4(shade_point_light(light, position, color, normal), 0.0);"
         "}";
 
 
+    SceneTreeProxy::SceneTreeProxy(std::shared_ptr<DynamicBVH> p_tree, DynamicBVH::ProxyId p_proxy, uint64_t p_transform_version, flecs::entity_t p_mesh)
+        : tree(std::move(p_tree)),
+        proxy(p_proxy),
+        transform_version(p_transform_version),
+        mesh(p_mesh) {}
+
+
+    SceneTreeProxy::SceneTreeProxy(SceneTreeProxy &&p_other)
+        : tree(std::move(p_other.tree)),
+        proxy(p_other.proxy),
+        transform_version(p_other.transform_version),
+        mesh(p_other.mesh)
+    {
+        p_other.proxy = DynamicBVH::INVALID_PROXY;
+    }
+
+
+    SceneTreeProxy &SceneTreeProxy::operator=(SceneTreeProxy &&p_other) {
+        if (this == &p_other) return *this;
+        if (proxy != DynamicBVH::INVALID_PROXY) tree->destroy_proxy(proxy);
+
+        tree = std::move(p_other.tree);
+        proxy = p_other.proxy;
+        transform_version = p_other.transform_version;
+        mesh = p_other.mesh;
+
+        p_other.proxy = DynamicBVH::INVALID_PROXY;
+        return *this;
+    }
+
+
+    SceneTreeProxy::~SceneTreeProxy() {
+        if (proxy != DynamicBVH::INVALID_PROXY) tree->destroy_proxy(proxy);
+    }
+
+
     void Renderer::set_current_camera(flecs::entity p_camera) {
         ASSERT_FATAL_ERROR(p_camera.has<Camera>(), "The provided entity is not a camera");
         ASSERT_FATAL_ERROR(p_camera.has<Transform>(), "The provided camera has no transform component");
@@ -171,31 +382,610 @@ namespace lixy {
     };
 
 
+    const std::shared_ptr<GeometryArena> &Renderer::get_geometry_arena() const {
+        return geometry_arena;
+    }
+
+
+    const DynamicBVH &Renderer::get_scene_tree() const {
+        return *scene_tree;
+    }
+
+
+    void Renderer::set_multi_draw_indirect(bool p_enabled) {
+        multi_draw_indirect = p_enabled;
+    }
+
+
+    bool Renderer::is_multi_draw_indirect() const {
+        return multi_draw_indirect;
+    }
+
+
+    void Renderer::set_occlusion_culling(bool p_enabled) {
+        occlusion_culling = p_enabled;
+    }
+
+
+    bool Renderer::is_occlusion_culling() const {
+        return occlusion_culling;
+    }
+
+
+    Renderer::GBufferLayout Renderer::get_gbuffer_layout() const {
+        return gbuffer_layout;
+    }
+
+
+    uint32_t Renderer::get_sample_count() const {
+        return sample_count;
+    }
+
+
+    const std::string &Renderer::get_surface_output_source() const {
+        if (pipeline == Pipeline::FORWARD_PLUS) return FORWARD_SURFACE_OUTPUT;
+        return gbuffer_layout == GBufferLayout::COMPACT ? COMPACT_SURFACE_OUTPUT : FULL_SURFACE_OUTPUT;
+    }
+
+
+    Renderer::Pipeline Renderer::get_pipeline() const {
+        return pipeline;
+    }
+
+
+    void Renderer::set_lighting_mode(LightingMode p_mode) {
+        lighting_mode = p_mode;
+    }
+
+
+    Renderer::LightingMode Renderer::get_lighting_mode() const {
+        return lighting_mode;
+    }
+
+
+    void Renderer::set_render_scale(float p_scale) {
+        float scale = glm::clamp(p_scale, MIN_RENDER_SCALE, 1.0f);
+        if (scale == render_scale) return;
+
+        render_scale = scale;
+        render_size_outdated = true;
+    }
+
+
+    float Renderer::get_render_scale() const {
+        return render_scale;
+    }
+
+
+    glm::uvec2 Renderer::get_render_size() const {
+        return render_size;
+    }
+
+
+    const opengl::StateCache::Counters &Renderer::get_state_counters() const {
+        return state_counters;
+    }
+
+
+    const RenderTargetPool::Metrics &Renderer::get_render_target_metrics() const {
+        return render_target_pool->get_metrics();
+    }
+
+
     Renderer *Renderer::get_singleton(flecs::world &p_world) {
         return p_world.get_mut<Renderer>();
     }
 
 
-    void Renderer::_initialize(flecs::world &p_world, flecs::entity &p_self) {
+    uint32_t Renderer::get_visible_instance_count() const {
+        return instance_draws.size();
+    }
+
+
+    uint32_t Renderer::get_written_light_count() const {
+        return light_manager->get_written_light_count();
+    }
+
+
+    void Renderer::_update_render_size(const Window &p_window) {
+        glm::vec2 window_size = glm::vec2(p_window.get_width(), p_window.get_height());
+        glm::uvec2 size = glm::max(glm::uvec2(glm::round(window_size * render_scale)), glm::uvec2(1)); // Minimized windows are empty
+        render_size_outdated = false;
+        if (size == render_size) return;
+
+        // Transients are keyed by size, the next frame allocates them once at the new one. Free the previous ones now
+        // rather than after they idled, a drag resizing the window goes through many sizes.
+        if (render_size.x != 0) render_target_pool->destroy_targets(render_size.x, render_size.y);
+        render_size = size;
+    }
+
+
+    void Renderer::_update_view(const Window &p_window, float p_time) {
+        if (current_camera.is_alive()) {
+            const Camera *camera = current_camera.get<Camera>();
+            Transform *camera_transform = current_camera.get_mut<Transform>();
+
+            int width = p_window.get_width(), height = p_window.get_height();
+            view_matrix = glm::inverse(camera_transform->get_matrix());
+
+            switch (camera->type) {
+            case Camera::Type::PERSPECTIVE:
+            {
+                float aspect_ratio = (float) width / height;
+                projection_matrix = glm::perspective(camera->fov, aspect_ratio, camera->clip_near, camera->clip_far);
+                break;
+            }
+            case Camera::Type::ORTHOGRAPHIC:
+            {
+                projection_matrix = glm::ortho(-0.5f * width, 0.5f * width, -0.5f * height, 0.5f * height, camera->clip_near, camera->clip_far);
+                break;
+            }
+            }
+        }
+
+        glm::mat4 inverse_view = glm::inverse(view_matrix);
+        FrameData frame_data{
+            .view = view_matrix,
+            .projection = projection_matrix,
+            .inverse_view = inverse_view,
+            .inverse_projection = glm::inverse(projection_matrix),
+            .camera_position = inverse_view[3],
+            .time = p_time,
+        };
+
+        frame_data_buffer.allocate(sizeof(FrameData)); // Orphan the previous frame data instead of waiting for it
+        frame_data_buffer.write_data(0, sizeof(FrameData), &frame_data);
+    }
+
+
+    void Renderer::_update_scene_tree() {
+        for (flecs::query<> &query : stale_proxy_queries) {
+            query.each([](flecs::entity p_entity) { p_entity.remove<SceneTreeProxy>(); });
+        }
+
+        // Instances of a mesh are mostly consecutive, its bounds are only fetched again when the mesh changes
+        flecs::entity_t bounds_mesh = 0;
+        AABB mesh_bounds;
+
+        scene_tree_query.each([&](flecs::entity p_entity, const MeshInstance &p_instance, Transform &p_transform, SceneTreeProxy *p_proxy) {
+            flecs::entity_t mesh = p_instance.mesh.is_alive() ? p_instance.mesh.get_id() : 0;
+            if (p_proxy && p_proxy->transform_version == p_transform.get_version() && p_proxy->mesh == mesh) return;
+
+            if (mesh != bounds_mesh) {
+                if (const ObjMesh *obj_mesh = mesh ? p_instance.mesh.get<ObjMesh>() : nullptr) {
+                    mesh_bounds = obj_mesh->get_bounds();
+                } else if (const ArrayMesh *array_mesh = mesh ? p_instance.mesh.get<ArrayMesh>() : nullptr) {
+                    mesh_bounds = array_mesh->get_bounds();
+                } else {
+                    mesh_bounds = AABB();
+                }
+                bounds_mesh = mesh;
+            }
+
+            // Instances with nothing to draw stay out of the tree
+            if (mesh_bounds.is_empty()) {
+                if (p_proxy) p_entity.remove<SceneTreeProxy>();
+                return;
+            }
+
+            AABB bounds = mesh_bounds.transformed(p_transform.get_matrix());
+            if (p_proxy) {
+                scene_tree->move_proxy(p_proxy->proxy, bounds);
+                p_proxy->transform_version = p_transform.get_version();
+                p_proxy->mesh = mesh;
+            } else {
+                p_entity.set<SceneTreeProxy>(SceneTreeProxy(scene_tree, scene_tree->create_proxy(bounds, p_entity.id()), p_transform.get_version(), mesh));
+            }
+        });
+    }
+
+
+    void Renderer::_cull_mesh_instances(flecs::world &p_world) {
+        instance_draws.clear();
+        instance_transforms.clear();
+
+        visible_entities.clear();
+        scene_tree->query(Frustum::from_matrix(projection_matrix * view_matrix), visible_entities);
+
+        for (uint64_t id : visible_entities) {
+            flecs::entity entity(p_world, id);
+            const MeshInstance *instance = entity.get<MeshInstance>();
+            Transform *transform = entity.get_mut<Transform>();
+            if (!instance->mesh.is_alive()) continue; // Its proxy leaves the tree on the next update
+
+            instance_draws.push_back(InstanceDraw{
+                .mesh = instance->mesh.get_id(),
+                .transform = (uint32_t)instance_transforms.size(),
+            });
+            instance_transforms.push_back(transform->get_matrix());
+        }
+    }
+
+
+    void Renderer::_render_frame(flecs::world &p_world, const Window &p_window) {
+        using Access = RenderGraph::Access;
+        RenderGraph &graph = *render_graph;
+        uint32_t width = render_size.x, height = render_size.y;
+        bool scaled = width != (uint32_t)p_window.get_width() || height != (uint32_t)p_window.get_height();
+
+        frame_data_buffer.slice(0, sizeof(FrameData)).bind_to_location(FRAME_DATA_BINDING);
+
+        RenderGraph::Resource backbuffer = graph.import_backbuffer(p_window.get_width(), p_window.get_height());
+        RenderGraph::Resource depth_pyramid = graph.import_resource("Depth Pyramid");
+        RenderGraph::Resource point_lights = graph.import_resource("Point Lights"); // Written by the CPU
+        RenderGraph::Resource light_clusters = graph.import_resource("Light Clusters");
+
+        GBuffer gbuffer;
+        gbuffer.depth = graph.create_texture("Depth", { width, height, opengl::TextureFormat::DEPTH24_STENCIL8, sample_count });
+        if (pipeline == Pipeline::DEFERRED && gbuffer_layout == GBufferLayout::COMPACT) {
+            gbuffer.attachments = {
+                graph.create_texture("Albedo", { width, height, opengl::TextureFormat::RGBA8 }),
+                graph.create_texture("Octahedral Normal", { width, height, opengl::TextureFormat::RG16 }),
+            };
+        } else if (pipeline == Pipeline::DEFERRED) {
+            gbuffer.attachments = {
+                graph.create_texture("Position", { width, height, opengl::TextureFormat::RGBA16F }),
+                graph.create_texture("Albedo", { width, height, opengl::TextureFormat::RGBA16F }),
+                graph.create_texture("Normal", { width, height, opengl::TextureFormat::RGBA16F }),
+            };
+        }
+
+        // Instances in view fill the gbuffer, or only write their depth in the forward pipeline. Occlusion culling
+        // tests them against the depth pyramid of the previous frame, built from the depth of this one.
+        bool cull_occluded = occlusion_culling && multi_draw_indirect;
+        RenderGraph::PassBuilder geometry = graph.add_pass("Geometry", [this, &p_world](RenderGraph &) {
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+            _draw_mesh_instances(p_world);
+        });
+        if (cull_occluded) geometry.read(depth_pyramid, Access::SAMPLED);
+        gbuffer.depth = geometry.write(gbuffer.depth, Access::ATTACHMENT);
+        for (RenderGraph::Resource &attachment : gbuffer.attachments) attachment = geometry.write(attachment, Access::ATTACHMENT);
+
+        // Multisampled depth is resolved for the passes sampling it
+        RenderGraph::Resource sampled_depth = gbuffer.depth;
+        if (sample_count > 1) {
+            RenderGraph::Resource resolved_depth = graph.create_texture("Resolved Depth", { width, height, opengl::TextureFormat::DEPTH24_STENCIL8 });
+            sampled_depth = graph.add_pass("Resolve Depth", [depth = gbuffer.depth, resolved_depth](RenderGraph &p_graph) { p_graph.blit(depth, resolved_depth); })
+                .read(gbuffer.depth, Access::BLIT)
+                .write(resolved_depth, Access::BLIT);
+        }
+
+        if (cull_occluded) {
+            graph.add_pass("Build Depth Pyramid", [this, depth = sampled_depth](RenderGraph &p_graph) {
+                const RenderGraph::TextureDesc &depth_desc = p_graph.get_texture_desc(depth);
+                occlusion_culler->build_pyramid(p_graph.get_texture_id(depth), depth_desc.width, depth_desc.height, projection_matrix * view_matrix);
+            })
+                .read(sampled_depth, Access::SAMPLED)
+                .write(depth_pyramid, Access::IMAGE);
+        } else {
+            occlusion_culler->clear_pyramid(); // Would be stale when culling is enabled again
+        }
+
+        uint32_t light_count = light_manager->get_light_count();
+        opengl::ShaderStorageBuffer::Slice lights = light_manager->get_lights();
+        opengl::ShaderStorageBuffer::Slice positions = light_manager->get_positions();
+
+        // Light volumes and forward surfaces are drawn in a lit texture, copied to the backbuffer. Clustered lighting
+        // shades the backbuffer directly unless the frame is rendered at a smaller size.
+        RenderGraph::Resource lit = RenderGraph::INVALID_RESOURCE;
+        if (pipeline == Pipeline::DEFERRED && lighting_mode == LightingMode::LIGHT_VOLUMES) {
+            lit = graph.create_texture("Lit", { width, height, opengl::TextureFormat::RGBA16F });
+
+            RenderGraph::PassBuilder light_volumes = graph.add_pass("Light Volumes", [this, gbuffer, light_count, lights, positions](RenderGraph &p_graph) {
+                _set_gbuffer_input(light_volume_material, p_graph, gbuffer);
+                ambient_material.set_uniform("u_color", p_graph.get_texture(gbuffer.attachments[gbuffer_layout == GBufferLayout::COMPACT ? 0 : 1]));
+                _draw_light_volumes(light_count, lights, positions);
+            });
+            _read_gbuffer(light_volumes, gbuffer);
+            light_volumes.read(point_lights, Access::STORAGE);
+            light_volumes.read(gbuffer.depth, Access::ATTACHMENT);
+            gbuffer.depth = light_volumes.write(gbuffer.depth, Access::ATTACHMENT); // Counts the volumes in the stencil
+            lit = light_volumes.write(lit, Access::ATTACHMENT);
+        } else {
+            // Bin the lights into the clusters of the view holding surfaces
+            light_clusters = graph.add_pass("Bin Lights", [this, depth = sampled_depth, light_count, lights, positions](RenderGraph &p_graph) {
+                // Blended surfaces lie in front of the opaque depth, which then no longer bounds the slices to light
+                const RenderGraph::TextureDesc &depth_desc = p_graph.get_texture_desc(depth);
+                uint32_t depth_texture = draw_list.get_draw_count(DrawPass::TRANSPARENT) ? 0 : p_graph.get_texture_id(depth);
+                _bin_lights(light_count, lights, positions, depth_texture, depth_desc.width, depth_desc.height);
+            })
+                .read(sampled_depth, Access::SAMPLED)
+                .read(point_lights, Access::STORAGE)
+                .write(light_clusters, Access::STORAGE);
+
+            if (pipeline == Pipeline::FORWARD_PLUS) {
+                // Opaque surfaces are shaded first, then blended ones are drawn over them back to front
+                lit = graph.create_texture("Lit", { width, height, opengl::TextureFormat::RGBA16F, sample_count });
+                lit = graph.add_pass("Forward Shading", [this](RenderGraph &) { _draw_forward(); })
+                    .read(gbuffer.depth, Access::ATTACHMENT)
+                    .read(point_lights, Access::STORAGE)
+                    .read(light_clusters, Access::STORAGE)
+                    .write(lit, Access::ATTACHMENT);
+                lit = graph.add_pass("Transparent Shading", [this](RenderGraph &) { _draw_transparent(); })
+                    .read(lit, Access::ATTACHMENT)
+                    .read(gbuffer.depth, Access::ATTACHMENT)
+                    .read(point_lights, Access::STORAGE)
+                    .read(light_clusters, Access::STORAGE)
+                    .write(lit, Access::ATTACHMENT);
+
+                if (sample_count > 1) {
+                    RenderGraph::Resource resolved_lit = graph.create_texture("Resolved Lit", { width, height, opengl::TextureFormat::RGBA16F });
+                    lit = graph.add_pass("Resolve Lit", [lit, resolved_lit](RenderGraph &p_graph) { p_graph.blit(lit, resolved_lit); })
+                        .read(lit, Access::BLIT)
+                        .write(resolved_lit, Access::BLIT);
+                }
+            } else {
+                RenderGraph::PassBuilder clustered_lighting = graph.add_pass("Clustered Lighting", [this, gbuffer](RenderGraph &p_graph) {
+                    _set_gbuffer_input(screen_material, p_graph, gbuffer);
+                    _draw_clustered_lighting();
+                });
+                _read_gbuffer(clustered_lighting, gbuffer);
+                clustered_lighting.read(point_lights, Access::STORAGE);
+                clustered_lighting.read(light_clusters, Access::STORAGE);
+                if (scaled) {
+                    lit = clustered_lighting.write(graph.create_texture("Lit", { width, height, opengl::TextureFormat::RGBA16F }), Access::ATTACHMENT);
+                } else {
+                    backbuffer = clustered_lighting.write(backbuffer, Access::ATTACHMENT);
+                }
+            }
+        }
+
+        if (lit != RenderGraph::INVALID_RESOURCE) {
+            graph.add_pass("Present", [lit, backbuffer](RenderGraph &p_graph) { p_graph.blit(lit, backbuffer); })
+                .read(lit, Access::BLIT)
+                .write(backbuffer, Access::BLIT);
+        }
+
+        graph.execute(p_world);
+        render_target_pool->end_frame();
+    }
+
+
+    void Renderer::_draw_mesh_instances(flecs::world &p_world) {
+        // Surfaces of the forward pipeline only write their depth until the lights are binned against it
+        if (pipeline == Pipeline::FORWARD_PLUS) prepass_cluster_data_buffer.slice(0, sizeof(ClusterData)).bind_to_location(CLUSTER_DATA_BINDING);
+
+        draw_list.clear();
+        if (instance_draws.empty()) return;
+
+        // Group the instances of each mesh, their data is uploaded in draw order
+        std::sort(instance_draws.begin(), instance_draws.end(), [](const InstanceDraw &a, const InstanceDraw &b) { return a.mesh < b.mesh; });
+
+        uint32_t instance_count = instance_draws.size();
+        instance_data.resize(instance_count);
+        instance_depths.resize(instance_count);
+
+        bool cull_occluded = occlusion_culling && multi_draw_indirect;
+        occlusion_batches.clear();
+        instance_batches.clear();
+
+        for (uint32_t first = 0; first < instance_count;) {
+            uint32_t last = first + 1;
+            while (last < instance_count && instance_draws[last].mesh == instance_draws[first].mesh) last++;
+
+            flecs::entity mesh(p_world, instance_draws[first].mesh);
+            bool mesh_alive = mesh.is_alive(); // Unless destroyed by a system after culling
+            const ObjMesh *obj_mesh = mesh_alive ? mesh.get<ObjMesh>() : nullptr;
+            glm::vec4 position_offset = obj_mesh ? glm::vec4(obj_mesh->get_position_offset(), 0.0) : glm::vec4(0.0);
+            glm::vec4 position_scale = obj_mesh ? glm::vec4(obj_mesh->get_position_scale(), 0.0) : glm::vec4(1.0);
+
+            float depth = FLT_MAX;
+            for (uint32_t i = first; i < last; i++) {
+                const glm::mat4 &model = instance_transforms[instance_draws[i].transform];
+                instance_data[i] = InstanceData{
+                    .model = model,
+                    .position_offset = position_offset,
+                    .position_scale = position_scale,
+                };
+                instance_depths[i] = -(view_matrix * model[3]).z;
+                depth = std::min(depth, instance_depths[i]);
+            }
+
+            // Only the forward pipeline has a transparent pass
+            InstanceBatch batch{
+                .first_instance = first,
+                .instance_count = last - first,
+                .instances = &instance_data[first],
+                .depth = depth,
+                .depths = pipeline == Pipeline::FORWARD_PLUS ? &instance_depths[first] : nullptr,
+            };
+            const ArrayMesh *array_mesh = obj_mesh || !mesh_alive ? nullptr : mesh.get<ArrayMesh>();
+            if (obj_mesh) {
+                obj_mesh->record_draws(batch, draw_list);
+            } else if (array_mesh) {
+                array_mesh->record_draws(batch, draw_list);
+            }
+
+            if (cull_occluded) {
+                AABB bounds = obj_mesh ? obj_mesh->get_bounds() : array_mesh ? array_mesh->get_bounds() : AABB();
+                instance_batches.insert(instance_batches.end(), last - first, occlusion_batches.size());
+                occlusion_batches.push_back(OcclusionCuller::Batch{
+                    .bounds_min = bounds.min,
+                    .first_instance = first,
+                    .bounds_max = bounds.max,
+                    .visible_count = 0,
+                });
+            }
+
+            first = last;
+        }
+
+        uint32_t instance_data_size = instance_count * sizeof(InstanceData);
+        uint32_t storage_size = instance_data_storage.get_size();
+        if (storage_size < instance_data_size) storage_size = std::max(instance_data_size, 2 * storage_size);
+        instance_data_storage.allocate(storage_size); // Orphan the previous frame storage instead of waiting for it
+        instance_data_storage.write_data(0, instance_data_size, instance_data.data());
+        geometry_arena->reserve_instances(instance_count);
+
+        opengl::ShaderStorageBuffer::Slice instances = instance_data_storage.slice(0, instance_data_size);
+        transparent_instances = instances;
+        if (cull_occluded) {
+            instances = occlusion_culler->cull(instances, occlusion_batches, instance_batches);
+            draw_list.submit(*geometry_arena, projection_matrix, view_matrix, instances, true, occlusion_culler.get());
+        } else {
+            draw_list.submit(*geometry_arena, projection_matrix, view_matrix, instances, multi_draw_indirect);
+        }
+        drawn_instances = instances;
+    }
+
+
+    void Renderer::_bin_lights(uint32_t p_light_count, const opengl::ShaderStorageBuffer::Slice &p_lights, const opengl::ShaderStorageBuffer::Slice &p_positions, uint32_t p_depth_texture, uint32_t p_width, uint32_t p_height) {
+        Camera camera = current_camera.is_alive() ? *current_camera.get<Camera>() : Camera();
+        light_culler->cull(p_lights, p_positions, p_light_count, projection_matrix, view_matrix, p_width, p_height, camera.clip_near, camera.clip_far, p_depth_texture);
+
+        ClusterData cluster_data{
+            .grid = glm::ivec4(light_culler->get_cluster_grid(), 0),
+            .depth = glm::vec4(light_culler->get_cluster_depth(), 0.0, 0.0),
+        };
+        cluster_data_buffer.allocate(sizeof(ClusterData)); // Orphan the previous frame data instead of waiting for it
+        cluster_data_buffer.write_data(0, sizeof(ClusterData), &cluster_data);
+        cluster_data_buffer.slice(0, sizeof(ClusterData)).bind_to_location(CLUSTER_DATA_BINDING);
+
+        p_lights.bind_to_location(POINT_LIGHTS_BINDING);
+        p_positions.bind_to_location(POINT_LIGHT_POSITIONS_BINDING);
+        light_culler->get_clusters().bind_to_location(LIGHT_CLUSTERS_BINDING);
+        light_culler->get_light_indices().bind_to_location(LIGHT_INDICES_BINDING);
+    }
+
+
+    void Renderer::_draw_forward() {
+        opengl::StateCache &state = opengl::OpenGLContext::get_state();
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        // The prepass left the closest surface of every pixel in the depth, which is the only one shaded. Both passes
+        // run the same programs on the same vertices, so the depths are equal.
+        state.set_depth_func(GL_LEQUAL);
+        state.set_depth_mask(false);
+        draw_list.redraw(DrawPass::GEOMETRY, *geometry_arena, projection_matrix, view_matrix, drawn_instances, multi_draw_indirect);
+        state.set_depth_mask(true);
+        state.set_depth_func(GL_LESS);
+    }
+
+
+    void Renderer::_draw_transparent() {
+        // Blended surfaces were left out of the prepass, they are tested against the opaque depth without writing it
+        opengl::StateCache &state = opengl::OpenGLContext::get_state();
+        state.set_depth_mask(false);
+        draw_list.redraw(DrawPass::TRANSPARENT, *geometry_arena, projection_matrix, view_matrix, transparent_instances, multi_draw_indirect);
+        state.set_depth_mask(true);
+    }
+
+
+    void Renderer::_draw_clustered_lighting() {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+        screen_material.bind_material();
+        quad_vao->bind();
+        glDrawElements(GL_TRIANGLES, 6, quad_indices->get_gl_type(), nullptr);
+        quad_vao->unbind();
+    }
+
+
+    void Renderer::_read_gbuffer(RenderGraph::PassBuilder &p_pass, const GBuffer &p_gbuffer) const {
+        for (RenderGraph::Resource attachment : p_gbuffer.attachments) p_pass.read(attachment, RenderGraph::Access::SAMPLED);
+        if (gbuffer_layout == GBufferLayout::COMPACT) p_pass.read(p_gbuffer.depth, RenderGraph::Access::SAMPLED);
+    }
+
+
+    void Renderer::_set_gbuffer_input(Material &p_material, const RenderGraph &p_graph, const GBuffer &p_gbuffer) {
+        if (gbuffer_layout == GBufferLayout::COMPACT) {
+            p_material.set_uniform("u_depth", p_graph.get_texture(p_gbuffer.depth));
+            p_material.set_uniform("u_color", p_graph.get_texture(p_gbuffer.attachments[0]));
+            p_material.set_uniform("u_normal", p_graph.get_texture(p_gbuffer.attachments[1]));
+        } else {
+            p_material.set_uniform("u_position", p_graph.get_texture(p_gbuffer.attachments[0]));
+            p_material.set_uniform("u_color", p_graph.get_texture(p_gbuffer.attachments[1]));
+            p_material.set_uniform("u_normal", p_graph.get_texture(p_gbuffer.attachments[2]));
+        }
+    }
+
+
+    void Renderer::_draw_light_volumes(uint32_t p_light_count, const opengl::ShaderStorageBuffer::Slice &p_lights, const opengl::ShaderStorageBuffer::Slice &p_positions) {
+        opengl::StateCache &state = opengl::OpenGLContext::get_state();
+        state.set_enabled(GL_DEPTH_TEST, false);
+        ambient_material.bind_material();
+        quad_vao->bind();
+        glDrawElements(GL_TRIANGLES, 6, quad_indices->get_gl_type(), nullptr);
+        quad_vao->unbind();
+
+        if (p_light_count) {
+            light_stencil_material.set_uniform("PointLightsData", p_lights);
+            light_stencil_material.set_uniform("PointLightsPosition", p_positions);
+            light_volume_material.set_uniform("PointLightsData", p_lights);
+            light_volume_material.set_uniform("PointLightsPosition", p_positions);
+
+            // Count the volumes holding the surface of every pixel in the stencil: back faces behind the surface add
+            // one, front faces behind it remove one. Counting depth test failures keeps the volumes holding the
+            // camera, depth clamping keeps the faces past the far plane.
+            state.set_enabled(GL_DEPTH_TEST, true);
+            state.set_depth_mask(false);
+            state.set_enabled(GL_STENCIL_TEST, true);
+            state.set_enabled(GL_DEPTH_CLAMP, true);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glStencilFunc(GL_ALWAYS, 0, 0xFF);
+            glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+            glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+
+            light_stencil_material.bind_material();
+            sphere_vao->bind();
+            glDrawElementsInstanced(GL_TRIANGLES, sphere_index_count, sphere_indices->get_gl_type(), nullptr, p_light_count);
+
+            // Add the lighting of every volume to the pixels inside at least one, from its back faces so that volumes
+            // holding the camera are drawn. The compact gbuffer samples the depth attached for the stencil test, which
+            // nothing writes during this pass.
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+            state.set_enabled(GL_DEPTH_TEST, false);
+            state.set_enabled(GL_CULL_FACE, true);
+            glCullFace(GL_FRONT);
+            state.set_blend_func(GL_ONE, GL_ONE);
+
+            light_volume_material.bind_material();
+            glDrawElementsInstanced(GL_TRIANGLES, sphere_index_count, sphere_indices->get_gl_type(), nullptr, p_light_count);
+            sphere_vao->unbind();
+
+            state.set_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glCullFace(GL_BACK);
+            state.set_enabled(GL_CULL_FACE, false);
+            state.set_enabled(GL_DEPTH_CLAMP, false);
+            state.set_enabled(GL_STENCIL_TEST, false);
+            state.set_depth_mask(true);
+        }
+        state.set_enabled(GL_DEPTH_TEST, true);
+    }
+
+
+    void Renderer::_initialize(flecs::world &p_world) {
         // Create opengl context
         context.initialize(&Window::get_proc_address);
 
-        // Create gbuffer
-        {
-            std::vector<opengl::TextureFormat> g_framebuffer_formats = {
-                opengl::TextureFormat::RGBA16F, // Position
-                opengl::TextureFormat::RGBA16F, // Albedo
-                opengl::TextureFormat::RGBA16F, // Normal
-            };
-            Window *window = p_world.get_mut<Window>();
-            int width = window->get_width(), height = window->get_height();
-            gbuffer_ref = Framebuffer::create(p_world, width, height, g_framebuffer_formats)
-                .add(flecs::ChildOf, p_self);
-            ASSERT_FATAL_ERROR(gbuffer_ref.get<Framebuffer>()->is_complete(), "Incomplete GBuffer");
+        geometry_arena = std::make_shared<GeometryArena>();
+        scene_tree = std::make_shared<DynamicBVH>();
+        occlusion_culler = std::make_unique<OcclusionCuller>();
+        light_culler = std::make_unique<LightCuller>();
+        light_manager = std::make_unique<LightManager>(p_world);
+        render_target_pool = std::make_unique<RenderTargetPool>();
+        render_graph = std::make_unique<RenderGraph>(*render_target_pool);
+
+        const RendererOptions *options = p_world.get<RendererOptions>();
+        pipeline = options ? options->pipeline : Pipeline::DEFERRED;
+        gbuffer_layout = options ? options->gbuffer_layout : GBufferLayout::FULL;
+        if (pipeline == Pipeline::FORWARD_PLUS && options) {
+            GLint max_samples = 1;
+            glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+            sample_count = std::clamp<uint32_t>(options->samples, 1, max_samples);
         }
 
+        // The gbuffer and lit textures are transients of the render graph, allocated for the passes of the pipeline
+        ClusterData prepass_cluster_data{ .grid = glm::ivec4(0, 0, 0, 1) };
+        prepass_cluster_data_buffer.allocate(sizeof(ClusterData));
+        prepass_cluster_data_buffer.write_data(0, sizeof(ClusterData), &prepass_cluster_data);
+
         // Create materials
-        default_material = Material(DEFAULT_VERTEX_SHADER, DEFAULT_FRAGMENT_SHADER);
+        default_material = Material(DEFAULT_VERTEX_SHADER, "#version 430 core\n" + get_surface_output_source() + DEFAULT_FRAGMENT_SHADER);
+        default_material.set_uniform("u_albedo_scale", glm::vec3(1.0));
         ASSERT_FATAL_ERROR(default_material.is_valid(), "The default material is invalid: " << default_material.get_errors());
 
         // Create surface to render on the screen
@@ -225,17 +1015,60 @@ namespace lixy {
         quad_vao->add_index_buffer(quad_indices);
         quad_vao->add_vertex_buffer(quad_vertices, quad_buffer_layout);
 
-        screen_material = Material(SCREEN_VERTEX_SHADER, SCREEN_FRAGMENT_SHADER);
-        ASSERT_FATAL_ERROR(screen_material.is_valid(), "The screen material is invalid: " << screen_material.get_errors());
-        { // Setup material uniforms
-            Framebuffer *gbuffer = gbuffer_ref.get_mut<Framebuffer>();
-            screen_material.set_uniform("u_position", gbuffer->get_attachment(0));
-            screen_material.set_uniform("u_color", gbuffer->get_attachment(1));
-            screen_material.set_uniform("u_normal", gbuffer->get_attachment(2));
+        // Create the lighting passes of the deferred pipeline, the forward one shades surfaces as they are drawn
+        if (pipeline == Pipeline::DEFERRED) {
+            const std::string &gbuffer_input = gbuffer_layout == GBufferLayout::COMPACT ? COMPACT_GBUFFER_INPUT : FULL_GBUFFER_INPUT;
+            const std::string lighting_prelude = "#version 430 core\n" + POINT_LIGHT_SHADING + FRAME_DATA_BLOCK + gbuffer_input;
+
+            screen_material = Material(SCREEN_VERTEX_SHADER, lighting_prelude + CLUSTERED_SHADING + SCREEN_FRAGMENT_SHADER);
+            ASSERT_FATAL_ERROR(screen_material.is_valid(), "The screen material is invalid: " << screen_material.get_errors());
+
+            // Light volumes: coarse sphere, its faces cut inside the unit sphere by at most the cosines of half its angular steps so
+            // its vertices are pushed out by their inverse
+            constexpr uint32_t SPHERE_SEGMENTS = 16, SPHERE_RINGS = 8;
+            float enclosing_scale = 1.0 / (std::cos(glm::pi<float>() / SPHERE_SEGMENTS) * std::cos(glm::pi<float>() / (2 * SPHERE_RINGS)));
+
+            std::vector<glm::vec3> sphere_vertices_array;
+            for (uint32_t ring = 0; ring <= SPHERE_RINGS; ring++) {
+                float latitude = glm::pi<float>() * ring / SPHERE_RINGS;
+                for (uint32_t segment = 0; segment < SPHERE_SEGMENTS; segment++) {
+                    float longitude = 2.0 * glm::pi<float>() * segment / SPHERE_SEGMENTS;
+                    sphere_vertices_array.push_back(enclosing_scale * glm::vec3(std::sin(latitude) * std::cos(longitude), std::cos(latitude), std::sin(latitude) * std::sin(longitude)));
+                }
+            }
+
+            std::vector<uint32_t> sphere_indices_array;
+            for (uint32_t ring = 0; ring < SPHERE_RINGS; ring++) {
+                for (uint32_t segment = 0; segment < SPHERE_SEGMENTS; segment++) {
+                    uint32_t next_segment = (segment + 1) % SPHERE_SEGMENTS;
+                    uint32_t top = ring * SPHERE_SEGMENTS, bottom = (ring + 1) * SPHERE_SEGMENTS;
+                    sphere_indices_array.insert(sphere_indices_array.end(), { // Counter clockwise seen from outside
+                        top + segment, bottom + next_segment, bottom + segment,
+                        top + segment, top + next_segment, bottom + next_segment,
+                    });
+                }
+            }
+            sphere_index_count = sphere_indices_array.size();
+
+            std::array<opengl::ShaderDataType, 1> sphere_buffer_layout_array = { opengl::ShaderDataType::Vec3 };
+            opengl::BufferLayout sphere_buffer_layout(sphere_buffer_layout_array.data(), sphere_buffer_layout_array.size());
+
+            sphere_vertices = std::make_shared<opengl::VertexBuffer>(sphere_vertices_array.data(), sphere_vertices_array.size() * sizeof(glm::vec3));
+            sphere_indices = std::make_shared<opengl::IndexBuffer>(sphere_indices_array.data(), sphere_indices_array.size());
+            sphere_vao = std::make_shared<opengl::VertexArrayBuffer>();
+            sphere_vao->add_index_buffer(sphere_indices);
+            sphere_vao->add_vertex_buffer(sphere_vertices, sphere_buffer_layout);
+
+            ambient_material = Material(SCREEN_VERTEX_SHADER, AMBIENT_FRAGMENT_SHADER);
+            ASSERT_FATAL_ERROR(ambient_material.is_valid(), "The ambient material is invalid: " << ambient_material.get_errors());
+            light_stencil_material = Material(LIGHT_VOLUME_VERTEX_SHADER, LIGHT_STENCIL_FRAGMENT_SHADER);
+            ASSERT_FATAL_ERROR(light_stencil_material.is_valid(), "The light stencil material is invalid: " << light_stencil_material.get_errors());
+            light_volume_material = Material(LIGHT_VOLUME_VERTEX_SHADER, lighting_prelude + LIGHT_VOLUME_FRAGMENT_SHADER);
+            ASSERT_FATAL_ERROR(light_volume_material.is_valid(), "The light volume material is invalid: " << light_volume_material.get_errors());
         }
 
 
-        // Create renderer systems
+        // Create renderer systems. Systems gather the frame on the CPU, then the render graph draws it.
         p_world.system<Renderer, Window>("Start Frame")
             .term_at(0).singleton()
             .term_at(1).singleton()
@@ -243,125 +1076,63 @@ namespace lixy {
             .each([](Renderer &rd, Window &window) {
                 window.set_as_current_context();
                 window.poll_events();
+                if (window.is_resized() || rd.render_size_outdated) rd._update_render_size(window);
 
-                // Set viewport size
-                int width = window.get_width(), height = window.get_height();
-                glViewport(0, 0, width, height); // FIXME: resize when there is a resize event
-
-                // Clear screen
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
-                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-
-                // Set the current framebuffer to the gbuffer, resize it and clear it
-                Framebuffer *gbuffer = rd.gbuffer_ref.get_mut<Framebuffer>();
-                gbuffer->bind();
-                gbuffer->set_size(width, height);
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+                opengl::StateCache &state = opengl::OpenGLContext::get_state();
+                rd.state_counters = state.get_counters();
+                state.reset_counters();
             });
 
-        p_world.system<Renderer, Window>("Calculate Camera Transform")
+        p_world.system<Renderer, const Window>("Update View")
             .term_at(0).singleton()
             .term_at(1).singleton()
             .kind(flecs::PostUpdate)
-            .each([](Renderer &rd, Window &window) {
-                if (!rd.current_camera.is_alive()) return;
-
-                const Camera *camera = rd.current_camera.get<Camera>();
-                Transform *camera_transform = rd.current_camera.get_mut<Transform>();
-
-                int width = window.get_width(), height = window.get_height();
+            .each([](flecs::iter &it, size_t, Renderer &rd, const Window &window) {
+                rd._update_view(window, it.world().get_info()->world_time_total);
+            });
 
-                // Calculate view matrix transform
-                rd.view_matrix = glm::inverse(camera_transform->get_matrix());
+        scene_tree_query = p_world.query_builder<const MeshInstance, Transform, SceneTreeProxy*>()
+            .with<Visible>()
+            .cached()
+            .build();
+        stale_proxy_queries = {
+            p_world.query_builder().with<SceneTreeProxy>().without<Visible>().cached().build(),
+            p_world.query_builder().with<SceneTreeProxy>().without<MeshInstance>().cached().build(),
+        };
 
-                // Calculate projection matrix
-                switch (camera->type) {
-                case Camera::Type::PERSPECTIVE:
-                {
-                    float aspect_ratio = (float) width / height;
-                    rd.projection_matrix = glm::perspective(camera->fov, aspect_ratio, camera->clip_near, camera->clip_far);
-                    break;
-                }
-                case Camera::Type::ORTHOGRAPHIC:
-                {
-                    rd.projection_matrix = glm::ortho(-0.5f * width, 0.5f * width, -0.5f * height, 0.5f * height, camera->clip_near, camera->clip_far);
-                    break;
-                }
-                }
+        p_world.system<Renderer>("Update Scene Tree")
+            .term_at(0).singleton()
+            .kind(flecs::PostUpdate)
+            .each([](Renderer &rd) {
+                rd._update_scene_tree();
             });
 
-        p_world.system<const Renderer, const MeshInstance, Transform>("Draw MeshInstances")
+        p_world.system<Renderer>("Cull MeshInstances")
             .term_at(0).singleton()
-            .with<Visible>()
-            .kind(flecs::PreStore)
-            .each([](const Renderer &rd, const MeshInstance &p_instance, Transform &p_transform) {
-                if (p_instance.mesh.has<ArrayMesh>()) {
-                    const ArrayMesh *mesh = p_instance.mesh.get<ArrayMesh>();
-                    mesh->record_draw(rd.projection_matrix, rd.view_matrix, p_transform.get_matrix());
-                } else if (p_instance.mesh.has<ObjMesh>()) {
-                    const ObjMesh *mesh = p_instance.mesh.get<ObjMesh>();
-                    mesh->record_draw(rd.projection_matrix, rd.view_matrix, p_transform.get_matrix());
-                }
+            .kind(flecs::PostUpdate)
+            .each([](flecs::iter &it, size_t, Renderer &rd) {
+                flecs::world world = it.world();
+                rd._cull_mesh_instances(world);
             });
 
+        p_world.system<Renderer>("Update Lights")
+            .term_at(0).singleton()
+            .kind(flecs::PostUpdate)
+            .each([](flecs::iter &it, size_t, Renderer &rd) {
+                flecs::world world = it.world();
+                rd.light_manager->update(world);
+            });
 
-        p_world.system("Draw Lights And Present")
+        p_world.system("Render Frame")
             .kind(flecs::OnStore)
-            .immediate()
+            .immediate() // The render target pool creates the texture entities of new targets
             .run([](flecs::iter &it) {
-                Renderer *rd = it.world().get_mut<Renderer>();
-                Window *window = it.world().get_mut<Window>();
-
-                // Render to the main window
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-                // Fetch point lights data
-                flecs::query<PointLight, Transform> point_light_query = it.world().query_builder<PointLight, Transform>()
-                    .with<Visible>()
-                    .cached()
-                    .build();
-
-                int32_t point_light_count = point_light_query.count();
-                int32_t light_buffer_size = point_light_count * sizeof(PointLight);
-                int32_t light_transform_buffer_size = point_light_count * sizeof(glm::vec4);
-
-                if (rd->point_lights_storage.get_size() < light_buffer_size) {
-                    rd->point_lights_storage.allocate(light_buffer_size);
-                }
-                if (rd->point_lights_transform_storage.get_size() < light_transform_buffer_size) {
-                    rd->point_lights_transform_storage.allocate(light_transform_buffer_size);
-                }
-
-                point_light_query.run([&rd, point_light_count, light_transform_buffer_size](flecs::iter &it) {
-                    int32_t point_light_total = 0;
-
-                    std::vector<glm::vec4> transform_buffer;
-                    transform_buffer.reserve(point_light_count);
-
-                    while (it.next()) {
-                        auto point_lights = it.field<PointLight>(0);
-                        rd->point_lights_storage.write_data(point_light_total * sizeof(PointLight), it.count() * sizeof(PointLight), &*point_lights);
-
-                        auto transforms = it.field<Transform>(1);
-                        for (int32_t i = 0; i < it.count(); i++) {
-                            transform_buffer[point_light_total + i] = glm::vec4(transforms[i].get_local_position(), 1.0);
-                        }
-
-                        point_light_total += it.count();
-                    }
-
-                    rd->point_lights_transform_storage.write_data(0, light_transform_buffer_size, transform_buffer.data());
-                });
-
-                // Render the lit scene to the screen fbo
-                rd->screen_material.set_uniform("PointLightsData", rd->point_lights_storage.slice(0, light_buffer_size));
-                rd->screen_material.set_uniform("PointLightsPosition", rd->point_lights_transform_storage.slice(0, light_transform_buffer_size));
-                rd->screen_material.bind_material();
-                rd->quad_vao->bind();
-                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-                rd->quad_vao->unbind();
+                flecs::world world = it.world();
+                Renderer *rd = world.get_mut<Renderer>();
+                Window *window = world.get_mut<Window>();
 
+                rd->_render_frame(world, *window);
+                rd->light_manager->end_frame();
                 window->swap_buffers();
             });
     }
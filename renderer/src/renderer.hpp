@@ -20,21 +20,32 @@
 
 
 #include "core/src/ref.hpp"
+#include "core/src/transform.hpp"
 #include "primitives/context.hpp"
 
-#include "renderer/src/framebuffer.hpp"
+#include "renderer/src/draw_list.hpp"
+#include "renderer/src/dynamic_bvh.hpp"
+#include "renderer/src/geometry_arena.hpp"
+#include "renderer/src/light_culler.hpp"
+#include "renderer/src/light_manager.hpp"
 #include "renderer/src/material.hpp"
-#include "renderer/src/primitives/framebuffer.hpp"
+#include "renderer/src/occlusion_culler.hpp"
 #include "renderer/src/primitives/vbuffer.hpp"
+#include "renderer/src/render_graph.hpp"
+#include "renderer/src/render_target_pool.hpp"
 #include "thirdparty/flecs/flecs.h"
 #include "thirdparty/glm/glm.hpp"
 
+#include <array>
 #include <memory>
+#include <string>
+#include <vector>
 
 
 namespace lixy {
 
     struct RendererModule;
+    class Window;
 
     
     struct MeshInstance {
@@ -45,37 +56,227 @@ namespace lixy {
     struct Visible {};
 
 
+    // Leaf of a visible mesh instance in the scene tree of the renderer, which adds it and keeps it up to date
+    class SceneTreeProxy {
+    public:
+        SceneTreeProxy() = default;
+        SceneTreeProxy(std::shared_ptr<DynamicBVH> p_tree, DynamicBVH::ProxyId p_proxy, uint64_t p_transform_version, flecs::entity_t p_mesh);
+        SceneTreeProxy(SceneTreeProxy &&p_other);
+        SceneTreeProxy &operator=(SceneTreeProxy &&p_other);
+        virtual ~SceneTreeProxy();
+
+    private:
+        friend class Renderer;
+
+        std::shared_ptr<DynamicBVH> tree;
+        DynamicBVH::ProxyId proxy = DynamicBVH::INVALID_PROXY;
+        uint64_t transform_version = 0; // Of the transform the bounds were computed from
+        flecs::entity_t mesh = 0;
+    };
+
+
     class Renderer {
+    public:
+        // Binding of the per-frame `FrameData` uniform block, bound once per frame for every shader
+        static constexpr uint32_t FRAME_DATA_BINDING = 0;
+
+        // Bindings of the clustered lighting, bound once per frame after the lights are binned: the `ClusterData`
+        // uniform block, the point light buffers and the light clusters. Forward materials read them through their
+        // surface output, their own storage buffers must not use these bindings.
+        static constexpr uint32_t CLUSTER_DATA_BINDING = 1;
+        static constexpr uint32_t POINT_LIGHTS_BINDING = 0;
+        static constexpr uint32_t POINT_LIGHT_POSITIONS_BINDING = 1;
+        static constexpr uint32_t LIGHT_CLUSTERS_BINDING = 4;
+        static constexpr uint32_t LIGHT_INDICES_BINDING = 5;
+
+        static constexpr float MIN_RENDER_SCALE = 0.25f;
+
+        enum class Pipeline {
+            DEFERRED, // Surfaces fill the gbuffer, then the lighting passes shade its pixels
+            FORWARD_PLUS, // A depth prepass bounds the light clusters, then surfaces walk the lights of theirs as they are drawn
+        };
+
+        enum class GBufferLayout {
+            FULL, // World position, albedo and normal in RGBA16F, 24 bytes per pixel
+            COMPACT, // Albedo in RGBA8 and octahedral normal in RG16, 8 bytes per pixel, positions are read from the depth
+        };
+
+        enum class LightingMode {
+            CLUSTERED, // One full screen pass walking the lights binned into the cluster of every pixel by compute
+            LIGHT_VOLUMES, // Every light draws a sphere proxy, its cost follows the screen area it covers
+        };
+
     public:
         void set_current_camera(flecs::entity p_camera);
         flecs::entity get_current_camera() const;
 
         EntityRef create_default_material(flecs::world &p_world);
 
+        const std::shared_ptr<GeometryArena> &get_geometry_arena() const;
+
+        // World space bounds of the visible mesh instances, user data are their entity ids. The tree is refit before
+        // culling every frame, only instances whose transform or mesh changed are updated.
+        const DynamicBVH &get_scene_tree() const;
+
+        // Submit the geometry pass with glMultiDrawElementsIndirect instead of one instanced call per draw
+        void set_multi_draw_indirect(bool p_enabled);
+        bool is_multi_draw_indirect() const;
+
+        // Cull the instances hidden by the depth of the previous frame on the GPU, only with multi draw indirect
+        void set_occlusion_culling(bool p_enabled);
+        bool is_occlusion_culling() const;
+
+        // Chosen by the `RendererOptions` when the module is imported
+        Pipeline get_pipeline() const;
+        GBufferLayout get_gbuffer_layout() const;
+        uint32_t get_sample_count() const; // Of the depth and lit targets of the forward pipeline, 1 in the deferred one
+        // Declares the outputs of the geometry pass in the layout of the gbuffer and `void write_surface(vec3 position,
+        // vec4 color, vec3 normal)` writing them, material fragment shaders insert it after their version directive.
+        // In the forward pipeline `write_surface` shades the surface instead, so materials run in both pipelines.
+        const std::string &get_surface_output_source() const;
+
+        // Lighting of the deferred pipeline
+        void set_lighting_mode(LightingMode p_mode);
+        LightingMode get_lighting_mode() const;
+
+        // Fraction of the window size frames are rendered at before being scaled to the window, lowered under load for
+        // dynamic resolution. Clamped between `MIN_RENDER_SCALE` and 1, the gbuffer is reallocated when the size changes.
+        void set_render_scale(float p_scale);
+        float get_render_scale() const;
+        glm::uvec2 get_render_size() const;
+
+        // Mesh instances that passed frustum culling during the last frame
+        uint32_t get_visible_instance_count() const;
+
+        // Point lights written to the light buffers during the last frame, only the ones that changed are
+        uint32_t get_written_light_count() const;
+
+        // OpenGL state changes issued and elided by the state cache during the last frame
+        const opengl::StateCache::Counters &get_state_counters() const;
+
+        // Render target acquisitions of the last frame and the targets the pool holds after it
+        const RenderTargetPool::Metrics &get_render_target_metrics() const;
+
         static Renderer *get_singleton(flecs::world &p_world);
 
         Renderer() = default;
         
     private:
-        void _initialize(flecs::world &p_world, flecs::entity &p_self);
+        // Resources of the render graph written by the geometry pass
+        struct GBuffer {
+            RenderGraph::Resource depth;
+            std::vector<RenderGraph::Resource> attachments; // In the order of the gbuffer layout, none in the forward pipeline
+        };
+
+    private:
+        void _initialize(flecs::world &p_world);
+        void _update_render_size(const Window &p_window);
+        void _update_view(const Window &p_window, float p_time);
+        void _update_scene_tree();
+        void _cull_mesh_instances(flecs::world &p_world);
+        void _render_frame(flecs::world &p_world, const Window &p_window);
+        void _draw_mesh_instances(flecs::world &p_world);
+        void _bin_lights(uint32_t p_light_count, const opengl::ShaderStorageBuffer::Slice &p_lights, const opengl::ShaderStorageBuffer::Slice &p_positions, uint32_t p_depth_texture, uint32_t p_width, uint32_t p_height);
+        void _draw_forward();
+        void _draw_transparent();
+        void _draw_clustered_lighting();
+        void _read_gbuffer(RenderGraph::PassBuilder &p_pass, const GBuffer &p_gbuffer) const;
+        void _set_gbuffer_input(Material &p_material, const RenderGraph &p_graph, const GBuffer &p_gbuffer);
+        void _draw_light_volumes(uint32_t p_light_count, const opengl::ShaderStorageBuffer::Slice &p_lights, const opengl::ShaderStorageBuffer::Slice &p_positions);
         friend RendererModule;
+
+    private:
+        // std140 layout of the `FrameData` uniform block
+        struct FrameData {
+            glm::mat4 view;
+            glm::mat4 projection;
+            glm::mat4 inverse_view;
+            glm::mat4 inverse_projection;
+            glm::vec4 camera_position;
+            float time; // In seconds
+            float padding[3];
+        };
+
+        // std140 layout of the `ClusterData` uniform block
+        struct ClusterData {
+            glm::ivec4 grid; // Tiles along x and y, then slices, w is 1 during the depth prepass
+            glm::vec4 depth; // Near and slice scale, then padding
+        };
+
+        struct InstanceDraw {
+            flecs::entity_t mesh; // Looked up again when drawing, the instance may have moved to another table since
+            uint32_t transform; // Index in `instance_transforms`
+        };
     
     private:
         opengl::OpenGLContext context;
-        EntityRef gbuffer_ref;
+        opengl::StateCache::Counters state_counters;
+        std::unique_ptr<RenderTargetPool> render_target_pool; // Textures of the transients of the render graph
+        std::unique_ptr<RenderGraph> render_graph; // Declared again every frame by `_render_frame`
+        float render_scale = 1.0f;
+        glm::uvec2 render_size = glm::uvec2(0); // Of the transients of the render graph, the window size scaled
+        bool render_size_outdated = true; // The render scale changed since the render size was updated
+        Pipeline pipeline = Pipeline::DEFERRED;
+        GBufferLayout gbuffer_layout = GBufferLayout::FULL;
+        uint32_t sample_count = 1;
         
         flecs::entity current_camera = flecs::entity::null();
         glm::mat4 projection_matrix = glm::mat4(1.0);
         glm::mat4 view_matrix = glm::mat4(1.0);
+        opengl::UniformBuffer frame_data_buffer;
 
         Material default_material;
+        std::shared_ptr<GeometryArena> geometry_arena; // Shared with meshes, which free their geometry on destruction
+
+        // Instances tagged `Visible` are culled against the camera frustum with the scene tree, then the ones in view
+        // are grouped by mesh and each group is recorded as one instanced draw per surface
+        std::shared_ptr<DynamicBVH> scene_tree; // Shared with the proxies, which leave the tree on destruction
+        flecs::query<const MeshInstance, Transform, SceneTreeProxy*> scene_tree_query;
+        std::array<flecs::query<>, 2> stale_proxy_queries; // Proxies of entities that are no longer visible mesh instances
+        std::vector<uint64_t> visible_entities;
+        std::vector<InstanceDraw> instance_draws; // Instances in view after culling
+        std::vector<glm::mat4> instance_transforms; // In query order
+        std::vector<InstanceData> instance_data; // In draw order, uploaded to `instance_data_storage`
+        std::vector<float> instance_depths; // In draw order, blended surfaces of the forward pipeline are sorted by them
+        opengl::ShaderStorageBuffer instance_data_storage;
+        DrawList draw_list;
+        opengl::ShaderStorageBuffer::Slice drawn_instances; // Of the draw list, drawn again by the forward pass
+        opengl::ShaderStorageBuffer::Slice transparent_instances; // Every instance in view, the transparent pass is not culled
+        bool multi_draw_indirect = true;
+
+        // Instances in view are then tested against the depth pyramid of the previous frame, on the GPU
+        std::unique_ptr<OcclusionCuller> occlusion_culler;
+        std::vector<OcclusionCuller::Batch> occlusion_batches;
+        std::vector<uint32_t> instance_batches; // Index in `occlusion_batches` of every instance, in draw order
+        bool occlusion_culling = true;
         
         Material screen_material;
         std::shared_ptr<opengl::VertexBuffer> quad_vertices;
         std::shared_ptr<opengl::IndexBuffer> quad_indices;
         std::shared_ptr<opengl::VertexArrayBuffer> quad_vao;
 
-        opengl::ShaderStorageBuffer point_lights_storage;
-        opengl::ShaderStorageBuffer point_lights_transform_storage;
+        std::unique_ptr<LightManager> light_manager; // Data of the visible point lights, read by both lighting modes
+        std::unique_ptr<LightCuller> light_culler; // Bins the point lights into the clusters read by the clustered shading
+        opengl::UniformBuffer cluster_data_buffer;
+        opengl::UniformBuffer prepass_cluster_data_buffer; // Written once, bound for the depth prepass
+        LightingMode lighting_mode = LightingMode::CLUSTERED;
+
+        // Light volumes and forward surfaces are accumulated in a lit texture, drawn with the depth and stencil of the
+        // gbuffer, then copied to the screen
+        Material ambient_material;
+        Material light_stencil_material; // Counts the volumes holding the surface of every pixel
+        Material light_volume_material;
+        std::shared_ptr<opengl::VertexBuffer> sphere_vertices;
+        std::shared_ptr<opengl::IndexBuffer> sphere_indices;
+        std::shared_ptr<opengl::VertexArrayBuffer> sphere_vao;
+        uint32_t sphere_index_count = 0;
+    };
+
+
+    // Read once when the renderer module is imported, set it as a singleton beforehand to change it
+    struct RendererOptions {
+        Renderer::Pipeline pipeline = Renderer::Pipeline::DEFERRED;
+        Renderer::GBufferLayout gbuffer_layout = Renderer::GBufferLayout::FULL; // Of the deferred pipeline
+        uint32_t samples = 1; // MSAA of the forward pipeline, clamped to GL_MAX_SAMPLES
     };
 }
\ No newline at end of file
@@ -45,9 +45,9 @@ namespace lixy {
         return internal_texture->get_texture_id();
     }
 
-    EntityRef Texture::create_texture2d(flecs::world &p_world, int p_width, int p_height, opengl::TextureFormat p_format) {
+    EntityRef Texture::create_texture2d(flecs::world &p_world, int p_width, int p_height, opengl::TextureFormat p_format, uint32_t p_samples) {
         EntityRef texture = EntityRef::create_reference(p_world).add<Texture>();
-        texture.get_mut<Texture>()->internal_texture = std::make_unique<opengl::Texture2D>(opengl::Texture2D(p_width, p_height, p_format));
+        texture.get_mut<Texture>()->internal_texture = std::make_unique<opengl::Texture2D>(opengl::Texture2D(p_width, p_height, p_format, p_samples));
         return texture;
     }
     
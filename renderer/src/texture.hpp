@@ -39,7 +39,7 @@ namespace lixy {
         uint32_t get_texture_id() const;
 
         static EntityRef load_texture2d(flecs::world &p_world, const std::filesystem::path &p_path);
-        static EntityRef create_texture2d(flecs::world &p_world, int p_width, int p_height, opengl::TextureFormat p_format);
+        static EntityRef create_texture2d(flecs::world &p_world, int p_width, int p_height, opengl::TextureFormat p_format, uint32_t p_samples = 1);
 
         Texture() = default;
         Texture(Texture&&) = default;
@@ -0,0 +1,64 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "vertex_weld_table.hpp"
+
+#include <utility>
+
+
+namespace lixy {
+
+    void VertexWeldTable::reserve(size_t p_vertex_count) {
+        // Keep the load factor under 3/4 with a power of two capacity
+        size_t capacity = 16;
+        while (capacity * 3 < p_vertex_count * 4) capacity *= 2;
+
+        if (capacity > slots.size()) _rehash(capacity);
+    }
+
+
+    void VertexWeldTable::clear() {
+        for (Slot &slot : slots) slot.vertex = EMPTY;
+        size = 0;
+    }
+
+
+    VertexWeldTable::VertexWeldTable(size_t p_vertex_count) {
+        reserve(p_vertex_count);
+    }
+
+
+    void VertexWeldTable::_grow() {
+        _rehash(slots.empty() ? 16 : slots.size() * 2);
+    }
+
+
+    void VertexWeldTable::_rehash(size_t p_capacity) {
+        std::vector<Slot> old_slots = std::move(slots);
+        slots.assign(p_capacity, Slot{ 0, 0, 0, EMPTY });
+
+        size_t mask = slots.size() - 1;
+        for (const Slot &old_slot : old_slots) {
+            if (old_slot.vertex == EMPTY) continue;
+
+            size_t i = _get_home_slot(old_slot.position, old_slot.normal, old_slot.uv) & mask;
+            while (slots[i].vertex != EMPTY) i = (i + 1) & mask;
+            slots[i] = old_slot;
+        }
+    }
+}
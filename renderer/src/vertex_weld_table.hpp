@@ -0,0 +1,87 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace lixy {
+
+    // Open addressing hash table mapping (position, normal, uv) index triples to welded vertex indices.
+    // Slots are stored inline and probed linearly, clearing keeps the allocation for the next mesh.
+    // Triples of consecutive positions share a run of slots, so faces referencing nearby positions hit nearby slots.
+    class VertexWeldTable {
+    public:
+        static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    public:
+        // Returns the vertex welded to the triple, inserting `p_new_vertex` if the triple is not in the table yet
+        inline uint32_t find_or_insert(uint32_t p_position, uint32_t p_normal, uint32_t p_uv, uint32_t p_new_vertex) {
+            if ((size + 1) * 4 > slots.size() * 3) _grow();
+
+            size_t mask = slots.size() - 1;
+            for (size_t i = _get_home_slot(p_position, p_normal, p_uv) & mask;; i = (i + 1) & mask) {
+                Slot &slot = slots[i];
+                if (slot.vertex == EMPTY) {
+                    slot = { p_position, p_normal, p_uv, p_new_vertex };
+                    size++;
+                    return p_new_vertex;
+                }
+                if (slot.position == p_position && slot.normal == p_normal && slot.uv == p_uv) return slot.vertex;
+            }
+        }
+
+        inline size_t get_size() const { return size; }
+        inline size_t get_capacity() const { return slots.size(); }
+
+        void reserve(size_t p_vertex_count);
+        void clear();
+
+        VertexWeldTable() = default;
+        VertexWeldTable(size_t p_vertex_count);
+
+    private:
+        static constexpr uint32_t POSITIONS_PER_RUN = 4; // Four positions span 8 slots, two cache lines
+
+        struct Slot {
+            uint32_t position;
+            uint32_t normal;
+            uint32_t uv;
+            uint32_t vertex;
+        };
+
+    private:
+        static inline size_t _get_home_slot(uint32_t p_position, uint32_t p_normal, uint32_t p_uv) {
+            // Blocks of POSITIONS_PER_RUN positions are hashed to a run of slots, two home slots per position in the run
+            uint64_t run_hash = (uint64_t)(p_position / POSITIONS_PER_RUN) * 0x9E3779B97F4A7C15ull;
+            uint64_t attribute_hash = ((uint64_t)p_normal * 0xC2B2AE3D27D4EB4Full) ^ ((uint64_t)p_uv * 0x165667B19E3779F9ull);
+            return (size_t)(run_hash >> 20) * POSITIONS_PER_RUN * 2 + (p_position % POSITIONS_PER_RUN) * 2 + (size_t)(attribute_hash >> 63);
+        }
+
+        void _grow();
+        void _rehash(size_t p_capacity);
+
+    private:
+        std::vector<Slot> slots;
+        size_t size = 0;
+    };
+}
@@ -0,0 +1,167 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+
+#include "mapped_file.hpp"
+
+#include "debug/debug.hpp"
+
+#include <filesystem>
+
+#ifdef LIXY_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace lixy {
+
+    bool MappedFile::is_valid() const {
+        return valid;
+    }
+
+
+    MappedFile::MappedFile(const std::filesystem::path &p_path) {
+#ifdef LIXY_WINDOWS
+        HANDLE file = CreateFileW(p_path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            LOG_ERROR("Could not open file at " << p_path);
+            return;
+        }
+
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file, &file_size);
+        size = file_size.QuadPart;
+        file_handle = file;
+        valid = true;
+
+        if (size == 0) return; // Empty files can not be mapped, but are still valid
+
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            LOG_ERROR("Could not map file at " << p_path);
+            _unmap();
+            return;
+        }
+        mapping_handle = mapping;
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+        int fd = open(p_path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            LOG_ERROR("Could not open file at " << p_path);
+            return;
+        }
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == -1) {
+            LOG_ERROR("Could not stat file at " << p_path);
+            close(fd);
+            return;
+        }
+        size = file_stat.st_size;
+        valid = true;
+
+        if (size == 0) { // Empty files can not be mapped, but are still valid
+            close(fd);
+            return;
+        }
+
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        close(fd); // The mapping keeps its own reference to the file
+
+        if (mapping == MAP_FAILED) {
+            LOG_ERROR("Could not map file at " << p_path);
+            size = 0;
+            valid = false;
+            return;
+        }
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapping);
+#endif
+
+        if (!data) {
+            LOG_ERROR("Could not map file at " << p_path);
+            _unmap();
+        }
+    }
+
+
+    MappedFile::MappedFile(MappedFile &&p_other)
+        : data(p_other.data),
+        size(p_other.size),
+        valid(p_other.valid)
+#ifdef LIXY_WINDOWS
+        , file_handle(p_other.file_handle),
+        mapping_handle(p_other.mapping_handle)
+#endif
+    {
+        p_other.data = nullptr;
+        p_other.size = 0;
+        p_other.valid = false;
+#ifdef LIXY_WINDOWS
+        p_other.file_handle = nullptr;
+        p_other.mapping_handle = nullptr;
+#endif
+    }
+
+
+    MappedFile &MappedFile::operator=(MappedFile &&p_other) {
+        _unmap();
+
+        data = p_other.data;
+        size = p_other.size;
+        valid = p_other.valid;
+#ifdef LIXY_WINDOWS
+        file_handle = p_other.file_handle;
+        mapping_handle = p_other.mapping_handle;
+        p_other.file_handle = nullptr;
+        p_other.mapping_handle = nullptr;
+#endif
+
+        p_other.data = nullptr;
+        p_other.size = 0;
+        p_other.valid = false;
+
+        return *this;
+    }
+
+
+    MappedFile::~MappedFile() {
+        _unmap();
+    }
+
+
+    void MappedFile::_unmap() {
+#ifdef LIXY_WINDOWS
+        if (data) UnmapViewOfFile(data);
+        if (mapping_handle) CloseHandle(mapping_handle);
+        if (file_handle) CloseHandle(file_handle);
+        mapping_handle = nullptr;
+        file_handle = nullptr;
+#else
+        if (data) munmap(const_cast<char*>(data), size);
+#endif
+        data = nullptr;
+        size = 0;
+        valid = false;
+    }
+}
@@ -16,42 +16,42 @@
 */
 
 
+
 #pragma once
 
 
-#include "core/src/ref.hpp"
-#include "thirdparty/flecs/flecs.h"
-#include "primitives/framebuffer.hpp"
-#include "primitives/texture.hpp"
+#include <cstddef>
+#include <filesystem>
 
 
 namespace lixy {
 
-
-    class Framebuffer {
+    // Read-only view of a whole file mapped in memory
+    class MappedFile {
     public:
-        void bind() const;
-        void unbind() const;
-
-        bool is_complete() const;
+        bool is_valid() const;
 
-        inline uint32_t get_width() const { return framebuffer.get_width(); };
-        inline uint32_t get_height() const { return framebuffer.get_height(); };
-        void set_size(uint32_t p_width, uint32_t p_height);
+        inline const char *get_data() const { return data; }
+        inline size_t get_size() const { return size; }
 
-        inline int get_attachment_count() { return texture_attachments.size(); };
-        EntityRef get_attachment(int p_index);
+        MappedFile() = default;
+        MappedFile(const std::filesystem::path &p_path);
+        MappedFile(const MappedFile&) = delete;
+        MappedFile(MappedFile &&p_other);
+        MappedFile &operator=(MappedFile &&p_other);
+        virtual ~MappedFile();
 
-        static EntityRef create(flecs::world &p_world, uint32_t p_width, uint32_t p_height, const std::vector<opengl::TextureFormat> &p_texture_attachment_formats);
-
-        Framebuffer() = default;
-        Framebuffer(Framebuffer&&) = default;
-        Framebuffer &operator=(Framebuffer&&) = default;
-        virtual ~Framebuffer() = default;
     private:
-        opengl::Framebuffer framebuffer;
-        std::vector<EntityRef> texture_attachments;
+        void _unmap();
 
-        uint32_t width, height;
+    private:
+        const char *data = nullptr;
+        size_t size = 0;
+        bool valid = false;
+
+#ifdef LIXY_WINDOWS
+        void *file_handle = nullptr;
+        void *mapping_handle = nullptr;
+#endif
     };
-}
\ No newline at end of file
+}
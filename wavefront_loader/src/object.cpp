@@ -1,11 +1,18 @@
 #include "object.hpp"
 #include "debug/debug.hpp"
+#include "mapped_file.hpp"
+#include "scanner.hpp"
 
 #include "thirdparty/glm/fwd.hpp"
 #include "thirdparty/glm/glm.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <fstream>
 #include <string>
+#include <string_view>
+#include <thread>
 
 
 namespace lixy {
@@ -40,7 +47,20 @@ namespace lixy {
     }
 
 
-    WavefrontMesh WavefrontMesh::load(const std::filesystem::path &p_path) {
+    WavefrontMesh WavefrontMesh::load(const std::filesystem::path &p_path, ParseBackend p_backend) {
+        switch (p_backend) {
+        case ParseBackend::STREAM:
+            return _load_stream(p_path);
+        case ParseBackend::MAPPED:
+            return _load_mapped(p_path, 1);
+        case ParseBackend::MAPPED_PARALLEL:
+            return _load_mapped(p_path, std::max(std::thread::hardware_concurrency(), 1u));
+        }
+        return WavefrontMesh{};
+    }
+
+
+    WavefrontMesh WavefrontMesh::_load_stream(const std::filesystem::path &p_path) {
         WavefrontMesh mesh{};
         
         std::ifstream file(p_path);
@@ -120,6 +140,349 @@ namespace lixy {
     }
 
 
+    // Parsed content of a line aligned range of a wavefront file
+    struct WavefrontChunk {
+        struct Statement {
+            enum class Type {
+                OBJECT, MATERIAL, MATERIAL_LIBRARY
+            };
+
+            Type type;
+            std::string argument;
+            size_t face_index_offset; // Number of face indices of the chunk parsed before this statement
+        };
+
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+
+        std::vector<uint32_t> position_indices;
+        std::vector<uint32_t> uv_indices;
+        std::vector<uint32_t> normal_indices;
+
+        // Face index slots holding indices relative to the start of the chunk, coming from negative indices
+        std::vector<size_t> relative_positions;
+        std::vector<size_t> relative_uvs;
+        std::vector<size_t> relative_normals;
+
+        std::vector<Statement> statements;
+        bool requires_object = false; // Some geometry is defined before the first object of the chunk
+    };
+
+
+    struct WavefrontFaceVertex {
+        uint32_t position;
+        uint32_t uv;
+        uint32_t normal;
+
+        bool relative_position;
+        bool relative_uv;
+        bool relative_normal;
+    };
+
+
+    // Copy of a range of chunk face indices into an object
+    struct WavefrontFaceCopy {
+        WavefrontChunk *chunk;
+        WavefrontObject *object;
+        size_t begin, end;
+        size_t destination;
+    };
+
+
+    static const size_t MIN_PARALLEL_CHUNK_SIZE = 1 << 20;
+    static const size_t CHUNKS_PER_THREAD = 4; // More chunks than threads to balance vertex and face heavy regions
+
+
+    template<class Function>
+    static void _run_parallel(size_t p_job_count, size_t p_thread_count, const Function &p_job) {
+        std::atomic<size_t> next_job = 0;
+        auto worker = [&]() {
+            size_t job;
+            while ((job = next_job.fetch_add(1)) < p_job_count) {
+                p_job(job);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(p_thread_count - 1);
+        for (size_t i = 1; i < p_thread_count; i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+
+
+    // Converts a wavefront index, either 1-based or negative and relative to the last element, to a 0-based index
+    static inline uint32_t _resolve_index(int64_t p_index, size_t p_count, bool &p_relative) {
+        p_relative = p_index < 0;
+        return (uint32_t)(p_index < 0 ? (int64_t)p_count + p_index : p_index - 1);
+    }
+
+
+    // Parses one of the `v`, `v/vt`, `v//vn` or `v/vt/vn` face vertex forms
+    static inline bool _parse_face_vertex(WavefrontScanner &p_scanner, const WavefrontChunk &p_chunk, WavefrontFaceVertex &p_vertex) {
+        int64_t index;
+        if (!p_scanner.parse_int(index)) return false;
+
+        p_vertex.position = _resolve_index(index, p_chunk.positions.size(), p_vertex.relative_position);
+        p_vertex.uv = WavefrontObject::NO_INDEX;
+        p_vertex.normal = WavefrontObject::NO_INDEX;
+        p_vertex.relative_uv = false;
+        p_vertex.relative_normal = false;
+
+        if (p_scanner.consume('/')) {
+            if (p_scanner.parse_int(index)) {
+                p_vertex.uv = _resolve_index(index, p_chunk.uvs.size(), p_vertex.relative_uv);
+            }
+            if (p_scanner.consume('/') && p_scanner.parse_int(index)) {
+                p_vertex.normal = _resolve_index(index, p_chunk.normals.size(), p_vertex.relative_normal);
+            }
+        }
+        return true;
+    }
+
+
+    static inline void _push_face_vertex(WavefrontChunk &p_chunk, const WavefrontFaceVertex &p_vertex) {
+        size_t slot = p_chunk.position_indices.size();
+        if (p_vertex.relative_position) p_chunk.relative_positions.push_back(slot);
+        if (p_vertex.relative_uv) p_chunk.relative_uvs.push_back(slot);
+        if (p_vertex.relative_normal) p_chunk.relative_normals.push_back(slot);
+
+        p_chunk.position_indices.push_back(p_vertex.position);
+        p_chunk.uv_indices.push_back(p_vertex.uv);
+        p_chunk.normal_indices.push_back(p_vertex.normal);
+    }
+
+
+    static void _parse_chunk(const char *p_begin, const char *p_end, WavefrontChunk &p_chunk) {
+        WavefrontScanner scanner(p_begin, p_end);
+        bool has_object = false;
+
+        while (!scanner.is_at_end()) {
+            std::string_view token = scanner.next_token();
+
+            if (token.empty() || token[0] == '#') {
+                // Empty line or comment
+            } else if (token == "v") { // Vertex position
+                glm::vec3 position;
+                scanner.parse_float(position.x);
+                scanner.parse_float(position.y);
+                scanner.parse_float(position.z);
+                p_chunk.positions.push_back(position);
+                p_chunk.requires_object |= !has_object;
+            } else if (token == "vn") { // Vertex normal
+                glm::vec3 normal;
+                scanner.parse_float(normal.x);
+                scanner.parse_float(normal.y);
+                scanner.parse_float(normal.z);
+                p_chunk.normals.push_back(normal);
+                p_chunk.requires_object |= !has_object;
+            } else if (token == "vt") { // Vertex texture
+                glm::vec2 uv;
+                scanner.parse_float(uv.x);
+                scanner.parse_float(uv.y);
+                p_chunk.uvs.push_back(uv);
+                p_chunk.requires_object |= !has_object;
+            } else if (token == "f") { // Polygon, triangulated as a fan around its first vertex
+                WavefrontFaceVertex first, previous, current;
+                if (_parse_face_vertex(scanner, p_chunk, first) && _parse_face_vertex(scanner, p_chunk, previous)) {
+                    while (_parse_face_vertex(scanner, p_chunk, current)) {
+                        _push_face_vertex(p_chunk, first);
+                        _push_face_vertex(p_chunk, previous);
+                        _push_face_vertex(p_chunk, current);
+                        previous = current;
+                    }
+                }
+                p_chunk.requires_object |= !has_object;
+            } else if (token == "o") { // Change the current object
+                p_chunk.statements.push_back(WavefrontChunk::Statement{
+                    WavefrontChunk::Statement::Type::OBJECT,
+                    std::string(scanner.next_token()),
+                    p_chunk.position_indices.size()
+                });
+                has_object = true;
+            } else if (token == "mtllib") {
+                p_chunk.statements.push_back(WavefrontChunk::Statement{
+                    WavefrontChunk::Statement::Type::MATERIAL_LIBRARY,
+                    std::string(scanner.rest_of_line()),
+                    p_chunk.position_indices.size()
+                });
+            } else if (token == "usemtl") {
+                p_chunk.statements.push_back(WavefrontChunk::Statement{
+                    WavefrontChunk::Statement::Type::MATERIAL,
+                    std::string(scanner.next_token()),
+                    p_chunk.position_indices.size()
+                });
+                p_chunk.requires_object |= !has_object;
+            }
+
+            scanner.skip_line(); // Ignore the remaining of the line and unsupported statements
+        }
+    }
+
+
+    template<class T>
+    static void _copy_range(const std::vector<T> &p_source, size_t p_begin, size_t p_end, std::vector<T> &p_destination, size_t p_offset) {
+        std::copy(p_source.begin() + p_begin, p_source.begin() + p_end, p_destination.begin() + p_offset);
+    }
+
+
+    WavefrontMesh WavefrontMesh::_load_mapped(const std::filesystem::path &p_path, size_t p_thread_count) {
+        MappedFile file(p_path);
+        if (!file.is_valid()) return WavefrontMesh{};
+
+        // Split the file in line aligned chunks
+        const char *begin = file.get_data();
+        const char *end = begin + file.get_size();
+
+        size_t chunk_count = 1;
+        if (p_thread_count > 1) {
+            chunk_count = std::clamp(file.get_size() / MIN_PARALLEL_CHUNK_SIZE, size_t(1), p_thread_count * CHUNKS_PER_THREAD);
+        }
+        p_thread_count = std::min(p_thread_count, chunk_count);
+
+        std::vector<const char*> chunk_bounds(chunk_count + 1);
+        chunk_bounds[0] = begin;
+        chunk_bounds[chunk_count] = end;
+        for (size_t i = 1; i < chunk_count; i++) {
+            const char *split = std::max(begin + file.get_size() * i / chunk_count, chunk_bounds[i - 1]);
+            const char *line_end = static_cast<const char*>(memchr(split, '\n', end - split));
+            chunk_bounds[i] = line_end ? line_end + 1 : end;
+        }
+
+        // Parse every chunk independently
+        std::vector<WavefrontChunk> chunks(chunk_count);
+        _run_parallel(chunk_count, p_thread_count, [&](size_t p_chunk) {
+            _parse_chunk(chunk_bounds[p_chunk], chunk_bounds[p_chunk + 1], chunks[p_chunk]);
+        });
+
+        return _stitch_chunks(p_path, chunks, p_thread_count);
+    }
+
+
+    WavefrontMesh WavefrontMesh::_stitch_chunks(const std::filesystem::path &p_path, std::vector<WavefrontChunk> &p_chunks, size_t p_thread_count) {
+        WavefrontMesh mesh{};
+
+        // Replay object statements in file order to know where each range of faces goes
+        std::vector<WavefrontFaceCopy> face_copies;
+        std::map<WavefrontObject*, size_t> object_sizes;
+        WavefrontObject *current_object = nullptr;
+
+        auto add_faces = [&](WavefrontChunk &p_chunk, size_t p_begin, size_t p_end) {
+            if (p_begin == p_end) return;
+            size_t &object_size = object_sizes[current_object];
+            face_copies.push_back(WavefrontFaceCopy{ &p_chunk, current_object, p_begin, p_end, object_size });
+            object_size += p_end - p_begin;
+        };
+
+        for (WavefrontChunk &chunk : p_chunks) {
+            if (chunk.requires_object && !current_object) {
+                LOG_WARNING("Could not load mesh at `" << p_path << "` missing object");
+                return WavefrontMesh{};
+            }
+
+            size_t face_cursor = 0;
+            for (const WavefrontChunk::Statement &statement : chunk.statements) {
+                add_faces(chunk, face_cursor, statement.face_index_offset);
+                face_cursor = statement.face_index_offset;
+
+                switch (statement.type) {
+                case WavefrontChunk::Statement::Type::OBJECT:
+                {
+                    auto existing = mesh.objects.find(statement.argument);
+                    if (existing != mesh.objects.end()) { // Redefining an object discards its previous faces
+                        WavefrontObject *object = &existing->second;
+                        face_copies.erase(std::remove_if(face_copies.begin(), face_copies.end(), [object](const WavefrontFaceCopy &p_copy) {
+                            return p_copy.object == object;
+                        }), face_copies.end());
+                        object_sizes[object] = 0;
+                    }
+                    mesh.objects[statement.argument] = WavefrontObject{};
+                    current_object = &mesh.objects[statement.argument];
+                    break;
+                }
+                case WavefrontChunk::Statement::Type::MATERIAL:
+                    current_object->material = statement.argument;
+                    break;
+                case WavefrontChunk::Statement::Type::MATERIAL_LIBRARY:
+                    mesh._include_materials(p_path.parent_path() / statement.argument);
+                    break;
+                }
+            }
+            add_faces(chunk, face_cursor, chunk.position_indices.size());
+        }
+
+        // Single chunk files are moved instead of copied
+        if (p_chunks.size() == 1) {
+            WavefrontChunk &chunk = p_chunks[0];
+            mesh.positions = std::move(chunk.positions);
+            mesh.uvs = std::move(chunk.uvs);
+            mesh.normals = std::move(chunk.normals);
+
+            if (face_copies.size() == 1 && face_copies[0].end - face_copies[0].begin == chunk.position_indices.size()) {
+                WavefrontObject *object = face_copies[0].object;
+                object->position_indices = std::move(chunk.position_indices);
+                object->uv_indices = std::move(chunk.uv_indices);
+                object->normal_indices = std::move(chunk.normal_indices);
+                return mesh;
+            }
+        }
+
+        // Allocate the final buffers
+        std::vector<size_t> position_offsets(p_chunks.size()), uv_offsets(p_chunks.size()), normal_offsets(p_chunks.size());
+        size_t position_count = mesh.positions.size(), uv_count = mesh.uvs.size(), normal_count = mesh.normals.size();
+        if (p_chunks.size() > 1) {
+            for (size_t i = 0; i < p_chunks.size(); i++) {
+                position_offsets[i] = position_count;
+                uv_offsets[i] = uv_count;
+                normal_offsets[i] = normal_count;
+                position_count += p_chunks[i].positions.size();
+                uv_count += p_chunks[i].uvs.size();
+                normal_count += p_chunks[i].normals.size();
+            }
+        }
+        mesh.positions.resize(position_count);
+        mesh.uvs.resize(uv_count);
+        mesh.normals.resize(normal_count);
+
+        for (auto &[object, size] : object_sizes) {
+            object->position_indices.resize(size);
+            object->uv_indices.resize(size);
+            object->normal_indices.resize(size);
+        }
+
+        // Copy vertex attributes to their final location and make relative indices absolute
+        if (p_chunks.size() > 1) {
+            _run_parallel(p_chunks.size(), p_thread_count, [&](size_t p_job) {
+                WavefrontChunk &chunk = p_chunks[p_job];
+                _copy_range(chunk.positions, 0, chunk.positions.size(), mesh.positions, position_offsets[p_job]);
+                _copy_range(chunk.uvs, 0, chunk.uvs.size(), mesh.uvs, uv_offsets[p_job]);
+                _copy_range(chunk.normals, 0, chunk.normals.size(), mesh.normals, normal_offsets[p_job]);
+
+                // Relative indices may point before the chunk, the unsigned wrap around cancels out here
+                for (size_t slot : chunk.relative_positions) chunk.position_indices[slot] += (uint32_t)position_offsets[p_job];
+                for (size_t slot : chunk.relative_uvs) chunk.uv_indices[slot] += (uint32_t)uv_offsets[p_job];
+                for (size_t slot : chunk.relative_normals) chunk.normal_indices[slot] += (uint32_t)normal_offsets[p_job];
+            });
+        }
+
+        // Copy faces to their objects
+        _run_parallel(face_copies.size(), p_thread_count, [&](size_t p_job) {
+            const WavefrontFaceCopy &copy = face_copies[p_job];
+            _copy_range(copy.chunk->position_indices, copy.begin, copy.end, copy.object->position_indices, copy.destination);
+            _copy_range(copy.chunk->uv_indices, copy.begin, copy.end, copy.object->uv_indices, copy.destination);
+            _copy_range(copy.chunk->normal_indices, copy.begin, copy.end, copy.object->normal_indices, copy.destination);
+        });
+
+        return mesh;
+    }
+
+
     WavefrontMaterial::TextureMap _parse_texture_map(std::istream &p_stream) {
         WavefrontMaterial::TextureMap map = {};
 
@@ -150,6 +513,8 @@ namespace lixy {
 
 
     void WavefrontMesh::_include_materials(const std::filesystem::path &p_path) {
+        material_libraries.push_back(p_path);
+
         std::ifstream file(p_path);
         WavefrontMaterial *current_material = nullptr;
         std::string token;
@@ -12,6 +12,7 @@
 namespace lixy {
 
     struct WavefrontObject;
+    struct WavefrontChunk;
 
 
     struct WavefrontMaterial {
@@ -59,7 +60,10 @@ namespace lixy {
     };
 
 
+    // Faces of an object, triangulated
     struct WavefrontObject {
+        static constexpr uint32_t NO_INDEX = UINT32_MAX; // The face vertex does not reference this attribute
+
         std::string material;
         std::vector<uint32_t> position_indices;
         std::vector<uint32_t> uv_indices;
@@ -68,15 +72,26 @@ namespace lixy {
 
 
     struct WavefrontMesh {
+        enum class ParseBackend {
+            STREAM, // Reference implementation based on std::istream, only supports `v/vt/vn` triangles
+            MAPPED, // Memory maps the file and tokenizes it in place
+            MAPPED_PARALLEL, // Same as MAPPED, parsing line aligned chunks of the file on all cores
+        };
+
         std::vector<glm::vec3> positions;
         std::vector<glm::vec2> uvs;
         std::vector<glm::vec3> normals;
         std::map<std::string, WavefrontObject> objects;
         std::map<std::string, WavefrontMaterial> materials;
+        std::vector<std::filesystem::path> material_libraries; // Material files included by the mesh
 
-        static WavefrontMesh load(const std::filesystem::path &p_path);
+        static WavefrontMesh load(const std::filesystem::path &p_path, ParseBackend p_backend = ParseBackend::MAPPED);
     
     private:
+        static WavefrontMesh _load_stream(const std::filesystem::path &p_path);
+        static WavefrontMesh _load_mapped(const std::filesystem::path &p_path, size_t p_thread_count);
+        static WavefrontMesh _stitch_chunks(const std::filesystem::path &p_path, std::vector<WavefrontChunk> &p_chunks, size_t p_thread_count);
+
         void _include_materials(const std::filesystem::path &p_path);
     };
 
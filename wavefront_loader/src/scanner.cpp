@@ -0,0 +1,198 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+
+#include "scanner.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+
+namespace lixy {
+
+    // Powers of ten that are exactly representable as floats and doubles. With an exact mantissa, the value is computed
+    // with a single correctly rounded operation.
+    static const float EXACT_FLOAT_POWERS_OF_TEN[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+    };
+    static const double EXACT_DOUBLE_POWERS_OF_TEN[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    static const int MAX_EXACT_FLOAT_POWER_OF_TEN = 10;
+    static const uint64_t MAX_EXACT_FLOAT_MANTISSA = uint64_t(1) << 24;
+    static const int MAX_EXACT_DOUBLE_POWER_OF_TEN = 22;
+    static const uint64_t MAX_EXACT_DOUBLE_MANTISSA = uint64_t(1) << 53;
+    // Double mantissa bits below the 24 bits of a float, the ones of a double halfway between two floats
+    static const uint64_t FLOAT_DISCARDED_BITS_MASK = (uint64_t(1) << 29) - 1;
+    static const uint64_t FLOAT_HALFWAY_BITS = uint64_t(1) << 28;
+    static const int MAX_MANTISSA_DIGITS = 19;
+
+
+    static inline bool _is_digit(char p_character) {
+        return (unsigned char)(p_character - '0') < 10;
+    }
+
+
+    static inline bool _is_space(char p_character) {
+        return p_character == ' ' || p_character == '\t' || p_character == '\r' || p_character == '\n';
+    }
+
+
+    void WavefrontScanner::skip_line() {
+        const char *line_end = static_cast<const char*>(memchr(cursor, '\n', end - cursor));
+        cursor = line_end ? line_end + 1 : end;
+    }
+
+
+    std::string_view WavefrontScanner::next_token() {
+        skip_blanks();
+        const char *start = cursor;
+        while (cursor < end && !_is_space(*cursor)) cursor++;
+        return std::string_view(start, cursor - start);
+    }
+
+
+    std::string_view WavefrontScanner::rest_of_line() {
+        skip_blanks();
+        const char *start = cursor;
+        while (cursor < end && *cursor != '\n') cursor++;
+
+        const char *stop = cursor;
+        while (stop > start && _is_space(stop[-1])) stop--;
+        return std::string_view(start, stop - start);
+    }
+
+
+    bool WavefrontScanner::parse_float(float &p_value) {
+        skip_blanks();
+        const char *start = cursor;
+        const char *c = cursor;
+
+        bool negative = false;
+        if (c < end && (*c == '-' || *c == '+')) {
+            negative = *c == '-';
+            c++;
+        }
+
+        uint64_t mantissa = 0;
+        int digit_count = 0;
+        int exponent = 0;
+        bool has_digits = false;
+
+        for (; c < end && _is_digit(*c); c++) {
+            has_digits = true;
+            if (digit_count < MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + (*c - '0');
+                if (mantissa != 0) digit_count++;
+            } else {
+                exponent++;
+            }
+        }
+
+        if (c < end && *c == '.') {
+            c++;
+            for (; c < end && _is_digit(*c); c++) {
+                has_digits = true;
+                if (digit_count < MAX_MANTISSA_DIGITS) {
+                    mantissa = mantissa * 10 + (*c - '0');
+                    if (mantissa != 0) digit_count++;
+                    exponent--;
+                }
+            }
+        }
+
+        if (!has_digits) { // Let the C library handle special values such as `inf` and `nan`
+            cursor = start;
+            return _parse_float_fallback(p_value);
+        }
+
+        if (c < end && (*c == 'e' || *c == 'E')) {
+            const char *exponent_start = c;
+            c++;
+            bool negative_exponent = false;
+            if (c < end && (*c == '-' || *c == '+')) {
+                negative_exponent = *c == '-';
+                c++;
+            }
+
+            if (c < end && _is_digit(*c)) {
+                int explicit_exponent = 0;
+                for (; c < end && _is_digit(*c); c++) {
+                    if (explicit_exponent < 10000) explicit_exponent = explicit_exponent * 10 + (*c - '0');
+                }
+                exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+            } else {
+                c = exponent_start; // Not an exponent, leave it to the caller
+            }
+        }
+
+        int exponent_magnitude = exponent < 0 ? -exponent : exponent;
+        float value;
+        if (mantissa <= MAX_EXACT_FLOAT_MANTISSA && exponent_magnitude <= MAX_EXACT_FLOAT_POWER_OF_TEN) {
+            value = (float)mantissa;
+            value = exponent < 0 ? value / EXACT_FLOAT_POWERS_OF_TEN[-exponent] : value * EXACT_FLOAT_POWERS_OF_TEN[exponent];
+        } else if (mantissa < MAX_EXACT_DOUBLE_MANTISSA && exponent_magnitude <= MAX_EXACT_DOUBLE_POWER_OF_TEN) {
+            double exact_value = (double)mantissa;
+            exact_value = exponent < 0 ? exact_value / EXACT_DOUBLE_POWERS_OF_TEN[-exponent] : exact_value * EXACT_DOUBLE_POWERS_OF_TEN[exponent];
+
+            // Narrowing rounds a second time, which only differs from rounding once when the double rounded to the
+            // halfway point between two floats. Values stay within the normal float range.
+            uint64_t bits;
+            memcpy(&bits, &exact_value, sizeof(bits));
+            uint64_t discarded_bits = bits & FLOAT_DISCARDED_BITS_MASK;
+            if (discarded_bits + 1 >= FLOAT_HALFWAY_BITS && discarded_bits <= FLOAT_HALFWAY_BITS + 1) {
+                cursor = start;
+                return _parse_float_fallback(p_value);
+            }
+            value = (float)exact_value;
+        } else { // Not representable with a single correctly rounded operation
+            cursor = start;
+            return _parse_float_fallback(p_value);
+        }
+
+        p_value = negative ? -value : value;
+        cursor = c;
+        return true;
+    }
+
+
+    bool WavefrontScanner::_parse_float_fallback(float &p_value) {
+        // The mapped range is not null terminated, copy the token before handing it to strtof
+        char buffer[64];
+        size_t length = 0;
+        while (cursor + length < end && length < sizeof(buffer) - 1 && !_is_space(cursor[length])) {
+            buffer[length] = cursor[length];
+            length++;
+        }
+        buffer[length] = '\0';
+
+        char *parse_end;
+        p_value = strtof(buffer, &parse_end);
+        if (parse_end == buffer) return false;
+
+        cursor += parse_end - buffer;
+        return true;
+    }
+
+
+    WavefrontScanner::WavefrontScanner(const char *p_begin, const char *p_end)
+        : cursor(p_begin),
+        end(p_end) {}
+}
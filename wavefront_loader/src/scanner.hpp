@@ -0,0 +1,89 @@
+/*
+* Copyright 2024 Souchet Ferdinand
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+* persons to whom the Software is furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+* Software.
+* 
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+* OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+
+#pragma once
+
+
+#include <cstdint>
+#include <string_view>
+
+
+namespace lixy {
+
+    // Tokenizer working in place on a character range, used to parse wavefront files without copies
+    class WavefrontScanner {
+    public:
+        inline bool is_at_end() const { return cursor >= end; }
+        inline const char *get_cursor() const { return cursor; }
+
+        inline void skip_blanks() {
+            while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')) cursor++;
+        }
+
+        inline bool is_at_line_end() const {
+            return cursor >= end || *cursor == '\n' || *cursor == '#';
+        }
+
+        inline bool consume(char p_character) {
+            if (cursor < end && *cursor == p_character) {
+                cursor++;
+                return true;
+            }
+            return false;
+        }
+
+        inline bool parse_int(int64_t &p_value) {
+            skip_blanks();
+            const char *c = cursor;
+
+            bool negative = false;
+            if (c < end && (*c == '-' || *c == '+')) {
+                negative = *c == '-';
+                c++;
+            }
+
+            if (c >= end || (unsigned char)(*c - '0') >= 10) return false;
+
+            int64_t value = 0;
+            for (; c < end && (unsigned char)(*c - '0') < 10; c++) {
+                value = value * 10 + (*c - '0');
+            }
+
+            p_value = negative ? -value : value;
+            cursor = c;
+            return true;
+        }
+
+        void skip_line();
+
+        std::string_view next_token();
+        std::string_view rest_of_line();
+
+        bool parse_float(float &p_value);
+
+        WavefrontScanner(const char *p_begin, const char *p_end);
+
+    private:
+        bool _parse_float_fallback(float &p_value);
+
+    private:
+        const char *cursor;
+        const char *end;
+    };
+}
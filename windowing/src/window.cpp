@@ -60,7 +60,15 @@ namespace lixy {
     void Window::poll_events() {
         RGFW_event *event = nullptr;
 
-        while ((event = RGFW_window_checkEvent(window_ptr)));
+        resized = false;
+        while ((event = RGFW_window_checkEvent(window_ptr))) {
+            if (event->type == RGFW_windowResized) resized = true;
+        }
+    }
+
+
+    bool Window::is_resized() const {
+        return resized;
     }
     
     
@@ -69,6 +77,12 @@ namespace lixy {
     }
 
 
+
+    void Window::set_vsync(bool p_enabled) {
+        RGFW_window_swapInterval(window_ptr, p_enabled ? 1 : 0);
+    }
+
+
     Window *Window::get_singleton(flecs::world &p_world) {
         return p_world.get_mut<Window>();
     }
@@ -88,6 +102,7 @@ namespace lixy {
         }
 
         window_ptr = p_other.window_ptr;
+        resized = p_other.resized;
 
         p_other.window_ptr = nullptr;
     }
@@ -99,6 +114,7 @@ namespace lixy {
         }
 
         window_ptr = p_other.window_ptr;
+        resized = p_other.resized;
 
         p_other.window_ptr = nullptr;
 
@@ -42,7 +42,9 @@ namespace lixy {
             int32_t get_width() const;
             int32_t get_height() const;
             void poll_events();
+            bool is_resized() const; // During the last `poll_events`
             void swap_buffers();
+            void set_vsync(bool p_enabled); // Swaps wait for the vertical blank of the screen, the default is up to the driver
 
             Window() = default;
             Window(uint32_t p_width, uint32_t p_height, std::string_view p_name);
@@ -52,5 +54,6 @@ namespace lixy {
 
         private:
             RGFW_window *window_ptr = nullptr;
+            bool resized = false;
     };
 }
\ No newline at end of file